@@ -19,10 +19,28 @@
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+// mmap() is POSIX, which strict C99 modes hide
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
 #define BJDATA_INTERNAL 1
 
 #include "bjd-common.h"
 
+#if BJDATA_MMAP
+    #ifdef _WIN32
+        #define WIN32_LEAN_AND_MEAN
+        #include <windows.h>
+    #else
+        #include <sys/types.h>
+        #include <sys/stat.h>
+        #include <sys/mman.h>
+        #include <fcntl.h>
+        #include <unistd.h>
+    #endif
+#endif
+
 #if BJDATA_DEBUG && BJDATA_STDIO
 #include <stdarg.h>
 #endif
@@ -41,6 +59,7 @@ const char* bjd_error_to_string(bjd_error_t error) {
         BJDATA_ERROR_STRING_CASE(bjd_error_bug);
         BJDATA_ERROR_STRING_CASE(bjd_error_data);
         BJDATA_ERROR_STRING_CASE(bjd_error_eof);
+        BJDATA_ERROR_STRING_CASE(bjd_would_block);
         #undef BJDATA_ERROR_STRING_CASE
     }
     bjd_assert(0, "unrecognized error %i", (int)error);
@@ -57,6 +76,7 @@ const char* bjd_type_to_string(bjd_type_t type) {
         #define BJDATA_TYPE_STRING_CASE(e) case e: return #e
         BJDATA_TYPE_STRING_CASE(bjd_type_missing);
         BJDATA_TYPE_STRING_CASE(bjd_type_nil);
+        BJDATA_TYPE_STRING_CASE(bjd_type_noop);
         BJDATA_TYPE_STRING_CASE(bjd_type_bool);
         BJDATA_TYPE_STRING_CASE(bjd_type_float);
         BJDATA_TYPE_STRING_CASE(bjd_type_double);
@@ -96,7 +116,8 @@ int bjd_tag_cmp(bjd_tag_t left, bjd_tag_t right) {
 
     switch (left.type) {
         case bjd_type_missing: // fallthrough
-        case bjd_type_nil:
+        case bjd_type_nil:     // fallthrough
+        case bjd_type_noop:
             return 0;
 
         case bjd_type_bool:
@@ -114,6 +135,10 @@ int bjd_tag_cmp(bjd_tag_t left, bjd_tag_t right) {
 
         case bjd_type_array:
         case bjd_type_map:
+            if (left.elemtype != right.elemtype)
+                return (int)left.elemtype - (int)right.elemtype;
+            if (left.unsized != right.unsized)
+                return left.unsized ? 1 : -1;
             if (left.v.n == right.v.n)
                 return 0;
             return (left.v.n < right.v.n) ? -1 : 1;
@@ -347,6 +372,449 @@ void bjd_tag_debug_describe(bjd_tag_t tag, char* buffer, size_t buffer_size) {
 
 
 
+/*
+ * ND-array views
+ */
+
+void bjd_ndarray_view_init(bjd_ndarray_view_t* view, char type,
+        const uint32_t* dims, size_t ndims, const char* data, bjd_endian_t endian)
+{
+    bjd_assert(ndims > 0 && ndims <= BJDATA_NDARRAY_MAX_DIMS, "invalid ndims %i", (int)ndims);
+    bjd_memset(view, 0, sizeof(*view));
+    view->type = type;
+    view->size = bjd_typed_marker_size(type);
+    view->ndims = ndims;
+    view->data = data;
+    view->endian = endian;
+
+    // row-major: the last dimension is contiguous
+    size_t stride = view->size;
+    for (size_t i = ndims; i-- > 0;) {
+        view->dims[i] = dims[i];
+        view->strides[i] = stride;
+        stride *= dims[i];
+    }
+}
+
+size_t bjd_ndarray_view_count(const bjd_ndarray_view_t* view) {
+    size_t count = 1;
+    for (size_t i = 0; i < view->ndims; ++i)
+        count *= view->dims[i];
+    return count;
+}
+
+bjd_tag_t bjd_ndarray_view_element(const bjd_ndarray_view_t* view, const size_t* index) {
+    return bjd_load_typed(view->type, bjd_ndarray_view_at(view, index), view->endian);
+}
+
+bool bjd_ndarray_view_slice(const bjd_ndarray_view_t* view, size_t axis,
+        size_t start, size_t count, bjd_ndarray_view_t* out)
+{
+    if (axis >= view->ndims || start > view->dims[axis] || count > view->dims[axis] - start)
+        return false;
+
+    if (out != view)
+        *out = *view;
+    out->data += start * out->strides[axis];
+    out->dims[axis] = count;
+    return true;
+}
+
+bool bjd_ndarray_view_select(const bjd_ndarray_view_t* view, size_t axis,
+        size_t index, bjd_ndarray_view_t* out)
+{
+    if (axis >= view->ndims || index >= view->dims[axis] || view->ndims == 1)
+        return false;
+
+    if (out != view)
+        *out = *view;
+    out->data += index * out->strides[axis];
+    for (size_t i = axis; i + 1 < out->ndims; ++i) {
+        out->dims[i] = out->dims[i + 1];
+        out->strides[i] = out->strides[i + 1];
+    }
+    --out->ndims;
+    out->dims[out->ndims] = 0;
+    out->strides[out->ndims] = 0;
+    return true;
+}
+
+
+
+/*
+ * Structural scanning
+ */
+
+typedef struct bjd_scan_level_t {
+    uint64_t left; // children left if the level is sized, or children read if unsized
+    char end; // the closing marker if the level is unsized, 0 otherwise
+    size_t packed; // the size of the packed value after each key of an optimized map
+    size_t entry; // the index entry of the container plus one, or 0
+} bjd_scan_level_t;
+
+// Reads a non-negative integer of the given marker at *pos.
+static bool bjd_scan_length_value(const char* data, size_t end, size_t* pos,
+        char marker, bjd_endian_t endian, uint64_t* length)
+{
+    size_t size = bjd_typed_marker_size(marker);
+    if (size == 0 || marker == 'd' || marker == 'D' || end - *pos < size)
+        return false;
+
+    bjd_tag_t value = bjd_load_typed(marker, data + *pos, endian);
+    if (value.type == bjd_type_int) {
+        if (value.v.i < 0)
+            return false;
+        value.v.u = (uint64_t)value.v.i;
+    }
+    if (value.v.u > UINT32_MAX)
+        return false;
+
+    *pos += size;
+    *length = value.v.u;
+    return true;
+}
+
+bool bjd_scan_length(const char* data, size_t end, size_t* pos,
+        bjd_endian_t endian, uint64_t* length)
+{
+    if (*pos == end)
+        return false;
+    char marker = data[(*pos)++];
+    return bjd_scan_length_value(data, end, pos, marker, endian, length);
+}
+
+// Skips the dimension vector of an ND-array at *pos and returns the product
+// of its dimensions. See bjd_parse_dims() in the reader.
+static bool bjd_scan_dims(const char* data, size_t end, size_t* pos,
+        bjd_endian_t endian, uint64_t* count)
+{
+    size_t p = *pos + 1; // the '['
+    char elemtype = 0;
+    uint64_t total = 1;
+    uint64_t dim;
+    size_t i = 0;
+
+    if (p == end)
+        return false;
+    if (data[p] == BJDATA_MARKER_TYPE) {
+        if (end - p < 3)
+            return false;
+        elemtype = data[p + 1];
+        p += 2;
+        if (data[p] != BJDATA_MARKER_COUNT)
+            return false;
+    }
+
+    if (data[p] == BJDATA_MARKER_COUNT) {
+        ++p;
+        uint64_t ndims;
+        if (!bjd_scan_length(data, end, &p, endian, &ndims) || ndims > BJDATA_NDARRAY_MAX_DIMS)
+            return false;
+        for (; i < ndims; ++i) {
+            bool ok = (elemtype != 0) ?
+                    bjd_scan_length_value(data, end, &p, elemtype, endian, &dim) :
+                    bjd_scan_length(data, end, &p, endian, &dim);
+            if (!ok)
+                return false;
+            total *= dim;
+            if (total > UINT32_MAX)
+                return false;
+        }
+    } else {
+        while (true) {
+            if (p == end)
+                return false;
+            char marker = data[p++];
+            if (marker == BJDATA_MARKER_ARRAY_END)
+                break;
+            if (i++ == BJDATA_NDARRAY_MAX_DIMS)
+                return false;
+            if (!bjd_scan_length_value(data, end, &p, marker, endian, &dim))
+                return false;
+            total *= dim;
+            if (total > UINT32_MAX)
+                return false;
+        }
+    }
+
+    if (i == 0)
+        return false;
+    *pos = p;
+    *count = total;
+    return true;
+}
+
+// Opens a container level, adding an entry for it to the index if any.
+static bjd_error_t bjd_scan_open(bjd_scan_level_t* level, bjd_skip_index_t* index, size_t start) {
+    level->entry = 0;
+    if (index == NULL)
+        return bjd_ok;
+
+    #ifdef BJDATA_MALLOC
+    if (index->count == index->capacity) {
+        size_t capacity = (index->capacity == 0) ? 64 : index->capacity * 2;
+        bjd_skip_entry_t* entries = (bjd_skip_entry_t*)bjd_allocator_realloc(index->allocator, index->entries,
+                sizeof(bjd_skip_entry_t) * index->count, sizeof(bjd_skip_entry_t) * capacity);
+        if (entries == NULL)
+            return bjd_error_memory;
+        index->entries = entries;
+        index->capacity = capacity;
+    }
+    index->entries[index->count].start = start;
+    index->entries[index->count].end = start;
+    level->entry = ++index->count;
+    return bjd_ok;
+    #else
+    BJDATA_UNUSED(start);
+    bjd_break("cannot build a skip index without malloc!");
+    return bjd_error_bug;
+    #endif
+}
+
+// Closes a container level, dropping its entry if it is too small. Its
+// descendants are even smaller, so its entry is the last one.
+static void bjd_scan_close(bjd_scan_level_t* level, bjd_skip_index_t* index, size_t end, size_t min_size) {
+    if (level->entry == 0)
+        return;
+    bjd_skip_entry_t* entry = &index->entries[level->entry - 1];
+    if (end - entry->start < min_size) {
+        bjd_assert(level->entry == index->count, "smaller entries should have been dropped");
+        --index->count;
+        return;
+    }
+    entry->end = end;
+}
+
+bjd_error_t bjd_scan_value(const char* data, size_t end, size_t* pos, bjd_endian_t endian,
+        bjd_skip_index_t* index, size_t min_size)
+{
+    bjd_scan_level_t stack[BJDATA_SCAN_MAX_DEPTH];
+    size_t depth = 0;
+    size_t p = *pos;
+
+    while (true) {
+        if (p == end)
+            return bjd_error_invalid;
+        size_t start = p;
+        bool opened = false;
+
+        // the keys of an optimized map are strings without their 'S' marker
+        char marker = (depth > 0 && stack[depth - 1].packed != 0) ? 'S' : data[p++];
+
+        switch (marker) {
+            case 'Z': case 'N': case 'T': case 'F':
+                break;
+
+            case 'S': case 'H': {
+                uint64_t length;
+                if (!bjd_scan_length(data, end, &p, endian, &length) || end - p < length)
+                    return bjd_error_invalid;
+                p += (size_t)length;
+                break;
+            }
+
+            case '[': case '{': {
+                bool map = (marker == '{');
+                char elemtype = 0;
+                uint64_t count;
+
+                if (p == end)
+                    return bjd_error_invalid;
+                if (data[p] == BJDATA_MARKER_TYPE) {
+                    if (end - p < 3)
+                        return bjd_error_invalid;
+                    elemtype = data[p + 1];
+                    if (bjd_typed_marker_size(elemtype) == 0 || data[p + 2] != BJDATA_MARKER_COUNT)
+                        return bjd_error_invalid;
+                    p += 2;
+                } else if (data[p] != BJDATA_MARKER_COUNT) {
+                    if (depth == BJDATA_SCAN_MAX_DEPTH)
+                        return bjd_error_too_big;
+                    stack[depth].left = 0;
+                    stack[depth].end = map ? BJDATA_MARKER_MAP_END : BJDATA_MARKER_ARRAY_END;
+                    stack[depth].packed = 0;
+                    bjd_error_t error = bjd_scan_open(&stack[depth], index, start);
+                    if (error != bjd_ok)
+                        return error;
+                    ++depth;
+                    opened = true;
+                    break;
+                }
+
+                ++p;
+                if (!map && p != end && data[p] == BJDATA_MARKER_ARRAY_START) {
+                    if (!bjd_scan_dims(data, end, &p, endian, &count))
+                        return bjd_error_invalid;
+                } else if (!bjd_scan_length(data, end, &p, endian, &count)) {
+                    return bjd_error_invalid;
+                }
+
+                // the payload of an optimized array is skipped as a whole
+                size_t size = bjd_typed_marker_size(elemtype);
+                if (elemtype != 0 && !map) {
+                    if (count > (end - p) / size)
+                        return bjd_error_invalid;
+                    p += (size_t)count * size;
+                    break;
+                }
+
+                if (count == 0)
+                    break;
+                if (depth == BJDATA_SCAN_MAX_DEPTH)
+                    return bjd_error_too_big;
+                stack[depth].left = (map && elemtype == 0) ? count * 2 : count;
+                stack[depth].end = 0;
+                stack[depth].packed = size;
+                bjd_error_t error = bjd_scan_open(&stack[depth], index, start);
+                if (error != bjd_ok)
+                    return error;
+                ++depth;
+                opened = true;
+                break;
+            }
+
+            default: {
+                size_t size = bjd_typed_marker_size(marker);
+                if (size == 0 || end - p < size)
+                    return bjd_error_invalid;
+                p += size;
+                break;
+            }
+        }
+
+        // pop the levels this value completes. a finished container is in
+        // turn a completed value of the level below it.
+        bool completed = !opened;
+        while (depth > 0) {
+            bjd_scan_level_t* top = &stack[depth - 1];
+            if (top->end != 0) {
+                // an unsized level counts its children so that a map can
+                // be checked for a value for each key
+                if (completed)
+                    ++top->left;
+                if (p == end)
+                    return bjd_error_invalid;
+                if (data[p] != top->end)
+                    break;
+                if (top->end == BJDATA_MARKER_MAP_END && top->left % 2 != 0)
+                    return bjd_error_invalid;
+                ++p;
+            } else {
+                if (!completed)
+                    break;
+                if (end - p < top->packed)
+                    return bjd_error_invalid;
+                p += top->packed;
+                if (--top->left > 0)
+                    break;
+            }
+            bjd_scan_close(top, index, p, min_size);
+            --depth;
+            completed = true;
+        }
+
+        if (depth == 0) {
+            *pos = p;
+            return bjd_ok;
+        }
+    }
+}
+
+#ifdef BJDATA_MALLOC
+bjd_error_t bjd_skip_index_build(bjd_skip_index_t* index, const char* data, size_t count,
+        bjd_endian_t endian, size_t min_size)
+{
+    bjd_memset(index, 0, sizeof(*index));
+
+    size_t pos = 0;
+    while (pos < count) {
+        bjd_error_t error = bjd_scan_value(data, count, &pos, endian, index, min_size);
+        if (error != bjd_ok) {
+            bjd_skip_index_destroy(index);
+            return error;
+        }
+    }
+
+    bjd_log("built skip index of %i entries for %i bytes\n", (int)index->count, (int)count);
+    return bjd_ok;
+}
+
+void bjd_skip_index_destroy(bjd_skip_index_t* index) {
+    if (index->capacity != 0)
+        bjd_allocator_free(index->allocator, index->entries);
+    index->entries = NULL;
+    index->count = 0;
+    index->capacity = 0;
+}
+#endif
+
+bjd_error_t bjd_path_compile(bjd_path_t* path, const char* expr) {
+    path->count = 0;
+    const char* p = expr;
+
+    while (*p != '\0') {
+        if (path->count == BJDATA_PATH_MAX_STEPS)
+            return bjd_error_too_big;
+
+        // a dot separates keys. it can't start the path or follow a dot.
+        if (*p == '.') {
+            if (path->count == 0)
+                return bjd_error_invalid;
+            ++p;
+            if (*p == '.' || *p == '[' || *p == '\0')
+                return bjd_error_invalid;
+        }
+
+        const char* key = p;
+        size_t length;
+        uint32_t index = 0;
+
+        if (*p == '[' && p[1] == '"') {
+            key = p + 2;
+            p = key;
+            while (*p != '"' && *p != '\0')
+                ++p;
+            if (*p == '\0' || p[1] != ']')
+                return bjd_error_invalid;
+            length = (size_t)(p - key);
+            p += 2;
+
+        } else if (*p == '[') {
+            ++p;
+            if (*p < '0' || *p > '9')
+                return bjd_error_invalid;
+            uint64_t value = 0;
+            while (*p >= '0' && *p <= '9') {
+                value = value * 10 + (uint64_t)(*p++ - '0');
+                if (value > UINT32_MAX)
+                    return bjd_error_invalid;
+            }
+            if (*p++ != ']')
+                return bjd_error_invalid;
+            key = NULL;
+            length = 0;
+            index = (uint32_t)value;
+
+        } else {
+            // a key must follow a dot unless it starts the path
+            if (path->count != 0 && p[-1] != '.')
+                return bjd_error_invalid;
+            while (*p != '.' && *p != '[' && *p != '\0')
+                ++p;
+            length = (size_t)(p - key);
+        }
+
+        path->steps[path->count].key = key;
+        path->steps[path->count].length = length;
+        path->steps[path->count].index = index;
+        ++path->count;
+    }
+
+    return bjd_ok;
+}
+
+
+
 #if BJDATA_READ_TRACKING || BJDATA_WRITE_TRACKING
 
 #ifndef BJDATA_TRACKING_INITIAL_CAPACITY
@@ -355,10 +823,12 @@ void bjd_tag_debug_describe(bjd_tag_t tag, char* buffer, size_t buffer_size) {
 #define BJDATA_TRACKING_INITIAL_CAPACITY 8
 #endif
 
-bjd_error_t bjd_track_init(bjd_track_t* track) {
+bjd_error_t bjd_track_init(bjd_track_t* track, const bjd_allocator_t* allocator) {
     track->count = 0;
     track->capacity = BJDATA_TRACKING_INITIAL_CAPACITY;
-    track->elements = (bjd_track_element_t*)BJDATA_MALLOC(sizeof(bjd_track_element_t) * track->capacity);
+    track->allocator = allocator;
+    track->elements = (bjd_track_element_t*)bjd_allocator_malloc(allocator,
+            sizeof(bjd_track_element_t) * track->capacity);
     if (track->elements == NULL)
         return bjd_error_memory;
     return bjd_ok;
@@ -370,7 +840,7 @@ bjd_error_t bjd_track_grow(bjd_track_t* track) {
 
     size_t new_capacity = track->capacity * 2;
 
-    bjd_track_element_t* new_elements = (bjd_track_element_t*)bjd_realloc(track->elements,
+    bjd_track_element_t* new_elements = (bjd_track_element_t*)bjd_allocator_realloc(track->allocator, track->elements,
             sizeof(bjd_track_element_t) * track->count, sizeof(bjd_track_element_t) * new_capacity);
     if (new_elements == NULL)
         return bjd_error_memory;
@@ -395,10 +865,21 @@ bjd_error_t bjd_track_push(bjd_track_t* track, bjd_type_t type, uint32_t count)
     track->elements[track->count].type = type;
     track->elements[track->count].left = count;
     track->elements[track->count].key_needs_value = false;
+    track->elements[track->count].unsized = false;
     ++track->count;
     return bjd_ok;
 }
 
+bjd_error_t bjd_track_push_unsized(bjd_track_t* track, bjd_type_t type) {
+    bjd_assert(type == bjd_type_array || type == bjd_type_map,
+            "only arrays and maps can be unsized, not %s", bjd_type_to_string(type));
+
+    bjd_error_t error = bjd_track_push(track, type, 0);
+    if (error == bjd_ok)
+        track->elements[track->count - 1].unsized = true;
+    return error;
+}
+
 bjd_error_t bjd_track_pop(bjd_track_t* track, bjd_type_t type) {
     bjd_assert(track->elements, "null track elements!");
     bjd_log("track popping %s\n", bjd_type_to_string(type));
@@ -423,7 +904,7 @@ bjd_error_t bjd_track_pop(bjd_track_t* track, bjd_type_t type) {
         return bjd_error_bug;
     }
 
-    if (element->left != 0) {
+    if (element->left != 0 && !element->unsized) {
         bjd_break("attempting to close a %s but there are %i %s left",
                 bjd_type_to_string(type), element->left,
                 (type == bjd_type_map || type == bjd_type_array) ? "elements" : "bytes");
@@ -434,6 +915,17 @@ bjd_error_t bjd_track_pop(bjd_track_t* track, bjd_type_t type) {
     return bjd_ok;
 }
 
+bjd_error_t bjd_track_pop_sized(bjd_track_t* track, bjd_type_t type, bool unsized) {
+    if (track->count != 0 && track->elements[track->count - 1].type == type &&
+            track->elements[track->count - 1].unsized != unsized)
+    {
+        bjd_break("attempting to close a %s %s a count but it was opened %s one",
+                bjd_type_to_string(type), unsized ? "without" : "with", unsized ? "with" : "without");
+        return bjd_error_bug;
+    }
+    return bjd_track_pop(track, type);
+}
+
 bjd_error_t bjd_track_peek_element(bjd_track_t* track, bool read) {
     BJDATA_UNUSED(read);
     bjd_assert(track->elements, "null track elements!");
@@ -450,7 +942,7 @@ bjd_error_t bjd_track_peek_element(bjd_track_t* track, bool read) {
         return bjd_error_bug;
     }
 
-    if (element->left == 0 && !element->key_needs_value) {
+    if (element->left == 0 && !element->key_needs_value && !element->unsized) {
         bjd_break("too many elements %s for %s", read ? "read" : "written",
                 bjd_type_to_string(element->type));
         return bjd_error_bug;
@@ -474,7 +966,8 @@ bjd_error_t bjd_track_element(bjd_track_t* track, bool read) {
         element->key_needs_value = false;
     }
 
-    --element->left;
+    if (!element->unsized)
+        --element->left;
     return bjd_ok;
 }
 
@@ -542,7 +1035,7 @@ bjd_error_t bjd_track_check_empty(bjd_track_t* track) {
 bjd_error_t bjd_track_destroy(bjd_track_t* track, bool cancel) {
     bjd_error_t error = cancel ? bjd_ok : bjd_track_check_empty(track);
     if (track->elements) {
-        BJDATA_FREE(track->elements);
+        bjd_allocator_free(track->allocator, track->elements);
         track->elements = NULL;
     }
     return error;
@@ -551,30 +1044,164 @@ bjd_error_t bjd_track_destroy(bjd_track_t* track, bool cancel) {
 
 
 
-static bool bjd_utf8_check_impl(const uint8_t* str, size_t count, bool allow_null) {
-    while (count > 0) {
-        uint8_t lead = str[0];
+#ifdef BJDATA_MALLOC
+void* bjd_allocator_realloc(const bjd_allocator_t* allocator, void* ptr, size_t used_size, size_t new_size) {
+    if (allocator == NULL)
+        return bjd_realloc(ptr, used_size, new_size);
+    if (allocator->reallocate)
+        return allocator->reallocate(allocator->context, ptr, used_size, new_size);
+
+    if (new_size == 0) {
+        if (ptr)
+            allocator->deallocate(allocator->context, ptr);
+        return NULL;
+    }
+
+    void* new_ptr = allocator->allocate(allocator->context, new_size);
+    if (new_ptr == NULL)
+        return NULL;
+
+    if (ptr) {
+        bjd_memcpy(new_ptr, ptr, used_size);
+        allocator->deallocate(allocator->context, ptr);
+    }
+    return new_ptr;
+}
+
+struct bjd_arena_block_t {
+    bjd_arena_block_t* next;
+    size_t size;
+};
 
-        // ASCII
-	switch(lead){
-		case 'Z': case 'F': case 'T': case 'N': 
-		case 'i': case 'U': case 'I': case 'u': 
-		case 'l': case 'm': case 'L': case 'M': 
-		case 'h': case 'd': case 'D': case 'H': 
-		case 'C': case 'S': case '[': case '{': 
-		    return true;
-		default: 
-		    return false;
-	}
+// Allocations are aligned for any fundamental type. The block header is
+// padded so that the space after it has the same alignment.
+#define BJDATA_ARENA_ALIGNMENT (2 * sizeof(void*))
+#define BJDATA_ARENA_ALIGN(size) (((size) + BJDATA_ARENA_ALIGNMENT - 1) & ~(BJDATA_ARENA_ALIGNMENT - 1))
+#define BJDATA_ARENA_HEADER_SIZE BJDATA_ARENA_ALIGN(sizeof(bjd_arena_block_t))
+
+BJDATA_STATIC_INLINE char* bjd_arena_block_data(bjd_arena_block_t* block) {
+    return (char*)block + BJDATA_ARENA_HEADER_SIZE;
+}
+
+// Moves the arena to a block with at least size bytes free. Blocks kept by
+// bjd_arena_reset() are reused before new ones are allocated.
+static bool bjd_arena_next_block(bjd_arena_t* arena, size_t size) {
+    bjd_arena_block_t** link = arena->block ? &arena->block->next : &arena->head;
+    while (*link != NULL && (*link)->size < size)
+        link = &(*link)->next;
+
+    bjd_arena_block_t* block = *link;
+    if (block == NULL) {
+        size_t block_size = (size > arena->block_size) ? size : arena->block_size;
+        if (block_size > SIZE_MAX - BJDATA_ARENA_HEADER_SIZE)
+            return false;
+
+        block = (bjd_arena_block_t*)BJDATA_MALLOC(BJDATA_ARENA_HEADER_SIZE + block_size);
+        if (block == NULL)
+            return false;
+        bjd_log("arena %p allocated block %p of size %i\n", (void*)arena, (void*)block, (int)block_size);
+
+        block->next = NULL;
+        block->size = block_size;
+        *link = block;
+    }
+
+    arena->block = block;
+    arena->position = bjd_arena_block_data(block);
+    arena->last = NULL;
     return true;
 }
 
+static void* bjd_arena_allocate(void* context, size_t size) {
+    bjd_arena_t* arena = (bjd_arena_t*)context;
+
+    size_t aligned = BJDATA_ARENA_ALIGN(size);
+    if (aligned < size)
+        return NULL;
+
+    if (arena->block == NULL ||
+            (size_t)(bjd_arena_block_data(arena->block) + arena->block->size - arena->position) < aligned)
+    {
+        if (!bjd_arena_next_block(arena, aligned))
+            return NULL;
+    }
+
+    char* p = arena->position;
+    arena->position += aligned;
+    arena->last = p;
+    return p;
+}
+
+static void* bjd_arena_reallocate(void* context, void* ptr, size_t used_size, size_t new_size) {
+    bjd_arena_t* arena = (bjd_arena_t*)context;
+
+    // the most recent allocation is resized in place if it fits
+    size_t aligned = BJDATA_ARENA_ALIGN(new_size);
+    if (ptr != NULL && (char*)ptr == arena->last && aligned >= new_size &&
+            (size_t)(bjd_arena_block_data(arena->block) + arena->block->size - arena->last) >= aligned)
+    {
+        arena->position = arena->last + aligned;
+        return ptr;
+    }
+
+    void* new_ptr = bjd_arena_allocate(context, new_size);
+    if (new_ptr != NULL && ptr != NULL)
+        bjd_memcpy(new_ptr, ptr, used_size);
+    return new_ptr;
+}
+
+static void bjd_arena_deallocate(void* context, void* ptr) {
+    bjd_arena_t* arena = (bjd_arena_t*)context;
+
+    // only the most recent allocation can be given back
+    if ((char*)ptr == arena->last) {
+        arena->position = arena->last;
+        arena->last = NULL;
+    }
+}
+
+void bjd_arena_init(bjd_arena_t* arena, size_t block_size) {
+    bjd_memset(arena, 0, sizeof(*arena));
+    arena->allocator.allocate = bjd_arena_allocate;
+    arena->allocator.reallocate = bjd_arena_reallocate;
+    arena->allocator.deallocate = bjd_arena_deallocate;
+    arena->allocator.context = arena;
+    arena->block_size = (block_size != 0) ? block_size : BJDATA_ARENA_BLOCK_SIZE;
+}
+
+void bjd_arena_reset(bjd_arena_t* arena) {
+    ++arena->resets;
+    arena->block = arena->head;
+    arena->position = arena->head ? bjd_arena_block_data(arena->head) : NULL;
+    arena->last = NULL;
+}
+
+size_t bjd_allocator_resets(const bjd_allocator_t* allocator) {
+    if (allocator == NULL || allocator->allocate != bjd_arena_allocate)
+        return 0;
+    return ((const bjd_arena_t*)allocator->context)->resets;
+}
+
+void bjd_arena_destroy(bjd_arena_t* arena) {
+    bjd_arena_block_t* block = arena->head;
+    while (block) {
+        bjd_arena_block_t* next = block->next;
+        BJDATA_FREE(block);
+        block = next;
+    }
+    arena->head = NULL;
+    bjd_arena_reset(arena);
+}
+#endif
+
+
+
 bool bjd_utf8_check(const char* str, size_t bytes) {
-    return bjd_utf8_check_impl((const uint8_t*)str, bytes, true);
+    return bjd_utf8_validate(str, bytes, true);
 }
 
 bool bjd_utf8_check_no_null(const char* str, size_t bytes) {
-    return bjd_utf8_check_impl((const uint8_t*)str, bytes, false);
+    return bjd_utf8_validate(str, bytes, false);
 }
 
 bool bjd_str_check_no_null(const char* str, size_t bytes) {
@@ -584,6 +1211,91 @@ bool bjd_str_check_no_null(const char* str, size_t bytes) {
     return true;
 }
 
+#if BJDATA_MMAP
+bjd_error_t bjd_file_map(bjd_file_map_t* map, const char* filename, unsigned flags) {
+    #ifdef _WIN32
+    DWORD attributes = (flags & bjd_mmap_sequential) ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_ATTRIBUTE_NORMAL;
+    HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, attributes, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return bjd_error_io;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        return bjd_error_io;
+    }
+    if (size.QuadPart == 0) {
+        CloseHandle(file);
+        return bjd_error_invalid;
+    }
+    if ((uint64_t)size.QuadPart > (uint64_t)SIZE_MAX) {
+        CloseHandle(file);
+        return bjd_error_too_big;
+    }
+
+    // the view keeps the mapping and the file open
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (mapping == NULL)
+        return bjd_error_io;
+    void* address = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (address == NULL)
+        return bjd_error_io;
+
+    map->address = address;
+    map->size = (size_t)size.QuadPart;
+
+    #else
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return bjd_error_io;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return bjd_error_io;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return bjd_error_invalid;
+    }
+    if ((uint64_t)st.st_size > (uint64_t)SIZE_MAX) {
+        close(fd);
+        return bjd_error_too_big;
+    }
+
+    // the mapping keeps the file open
+    size_t size = (size_t)st.st_size;
+    void* address = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (address == MAP_FAILED)
+        return bjd_error_io;
+
+    // the hints are advisory, so failures are ignored
+    if (flags & bjd_mmap_sequential)
+        posix_madvise(address, size, POSIX_MADV_SEQUENTIAL);
+    if (flags & bjd_mmap_willneed)
+        posix_madvise(address, size, POSIX_MADV_WILLNEED);
+
+    map->address = address;
+    map->size = size;
+    #endif
+
+    return bjd_ok;
+}
+
+void bjd_file_unmap(bjd_file_map_t* map) {
+    #ifdef _WIN32
+    UnmapViewOfFile(map->address);
+    #else
+    munmap(map->address, map->size);
+    #endif
+    map->address = NULL;
+    map->size = 0;
+}
+#endif
+
 #if BJDATA_DEBUG && BJDATA_STDIO
 void bjd_print_append(bjd_print_t* print, const char* data, size_t count) {
 
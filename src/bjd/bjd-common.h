@@ -169,6 +169,7 @@ typedef enum bjd_error_t {
     bjd_error_bug,     /**< The BJData API was used incorrectly. (This will always assert in debug mode.) */
     bjd_error_data,    /**< The contained data is not valid. */
     bjd_error_eof,     /**< The reader failed to read because of file or socket EOF */
+    bjd_would_block,   /**< Not an error: a resumable reader needs more data before it can continue. It is cleared by bjd_reader_feed(). */
 } bjd_error_t;
 
 /**
@@ -214,6 +215,22 @@ typedef enum bjd_type_t {
  */
 const char* bjd_type_to_string(bjd_type_t type);
 
+/**
+ * The byte order of multi-byte numbers in Binary JData.
+ *
+ * Readers, writers and trees use little-endian by default, as specified
+ * by BJData Draft 2. Big-endian can be selected to exchange data with
+ * UBJSON and earlier drafts of BJData.
+ *
+ * @see bjd_reader_set_endian()
+ * @see bjd_writer_set_endian()
+ * @see bjd_tree_set_endian()
+ */
+typedef enum bjd_endian_t {
+    bjd_endian_little = 0, /**< Little-endian, as in BJData Draft 2. */
+    bjd_endian_big,        /**< Big-endian, as in UBJSON. */
+} bjd_endian_t;
+
 #if BJDATA_EXTENSIONS
 /**
  * A timestamp.
@@ -264,6 +281,14 @@ struct bjd_tag_t {
             key/value pairs if the type is map. */
         uint32_t n;
     } v;
+
+    /* The element marker if the type is an optimized ($type) array or
+        map, or 0 otherwise. */
+    char elemtype;
+
+    /* Whether the type is an array or map without a count, terminated
+        by ']' or '}'. The count is then 0. */
+    bool unsized;
 };
 /** @endcond */
 
@@ -281,9 +306,9 @@ struct bjd_tag_t {
  * initialized this way. Use @ref bjd_tag_make_nil() to generate a nil tag.
  */
 #if BJDATA_EXTENSIONS
-#define BJDATA_TAG_ZERO {(bjd_type_t)0, 0, {0}}
+#define BJDATA_TAG_ZERO {(bjd_type_t)0, 0, {0}, 0, false}
 #else
-#define BJDATA_TAG_ZERO {(bjd_type_t)0, {0}}
+#define BJDATA_TAG_ZERO {(bjd_type_t)0, {0}, 0, false}
 #endif
 
 /** Generates a nil tag. */
@@ -373,6 +398,14 @@ BJDATA_INLINE bjd_tag_t bjd_tag_make_map(uint32_t count) {
     return ret;
 }
 
+/** Generates a tag for an array or map terminated by ']' or '}'. */
+BJDATA_INLINE bjd_tag_t bjd_tag_make_unsized(bjd_type_t type) {
+    bjd_tag_t ret = BJDATA_TAG_ZERO;
+    ret.type = type;
+    ret.unsized = true;
+    return ret;
+}
+
 /** Generates a str tag. */
 BJDATA_INLINE bjd_tag_t bjd_tag_make_str(uint32_t length) {
     bjd_tag_t ret = BJDATA_TAG_ZERO;
@@ -511,6 +544,33 @@ BJDATA_INLINE uint32_t bjd_tag_map_count(bjd_tag_t* tag) {
     return tag->v.n;
 }
 
+/**
+ * Gets the element marker of an optimized array or map tag, i.e. one
+ * whose header was of the form `[$<marker>#<count>`.
+ *
+ * Returns 0 if the container's elements each carry their own marker.
+ * Otherwise the elements are packed contiguously with no markers and
+ * must be read with bjd_read_typed_array() rather than bjd_read_tag().
+ */
+BJDATA_INLINE char bjd_tag_elemtype(bjd_tag_t* tag) {
+    bjd_assert(tag->type == bjd_type_array || tag->type == bjd_type_map,
+            "tag is not an array or map!");
+    return tag->elemtype;
+}
+
+/**
+ * Returns true if an array or map tag has no count, i.e. its elements are
+ * followed by a closing ']' or '}' marker instead.
+ *
+ * The count of such a tag is 0. Its elements must be read until
+ * bjd_read_array_end() or bjd_read_map_end() returns true.
+ */
+BJDATA_INLINE bool bjd_tag_is_unsized(bjd_tag_t* tag) {
+    bjd_assert(tag->type == bjd_type_array || tag->type == bjd_type_map,
+            "tag is not an array or map!");
+    return tag->unsized;
+}
+
 /**
  * Gets the length in bytes of a str-type tag.
  *
@@ -699,6 +759,107 @@ void bjd_print_file_callback(void* context, const char* data, size_t count);
 
 #endif
 
+#if BJDATA_MMAP
+/**
+ * Access hints for memory-mapped files, such as in bjd_tree_init_mmap()
+ * and bjd_reader_init_mmap().
+ */
+typedef enum bjd_mmap_flags_t {
+    bjd_mmap_sequential = 1, /**< The data will be read mostly in order (@c MADV_SEQUENTIAL.) */
+    bjd_mmap_willneed   = 2, /**< The data will be needed soon, so it can be read ahead (@c MADV_WILLNEED.) */
+} bjd_mmap_flags_t;
+#endif
+
+#ifdef BJDATA_MALLOC
+/**
+ * An allocator that can be attached to a tree, reader or writer in place of
+ * @ref BJDATA_MALLOC, @ref BJDATA_REALLOC and @ref BJDATA_FREE.
+ *
+ * The allocator must outlive everything it is attached to. Objects without
+ * an allocator use the compile-time functions.
+ *
+ * @see bjd_arena_t
+ * @see bjd_tree_set_allocator()
+ * @see bjd_reader_set_allocator()
+ * @see bjd_writer_set_allocator()
+ */
+typedef struct bjd_allocator_t {
+
+    /** Allocates the given number of bytes, or returns NULL. */
+    void* (*allocate)(void* context, size_t size);
+
+    /**
+     * Resizes an allocation, preserving its first used_size bytes, or returns
+     * NULL leaving it untouched. The pointer may be NULL. If this is NULL,
+     * reallocation is done with allocate and deallocate.
+     */
+    void* (*reallocate)(void* context, void* ptr, size_t used_size, size_t new_size);
+
+    /** Frees an allocation. The pointer is never NULL. */
+    void (*deallocate)(void* context, void* ptr);
+
+    /** The context passed to the allocator's functions. */
+    void* context;
+
+} bjd_allocator_t;
+
+/** @cond */
+typedef struct bjd_arena_block_t bjd_arena_block_t;
+/** @endcond */
+
+/**
+ * A bump-pointer allocator that frees everything at once.
+ *
+ * Allocations are carved out of large blocks. Freeing an allocation does
+ * nothing unless it is the most recent one. Call bjd_arena_reset() to free
+ * all allocations while keeping the blocks for reuse, for example after
+ * each request handled by a server.
+ *
+ * @see bjd_arena_allocator()
+ */
+typedef struct bjd_arena_t {
+    /** @cond */
+    bjd_allocator_t allocator;
+    bjd_arena_block_t* head;  /* The first block */
+    bjd_arena_block_t* block; /* The block being allocated from */
+    char* position;           /* The free space in the current block */
+    char* last;               /* The most recent allocation */
+    size_t block_size;
+    size_t resets;            /* The number of calls to bjd_arena_reset() */
+    /** @endcond */
+} bjd_arena_t;
+
+/**
+ * Initializes an arena that allocates blocks of the given size, or of
+ * @ref BJDATA_ARENA_BLOCK_SIZE if it is zero. Larger allocations get a
+ * block of their own. No memory is allocated until it is needed.
+ */
+void bjd_arena_init(bjd_arena_t* arena, size_t block_size);
+
+/**
+ * Returns the allocator interface of the arena to attach to trees, readers
+ * and writers.
+ */
+BJDATA_INLINE const bjd_allocator_t* bjd_arena_allocator(bjd_arena_t* arena) {
+    return &arena->allocator;
+}
+
+/**
+ * Frees all allocations made from the arena at once. The blocks are kept
+ * and reused by subsequent allocations.
+ *
+ * Readers and writers that use the arena must be destroyed first, and
+ * nothing allocated from it may be used afterwards. A tree may be kept for
+ * the next message (see bjd_tree_set_allocator()), but not its nodes.
+ */
+void bjd_arena_reset(bjd_arena_t* arena);
+
+/**
+ * Frees all memory owned by the arena.
+ */
+void bjd_arena_destroy(bjd_arena_t* arena);
+#endif
+
 /**
  * @}
  */
@@ -723,9 +884,9 @@ BJDATA_INLINE bjd_tag_t bjd_tag_nil(void) {
     return bjd_tag_make_nil();
 }
 
-/** \deprecated Renamed to bjd_tag_make_bool(). */
-BJDATA_INLINE bjd_tag_t bjd_tag_noop(bool value) {
-    return bjd_tag_make_noop(value);
+/** \deprecated Renamed to bjd_tag_make_noop(). */
+BJDATA_INLINE bjd_tag_t bjd_tag_noop(void) {
+    return bjd_tag_make_noop();
 }
 
 /** \deprecated Renamed to bjd_tag_make_bool(). */
@@ -778,9 +939,9 @@ BJDATA_INLINE bjd_tag_t bjd_tag_str(int32_t length) {
     return bjd_tag_make_str((uint32_t)length);
 }
 
-/** \deprecated Renamed to bjd_tag_make_bin(). */
+/** \deprecated Renamed to bjd_tag_make_huge(). */
 BJDATA_INLINE bjd_tag_t bjd_tag_bin(int32_t length) {
-    return bjd_tag_make_bin((uint32_t)length);
+    return bjd_tag_make_huge((uint32_t)length);
 }
 
 #if BJDATA_EXTENSIONS
@@ -805,35 +966,6 @@ BJDATA_INLINE bjd_tag_t bjd_tag_ext(int8_t exttype, int32_t length) {
  * use them for other purposes, but they are undocumented.
  */
 
-BJDATA_INLINE uint64_t bjd_load_uint(const char* p) {
-    switch(p[0]){
-	case 'i':
-	    return bjd_load_i8(p+1);
-	    break;
-	case 'U':
-	    return bjd_load_u8(p+1);
-	    break;
-	case 'I':
-	    return bjd_load_i16(p+1);
-	    break;
-	case 'u':
-	    return bjd_load_u16(p+1);
-	    break;
-	case 'l':
-	    return bjd_load_i32(p+1);
-	    break;
-	case 'm':
-	    return bjd_load_u32(p+1);
-	    break;
-	case 'L':
-	    return bjd_load_i64(p+1);
-	    break;
-	case 'M':
-	    return bjd_load_u64(p+1);
-	    break;
-    }
-}
-
 BJDATA_INLINE uint8_t bjd_load_u8(const char* p) {
     return (uint8_t)p[0];
 }
@@ -925,7 +1057,6 @@ BJDATA_INLINE void bjd_store_u64(char* p, uint64_t val) {
     #endif
 }
 
-BJDATA_INLINE int64_t bjd_load_int(const char* p) {return (int64_t)bjd_load_uint(p);}
 BJDATA_INLINE int8_t  bjd_load_i8 (const char* p) {return (int8_t) bjd_load_u8 (p);}
 BJDATA_INLINE int16_t bjd_load_i16(const char* p) {return (int16_t)bjd_load_u16(p);}
 BJDATA_INLINE int32_t bjd_load_i32(const char* p) {return (int32_t)bjd_load_u32(p);}
@@ -935,6 +1066,24 @@ BJDATA_INLINE void bjd_store_i16(char* p, int16_t val) {bjd_store_u16(p, (uint16
 BJDATA_INLINE void bjd_store_i32(char* p, int32_t val) {bjd_store_u32(p, (uint32_t)val);}
 BJDATA_INLINE void bjd_store_i64(char* p, int64_t val) {bjd_store_u64(p, (uint64_t)val);}
 
+// Loads an integer that starts with its marker, in network byte order.
+BJDATA_INLINE uint64_t bjd_load_uint(const char* p) {
+    switch (p[0]) {
+        case 'i': return (uint64_t)bjd_load_i8(p + 1);
+        case 'U': return bjd_load_u8(p + 1);
+        case 'I': return (uint64_t)bjd_load_i16(p + 1);
+        case 'u': return bjd_load_u16(p + 1);
+        case 'l': return (uint64_t)bjd_load_i32(p + 1);
+        case 'm': return bjd_load_u32(p + 1);
+        case 'L': return (uint64_t)bjd_load_i64(p + 1);
+        case 'M': return bjd_load_u64(p + 1);
+        default: break;
+    }
+    return 0;
+}
+
+BJDATA_INLINE int64_t bjd_load_int(const char* p) {return (int64_t)bjd_load_uint(p);}
+
 BJDATA_INLINE float bjd_load_float(const char* p) {
     BJDATA_CHECK_FLOAT_ORDER();
     BJDATA_STATIC_ASSERT(sizeof(float) == sizeof(uint32_t), "float is wrong size??");
@@ -977,6 +1126,184 @@ BJDATA_INLINE void bjd_store_double(char* p, double value) {
     bjd_store_u64(p, v.u);
 }
 
+/*
+ * The above load and store network (big-endian) byte order. The below
+ * are their little-endian counterparts, followed by variants that take
+ * the byte order of a reader, writer or tree.
+ */
+
+BJDATA_INLINE uint16_t bjd_load_u16_le(const char* p) {
+    #if BJDATA_HOST_LITTLE_ENDIAN
+    uint16_t val;
+    bjd_memcpy(&val, p, sizeof(val));
+    return val;
+    #else
+    return (uint16_t)((((uint16_t)(uint8_t)p[1]) << 8) |
+           ((uint16_t)(uint8_t)p[0]));
+    #endif
+}
+
+BJDATA_INLINE uint32_t bjd_load_u32_le(const char* p) {
+    #if BJDATA_HOST_LITTLE_ENDIAN
+    uint32_t val;
+    bjd_memcpy(&val, p, sizeof(val));
+    return val;
+    #else
+    return (((uint32_t)(uint8_t)p[3]) << 24) |
+           (((uint32_t)(uint8_t)p[2]) << 16) |
+           (((uint32_t)(uint8_t)p[1]) <<  8) |
+            ((uint32_t)(uint8_t)p[0]);
+    #endif
+}
+
+BJDATA_INLINE uint64_t bjd_load_u64_le(const char* p) {
+    #if BJDATA_HOST_LITTLE_ENDIAN
+    uint64_t val;
+    bjd_memcpy(&val, p, sizeof(val));
+    return val;
+    #else
+    return (((uint64_t)bjd_load_u32_le(p + 4)) << 32) |
+            ((uint64_t)bjd_load_u32_le(p));
+    #endif
+}
+
+BJDATA_INLINE void bjd_store_u16_le(char* p, uint16_t val) {
+    #if BJDATA_HOST_LITTLE_ENDIAN
+    bjd_memcpy(p, &val, sizeof(val));
+    #else
+    uint8_t* u = (uint8_t*)p;
+    u[0] = (uint8_t)( val       & 0xFF);
+    u[1] = (uint8_t)((val >> 8) & 0xFF);
+    #endif
+}
+
+BJDATA_INLINE void bjd_store_u32_le(char* p, uint32_t val) {
+    #if BJDATA_HOST_LITTLE_ENDIAN
+    bjd_memcpy(p, &val, sizeof(val));
+    #else
+    uint8_t* u = (uint8_t*)p;
+    u[0] = (uint8_t)( val        & 0xFF);
+    u[1] = (uint8_t)((val >>  8) & 0xFF);
+    u[2] = (uint8_t)((val >> 16) & 0xFF);
+    u[3] = (uint8_t)((val >> 24) & 0xFF);
+    #endif
+}
+
+BJDATA_INLINE void bjd_store_u64_le(char* p, uint64_t val) {
+    #if BJDATA_HOST_LITTLE_ENDIAN
+    bjd_memcpy(p, &val, sizeof(val));
+    #else
+    bjd_store_u32_le(p, (uint32_t)val);
+    bjd_store_u32_le(p + 4, (uint32_t)(val >> 32));
+    #endif
+}
+
+BJDATA_INLINE uint16_t bjd_load_u16_endian(const char* p, bjd_endian_t endian) {
+    return (endian == bjd_endian_little) ? bjd_load_u16_le(p) : bjd_load_u16(p);
+}
+
+BJDATA_INLINE uint32_t bjd_load_u32_endian(const char* p, bjd_endian_t endian) {
+    return (endian == bjd_endian_little) ? bjd_load_u32_le(p) : bjd_load_u32(p);
+}
+
+BJDATA_INLINE uint64_t bjd_load_u64_endian(const char* p, bjd_endian_t endian) {
+    return (endian == bjd_endian_little) ? bjd_load_u64_le(p) : bjd_load_u64(p);
+}
+
+BJDATA_INLINE void bjd_store_u16_endian(char* p, uint16_t val, bjd_endian_t endian) {
+    if (endian == bjd_endian_little)
+        bjd_store_u16_le(p, val);
+    else
+        bjd_store_u16(p, val);
+}
+
+BJDATA_INLINE void bjd_store_u32_endian(char* p, uint32_t val, bjd_endian_t endian) {
+    if (endian == bjd_endian_little)
+        bjd_store_u32_le(p, val);
+    else
+        bjd_store_u32(p, val);
+}
+
+BJDATA_INLINE void bjd_store_u64_endian(char* p, uint64_t val, bjd_endian_t endian) {
+    if (endian == bjd_endian_little)
+        bjd_store_u64_le(p, val);
+    else
+        bjd_store_u64(p, val);
+}
+
+BJDATA_INLINE int16_t bjd_load_i16_endian(const char* p, bjd_endian_t endian) {return (int16_t)bjd_load_u16_endian(p, endian);}
+BJDATA_INLINE int32_t bjd_load_i32_endian(const char* p, bjd_endian_t endian) {return (int32_t)bjd_load_u32_endian(p, endian);}
+BJDATA_INLINE int64_t bjd_load_i64_endian(const char* p, bjd_endian_t endian) {return (int64_t)bjd_load_u64_endian(p, endian);}
+
+BJDATA_INLINE float bjd_load_float_endian(const char* p, bjd_endian_t endian) {
+    BJDATA_CHECK_FLOAT_ORDER();
+    union {
+        float f;
+        uint32_t u;
+    } v;
+    v.u = bjd_load_u32_endian(p, endian);
+    return v.f;
+}
+
+BJDATA_INLINE double bjd_load_double_endian(const char* p, bjd_endian_t endian) {
+    BJDATA_CHECK_FLOAT_ORDER();
+    union {
+        double d;
+        uint64_t u;
+    } v;
+    v.u = bjd_load_u64_endian(p, endian);
+    return v.d;
+}
+
+BJDATA_INLINE void bjd_store_float_endian(char* p, float value, bjd_endian_t endian) {
+    BJDATA_CHECK_FLOAT_ORDER();
+    union {
+        float f;
+        uint32_t u;
+    } v;
+    v.f = value;
+    bjd_store_u32_endian(p, v.u, endian);
+}
+
+BJDATA_INLINE void bjd_store_double_endian(char* p, double value, bjd_endian_t endian) {
+    BJDATA_CHECK_FLOAT_ORDER();
+    union {
+        double d;
+        uint64_t u;
+    } v;
+    v.d = value;
+    bjd_store_u64_endian(p, v.u, endian);
+}
+
+/*
+ * The byte order of the host, if known at compile-time. Otherwise the
+ * host is assumed to be little-endian.
+ */
+#define BJDATA_HOST_ENDIAN (BJDATA_HOST_BIG_ENDIAN ? bjd_endian_big : bjd_endian_little)
+
+/*
+ * Loads a single fixed-size number encoded with the given marker (without
+ * the marker byte itself, as in the payload of a typed array) in the given
+ * byte order. Returns a nil tag if the marker is not a fixed-size numeric
+ * marker.
+ */
+BJDATA_INLINE bjd_tag_t bjd_load_typed(char marker, const char* p, bjd_endian_t endian) {
+    switch (marker) {
+        case 'U': return bjd_tag_make_uint(bjd_load_u8(p));
+        case 'u': return bjd_tag_make_uint(bjd_load_u16_endian(p, endian));
+        case 'm': return bjd_tag_make_uint(bjd_load_u32_endian(p, endian));
+        case 'M': return bjd_tag_make_uint(bjd_load_u64_endian(p, endian));
+        case 'i': return bjd_tag_make_int(bjd_load_i8(p));
+        case 'I': return bjd_tag_make_int(bjd_load_i16_endian(p, endian));
+        case 'l': return bjd_tag_make_int(bjd_load_i32_endian(p, endian));
+        case 'L': return bjd_tag_make_int(bjd_load_i64_endian(p, endian));
+        case 'd': return bjd_tag_make_float(bjd_load_float_endian(p, endian));
+        case 'D': return bjd_tag_make_double(bjd_load_double_endian(p, endian));
+        default: break;
+    }
+    return bjd_tag_make_nil();
+}
+
 /** @endcond */
 
 
@@ -995,9 +1322,258 @@ BJDATA_INLINE void bjd_store_double(char* p, double value) {
 #define BJDATA_TAG_SIZE_FLOAT    5
 #define BJDATA_TAG_SIZE_DOUBLE   9
 
+// Markers that introduce and describe containers
+#define BJDATA_MARKER_ARRAY_START '['
+#define BJDATA_MARKER_ARRAY_END   ']'
+#define BJDATA_MARKER_MAP_START   '{'
+#define BJDATA_MARKER_MAP_END     '}'
+#define BJDATA_MARKER_TYPE        '$'
+#define BJDATA_MARKER_COUNT       '#'
+
+// The maximum size of an optimized container header: the container
+// marker, '$' and element marker, '#' and a counted u64.
+#define BJDATA_TYPED_HEADER_MAX_SIZE (3 + 1 + BJDATA_TAG_SIZE_U64)
+
+/*
+ * Returns the size in bytes of a single element of the given fixed-size
+ * numeric marker, or 0 if the marker cannot be used as the element type
+ * of a typed array.
+ */
+BJDATA_INLINE size_t bjd_typed_marker_size(char marker) {
+    switch (marker) {
+        case 'i': case 'U': return 1;
+        case 'I': case 'u': return 2;
+        case 'l': case 'm': case 'd': return 4;
+        case 'L': case 'M': case 'D': return 8;
+        default: break;
+    }
+    return 0;
+}
+
+
+/** @endcond */
+
+
+
+/**
+ * @name ND-Array Views
+ * @{
+ */
+
+/**
+ * A strided view of the packed payload of an N-dimensional optimized
+ * array, that is an array with a '$' element type and a '#[...]'
+ * dimension vector in place of its count.
+ *
+ * A view does not own its data. It points into the buffer of the reader
+ * or tree it was obtained from, so it is only valid as long as that data
+ * is. Elements are in the byte order given by the endian field and may
+ * be unaligned; use bjd_ndarray_view_element() to decode one. When that
+ * matches the host (see @ref BJDATA_HOST_ENDIAN) and the elements are
+ * aligned, the payload can be used in place as a C array.
+ *
+ * Strides are in bytes. A view obtained from a reader or tree is
+ * contiguous and row-major (the last dimension varies fastest), but
+ * views produced by bjd_ndarray_view_slice() or bjd_ndarray_view_select()
+ * are not.
+ *
+ * @see bjd_read_ndarray()
+ * @see bjd_node_ndarray_view()
+ */
+typedef struct bjd_ndarray_view_t {
+    char type;    /**< The element type marker, e.g. 'd' or 'U'. */
+    size_t size;  /**< The size in bytes of each element. */
+    size_t ndims; /**< The number of dimensions. */
+    size_t dims[BJDATA_NDARRAY_MAX_DIMS];    /**< The length of each dimension. */
+    size_t strides[BJDATA_NDARRAY_MAX_DIMS]; /**< The distance in bytes between consecutive indices of each dimension. */
+    const char* data; /**< The element at index zero in every dimension. */
+    bjd_endian_t endian; /**< The byte order of the elements. */
+} bjd_ndarray_view_t;
+
+/**
+ * Returns the total number of elements in the view (the product of its
+ * dimensions.)
+ */
+size_t bjd_ndarray_view_count(const bjd_ndarray_view_t* view);
+
+/**
+ * Returns a pointer to the element at the given index, which must have
+ * view->ndims components each within bounds of its dimension.
+ */
+BJDATA_INLINE const char* bjd_ndarray_view_at(const bjd_ndarray_view_t* view, const size_t* index) {
+    const char* p = view->data;
+    for (size_t i = 0; i < view->ndims; ++i) {
+        bjd_assert(index[i] < view->dims[i], "index %i is out of bounds in dimension %i of length %i",
+                (int)index[i], (int)i, (int)view->dims[i]);
+        p += index[i] * view->strides[i];
+    }
+    return p;
+}
+
+/**
+ * Decodes the element at the given index of the view into a tag.
+ *
+ * @see bjd_ndarray_view_at()
+ */
+bjd_tag_t bjd_ndarray_view_element(const bjd_ndarray_view_t* view, const size_t* index);
 
+/**
+ * Restricts a view to count indices of the given axis starting at start,
+ * placing the result in out (which may be the same as view.) The number of
+ * dimensions is unchanged.
+ *
+ * Returns false if the axis or range is out of bounds, in which case out
+ * is left unchanged.
+ */
+bool bjd_ndarray_view_slice(const bjd_ndarray_view_t* view, size_t axis,
+        size_t start, size_t count, bjd_ndarray_view_t* out);
+
+/**
+ * Fixes the given axis of a view at the given index, placing the resulting
+ * view with one less dimension in out (which may be the same as view.) For
+ * example selecting index 3 of axis 0 of a 3D volume yields its fourth
+ * 2D plane.
+ *
+ * Returns false if the axis or index is out of bounds, or if the view has
+ * only one dimension, in which case out is left unchanged.
+ */
+bool bjd_ndarray_view_select(const bjd_ndarray_view_t* view, size_t axis,
+        size_t index, bjd_ndarray_view_t* out);
+
+/** @cond */
+/*
+ * Initializes a contiguous row-major view of the given packed payload.
+ */
+void bjd_ndarray_view_init(bjd_ndarray_view_t* view, char type,
+        const uint32_t* dims, size_t ndims, const char* data, bjd_endian_t endian);
 /** @endcond */
 
+/**
+ * @}
+ */
+
+
+
+/**
+ * @name Skip Indexes
+ * @{
+ */
+
+/**
+ * The byte range of an array or map in a @ref bjd_skip_index_t, as offsets
+ * from the start of the indexed data. The start is the offset of its
+ * opening marker, and the end is the offset just past its last byte.
+ */
+typedef struct bjd_skip_entry_t {
+    uint64_t start; /**< The offset of the container */
+    uint64_t end;   /**< The offset of the end of the container */
+} bjd_skip_entry_t;
+
+/**
+ * A structural index of Binary JData that maps the start of each large
+ * array or map to its end, so that bjd_discard() can skip the container
+ * without reading its contents.
+ *
+ * An index can be built with bjd_skip_index_build(), or kept as a sidecar
+ * to the data and loaded by pointing @c entries at the stored entries. It
+ * is attached to a reader with bjd_reader_set_skip_index().
+ */
+typedef struct bjd_skip_index_t {
+    bjd_skip_entry_t* entries; /**< The entries, sorted by start offset */
+    size_t count;              /**< The number of entries */
+
+    /** @cond */
+    size_t capacity; /* The capacity of entries if it is owned, 0 otherwise */
+    const bjd_allocator_t* allocator; /* The allocator of owned entries, or NULL */
+    /** @endcond */
+} bjd_skip_index_t;
+
+#ifdef BJDATA_MALLOC
+/**
+ * Builds a skip index of the arrays and maps of at least min_size bytes in
+ * the given data, in a single pass that doesn't decode any values. The data
+ * may contain several messages. Smaller containers are left out to keep the
+ * index small, since they are cheap to skip anyway.
+ *
+ * Containers nested deeper than @ref BJDATA_SCAN_MAX_DEPTH can't be
+ * indexed.
+ *
+ * @param index The index to initialize. It must be destroyed with
+ *        bjd_skip_index_destroy() unless an error is returned.
+ * @param data The data to index
+ * @param count The number of bytes of data
+ * @param endian The byte order of multi-byte numbers in the data
+ * @param min_size The minimum size in bytes of a container to index
+ *
+ * @return @ref bjd_ok; @ref bjd_error_invalid if the data is not valid
+ *         Binary JData; @ref bjd_error_too_big if it is nested too deeply;
+ *         or @ref bjd_error_memory.
+ */
+bjd_error_t bjd_skip_index_build(bjd_skip_index_t* index, const char* data, size_t count,
+        bjd_endian_t endian, size_t min_size);
+
+/**
+ * Frees the entries of a skip index built by bjd_skip_index_build().
+ */
+void bjd_skip_index_destroy(bjd_skip_index_t* index);
+#endif
+
+/**
+ * @}
+ */
+
+/**
+ * @name Paths
+ *
+ * A path names a value nested in a message by a sequence of map keys and
+ * array indices. Paths are evaluated over a reader with bjd_path_eval(),
+ * and select the parts of a message to parse into a tree with
+ * bjd_tree_set_projection().
+ *
+ * @{
+ */
+
+/**
+ * A compiled path query.
+ *
+ * @see bjd_path_compile()
+ */
+typedef struct bjd_path_t {
+    /** @cond */
+    struct {
+        const char* key; /* The map key, or NULL if the step is an array index */
+        size_t length;   /* The length of the key */
+        uint32_t index;  /* The array index */
+    } steps[BJDATA_PATH_MAX_STEPS];
+    size_t count;
+    /** @endcond */
+} bjd_path_t;
+
+/**
+ * Compiles a path query.
+ *
+ * The path is a sequence of steps, each either a map key or an array
+ * index in brackets. Keys are separated by dots and run until the next dot
+ * or bracket; a key containing these can be given in brackets in double
+ * quotes. For example, @c "a.b[3].c" and @c "[\"a.b\"][0]" are valid
+ * paths. An empty path matches the whole value.
+ *
+ * The keys of the compiled path point into the expression, so the
+ * expression must outlive the compiled path.
+ *
+ * @param path The path to compile.
+ * @param expr The null-terminated path expression.
+ *
+ * @return @ref bjd_ok, @ref bjd_error_invalid if the expression is not a
+ *         valid path, or @ref bjd_error_too_big if it has more than
+ *         @ref BJDATA_PATH_MAX_STEPS steps.
+ */
+bjd_error_t bjd_path_compile(bjd_path_t* path, const char* expr);
+
+/**
+ * @}
+ */
+
 
 
 #if BJDATA_READ_TRACKING || BJDATA_WRITE_TRACKING
@@ -1013,19 +1589,26 @@ typedef struct bjd_track_element_t {
     // read/written key. left is not decremented until both key and value are
     // read/written.
     bool key_needs_value;
+
+    // indicates an array or map closed by a terminator rather than a
+    // count, so left is not used.
+    bool unsized;
 } bjd_track_element_t;
 
 typedef struct bjd_track_t {
     size_t count;
     size_t capacity;
     bjd_track_element_t* elements;
+    const bjd_allocator_t* allocator;
 } bjd_track_t;
 
 #if BJDATA_INTERNAL
-bjd_error_t bjd_track_init(bjd_track_t* track);
+bjd_error_t bjd_track_init(bjd_track_t* track, const bjd_allocator_t* allocator);
 bjd_error_t bjd_track_grow(bjd_track_t* track);
 bjd_error_t bjd_track_push(bjd_track_t* track, bjd_type_t type, uint32_t count);
+bjd_error_t bjd_track_push_unsized(bjd_track_t* track, bjd_type_t type);
 bjd_error_t bjd_track_pop(bjd_track_t* track, bjd_type_t type);
+bjd_error_t bjd_track_pop_sized(bjd_track_t* track, bjd_type_t type, bool unsized);
 bjd_error_t bjd_track_element(bjd_track_t* track, bool read);
 bjd_error_t bjd_track_peek_element(bjd_track_t* track, bool read);
 bjd_error_t bjd_track_bytes(bjd_track_t* track, bool read, size_t count);
@@ -1044,6 +1627,73 @@ bjd_error_t bjd_track_destroy(bjd_track_t* track, bool cancel);
 
 
 
+#ifdef BJDATA_MALLOC
+/* Allocation through an optional bjd_allocator_t; NULL selects BJDATA_MALLOC */
+
+BJDATA_INLINE void* bjd_allocator_malloc(const bjd_allocator_t* allocator, size_t size) {
+    if (allocator)
+        return allocator->allocate(allocator->context, size);
+    return BJDATA_MALLOC(size);
+}
+
+void* bjd_allocator_realloc(const bjd_allocator_t* allocator, void* ptr, size_t used_size, size_t new_size);
+
+BJDATA_INLINE void bjd_allocator_free(const bjd_allocator_t* allocator, void* ptr) {
+    if (allocator)
+        allocator->deallocate(allocator->context, ptr);
+    else
+        BJDATA_FREE(ptr);
+}
+
+/*
+ * Returns the number of times the allocator has freed all of its
+ * allocations at once, which only a bjd_arena_t does, or 0 for any other
+ * allocator.
+ */
+size_t bjd_allocator_resets(const bjd_allocator_t* allocator);
+#endif
+
+
+
+/* Structural scanning */
+
+/*
+ * Reads a non-negative integer length with its marker at *pos, advancing
+ * *pos past it. Returns false if it is not a valid length.
+ */
+bool bjd_scan_length(const char* data, size_t end, size_t* pos,
+        bjd_endian_t endian, uint64_t* length);
+
+/*
+ * Skips the value at *pos without decoding it, advancing *pos past it. If
+ * index is not NULL, the arrays and maps of at least min_size bytes in the
+ * value are appended to it.
+ *
+ * Only the structure needed to find the end of the value is checked.
+ * Returns bjd_error_invalid if it can't be found, bjd_error_too_big if the
+ * value is nested deeper than BJDATA_SCAN_MAX_DEPTH, or bjd_error_memory if
+ * the index can't grow.
+ */
+bjd_error_t bjd_scan_value(const char* data, size_t end, size_t* pos, bjd_endian_t endian,
+        bjd_skip_index_t* index, size_t min_size);
+
+/*
+ * Returns true if the step of the path at the given depth is the given map
+ * key, or the given array index if key is NULL.
+ */
+BJDATA_INLINE bool bjd_path_step_matches(const bjd_path_t* path, size_t depth,
+        const char* key, size_t length, size_t index)
+{
+    if (depth >= path->count)
+        return false;
+    if (key == NULL)
+        return path->steps[depth].key == NULL && path->steps[depth].index == index;
+    return path->steps[depth].key != NULL && path->steps[depth].length == length &&
+            bjd_memcmp(path->steps[depth].key, key, length) == 0;
+}
+
+
+
 /* Miscellaneous string functions */
 
 /**
@@ -1063,6 +1713,31 @@ bool bjd_str_check_no_null(const char* str, size_t bytes);
 
 
 
+#if BJDATA_MMAP
+/* Memory-mapped files */
+
+typedef struct bjd_file_map_t {
+    void* address;
+    size_t size;
+} bjd_file_map_t;
+
+/**
+ * Maps the given file read-only, applying the given bjd_mmap_flags_t hints.
+ *
+ * Returns bjd_error_io if the file cannot be opened or mapped,
+ * bjd_error_invalid if it is empty, or bjd_error_too_big if it does not
+ * fit in the address space.
+ */
+bjd_error_t bjd_file_map(bjd_file_map_t* map, const char* filename, unsigned flags);
+
+/**
+ * Releases a mapping made by bjd_file_map().
+ */
+void bjd_file_unmap(bjd_file_map_t* map);
+#endif
+
+
+
 /** @endcond */
 #endif
 
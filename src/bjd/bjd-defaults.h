@@ -195,6 +195,54 @@
 #define BJDATA_FREE free
 #endif
 
+/**
+ * @def BJDATA_MMAP
+ *
+ * Enables bjd_tree_init_mmap(), which parses a file by mapping it into
+ * memory rather than reading it.
+ *
+ * This is enabled by default on POSIX and Windows platforms if
+ * @ref BJDATA_MALLOC is available.
+ */
+#ifndef BJDATA_MMAP
+#if defined(BJDATA_MALLOC) && (defined(__unix__) || defined(__APPLE__) || defined(_WIN32))
+#define BJDATA_MMAP 1
+#else
+#define BJDATA_MMAP 0
+#endif
+#endif
+
+/**
+ * @def BJDATA_IOV
+ *
+ * Enables bjd_writer_init_iov() and bjd_writer_init_fd(), which produce
+ * vectored output that references large payloads rather than copying them.
+ *
+ * This is enabled by default on POSIX platforms if @ref BJDATA_MALLOC is
+ * available.
+ */
+#ifndef BJDATA_IOV
+#if defined(BJDATA_MALLOC) && (defined(__unix__) || defined(__APPLE__))
+#define BJDATA_IOV 1
+#else
+#define BJDATA_IOV 0
+#endif
+#endif
+
+/**
+ * @def BJDATA_THREADS
+ *
+ * Enables bjd_tree_parse_parallel(), which parses the elements of a large
+ * top-level array on multiple POSIX threads. This requires
+ * @ref BJDATA_MALLOC and linking with -pthread.
+ *
+ * This is disabled by default, in which case bjd_tree_parse_parallel()
+ * parses on the calling thread.
+ */
+#ifndef BJDATA_THREADS
+#define BJDATA_THREADS 0
+#endif
+
 /**
  * @}
  */
@@ -305,6 +353,25 @@
 #endif
 #endif
 
+/**
+ * Whether to use SIMD instructions to convert bulk numeric payloads, such
+ * as the elements of typed arrays.
+ *
+ * On x86 the fastest of SSE2, SSSE3 and AVX2 supported by the CPU is
+ * picked at runtime, so this does not require any special compiler
+ * flags. On ARM, NEON is used if it is enabled at compile-time. Other
+ * platforms always use scalar code.
+ *
+ * This is disabled by default when optimizing for size.
+ */
+#ifndef BJDATA_SIMD
+#if BJDATA_OPTIMIZE_FOR_SIZE
+#define BJDATA_SIMD 0
+#else
+#define BJDATA_SIMD 1
+#endif
+#endif
+
 /**
  * Stack space in bytes to use when initializing a reader or writer
  * with a stack-allocated buffer.
@@ -325,6 +392,40 @@
 #define BJDATA_BUFFER_SIZE 4096
 #endif
 
+/**
+ * The maximum size of a chunk allocated by a chunked writer. Chunks start
+ * at @ref BJDATA_BUFFER_SIZE and double until they reach this size.
+ *
+ * @see bjd_writer_init_chunked()
+ */
+#ifndef BJDATA_CHUNK_MAX_SIZE
+#define BJDATA_CHUNK_MAX_SIZE (1024 * 1024)
+#endif
+
+/**
+ * The default size of a block allocated by an arena.
+ *
+ * @see bjd_arena_init()
+ */
+#ifndef BJDATA_ARENA_BLOCK_SIZE
+#define BJDATA_ARENA_BLOCK_SIZE (64 * 1024)
+#endif
+
+/**
+ * @def BJDATA_COMPACT_NODES
+ *
+ * Stores the type of each node of a tree in a single byte, shrinking
+ * @ref bjd_node_data_t from 24 to 16 bytes so that four nodes fit in a
+ * 64-byte cache line. This speeds up walking large trees and allows more
+ * nodes per page, at the cost of byte loads of the type.
+ *
+ * This only changes the internal layout of nodes; the node API behaves
+ * the same.
+ */
+#ifndef BJDATA_COMPACT_NODES
+#define BJDATA_COMPACT_NODES 0
+#endif
+
 /**
  * Minimum size of an allocated node page in bytes.
  *
@@ -342,6 +443,27 @@
 #define BJDATA_NODE_PAGE_SIZE 4096
 #endif
 
+/**
+ * The maximum total size in bytes of node pages a tree keeps from one
+ * message for reuse by the next, so that parsing a stream of messages of
+ * similar shape does not allocate.
+ *
+ * @see bjd_tree_set_page_cache_size()
+ */
+#ifndef BJDATA_NODE_PAGE_CACHE_SIZE
+#define BJDATA_NODE_PAGE_CACHE_SIZE (64 * 1024)
+#endif
+
+/**
+ * The minimum number of bytes of a message for each thread that
+ * bjd_tree_parse_parallel() uses. Smaller messages are parsed on fewer
+ * threads, or on the calling thread alone, since starting a thread costs
+ * more than parsing them.
+ */
+#ifndef BJDATA_NODE_PARALLEL_MIN_SIZE
+#define BJDATA_NODE_PARALLEL_MIN_SIZE (64 * 1024)
+#endif
+
 /**
  * The initial depth for the node parser. When BJDATA_MALLOC is available,
  * the node parser has no practical depth limit, and it is not recursive
@@ -358,6 +480,91 @@
 #define BJDATA_NODE_MAX_DEPTH_WITHOUT_MALLOC 32
 #endif
 
+/**
+ * The maximum nesting depth of the structural scan that builds skip
+ * indexes (see bjd_skip_index_build()) and splits messages for
+ * bjd_tree_parse_parallel(). The scan keeps its stack on the call stack.
+ */
+#ifndef BJDATA_SCAN_MAX_DEPTH
+#define BJDATA_SCAN_MAX_DEPTH 64
+#endif
+
+/**
+ * The minimum size in bytes of a container whose end is recorded when a
+ * message is parsed lazily with bjd_tree_parse_lazy(). The message is
+ * scanned once up front, and deferring a recorded container looks up its
+ * end instead of scanning it again. Smaller containers are scanned when
+ * they are deferred, which is cheap but repeats for each level of nesting
+ * among them. This only applies when @ref BJDATA_MALLOC is available.
+ */
+#ifndef BJDATA_NODE_LAZY_INDEX_MIN_SIZE
+#define BJDATA_NODE_LAZY_INDEX_MIN_SIZE 256
+#endif
+
+/**
+ * The minimum number of keys of a map for the node API to build a hash
+ * index for it on its first key lookup. Smaller maps are searched linearly.
+ *
+ * This is 0 by default, so that maps are only indexed explicitly with
+ * bjd_tree_build_index(). Otherwise key lookups modify the tree, so a tree
+ * must not be read from multiple threads at once unless
+ * bjd_tree_build_index() was called with at most this size first.
+ * Indexes are only built when @ref BJDATA_MALLOC is available.
+ */
+#ifndef BJDATA_NODE_INDEX_MIN_SIZE
+#define BJDATA_NODE_INDEX_MIN_SIZE 0
+#endif
+
+/**
+ * The maximum number of strings in a @ref bjd_keyset_t. The table of a key
+ * set is stored inline, so this determines its size. This must be between
+ * 1 and 32768; it does not need to be a power of two.
+ */
+#ifndef BJDATA_KEYSET_MAX_KEYS
+#define BJDATA_KEYSET_MAX_KEYS 128
+#endif
+
+/**
+ * The maximum number of keys and indices in a @ref bjd_path_t. The steps
+ * of a compiled path are stored inline, so this determines its size.
+ *
+ * @see bjd_path_compile()
+ */
+#ifndef BJDATA_PATH_MAX_STEPS
+#define BJDATA_PATH_MAX_STEPS 16
+#endif
+
+/**
+ * The maximum number of elements the writer buffers in auto-typed mode
+ * in order to promote an array to an optimized array. Arrays with more
+ * elements are written in their plain encoding.
+ *
+ * @see bjd_writer_set_auto_typed()
+ */
+#ifndef BJDATA_AUTO_TYPED_MAX
+#define BJDATA_AUTO_TYPED_MAX 4096
+#endif
+
+/**
+ * The minimum size in bytes of a payload for a vectored writer to reference
+ * it in place rather than copy it into its buffer.
+ *
+ * @see bjd_writer_init_iov()
+ */
+#ifndef BJDATA_IOV_REFERENCE_MIN
+#define BJDATA_IOV_REFERENCE_MIN 2048
+#endif
+
+/**
+ * The maximum number of dimensions of an ND-array. Arrays with more
+ * dimensions are rejected with @ref bjd_error_unsupported.
+ *
+ * @see bjd_ndarray_view_t
+ */
+#ifndef BJDATA_NDARRAY_MAX_DIMS
+#define BJDATA_NDARRAY_MAX_DIMS 8
+#endif
+
 /**
  * @}
  */
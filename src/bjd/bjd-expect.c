@@ -39,34 +39,10 @@ BJDATA_STATIC_INLINE uint8_t bjd_expect_native_u8(bjd_reader_t* reader) {
     return type;
 }
 
-#if !BJDATA_OPTIMIZE_FOR_SIZE
-BJDATA_STATIC_INLINE uint16_t bjd_expect_native_u16(bjd_reader_t* reader) {
-    if (bjd_reader_error(reader) != bjd_ok)
-        return 0;
-    uint16_t type;
-    if (!bjd_reader_ensure(reader, sizeof(type)))
-        return 0;
-    type = bjd_load_u16(reader->data);
-    reader->data += sizeof(type);
-    return type;
-}
-
-BJDATA_STATIC_INLINE uint32_t bjd_expect_native_u32(bjd_reader_t* reader) {
-    if (bjd_reader_error(reader) != bjd_ok)
-        return 0;
-    uint32_t type;
-    if (!bjd_reader_ensure(reader, sizeof(type)))
-        return 0;
-    type = bjd_load_u32(reader->data);
-    reader->data += sizeof(type);
-    return type;
-}
-#endif
-
-BJDATA_STATIC_INLINE uint8_t bjd_expect_type_byte(bjd_reader_t* reader) {
-    bjd_reader_track_element(reader);
-    return bjd_expect_native_u8(reader);
-}
+// Functions that read a tag along with its contents are split into a
+// _value function and a wrapper that rewinds a resumable reader that blocks
+// partway (see bjd_reader_mark()), so that the same call can be made again
+// once more data is fed.
 
 
 // Basic Number Functions
@@ -279,15 +255,17 @@ void bjd_expect_int_match(bjd_reader_t* reader, int64_t value) {
 // Other Basic Types
 
 void bjd_expect_nil(bjd_reader_t* reader) {
-    if (bjd_expect_type_byte(reader) != 0xc0)
+    bjd_tag_t var = bjd_read_tag(reader);
+    if (var.type != bjd_type_nil)
         bjd_reader_flag_error(reader, bjd_error_type);
 }
 
 bool bjd_expect_bool(bjd_reader_t* reader) {
-    uint8_t type = bjd_expect_type_byte(reader);
-    if ((type & ~1) != 0xc2)
-        bjd_reader_flag_error(reader, bjd_error_type);
-    return (bool)(type & 1);
+    bjd_tag_t var = bjd_read_tag(reader);
+    if (var.type == bjd_type_bool)
+        return var.v.b;
+    bjd_reader_flag_error(reader, bjd_error_type);
+    return false;
 }
 
 void bjd_expect_true(bjd_reader_t* reader) {
@@ -301,7 +279,7 @@ void bjd_expect_false(bjd_reader_t* reader) {
 }
 
 #if BJDATA_EXTENSIONS
-bjd_timestamp_t bjd_expect_timestamp(bjd_reader_t* reader) {
+static bjd_timestamp_t bjd_expect_timestamp_value(bjd_reader_t* reader) {
     bjd_timestamp_t zero = {0, 0};
 
     bjd_tag_t tag = bjd_read_tag(reader);
@@ -317,6 +295,14 @@ bjd_timestamp_t bjd_expect_timestamp(bjd_reader_t* reader) {
     return bjd_read_timestamp(reader, bjd_tag_ext_length(&tag));
 }
 
+bjd_timestamp_t bjd_expect_timestamp(bjd_reader_t* reader) {
+    bjd_reader_mark_t mark;
+    bjd_reader_mark(reader, &mark);
+    bjd_timestamp_t result = bjd_expect_timestamp_value(reader);
+    bjd_reader_rewind(reader, &mark);
+    return result;
+}
+
 int64_t bjd_expect_timestamp_truncate(bjd_reader_t* reader) {
     return bjd_expect_timestamp(reader).seconds;
 }
@@ -327,7 +313,7 @@ int64_t bjd_expect_timestamp_truncate(bjd_reader_t* reader) {
 
 uint32_t bjd_expect_map(bjd_reader_t* reader) {
     bjd_tag_t var = bjd_read_tag(reader);
-    if (var.type == bjd_type_map)
+    if (var.type == bjd_type_map && !var.unsized)
         return var.v.n;
     bjd_reader_flag_error(reader, bjd_error_type);
     return 0;
@@ -346,7 +332,7 @@ bool bjd_expect_map_or_nil(bjd_reader_t* reader, uint32_t* count) {
         *count = 0;
         return false;
     }
-    if (var.type == bjd_type_map) {
+    if (var.type == bjd_type_map && !var.unsized) {
         *count = var.v.n;
         return true;
     }
@@ -367,9 +353,23 @@ bool bjd_expect_map_max_or_nil(bjd_reader_t* reader, uint32_t max_count, uint32_
     return has_map;
 }
 
+uint32_t bjd_expect_typed_map_max(bjd_reader_t* reader, char marker, uint32_t max_count) {
+    bjd_tag_t var = bjd_read_tag(reader);
+    if (var.type == bjd_type_map && var.elemtype == marker && var.v.n <= max_count)
+        return var.v.n;
+    bjd_reader_flag_error(reader, bjd_error_type);
+    return 0;
+}
+
+void bjd_expect_map_unsized(bjd_reader_t* reader) {
+    bjd_tag_t var = bjd_read_tag(reader);
+    if (var.type != bjd_type_map || !var.unsized)
+        bjd_reader_flag_error(reader, bjd_error_type);
+}
+
 uint32_t bjd_expect_array(bjd_reader_t* reader) {
     bjd_tag_t var = bjd_read_tag(reader);
-    if (var.type == bjd_type_array)
+    if (var.type == bjd_type_array && !var.unsized)
         return var.v.n;
     bjd_reader_flag_error(reader, bjd_error_type);
     return 0;
@@ -388,7 +388,7 @@ bool bjd_expect_array_or_nil(bjd_reader_t* reader, uint32_t* count) {
         *count = 0;
         return false;
     }
-    if (var.type == bjd_type_array) {
+    if (var.type == bjd_type_array && !var.unsized) {
         *count = var.v.n;
         return true;
     }
@@ -409,6 +409,12 @@ bool bjd_expect_array_max_or_nil(bjd_reader_t* reader, uint32_t max_count, uint3
     return has_array;
 }
 
+void bjd_expect_array_unsized(bjd_reader_t* reader) {
+    bjd_tag_t var = bjd_read_tag(reader);
+    if (var.type != bjd_type_array || !var.unsized)
+        bjd_reader_flag_error(reader, bjd_error_type);
+}
+
 #ifdef BJDATA_MALLOC
 void* bjd_expect_array_alloc_impl(bjd_reader_t* reader, size_t element_size, uint32_t max_count, uint32_t* out_count, bool allow_nil) {
     bjd_assert(out_count != NULL, "out_count cannot be NULL");
@@ -433,7 +439,7 @@ void* bjd_expect_array_alloc_impl(bjd_reader_t* reader, size_t element_size, uin
         return NULL;
     }
 
-    void* p = BJDATA_MALLOC(element_size * count);
+    void* p = bjd_allocator_malloc(reader->allocator, element_size * count);
     if (p == NULL) {
         bjd_reader_flag_error(reader, bjd_error_memory);
         return NULL;
@@ -448,37 +454,14 @@ void* bjd_expect_array_alloc_impl(bjd_reader_t* reader, size_t element_size, uin
 // Str, Bin and Ext Functions
 
 uint32_t bjd_expect_str(bjd_reader_t* reader) {
-    #if BJDATA_OPTIMIZE_FOR_SIZE
     bjd_tag_t var = bjd_read_tag(reader);
     if (var.type == bjd_type_str)
         return var.v.l;
     bjd_reader_flag_error(reader, bjd_error_type);
     return 0;
-    #else
-    uint8_t type = bjd_expect_type_byte(reader);
-    uint32_t count;
-
-    if ((type >> 5) == 5) {
-        count = type & (uint8_t)~0xe0;
-    } else if (type == 0xd9) {
-        count = bjd_expect_native_u8(reader);
-    } else if (type == 0xda) {
-        count = bjd_expect_native_u16(reader);
-    } else if (type == 0xdb) {
-        count = bjd_expect_native_u32(reader);
-    } else {
-        bjd_reader_flag_error(reader, bjd_error_type);
-        return 0;
-    }
-
-    #if BJDATA_READ_TRACKING
-    bjd_reader_flag_if_error(reader, bjd_track_push(&reader->track, bjd_type_str, count));
-    #endif
-    return count;
-    #endif
 }
 
-size_t bjd_expect_str_buf(bjd_reader_t* reader, char* buf, size_t bufsize) {
+static size_t bjd_expect_str_buf_value(bjd_reader_t* reader, char* buf, size_t bufsize) {
     bjd_assert(buf != NULL, "buf cannot be NULL");
 
     size_t length = bjd_expect_str(reader);
@@ -498,6 +481,14 @@ size_t bjd_expect_str_buf(bjd_reader_t* reader, char* buf, size_t bufsize) {
     return length;
 }
 
+size_t bjd_expect_str_buf(bjd_reader_t* reader, char* buf, size_t bufsize) {
+    bjd_reader_mark_t mark;
+    bjd_reader_mark(reader, &mark);
+    size_t result = bjd_expect_str_buf_value(reader, buf, bufsize);
+    bjd_reader_rewind(reader, &mark);
+    return result;
+}
+
 size_t bjd_expect_utf8(bjd_reader_t* reader, char* buf, size_t size) {
     bjd_assert(buf != NULL, "buf cannot be NULL");
 
@@ -519,7 +510,7 @@ uint32_t bjd_expect_bin(bjd_reader_t* reader) {
     return 0;
 }
 
-size_t bjd_expect_bin_buf(bjd_reader_t* reader, char* buf, size_t bufsize) {
+static size_t bjd_expect_bin_buf_value(bjd_reader_t* reader, char* buf, size_t bufsize) {
     bjd_assert(buf != NULL, "buf cannot be NULL");
 
     size_t binsize = bjd_expect_bin(reader);
@@ -536,13 +527,28 @@ size_t bjd_expect_bin_buf(bjd_reader_t* reader, char* buf, size_t bufsize) {
     return binsize;
 }
 
-void bjd_expect_bin_size_buf(bjd_reader_t* reader, char* buf, uint32_t size) {
+size_t bjd_expect_bin_buf(bjd_reader_t* reader, char* buf, size_t bufsize) {
+    bjd_reader_mark_t mark;
+    bjd_reader_mark(reader, &mark);
+    size_t result = bjd_expect_bin_buf_value(reader, buf, bufsize);
+    bjd_reader_rewind(reader, &mark);
+    return result;
+}
+
+static void bjd_expect_bin_size_buf_value(bjd_reader_t* reader, char* buf, uint32_t size) {
     bjd_assert(buf != NULL, "buf cannot be NULL");
     bjd_expect_bin_size(reader, size);
     bjd_read_bytes(reader, buf, size);
     bjd_done_bin(reader);
 }
 
+void bjd_expect_bin_size_buf(bjd_reader_t* reader, char* buf, uint32_t size) {
+    bjd_reader_mark_t mark;
+    bjd_reader_mark(reader, &mark);
+    bjd_expect_bin_size_buf_value(reader, buf, size);
+    bjd_reader_rewind(reader, &mark);
+}
+
 #if BJDATA_EXTENSIONS
 uint32_t bjd_expect_ext(bjd_reader_t* reader, int8_t* type) {
     bjd_tag_t var = bjd_read_tag(reader);
@@ -555,7 +561,7 @@ uint32_t bjd_expect_ext(bjd_reader_t* reader, int8_t* type) {
     return 0;
 }
 
-size_t bjd_expect_ext_buf(bjd_reader_t* reader, int8_t* type, char* buf, size_t bufsize) {
+static size_t bjd_expect_ext_buf_value(bjd_reader_t* reader, int8_t* type, char* buf, size_t bufsize) {
     bjd_assert(buf != NULL, "buf cannot be NULL");
 
     size_t extsize = bjd_expect_ext(reader, type);
@@ -574,22 +580,44 @@ size_t bjd_expect_ext_buf(bjd_reader_t* reader, int8_t* type, char* buf, size_t
     bjd_done_ext(reader);
     return extsize;
 }
+
+size_t bjd_expect_ext_buf(bjd_reader_t* reader, int8_t* type, char* buf, size_t bufsize) {
+    bjd_reader_mark_t mark;
+    bjd_reader_mark(reader, &mark);
+    size_t result = bjd_expect_ext_buf_value(reader, type, buf, bufsize);
+    bjd_reader_rewind(reader, &mark);
+    return result;
+}
 #endif
 
-void bjd_expect_cstr(bjd_reader_t* reader, char* buf, size_t bufsize) {
+static void bjd_expect_cstr_value(bjd_reader_t* reader, char* buf, size_t bufsize) {
     uint32_t length = bjd_expect_str(reader);
     bjd_read_cstr(reader, buf, bufsize, length);
     bjd_done_str(reader);
 }
 
-void bjd_expect_utf8_cstr(bjd_reader_t* reader, char* buf, size_t bufsize) {
+void bjd_expect_cstr(bjd_reader_t* reader, char* buf, size_t bufsize) {
+    bjd_reader_mark_t mark;
+    bjd_reader_mark(reader, &mark);
+    bjd_expect_cstr_value(reader, buf, bufsize);
+    bjd_reader_rewind(reader, &mark);
+}
+
+static void bjd_expect_utf8_cstr_value(bjd_reader_t* reader, char* buf, size_t bufsize) {
     uint32_t length = bjd_expect_str(reader);
     bjd_read_utf8_cstr(reader, buf, bufsize, length);
     bjd_done_str(reader);
 }
 
+void bjd_expect_utf8_cstr(bjd_reader_t* reader, char* buf, size_t bufsize) {
+    bjd_reader_mark_t mark;
+    bjd_reader_mark(reader, &mark);
+    bjd_expect_utf8_cstr_value(reader, buf, bufsize);
+    bjd_reader_rewind(reader, &mark);
+}
+
 #ifdef BJDATA_MALLOC
-static char* bjd_expect_cstr_alloc_unchecked(bjd_reader_t* reader, size_t maxsize, size_t* out_length) {
+static char* bjd_expect_cstr_alloc_unchecked_value(bjd_reader_t* reader, size_t maxsize, size_t* out_length) {
     bjd_assert(out_length != NULL, "out_length cannot be NULL");
     *out_length = 0;
 
@@ -612,12 +640,20 @@ static char* bjd_expect_cstr_alloc_unchecked(bjd_reader_t* reader, size_t maxsiz
     return str;
 }
 
+static char* bjd_expect_cstr_alloc_unchecked(bjd_reader_t* reader, size_t maxsize, size_t* out_length) {
+    bjd_reader_mark_t mark;
+    bjd_reader_mark(reader, &mark);
+    char* result = bjd_expect_cstr_alloc_unchecked_value(reader, maxsize, out_length);
+    bjd_reader_rewind(reader, &mark);
+    return result;
+}
+
 char* bjd_expect_cstr_alloc(bjd_reader_t* reader, size_t maxsize) {
     size_t length;
     char* str = bjd_expect_cstr_alloc_unchecked(reader, maxsize, &length);
 
     if (str && !bjd_str_check_no_null(str, length)) {
-        BJDATA_FREE(str);
+        bjd_allocator_free(reader->allocator, str);
         bjd_reader_flag_error(reader, bjd_error_type);
         return NULL;
     }
@@ -630,7 +666,7 @@ char* bjd_expect_utf8_cstr_alloc(bjd_reader_t* reader, size_t maxsize) {
     char* str = bjd_expect_cstr_alloc_unchecked(reader, maxsize, &length);
 
     if (str && !bjd_utf8_check_no_null(str, length)) {
-        BJDATA_FREE(str);
+        bjd_allocator_free(reader->allocator, str);
         bjd_reader_flag_error(reader, bjd_error_type);
         return NULL;
     }
@@ -639,7 +675,7 @@ char* bjd_expect_utf8_cstr_alloc(bjd_reader_t* reader, size_t maxsize) {
 }
 #endif
 
-void bjd_expect_str_match(bjd_reader_t* reader, const char* str, size_t len) {
+static void bjd_expect_str_match_value(bjd_reader_t* reader, const char* str, size_t len) {
     bjd_assert(str != NULL, "str cannot be NULL");
 
     // expect a str the correct length
@@ -661,6 +697,13 @@ void bjd_expect_str_match(bjd_reader_t* reader, const char* str, size_t len) {
     bjd_done_str(reader);
 }
 
+void bjd_expect_str_match(bjd_reader_t* reader, const char* str, size_t len) {
+    bjd_reader_mark_t mark;
+    bjd_reader_mark(reader, &mark);
+    bjd_expect_str_match_value(reader, str, len);
+    bjd_reader_rewind(reader, &mark);
+}
+
 void bjd_expect_tag(bjd_reader_t* reader, bjd_tag_t expected) {
     bjd_tag_t actual = bjd_read_tag(reader);
     if (!bjd_tag_equal(actual, expected))
@@ -668,7 +711,7 @@ void bjd_expect_tag(bjd_reader_t* reader, bjd_tag_t expected) {
 }
 
 #ifdef BJDATA_MALLOC
-char* bjd_expect_bin_alloc(bjd_reader_t* reader, size_t maxsize, size_t* size) {
+static char* bjd_expect_bin_alloc_value(bjd_reader_t* reader, size_t maxsize, size_t* size) {
     bjd_assert(size != NULL, "size cannot be NULL");
     *size = 0;
 
@@ -686,10 +729,18 @@ char* bjd_expect_bin_alloc(bjd_reader_t* reader, size_t maxsize, size_t* size) {
         *size = length;
     return data;
 }
+
+char* bjd_expect_bin_alloc(bjd_reader_t* reader, size_t maxsize, size_t* size) {
+    bjd_reader_mark_t mark;
+    bjd_reader_mark(reader, &mark);
+    char* result = bjd_expect_bin_alloc_value(reader, maxsize, size);
+    bjd_reader_rewind(reader, &mark);
+    return result;
+}
 #endif
 
 #if BJDATA_EXTENSIONS && defined(BJDATA_MALLOC)
-char* bjd_expect_ext_alloc(bjd_reader_t* reader, int8_t* type, size_t maxsize, size_t* size) {
+static char* bjd_expect_ext_alloc_value(bjd_reader_t* reader, int8_t* type, size_t maxsize, size_t* size) {
     bjd_assert(size != NULL, "size cannot be NULL");
     *size = 0;
 
@@ -710,9 +761,17 @@ char* bjd_expect_ext_alloc(bjd_reader_t* reader, int8_t* type, size_t maxsize, s
     }
     return data;
 }
+
+char* bjd_expect_ext_alloc(bjd_reader_t* reader, int8_t* type, size_t maxsize, size_t* size) {
+    bjd_reader_mark_t mark;
+    bjd_reader_mark(reader, &mark);
+    char* result = bjd_expect_ext_alloc_value(reader, type, maxsize, size);
+    bjd_reader_rewind(reader, &mark);
+    return result;
+}
 #endif
 
-size_t bjd_expect_enum(bjd_reader_t* reader, const char* strings[], size_t count) {
+static size_t bjd_expect_enum_value(bjd_reader_t* reader, const char* strings[], size_t count) {
 
     // read the string in-place
     size_t keylen = bjd_expect_str(reader);
@@ -734,7 +793,15 @@ size_t bjd_expect_enum(bjd_reader_t* reader, const char* strings[], size_t count
     return count;
 }
 
-size_t bjd_expect_enum_optional(bjd_reader_t* reader, const char* strings[], size_t count) {
+size_t bjd_expect_enum(bjd_reader_t* reader, const char* strings[], size_t count) {
+    bjd_reader_mark_t mark;
+    bjd_reader_mark(reader, &mark);
+    size_t result = bjd_expect_enum_value(reader, strings, count);
+    bjd_reader_rewind(reader, &mark);
+    return result;
+}
+
+static size_t bjd_expect_enum_optional_value(bjd_reader_t* reader, const char* strings[], size_t count) {
     if (bjd_reader_error(reader) != bjd_ok)
         return count;
 
@@ -766,6 +833,14 @@ size_t bjd_expect_enum_optional(bjd_reader_t* reader, const char* strings[], siz
     return count;
 }
 
+size_t bjd_expect_enum_optional(bjd_reader_t* reader, const char* strings[], size_t count) {
+    bjd_reader_mark_t mark;
+    bjd_reader_mark(reader, &mark);
+    size_t result = bjd_expect_enum_optional_value(reader, strings, count);
+    bjd_reader_rewind(reader, &mark);
+    return result;
+}
+
 size_t bjd_expect_key_uint(bjd_reader_t* reader, bool found[], size_t count) {
     if (bjd_reader_error(reader) != bjd_ok)
         return count;
@@ -820,5 +895,173 @@ size_t bjd_expect_key_cstr(bjd_reader_t* reader, const char* keys[], bool found[
     return i;
 }
 
+// The hash of a key set only looks at the length and up to three bytes of a
+// string. The seed is searched for when the set is built so that the
+// strings usually don't collide.
+BJDATA_STATIC_INLINE size_t bjd_keyset_hash(const bjd_keyset_t* keyset, const char* str, size_t length) {
+    uint32_t hash = keyset->seed ^ (uint32_t)length;
+    if (length > 0) {
+        hash = hash * 31 + (uint8_t)str[0];
+        hash = hash * 31 + (uint8_t)str[length / 2];
+        hash = hash * 31 + (uint8_t)str[length - 1];
+    }
+    hash *= UINT32_C(0x9e3779b1);
+    return (size_t)(hash ^ (hash >> 16)) & keyset->mask;
+}
+
+// Fills the table of a key set with its current seed, returning the number
+// of strings that did not land in their first slot.
+static size_t bjd_keyset_fill(bjd_keyset_t* keyset) {
+    size_t collisions = 0;
+    bjd_memset(keyset->slots, 0, sizeof(keyset->slots));
+
+    for (size_t i = 0; i < keyset->count; ++i) {
+        const char* str = keyset->strings[i];
+        size_t length = bjd_strlen(str);
+
+        size_t slot = bjd_keyset_hash(keyset, str, length);
+        bool duplicate = false;
+        while (keyset->slots[slot] != 0) {
+            if (keyset->lengths[slot] == length &&
+                    bjd_memcmp(keyset->strings[keyset->slots[slot] - 1], str, length) == 0) {
+                duplicate = true;
+                break;
+            }
+            ++collisions;
+            slot = (slot + 1) & keyset->mask;
+        }
+
+        if (!duplicate) {
+            keyset->slots[slot] = (uint16_t)(i + 1);
+            keyset->lengths[slot] = (uint32_t)length;
+        }
+    }
+
+    return collisions;
+}
+
+void bjd_keyset_init(bjd_keyset_t* keyset, const char* strings[], size_t count) {
+    BJDATA_STATIC_ASSERT((BJDATA_KEYSET_SLOTS & (BJDATA_KEYSET_SLOTS - 1)) == 0,
+            "key set table size must be a power of two");
+    BJDATA_STATIC_ASSERT(BJDATA_KEYSET_SLOTS >= 2 * BJDATA_KEYSET_MAX_KEYS,
+            "key set table must hold twice the maximum number of strings");
+    BJDATA_STATIC_ASSERT(BJDATA_KEYSET_MAX_KEYS <= UINT16_MAX,
+            "key set slots must fit string indices in a uint16_t");
+
+    bjd_memset(keyset, 0, sizeof(*keyset));
+    if (count > BJDATA_KEYSET_MAX_KEYS) {
+        bjd_break("too many strings for a key set: %i (the maximum is %i)",
+                (int)count, (int)BJDATA_KEYSET_MAX_KEYS);
+        return;
+    }
+    bjd_assert(count == 0 || strings != NULL, "strings cannot be NULL");
+
+    keyset->strings = strings;
+    keyset->count = count;
+
+    size_t capacity = 8;
+    while (capacity < count * 2 && capacity < BJDATA_KEYSET_SLOTS)
+        capacity *= 2;
+    keyset->mask = capacity - 1;
+
+    // try a few seeds looking for a perfect hash, keeping the best
+    uint32_t best_seed = 0;
+    size_t best = SIZE_MAX;
+    for (uint32_t seed = 0; seed < 64 && best != 0; ++seed) {
+        keyset->seed = seed * UINT32_C(0x85ebca6b);
+        size_t collisions = bjd_keyset_fill(keyset);
+        if (collisions < best) {
+            best = collisions;
+            best_seed = keyset->seed;
+        }
+    }
+
+    if (keyset->seed != best_seed) {
+        keyset->seed = best_seed;
+        bjd_keyset_fill(keyset);
+    }
+}
+
+size_t bjd_keyset_find(const bjd_keyset_t* keyset, const char* str, size_t length) {
+    if (keyset->count == 0)
+        return 0;
+
+    size_t slot = bjd_keyset_hash(keyset, str, length);
+    while (keyset->slots[slot] != 0) {
+        size_t i = keyset->slots[slot] - 1;
+        if (keyset->lengths[slot] == length && bjd_memcmp(keyset->strings[i], str, length) == 0)
+            return i;
+        slot = (slot + 1) & keyset->mask;
+    }
+    return keyset->count;
+}
+
+// Reads a string in-place and matches it against a key set, returning the
+// key set count if it does not match or an error occurs. If optional is
+// true, values that are not strings are discarded.
+static size_t bjd_expect_keyset_impl_value(bjd_reader_t* reader, const bjd_keyset_t* keyset, bool optional) {
+    size_t count = keyset->count;
+    if (bjd_reader_error(reader) != bjd_ok)
+        return count;
+
+    if (count == 0) {
+        bjd_break("count cannot be zero; no strings are valid!");
+        bjd_reader_flag_error(reader, bjd_error_bug);
+        return count;
+    }
+
+    if (optional && bjd_peek_tag(reader).type != bjd_type_str) {
+        bjd_discard(reader);
+        return count;
+    }
+
+    // read the string in-place
+    size_t keylen = bjd_expect_str(reader);
+    const char* key = bjd_read_bytes_inplace(reader, keylen);
+    bjd_done_str(reader);
+    if (bjd_reader_error(reader) != bjd_ok)
+        return count;
+
+    return bjd_keyset_find(keyset, key, keylen);
+}
+
+static size_t bjd_expect_keyset_impl(bjd_reader_t* reader, const bjd_keyset_t* keyset, bool optional) {
+    bjd_reader_mark_t mark;
+    bjd_reader_mark(reader, &mark);
+    size_t result = bjd_expect_keyset_impl_value(reader, keyset, optional);
+    bjd_reader_rewind(reader, &mark);
+    return result;
+}
+
+size_t bjd_expect_enum_keyset(bjd_reader_t* reader, const bjd_keyset_t* keyset) {
+    size_t i = bjd_expect_keyset_impl(reader, keyset, false);
+    if (i == keyset->count && bjd_reader_error(reader) == bjd_ok)
+        bjd_reader_flag_error(reader, bjd_error_type);
+    return i;
+}
+
+size_t bjd_expect_enum_optional_keyset(bjd_reader_t* reader, const bjd_keyset_t* keyset) {
+    return bjd_expect_keyset_impl(reader, keyset, true);
+}
+
+size_t bjd_expect_key_keyset(bjd_reader_t* reader, const bjd_keyset_t* keyset, bool found[]) {
+    size_t count = keyset->count;
+    size_t i = bjd_expect_keyset_impl(reader, keyset, true);
+
+    // unrecognized keys are fine, we just return count
+    if (i == count)
+        return count;
+
+    // check if this key is a duplicate
+    bjd_assert(found != NULL, "found cannot be NULL");
+    if (found[i]) {
+        bjd_reader_flag_error(reader, bjd_error_invalid);
+        return count;
+    }
+
+    found[i] = true;
+    return i;
+}
+
 #endif
 
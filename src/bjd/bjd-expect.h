@@ -612,7 +612,7 @@ int64_t bjd_expect_timestamp_truncate(bjd_reader_t* reader);
  * infinite loop! You should strongly consider using bjd_expect_map_max()
  * with a safe maximum size instead.
  *
- * @throws bjd_error_type if the value is not a map.
+ * @throws bjd_error_type if the value is not a map with a count.
  */
 uint32_t bjd_expect_map(bjd_reader_t* reader);
 
@@ -719,6 +719,37 @@ bool bjd_expect_map_or_nil(bjd_reader_t* reader, uint32_t* count);
  */
 bool bjd_expect_map_max_or_nil(bjd_reader_t* reader, uint32_t max_count, uint32_t* count);
 
+/**
+ * Reads the start of an optimized map whose values are all packed as the
+ * given fixed-size marker, with a number of elements at most max_count,
+ * returning its element count.
+ *
+ * The keys and values are then read as with any other map, for example
+ * with bjd_expect_key_cstr() and bjd_expect_double(); the values simply
+ * have no marker of their own in the data, and the keys are strings
+ * without their 'S' marker. @ref bjd_done_map() must be
+ * called once all elements have been read.
+ *
+ * Zero is returned if an error occurs.
+ *
+ * @throws bjd_error_type if the value is not an optimized map of the
+ * given marker, or if its size is greater than max_count.
+ *
+ * @see bjd_start_typed_map()
+ */
+uint32_t bjd_expect_typed_map_max(bjd_reader_t* reader, char marker, uint32_t max_count);
+
+/**
+ * Reads the start of a map without a count, i.e. one terminated by '}'.
+ *
+ * Keys and values alternate until bjd_read_map_end() returns true, after
+ * which @ref bjd_done_map() must be called. The other map Expect functions
+ * only accept maps with a count.
+ *
+ * @throws bjd_error_type if the value is not a map without a count.
+ */
+void bjd_expect_map_unsized(bjd_reader_t* reader);
+
 /**
  * Reads the start of an array, returning its element count.
  *
@@ -815,6 +846,17 @@ bool bjd_expect_array_or_nil(bjd_reader_t* reader, uint32_t* count);
  */
 bool bjd_expect_array_max_or_nil(bjd_reader_t* reader, uint32_t max_count, uint32_t* count);
 
+/**
+ * Reads the start of an array without a count, i.e. one terminated by ']'.
+ *
+ * Elements follow until bjd_read_array_end() returns true, after which
+ * @ref bjd_done_array() must be called. The other array Expect functions
+ * only accept arrays with a count.
+ *
+ * @throws bjd_error_type if the value is not an array without a count.
+ */
+void bjd_expect_array_unsized(bjd_reader_t* reader);
+
 #ifdef BJDATA_MALLOC
 /**
  * @hideinitializer
@@ -833,6 +875,8 @@ bool bjd_expect_array_max_or_nil(bjd_reader_t* reader, uint32_t max_count, uint3
  *
  * The allocated array must be freed with BJDATA_FREE() (or simply free()
  * if BJData's allocator hasn't been customized.)
+ * If an allocator is attached with bjd_reader_set_allocator(), it is
+ * allocated from that instead.
  *
  * @throws bjd_error_type if the value is not an array or if its size is
  * greater than max_count.
@@ -857,6 +901,8 @@ bool bjd_expect_array_max_or_nil(bjd_reader_t* reader, uint32_t max_count, uint3
  *
  * The allocated array must be freed with BJDATA_FREE() (or simply free()
  * if BJData's allocator hasn't been customized.)
+ * If an allocator is attached with bjd_reader_set_allocator(), it is
+ * allocated from that instead.
  *
  * @warning You must call @ref bjd_done_array() if and only if a non-zero
  * element count is read. This function does not differentiate between nil
@@ -869,6 +915,79 @@ bool bjd_expect_array_max_or_nil(bjd_reader_t* reader, uint32_t max_count, uint3
     ((Type*)bjd_expect_array_alloc_impl(reader, sizeof(Type), max_count, out_count, true))
 #endif
 
+/**
+ * @}
+ */
+
+/**
+ * @name Typed Arrays
+ * @{
+ */
+
+/**
+ * Reads an array of numbers into the given buffer, returning its element
+ * count. These are wrappers for bjd_read_typed_array() that pick the
+ * destination marker from the C type.
+ *
+ * An optimized array (`[$<type>#<count>`) of any numeric element type is
+ * decoded in bulk, and an ordinary array of numbers is converted element
+ * by element. You must not call bjd_done_array() afterwards.
+ *
+ * @throws bjd_error_type if the value is not an array, or if an element is
+ * not a number or is out of range for the destination type.
+ * @throws bjd_error_too_big if the array has more than max_count elements.
+ *
+ * @see bjd_read_typed_array()
+ */
+BJDATA_INLINE size_t bjd_expect_u8_array(bjd_reader_t* reader, uint8_t* out, size_t max_count) {
+    return bjd_read_typed_array(reader, 'U', out, max_count);
+}
+
+/** Reads an array of int8_t. @see bjd_expect_u8_array() */
+BJDATA_INLINE size_t bjd_expect_i8_array(bjd_reader_t* reader, int8_t* out, size_t max_count) {
+    return bjd_read_typed_array(reader, 'i', out, max_count);
+}
+
+/** Reads an array of uint16_t. @see bjd_expect_u8_array() */
+BJDATA_INLINE size_t bjd_expect_u16_array(bjd_reader_t* reader, uint16_t* out, size_t max_count) {
+    return bjd_read_typed_array(reader, 'u', out, max_count);
+}
+
+/** Reads an array of int16_t. @see bjd_expect_u8_array() */
+BJDATA_INLINE size_t bjd_expect_i16_array(bjd_reader_t* reader, int16_t* out, size_t max_count) {
+    return bjd_read_typed_array(reader, 'I', out, max_count);
+}
+
+/** Reads an array of uint32_t. @see bjd_expect_u8_array() */
+BJDATA_INLINE size_t bjd_expect_u32_array(bjd_reader_t* reader, uint32_t* out, size_t max_count) {
+    return bjd_read_typed_array(reader, 'm', out, max_count);
+}
+
+/** Reads an array of int32_t. @see bjd_expect_u8_array() */
+BJDATA_INLINE size_t bjd_expect_i32_array(bjd_reader_t* reader, int32_t* out, size_t max_count) {
+    return bjd_read_typed_array(reader, 'l', out, max_count);
+}
+
+/** Reads an array of uint64_t. @see bjd_expect_u8_array() */
+BJDATA_INLINE size_t bjd_expect_u64_array(bjd_reader_t* reader, uint64_t* out, size_t max_count) {
+    return bjd_read_typed_array(reader, 'M', out, max_count);
+}
+
+/** Reads an array of int64_t. @see bjd_expect_u8_array() */
+BJDATA_INLINE size_t bjd_expect_i64_array(bjd_reader_t* reader, int64_t* out, size_t max_count) {
+    return bjd_read_typed_array(reader, 'L', out, max_count);
+}
+
+/** Reads an array of float. @see bjd_expect_u8_array() */
+BJDATA_INLINE size_t bjd_expect_f32_array(bjd_reader_t* reader, float* out, size_t max_count) {
+    return bjd_read_typed_array(reader, 'd', out, max_count);
+}
+
+/** Reads an array of double. @see bjd_expect_u8_array() */
+BJDATA_INLINE size_t bjd_expect_f64_array(bjd_reader_t* reader, double* out, size_t max_count) {
+    return bjd_read_typed_array(reader, 'D', out, max_count);
+}
+
 /**
  * @}
  */
@@ -1002,6 +1121,8 @@ void bjd_expect_utf8_cstr(bjd_reader_t* reader, char* buf, size_t size);
  *
  * The allocated string must be freed with BJDATA_FREE() (or simply free()
  * if BJData's allocator hasn't been customized.)
+ * If an allocator is attached with bjd_reader_set_allocator(), it is
+ * allocated from that instead.
  *
  * @throws bjd_error_too_big If the string plus null-terminator is larger than the given maxsize.
  * @throws bjd_error_type If the value is not a string or contains a null byte.
@@ -1023,6 +1144,8 @@ char* bjd_expect_cstr_alloc(bjd_reader_t* reader, size_t maxsize);
  *
  * The allocated string must be freed with BJDATA_FREE() (or simply free()
  * if BJData's allocator hasn't been customized.)
+ * If an allocator is attached with bjd_reader_set_allocator(), it is
+ * allocated from that instead.
  * if you want a null-terminator.
  *
  * @throws bjd_error_too_big If the string plus null-terminator is larger
@@ -1435,6 +1558,148 @@ size_t bjd_expect_key_uint(bjd_reader_t* reader, bool found[], size_t count);
 size_t bjd_expect_key_cstr(bjd_reader_t* reader, const char* keys[],
         bool found[], size_t count);
 
+/** @cond */
+// The table size of a key set: the smallest power of two of at least 8
+// that is at least twice the maximum number of strings. Slots hold string
+// indices plus one in a uint16_t, so this caps the maximum.
+#if BJDATA_KEYSET_MAX_KEYS < 1 || BJDATA_KEYSET_MAX_KEYS > 32768
+#error "BJDATA_KEYSET_MAX_KEYS must be between 1 and 32768."
+#elif BJDATA_KEYSET_MAX_KEYS <= 4
+#define BJDATA_KEYSET_SLOTS 8
+#elif BJDATA_KEYSET_MAX_KEYS <= 8
+#define BJDATA_KEYSET_SLOTS 16
+#elif BJDATA_KEYSET_MAX_KEYS <= 16
+#define BJDATA_KEYSET_SLOTS 32
+#elif BJDATA_KEYSET_MAX_KEYS <= 32
+#define BJDATA_KEYSET_SLOTS 64
+#elif BJDATA_KEYSET_MAX_KEYS <= 64
+#define BJDATA_KEYSET_SLOTS 128
+#elif BJDATA_KEYSET_MAX_KEYS <= 128
+#define BJDATA_KEYSET_SLOTS 256
+#elif BJDATA_KEYSET_MAX_KEYS <= 256
+#define BJDATA_KEYSET_SLOTS 512
+#elif BJDATA_KEYSET_MAX_KEYS <= 512
+#define BJDATA_KEYSET_SLOTS 1024
+#elif BJDATA_KEYSET_MAX_KEYS <= 1024
+#define BJDATA_KEYSET_SLOTS 2048
+#elif BJDATA_KEYSET_MAX_KEYS <= 2048
+#define BJDATA_KEYSET_SLOTS 4096
+#elif BJDATA_KEYSET_MAX_KEYS <= 4096
+#define BJDATA_KEYSET_SLOTS 8192
+#elif BJDATA_KEYSET_MAX_KEYS <= 8192
+#define BJDATA_KEYSET_SLOTS 16384
+#elif BJDATA_KEYSET_MAX_KEYS <= 16384
+#define BJDATA_KEYSET_SLOTS 32768
+#elif BJDATA_KEYSET_MAX_KEYS <= 32768
+#define BJDATA_KEYSET_SLOTS 65536
+#endif
+/** @endcond */
+
+/**
+ * A set of strings compiled into a hash table for matching strings read
+ * with the Expect API, such as enum values or map keys.
+ *
+ * A key set is built once with bjd_keyset_init() from an array of strings,
+ * which must remain valid for as long as the key set is used. Matching a
+ * string against a key set takes constant time regardless of the number of
+ * strings, and the lengths of the strings are not recomputed.
+ *
+ * @code{.c}
+ * typedef enum           { APPLE ,  BANANA ,  ORANGE , COUNT} fruit_t;
+ * const char* fruits[] = {"apple", "banana", "orange"};
+ *
+ * static bjd_keyset_t fruit_set;
+ * bjd_keyset_init(&fruit_set, fruits, COUNT);
+ *
+ * fruit_t fruit = (fruit_t)bjd_expect_enum_keyset(reader, &fruit_set);
+ * @endcode
+ *
+ * @see BJDATA_KEYSET_MAX_KEYS
+ */
+typedef struct bjd_keyset_t {
+    /* Hide internals from documentation */
+    /** @cond */
+    const char** strings;
+    size_t count;
+    size_t mask;
+    uint32_t seed;
+    uint16_t slots[BJDATA_KEYSET_SLOTS];   /* index of string plus one, or 0 if empty */
+    uint32_t lengths[BJDATA_KEYSET_SLOTS]; /* length of the string in each slot */
+    /** @endcond */
+} bjd_keyset_t;
+
+/**
+ * Builds a key set from the given array of strings.
+ *
+ * The strings are not copied so they must outlive the key set. If a string
+ * occurs more than once, it matches its first index.
+ *
+ * The count must not exceed @ref BJDATA_KEYSET_MAX_KEYS. If it does, the
+ * key set is empty and using it with the Expect API flags
+ * @ref bjd_error_bug.
+ *
+ * @param keyset The key set to initialize
+ * @param strings An array of strings of length count
+ * @param count The number of strings
+ */
+void bjd_keyset_init(bjd_keyset_t* keyset, const char* strings[], size_t count);
+
+/**
+ * Returns the number of strings in the key set.
+ */
+BJDATA_INLINE size_t bjd_keyset_count(const bjd_keyset_t* keyset) {
+    return keyset->count;
+}
+
+/**
+ * Returns the index of the given string in the key set, or
+ * bjd_keyset_count() if it is not in the set.
+ */
+size_t bjd_keyset_find(const bjd_keyset_t* keyset, const char* str, size_t length);
+
+/**
+ * Expects a string matching one of the strings in the given key set,
+ * returning its index.
+ *
+ * This is the same as bjd_expect_enum() except that the strings are
+ * matched with a precompiled key set.
+ *
+ * @param reader The reader
+ * @param keyset The strings to match
+ * @return The index of the matched string, or bjd_keyset_count() in case
+ * of error
+ *
+ * @see bjd_expect_enum()
+ */
+size_t bjd_expect_enum_keyset(bjd_reader_t* reader, const bjd_keyset_t* keyset);
+
+/**
+ * Expects a string matching one of the strings in the given key set
+ * returning its index, or bjd_keyset_count() if no strings match.
+ *
+ * This is the same as bjd_expect_enum_optional() except that the strings
+ * are matched with a precompiled key set.
+ *
+ * @see bjd_expect_enum_optional()
+ */
+size_t bjd_expect_enum_optional_keyset(bjd_reader_t* reader, const bjd_keyset_t* keyset);
+
+/**
+ * Expects a string map key matching one of the strings in the given key set,
+ * marking it as found in the given bool array and returning its index.
+ *
+ * This is the same as bjd_expect_key_cstr() except that the keys are
+ * matched with a precompiled key set, which is much faster for maps with
+ * many keys.
+ *
+ * @param reader The reader
+ * @param keyset The expected keys
+ * @param found An array of bool flags of length bjd_keyset_count()
+ *
+ * @see bjd_expect_key_cstr()
+ */
+size_t bjd_expect_key_keyset(bjd_reader_t* reader, const bjd_keyset_t* keyset, bool found[]);
+
 /**
  * @}
  */
@@ -23,6 +23,10 @@
 
 #include "bjd-node.h"
 
+#if BJDATA_NODE && defined(BJDATA_MALLOC) && BJDATA_THREADS
+#include <pthread.h>
+#endif
+
 #if BJDATA_NODE
 
 BJDATA_STATIC_INLINE const char* bjd_node_data_unchecked(bjd_node_t node) {
@@ -73,6 +77,54 @@ BJDATA_STATIC_INLINE int8_t bjd_node_exttype_unchecked(bjd_node_t node) {
 #define BJDATA_PAGE_ALLOC_SIZE \
     (sizeof(bjd_tree_page_t) + sizeof(bjd_node_data_t) * (BJDATA_NODES_PER_PAGE - 1))
 
+BJDATA_STATIC_INLINE size_t bjd_tree_page_size(size_t count) {
+    return sizeof(bjd_tree_page_t) + sizeof(bjd_node_data_t) * (count - 1);
+}
+
+// Returns a page with room for at least count nodes, reusing a page kept
+// from a previous parse if one is large enough. New pages are allocated
+// with room for at least a full page of nodes.
+static bjd_tree_page_t* bjd_tree_page_alloc(bjd_tree_t* tree, size_t count) {
+    bjd_tree_page_t** link = &tree->free_pages;
+    while (*link != NULL) {
+        bjd_tree_page_t* page = *link;
+        if (page->count >= count) {
+            *link = page->next;
+            tree->free_size -= bjd_tree_page_size(page->count);
+            bjd_log("reusing page %p of %i nodes\n", (void*)page, (int)page->count);
+            return page;
+        }
+        link = &page->next;
+    }
+
+    if (count < BJDATA_NODES_PER_PAGE)
+        count = BJDATA_NODES_PER_PAGE;
+    if (count > (SIZE_MAX - sizeof(bjd_tree_page_t)) / sizeof(bjd_node_data_t))
+        return NULL;
+
+    bjd_tree_page_t* page = (bjd_tree_page_t*)bjd_allocator_malloc(tree->allocator, bjd_tree_page_size(count));
+    if (page == NULL)
+        return NULL;
+    bjd_log("allocated page %p of %i nodes\n", (void*)page, (int)count);
+    page->count = count;
+    return page;
+}
+
+// The hash index of a map. Each slot holds the index of a key plus one, or
+// zero if the slot is empty. Keys that occur more than once in the map are
+// marked so that looking them up flags an error, as the linear search does.
+//
+// The same registry entry holds the element nodes of an optimized array or
+// map, which are only created when an element is first accessed as a node.
+struct bjd_map_index_t {
+    const bjd_node_data_t* map; // the map or optimized array
+    uint32_t* slots; // the hash index of a map, or NULL if it has none
+    size_t mask;
+    bjd_node_data_t* elements; // the packed values as nodes, or NULL
+};
+
+#define BJDATA_INDEX_DUPLICATE ((uint32_t)1 << 31)
+
 #endif
 
 #ifdef BJDATA_MALLOC
@@ -116,11 +168,14 @@ static bool bjd_tree_reserve_fill(bjd_tree_t* tree) {
 
         bjd_log("expanding buffer from %i to %i\n", (int)tree->buffer_capacity, (int)new_capacity);
 
+        // the buffer holds the start of the next message across parses, so
+        // it doesn't come from the tree's allocator (which may be an arena
+        // that is reset in between.)
         char* new_buffer;
         if (tree->buffer == NULL)
             new_buffer = (char*)BJDATA_MALLOC(new_capacity);
         else
-            new_buffer = (char*)bjd_realloc(tree->buffer, tree->data_length, new_capacity);
+            new_buffer = (char*)bjd_allocator_realloc(NULL, tree->buffer, tree->data_length, new_capacity);
 
         if (new_buffer == NULL) {
             bjd_tree_flag_error(tree, bjd_error_memory);
@@ -215,15 +270,9 @@ BJDATA_STATIC_INLINE size_t bjd_tree_parser_stack_capacity(bjd_tree_t* tree) {
     #endif
 }
 
-static bool bjd_tree_push_stack(bjd_tree_t* tree, bjd_node_data_t* first_child, size_t total) {
+// Makes sure there is room in the parse stack for another level.
+static bool bjd_tree_grow_stack(bjd_tree_t* tree) {
     bjd_tree_parser_t* parser = &tree->parser;
-    bjd_assert(parser->state == bjd_tree_parse_state_in_progress);
-
-    // No need to push empty containers
-    if (total == 0)
-        return true;
-
-    // Make sure we have enough room in the stack
     if (parser->level + 1 == bjd_tree_parser_stack_capacity(tree)) {
         #ifdef BJDATA_MALLOC
         size_t new_capacity = parser->stack_capacity * 2;
@@ -231,7 +280,7 @@ static bool bjd_tree_push_stack(bjd_tree_t* tree, bjd_node_data_t* first_child,
 
         // Replace the stack-allocated parsing stack
         if (!parser->stack_owned) {
-            bjd_level_t* new_stack = (bjd_level_t*)BJDATA_MALLOC(sizeof(bjd_level_t) * new_capacity);
+            bjd_level_t* new_stack = (bjd_level_t*)bjd_allocator_malloc(tree->allocator, sizeof(bjd_level_t) * new_capacity);
             if (!new_stack) {
                 bjd_tree_flag_error(tree, bjd_error_memory);
                 return false;
@@ -242,7 +291,7 @@ static bool bjd_tree_push_stack(bjd_tree_t* tree, bjd_node_data_t* first_child,
 
         // Realloc the allocated parsing stack
         } else {
-            bjd_level_t* new_stack = (bjd_level_t*)bjd_realloc(parser->stack,
+            bjd_level_t* new_stack = (bjd_level_t*)bjd_allocator_realloc(tree->allocator, parser->stack,
                     sizeof(bjd_level_t) * parser->stack_capacity, sizeof(bjd_level_t) * new_capacity);
             if (!new_stack) {
                 bjd_tree_flag_error(tree, bjd_error_memory);
@@ -256,45 +305,130 @@ static bool bjd_tree_push_stack(bjd_tree_t* tree, bjd_node_data_t* first_child,
         return false;
         #endif
     }
+    return true;
+}
+
+static bool bjd_tree_push_stack(bjd_tree_t* tree, bjd_node_data_t* first_child, size_t total, char elemtype) {
+    bjd_tree_parser_t* parser = &tree->parser;
+    bjd_assert(parser->state == bjd_tree_parse_state_in_progress);
+
+    // No need to push empty containers
+    if (total == 0)
+        return true;
+
+    if (!bjd_tree_grow_stack(tree))
+        return false;
 
     // Push the contents of this node onto the parsing stack
     ++parser->level;
     parser->stack[parser->level].child = first_child;
     parser->stack[parser->level].left = total;
+    parser->stack[parser->level].elemtype = elemtype;
+    parser->stack[parser->level].end = 0;
+    parser->stack[parser->level].projected = false;
     return true;
 }
 
-static bool bjd_tree_parse_children(bjd_tree_t* tree, bjd_node_data_t* node) {
+#ifdef BJDATA_MALLOC
+// Returns true if the children of the given level are gathered in
+// unsized_nodes, which is the case for unsized and projected containers.
+BJDATA_STATIC_INLINE bool bjd_tree_level_gathers(const bjd_level_t* level) {
+    return level->end != 0 || level->projected;
+}
+
+// Pushes an unsized container onto the parsing stack. Its children are
+// gathered in unsized_nodes until its closing marker is reached, so it is
+// pushed even if it turns out to be empty.
+static bool bjd_tree_push_unsized(bjd_tree_t* tree, bjd_type_t type) {
     bjd_tree_parser_t* parser = &tree->parser;
     bjd_assert(parser->state == bjd_tree_parse_state_in_progress);
 
-    bjd_type_t type = node->type;
-    size_t total = node->len;
+    if (!bjd_tree_grow_stack(tree))
+        return false;
 
-    // Calculate total elements to read
-    if (type == bjd_type_map) {
-        if ((uint64_t)total * 2 > SIZE_MAX) {
-            bjd_tree_flag_error(tree, bjd_error_too_big);
+    // If the container is itself gathered by its parent, it is about to
+    // take the next slot in unsized_nodes, so its own children start after
+    // it.
+    size_t start = parser->unsized_count;
+    if (bjd_tree_level_gathers(&parser->stack[parser->level]))
+        ++start;
+
+    ++parser->level;
+    parser->stack[parser->level].child = NULL;
+    parser->stack[parser->level].left = 0;
+    parser->stack[parser->level].elemtype = 0;
+    parser->stack[parser->level].end = (type == bjd_type_map) ?
+            BJDATA_MARKER_MAP_END : BJDATA_MARKER_ARRAY_END;
+    parser->stack[parser->level].reserved = false;
+    parser->stack[parser->level].start = start;
+    parser->stack[parser->level].projected = false;
+    return true;
+}
+
+// Returns true if the children of the container being parsed should be
+// projected, i.e. if it was kept by the projection of the tree and there
+// are paths that continue below it but none that end at it.
+static bool bjd_tree_projects(bjd_tree_t* tree) {
+    bjd_tree_parser_t* parser = &tree->parser;
+    size_t depth = parser->level;
+    if (!((depth == 0) ? parser->projecting : parser->stack[depth].projected))
+        return false;
+
+    bool projects = false;
+    for (size_t i = 0; i < tree->projection_count; ++i) {
+        if (tree->projection_depth[i] != depth)
+            continue;
+        if (tree->projection[i].count == depth)
             return false;
+        projects = true;
+    }
+    return projects;
+}
+
+// Pushes a container whose children are projected. They are gathered in
+// unsized_nodes like those of an unsized container, keeping only those on
+// the paths of the projection (see bjd_tree_projected_next().) The children
+// of a sized container are reserved as usual.
+static bool bjd_tree_push_projected(bjd_tree_t* tree, bjd_node_data_t* node, bool sized) {
+    size_t total = node->len;
+    if (sized) {
+        if (node->type == bjd_type_map && node->elemtype == 0) {
+            if ((uint64_t)total * 2 > SIZE_MAX) {
+                bjd_tree_flag_error(tree, bjd_error_too_big);
+                return false;
+            }
+            total *= 2;
         }
-        total *= 2;
+        if (!bjd_tree_reserve_bytes(tree, total))
+            return false;
     }
 
-    // Make sure we are under our total node limit (TODO can this overflow?)
-    tree->node_count += total;
-    if (tree->node_count > tree->max_nodes) {
-        bjd_tree_flag_error(tree, bjd_error_too_big);
+    node->value.children = NULL;
+    if (!bjd_tree_push_unsized(tree, node->type))
         return false;
+
+    bjd_level_t* level = &tree->parser.stack[tree->parser.level];
+    level->projected = true;
+    level->map = (node->type == bjd_type_map);
+    level->index = 0;
+    if (sized) {
+        level->end = 0;
+        level->left = total;
+        level->elemtype = node->elemtype;
     }
+    return true;
+}
+#endif
 
-    // Each node is at least one byte. Count these bytes now to make
-    // sure there is enough data left.
-    if (!bjd_tree_reserve_bytes(tree, total))
-        return false;
+// Allocates total contiguous nodes from the current page, or from a new
+// page if they don't fit. Returns NULL and flags an error on failure.
+static bjd_node_data_t* bjd_tree_alloc_nodes(bjd_tree_t* tree, size_t total) {
+    bjd_tree_parser_t* parser = &tree->parser;
+    bjd_node_data_t* nodes;
 
     // If there are enough nodes left in the current page, no need to grow
     if (total <= parser->nodes_left) {
-        node->value.children = parser->nodes;
+        nodes = parser->nodes;
         parser->nodes += total;
         parser->nodes_left -= total;
 
@@ -305,45 +439,26 @@ static bool bjd_tree_parse_children(bjd_tree_t* tree, bjd_node_data_t* node) {
         // We can't grow if we're using a fixed pool (i.e. we didn't start with a page)
         if (!tree->next) {
             bjd_tree_flag_error(tree, bjd_error_too_big);
-            return false;
+            return NULL;
         }
 
         // Otherwise we need to grow, and the node's children need to be contiguous.
-        // This is a heuristic to decide whether we should waste the remaining space
-        // in the current page and start a new one, or give the children their
-        // own page. With a fraction of 1/8, this causes at most 12% additional
-        // waste. Note that reducing this too much causes less cache coherence and
-        // more malloc() overhead due to smaller allocations, so there's a tradeoff
-        // here. This heuristic could use some improvement, especially with custom
-        // page sizes.
-
-        bjd_tree_page_t* page;
-
-        if (total > BJDATA_NODES_PER_PAGE || parser->nodes_left > BJDATA_NODES_PER_PAGE / 8) {
-            // TODO: this should check for overflow
-            page = (bjd_tree_page_t*)BJDATA_MALLOC(
-                    sizeof(bjd_tree_page_t) + sizeof(bjd_node_data_t) * (total - 1));
-            if (page == NULL) {
-                bjd_tree_flag_error(tree, bjd_error_memory);
-                return false;
-            }
-            bjd_log("allocated seperate page %p for %i children, %i left in page of %i total\n",
-                    (void*)page, (int)total, (int)parser->nodes_left, (int)BJDATA_NODES_PER_PAGE);
+        // They go at the start of a new page (or a kept page large enough to
+        // hold them), and parsing continues in whichever of the new page and
+        // the current page has more room left. Pages are at least a full page
+        // in size so that they can be reused for any message.
 
-            node->value.children = page->nodes;
-
-        } else {
-            page = (bjd_tree_page_t*)BJDATA_MALLOC(BJDATA_PAGE_ALLOC_SIZE);
-            if (page == NULL) {
-                bjd_tree_flag_error(tree, bjd_error_memory);
-                return false;
-            }
-            bjd_log("allocated new page %p for %i children, wasting %i in page of %i total\n",
-                    (void*)page, (int)total, (int)parser->nodes_left, (int)BJDATA_NODES_PER_PAGE);
+        bjd_tree_page_t* page = bjd_tree_page_alloc(tree, total);
+        if (page == NULL) {
+            bjd_tree_flag_error(tree, bjd_error_memory);
+            return NULL;
+        }
 
-            node->value.children = page->nodes;
+        nodes = page->nodes;
+        if (page->count - total > parser->nodes_left) {
+            bjd_log("continuing in page %p, wasting %i nodes\n", (void*)page, (int)parser->nodes_left);
             parser->nodes = page->nodes + total;
-            parser->nodes_left = BJDATA_NODES_PER_PAGE - total;
+            parser->nodes_left = page->count - total;
         }
 
         page->next = tree->next;
@@ -352,401 +467,527 @@ static bool bjd_tree_parse_children(bjd_tree_t* tree, bjd_node_data_t* node) {
         #else
         // We can't grow if we don't have an allocator
         bjd_tree_flag_error(tree, bjd_error_too_big);
-        return false;
+        return NULL;
         #endif
     }
 
-    return bjd_tree_push_stack(tree, node->value.children, total);
-}
-
-static bool bjd_tree_parse_bytes(bjd_tree_t* tree, bjd_node_data_t* node) {
-    node->value.offset = tree->size + tree->parser.current_node_reserved + 1;
-    return bjd_tree_reserve_bytes(tree, node->len);
+    return nodes;
 }
 
-#if BJDATA_EXTENSIONS
-static bool bjd_tree_parse_ext(bjd_tree_t* tree, bjd_node_data_t* node) {
-    // reserve space for exttype
-    tree->parser.current_node_reserved += sizeof(int8_t);
-    node->type = bjd_type_ext;
-    return bjd_tree_parse_bytes(tree, node);
+#ifdef BJDATA_MALLOC
+// Returns the end of the container at the given offset if it is in the lazy
+// index of the tree, or 0 otherwise.
+static size_t bjd_tree_lazy_end(bjd_tree_t* tree, size_t offset) {
+    const bjd_skip_index_t* index = &tree->lazy_index;
+    size_t low = 0;
+    size_t high = index->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (index->entries[mid].start < offset)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    if (low == index->count || index->entries[low].start != offset)
+        return 0;
+    return (size_t)index->entries[low].end;
 }
 #endif
 
-static bool bjd_tree_parse_node_contents(bjd_tree_t* tree, bjd_node_data_t* node) {
-    bjd_assert(tree->parser.state == bjd_tree_parse_state_in_progress);
-    bjd_assert(node != NULL, "null node?");
+// In a lazily parsed tree, the children of a container are parsed on first
+// access (see bjd_tree_expand().) The end of the container is looked up in
+// the lazy index or found by scanning it, and the rest of its bytes are
+// reserved as part of the node. Returns false if the children should be
+// parsed now instead, either because the scan found an error or because the
+// container doesn't fit in the data, in which case parsing it reports the
+// error.
+static bool bjd_tree_defer_children(bjd_tree_t* tree, bjd_node_data_t* node) {
+    bjd_tree_parser_t* parser = &tree->parser;
+    if (!parser->lazy)
+        return false;
 
-    // read the type. we've already accounted for this byte in
-    // possible_nodes_left, so we already know it is in bounds, and we don't
-    // need to reserve it for this node.
-    bjd_assert(tree->data_length > tree->size);
-    uint8_t type = bjd_load_u8(tree->data + tree->size);
-    bjd_log("node type %x\n", type);
-    tree->parser.current_node_reserved = 0;
+    size_t end = 0;
+    #ifdef BJDATA_MALLOC
+    end = bjd_tree_lazy_end(tree, tree->size);
+    #endif
+    if (end == 0) {
+        end = tree->size;
+        if (bjd_scan_value(tree->data, tree->data_length, &end, tree->endian, NULL, 0) != bjd_ok)
+            return false;
+    }
 
-    // as with bjd_read_tag(), the fastest way to parse a node is to switch
-    // on the first byte, and to explicitly list every possible byte. we switch
-    // on the first four bits in size-optimized builds.
+    size_t offset = tree->size + parser->current_node_reserved + 1;
+    if (end - offset > parser->possible_nodes_left - parser->current_node_reserved)
+        return false;
+    parser->current_node_reserved += end - offset;
 
-    #if BJDATA_OPTIMIZE_FOR_SIZE
-    switch (type >> 4) {
+    node->lazy = true;
+    node->value.offset = offset;
+    return true;
+}
 
-        // positive fixnum
-        case 0x0: case 0x1: case 0x2: case 0x3:
-        case 0x4: case 0x5: case 0x6: case 0x7:
-            node->type = bjd_type_uint;
-            node->value.u = type;
-            return true;
+static bool bjd_tree_parse_children(bjd_tree_t* tree, bjd_node_data_t* node) {
+    bjd_tree_parser_t* parser = &tree->parser;
+    bjd_assert(parser->state == bjd_tree_parse_state_in_progress);
 
-        // negative fixnum
-        case 0xe: case 0xf:
-            node->type = bjd_type_int;
-            node->value.i = (int8_t)type;
-            return true;
+    bjd_type_t type = node->type;
+    size_t total = node->len;
 
-        // fixmap
-        case 0x8:
-            node->type = bjd_type_map;
-            node->len = (uint32_t)(type & ~0xf0);
-            return bjd_tree_parse_children(tree, node);
-
-        // fixarray
-        case 0x9:
-            node->type = bjd_type_array;
-            node->len = (uint32_t)(type & ~0xf0);
-            return bjd_tree_parse_children(tree, node);
-
-        // fixstr
-        case 0xa: case 0xb:
-            node->type = bjd_type_str;
-            node->len = (uint32_t)(type & ~0xe0);
-            return bjd_tree_parse_bytes(tree, node);
-
-        // not one of the common infix types
-        default:
-            break;
+    // Calculate total elements to read. The values of an optimized map are
+    // packed after each key rather than stored as nodes.
+    if (type == bjd_type_map && node->elemtype == 0) {
+        if ((uint64_t)total * 2 > SIZE_MAX) {
+            bjd_tree_flag_error(tree, bjd_error_too_big);
+            return false;
+        }
+        total *= 2;
     }
-    #endif
 
-    switch (type) {
+    // Make sure we are under our total node limit (TODO can this overflow?)
+    tree->node_count += total;
+    if (tree->node_count > tree->max_nodes) {
+        bjd_tree_flag_error(tree, bjd_error_too_big);
+        return false;
+    }
 
-        #if !BJDATA_OPTIMIZE_FOR_SIZE
-        // positive fixnum
-        case 0x00: case 0x01: case 0x02: case 0x03: case 0x04: case 0x05: case 0x06: case 0x07:
-        case 0x08: case 0x09: case 0x0a: case 0x0b: case 0x0c: case 0x0d: case 0x0e: case 0x0f:
-        case 0x10: case 0x11: case 0x12: case 0x13: case 0x14: case 0x15: case 0x16: case 0x17:
-        case 0x18: case 0x19: case 0x1a: case 0x1b: case 0x1c: case 0x1d: case 0x1e: case 0x1f:
-        case 0x20: case 0x21: case 0x22: case 0x23: case 0x24: case 0x25: case 0x26: case 0x27:
-        case 0x28: case 0x29: case 0x2a: case 0x2b: case 0x2c: case 0x2d: case 0x2e: case 0x2f:
-        case 0x30: case 0x31: case 0x32: case 0x33: case 0x34: case 0x35: case 0x36: case 0x37:
-        case 0x38: case 0x39: case 0x3a: case 0x3b: case 0x3c: case 0x3d: case 0x3e: case 0x3f:
-        case 0x40: case 0x41: case 0x42: case 0x43: case 0x44: case 0x45: case 0x46: case 0x47:
-        case 0x48: case 0x49: case 0x4a: case 0x4b: case 0x4c: case 0x4d: case 0x4e: case 0x4f:
-        case 0x50: case 0x51: case 0x52: case 0x53: case 0x54: case 0x55: case 0x56: case 0x57:
-        case 0x58: case 0x59: case 0x5a: case 0x5b: case 0x5c: case 0x5d: case 0x5e: case 0x5f:
-        case 0x60: case 0x61: case 0x62: case 0x63: case 0x64: case 0x65: case 0x66: case 0x67:
-        case 0x68: case 0x69: case 0x6a: case 0x6b: case 0x6c: case 0x6d: case 0x6e: case 0x6f:
-        case 0x70: case 0x71: case 0x72: case 0x73: case 0x74: case 0x75: case 0x76: case 0x77:
-        case 0x78: case 0x79: case 0x7a: case 0x7b: case 0x7c: case 0x7d: case 0x7e: case 0x7f:
-            node->type = bjd_type_uint;
-            node->value.u = type;
-            return true;
+    // Each node is at least one byte. Count these bytes now to make
+    // sure there is enough data left.
+    if (!bjd_tree_reserve_bytes(tree, total))
+        return false;
 
-        // negative fixnum
-        case 0xe0: case 0xe1: case 0xe2: case 0xe3: case 0xe4: case 0xe5: case 0xe6: case 0xe7:
-        case 0xe8: case 0xe9: case 0xea: case 0xeb: case 0xec: case 0xed: case 0xee: case 0xef:
-        case 0xf0: case 0xf1: case 0xf2: case 0xf3: case 0xf4: case 0xf5: case 0xf6: case 0xf7:
-        case 0xf8: case 0xf9: case 0xfa: case 0xfb: case 0xfc: case 0xfd: case 0xfe: case 0xff:
-            node->type = bjd_type_int;
-            node->value.i = (int8_t)type;
-            return true;
+    node->value.children = bjd_tree_alloc_nodes(tree, total);
+    if (node->value.children == NULL)
+        return false;
 
-        // fixmap
-        case 0x80: case 0x81: case 0x82: case 0x83: case 0x84: case 0x85: case 0x86: case 0x87:
-        case 0x88: case 0x89: case 0x8a: case 0x8b: case 0x8c: case 0x8d: case 0x8e: case 0x8f:
-            node->type = bjd_type_map;
-            node->len = (uint32_t)(type & ~0xf0);
-            return bjd_tree_parse_children(tree, node);
-
-        // fixarray
-        case 0x90: case 0x91: case 0x92: case 0x93: case 0x94: case 0x95: case 0x96: case 0x97:
-        case 0x98: case 0x99: case 0x9a: case 0x9b: case 0x9c: case 0x9d: case 0x9e: case 0x9f:
-            node->type = bjd_type_array;
-            node->len = (uint32_t)(type & ~0xf0);
-            return bjd_tree_parse_children(tree, node);
-
-        // fixstr
-        case 0xa0: case 0xa1: case 0xa2: case 0xa3: case 0xa4: case 0xa5: case 0xa6: case 0xa7:
-        case 0xa8: case 0xa9: case 0xaa: case 0xab: case 0xac: case 0xad: case 0xae: case 0xaf:
-        case 0xb0: case 0xb1: case 0xb2: case 0xb3: case 0xb4: case 0xb5: case 0xb6: case 0xb7:
-        case 0xb8: case 0xb9: case 0xba: case 0xbb: case 0xbc: case 0xbd: case 0xbe: case 0xbf:
-            node->type = bjd_type_str;
-            node->len = (uint32_t)(type & ~0xe0);
-            return bjd_tree_parse_bytes(tree, node);
-        #endif
+    return bjd_tree_push_stack(tree, node->value.children, total,
+            type == bjd_type_map ? node->elemtype : 0);
+}
 
-        // nil
-        case 0xc0:
-            node->type = bjd_type_nil;
-            return true;
+static bool bjd_tree_parse_bytes(bjd_tree_t* tree, bjd_node_data_t* node) {
+    node->value.offset = tree->size + tree->parser.current_node_reserved + 1;
+    return bjd_tree_reserve_bytes(tree, node->len);
+}
 
-        // bool
-        case 0xc2: case 0xc3:
-            node->type = bjd_type_bool;
-            node->value.b = type & 1;
-            return true;
+// Parses an integer length or count of the given marker whose value is in
+// the next unreserved bytes of the current node.
+static bool bjd_tree_parse_length_value(bjd_tree_t* tree, char marker, uint32_t* length) {
+    size_t pos = tree->size + 1 + tree->parser.current_node_reserved;
+    size_t size = bjd_typed_marker_size(marker);
+    if (size == 0 || marker == 'd' || marker == 'D') {
+        bjd_tree_flag_error(tree, bjd_error_invalid);
+        return false;
+    }
+    if (!bjd_tree_reserve_bytes(tree, size))
+        return false;
 
-        // bin8
-        case 0xc4:
-            node->type = bjd_type_huge;
-            if (!bjd_tree_reserve_bytes(tree, sizeof(uint8_t)))
-                return false;
-            node->len = bjd_load_u8(tree->data + tree->size + 1);
-            return bjd_tree_parse_bytes(tree, node);
+    bjd_tag_t value = bjd_load_typed(marker, tree->data + pos, tree->endian);
+    if (value.type == bjd_type_int) {
+        if (value.v.i < 0) {
+            bjd_tree_flag_error(tree, bjd_error_invalid);
+            return false;
+        }
+        value.v.u = (uint64_t)value.v.i;
+    }
 
-        // bin16
-        case 0xc5:
-            node->type = bjd_type_huge;
-            if (!bjd_tree_reserve_bytes(tree, sizeof(uint16_t)))
-                return false;
-            node->len = bjd_load_u16(tree->data + tree->size + 1);
-            return bjd_tree_parse_bytes(tree, node);
+    if (value.v.u > UINT32_MAX) {
+        bjd_tree_flag_error(tree, bjd_error_too_big);
+        return false;
+    }
 
-        // bin32
-        case 0xc6:
-            node->type = bjd_type_huge;
-            if (!bjd_tree_reserve_bytes(tree, sizeof(uint32_t)))
-                return false;
-            node->len = bjd_load_u32(tree->data + tree->size + 1);
-            return bjd_tree_parse_bytes(tree, node);
+    *length = (uint32_t)value.v.u;
+    return true;
+}
 
-        #if BJDATA_EXTENSIONS
-        // ext8
-        case 0xc7:
-            if (!bjd_tree_reserve_bytes(tree, sizeof(uint8_t)))
-                return false;
-            node->len = bjd_load_u8(tree->data + tree->size + 1);
-            return bjd_tree_parse_ext(tree, node);
+// Parses an integer length or count whose marker is the next unreserved
+// byte of the current node, as follows the '#' of an optimized container
+// or the 'S' of a string.
+static bool bjd_tree_parse_length(bjd_tree_t* tree, uint32_t* length) {
+    size_t pos = tree->size + 1 + tree->parser.current_node_reserved;
+    if (!bjd_tree_reserve_bytes(tree, 1))
+        return false;
+    return bjd_tree_parse_length_value(tree, tree->data[pos], length);
+}
 
-        // ext16
-        case 0xc8:
-            if (!bjd_tree_reserve_bytes(tree, sizeof(uint16_t)))
-                return false;
-            node->len = bjd_load_u16(tree->data + tree->size + 1);
-            return bjd_tree_parse_ext(tree, node);
+// Parses the dimension vector of an ND-array whose '[' has just been
+// reserved. See bjd_parse_dims() in the reader.
+static bool bjd_tree_parse_dims(bjd_tree_t* tree, uint32_t* dims, size_t* ndims) {
+    size_t pos = tree->size + 1 + tree->parser.current_node_reserved;
+    char elemtype = 0;
+    size_t i = 0;
 
-        // ext32
-        case 0xc9:
-            if (!bjd_tree_reserve_bytes(tree, sizeof(uint32_t)))
-                return false;
-            node->len = bjd_load_u32(tree->data + tree->size + 1);
-            return bjd_tree_parse_ext(tree, node);
-        #endif
+    if (!bjd_tree_reserve_bytes(tree, 1))
+        return false;
 
-        // float
-        case 0xca:
-            if (!bjd_tree_reserve_bytes(tree, sizeof(float)))
-                return false;
-            node->value.f = bjd_load_float(tree->data + tree->size + 1);
-            node->type = bjd_type_float;
-            return true;
+    if (tree->data[pos] == BJDATA_MARKER_TYPE) {
+        if (!bjd_tree_reserve_bytes(tree, 2))
+            return false;
+        elemtype = tree->data[pos + 1];
+        pos += 2;
+        if (tree->data[pos] != BJDATA_MARKER_COUNT) {
+            bjd_tree_flag_error(tree, bjd_error_invalid);
+            return false;
+        }
+    }
 
-        // double
-        case 0xcb:
-            if (!bjd_tree_reserve_bytes(tree, sizeof(double)))
-                return false;
-            node->value.d = bjd_load_double(tree->data + tree->size + 1);
-            node->type = bjd_type_double;
-            return true;
+    if (tree->data[pos] == BJDATA_MARKER_COUNT) {
+        uint32_t count;
+        if (!bjd_tree_parse_length(tree, &count))
+            return false;
+        if (count > BJDATA_NDARRAY_MAX_DIMS) {
+            bjd_tree_flag_error(tree, bjd_error_unsupported);
+            return false;
+        }
 
-        // uint8
-        case 0xcc:
-            node->type = bjd_type_uint;
-            if (!bjd_tree_reserve_bytes(tree, sizeof(uint8_t)))
-                return false;
-            node->value.u = bjd_load_u8(tree->data + tree->size + 1);
-            return true;
+        for (; i < count; ++i) {
+            if (elemtype != 0) {
+                if (!bjd_tree_parse_length_value(tree, elemtype, &dims[i]))
+                    return false;
+            } else {
+                if (!bjd_tree_parse_length(tree, &dims[i]))
+                    return false;
+            }
+        }
 
-        // uint16
-        case 0xcd:
-            node->type = bjd_type_uint;
-            if (!bjd_tree_reserve_bytes(tree, sizeof(uint16_t)))
+    } else {
+        // a vector without a count is terminated by ']'. its first
+        // marker has already been reserved.
+        char marker = tree->data[pos];
+        while (marker != BJDATA_MARKER_ARRAY_END) {
+            if (i == BJDATA_NDARRAY_MAX_DIMS) {
+                bjd_tree_flag_error(tree, bjd_error_unsupported);
                 return false;
-            node->value.u = bjd_load_u16(tree->data + tree->size + 1);
-            return true;
-
-        // uint32
-        case 0xce:
-            node->type = bjd_type_uint;
-            if (!bjd_tree_reserve_bytes(tree, sizeof(uint32_t)))
+            }
+            if (!bjd_tree_parse_length_value(tree, marker, &dims[i++]))
                 return false;
-            node->value.u = bjd_load_u32(tree->data + tree->size + 1);
-            return true;
 
-        // uint64
-        case 0xcf:
-            node->type = bjd_type_uint;
-            if (!bjd_tree_reserve_bytes(tree, sizeof(uint64_t)))
+            pos = tree->size + 1 + tree->parser.current_node_reserved;
+            if (!bjd_tree_reserve_bytes(tree, 1))
                 return false;
-            node->value.u = bjd_load_u64(tree->data + tree->size + 1);
-            return true;
+            marker = tree->data[pos];
+        }
+    }
 
-        // int8
-        case 0xd0:
-            node->type = bjd_type_int;
-            if (!bjd_tree_reserve_bytes(tree, sizeof(int8_t)))
-                return false;
-            node->value.i = bjd_load_i8(tree->data + tree->size + 1);
-            return true;
+    if (i == 0) {
+        bjd_tree_flag_error(tree, bjd_error_invalid);
+        return false;
+    }
 
-        // int16
-        case 0xd1:
-            node->type = bjd_type_int;
-            if (!bjd_tree_reserve_bytes(tree, sizeof(int16_t)))
-                return false;
-            node->value.i = bjd_load_i16(tree->data + tree->size + 1);
-            return true;
+    *ndims = i;
+    return true;
+}
 
-        // int32
-        case 0xd2:
-            node->type = bjd_type_int;
-            if (!bjd_tree_reserve_bytes(tree, sizeof(int32_t)))
-                return false;
-            node->value.i = bjd_load_i32(tree->data + tree->size + 1);
-            return true;
+static bool bjd_tree_parse_str(bjd_tree_t* tree, bjd_node_data_t* node) {
+    uint32_t length;
+    if (!bjd_tree_parse_length(tree, &length))
+        return false;
+    node->type = bjd_type_str;
+    node->len = length;
+    return bjd_tree_parse_bytes(tree, node);
+}
 
-        // int64
-        case 0xd3:
-            node->type = bjd_type_int;
-            if (!bjd_tree_reserve_bytes(tree, sizeof(int64_t)))
-                return false;
-            node->value.i = bjd_load_i64(tree->data + tree->size + 1);
-            return true;
+// An optimized array ('$' element type and '#' count) is stored as a single
+// node. Its payload is reserved in place of its children, and the offset of
+// the payload is stored in the node. Elements are materialized on demand by
+// bjd_node_array_at().
+static bool bjd_tree_parse_container(bjd_tree_t* tree, bjd_node_data_t* node, bjd_type_t type) {
+    size_t pos = tree->size + 1 + tree->parser.current_node_reserved;
+    char elemtype = 0;
 
-        #if BJDATA_EXTENSIONS
-        // fixext1
-        case 0xd4:
-            node->len = 1;
-            return bjd_tree_parse_ext(tree, node);
-
-        // fixext2
-        case 0xd5:
-            node->len = 2;
-            return bjd_tree_parse_ext(tree, node);
-
-        // fixext4
-        case 0xd6:
-            node->len = 4;
-            return bjd_tree_parse_ext(tree, node);
-
-        // fixext8
-        case 0xd7:
-            node->len = 8;
-            return bjd_tree_parse_ext(tree, node);
-
-        // fixext16
-        case 0xd8:
-            node->len = 16;
-            return bjd_tree_parse_ext(tree, node);
+    if (!bjd_tree_reserve_bytes(tree, 1))
+        return false;
+
+    if (tree->data[pos] == BJDATA_MARKER_TYPE) {
+        if (!bjd_tree_reserve_bytes(tree, 2))
+            return false;
+        elemtype = tree->data[pos + 1];
+
+        // only fixed-size numbers can be packed without markers
+        if (bjd_typed_marker_size(elemtype) == 0) {
+            bjd_tree_flag_error(tree, bjd_error_unsupported);
+            return false;
+        }
+
+        // a '$' type must always be followed by a '#' count
+        if (tree->data[pos + 2] != BJDATA_MARKER_COUNT) {
+            bjd_tree_flag_error(tree, bjd_error_invalid);
+            return false;
+        }
+
+    // a container without a count ends at its closing marker. the byte we
+    // reserved is the marker of its first child (or its end), which is
+    // reserved again when the children are parsed.
+    } else if (tree->data[pos] != BJDATA_MARKER_COUNT) {
+        --tree->parser.current_node_reserved;
+        node->type = type;
+        node->len = 0;
+        node->value.children = NULL;
+        #ifdef BJDATA_MALLOC
+        if (bjd_tree_defer_children(tree, node))
+            return true;
+        if (bjd_tree_projects(tree))
+            return bjd_tree_push_projected(tree, node, false);
+        return bjd_tree_push_unsized(tree, type);
+        #else
+        bjd_tree_flag_error(tree, bjd_error_unsupported);
+        return false;
         #endif
+    }
+
+    // the count is either an integer or the dimension vector of an ND-array
+    pos = tree->size + 1 + tree->parser.current_node_reserved;
+    if (!bjd_tree_reserve_bytes(tree, 1))
+        return false;
+
+    uint32_t count;
+    uint32_t dims[BJDATA_NDARRAY_MAX_DIMS];
+    size_t ndims = 0;
+
+    if (tree->data[pos] == BJDATA_MARKER_ARRAY_START && type == bjd_type_array) {
+        if (!bjd_tree_parse_dims(tree, dims, &ndims))
+            return false;
+
+        // the element count is the product of the dimensions
+        uint64_t total = 1;
+        for (size_t i = 0; i < ndims; ++i) {
+            total *= dims[i];
+            if (total > UINT32_MAX) {
+                bjd_tree_flag_error(tree, bjd_error_too_big);
+                return false;
+            }
+        }
+        count = (uint32_t)total;
 
-        // str8
-        case 0xd9:
+    } else if (!bjd_tree_parse_length_value(tree, tree->data[pos], &count)) {
+        return false;
+    }
+
+    node->type = type;
+    node->len = count;
+
+    // the dimensions of an ordinary array are not kept, and the keys of an
+    // optimized map are parsed as children, each reserving its packed value
+    // (see bjd_tree_parse_node())
+    if (elemtype == 0 || type == bjd_type_map) {
+        node->elemtype = elemtype;
+        if (count > 0 && bjd_tree_defer_children(tree, node))
+            return true;
+        #ifdef BJDATA_MALLOC
+        if (count > 0 && bjd_tree_projects(tree))
+            return bjd_tree_push_projected(tree, node, true);
+        #endif
+        return bjd_tree_parse_children(tree, node);
+    }
+
+    size_t size = bjd_typed_marker_size(elemtype);
+    if (count > SIZE_MAX / size) {
+        bjd_tree_flag_error(tree, bjd_error_too_big);
+        return false;
+    }
+
+    size_t offset = tree->size + tree->parser.current_node_reserved + 1;
+    if (!bjd_tree_reserve_bytes(tree, count * size))
+        return false;
+
+    node->elemtype = elemtype;
+    if (ndims == 0) {
+        node->value.offset = offset;
+        return true;
+    }
+
+    // An ND-array stores its payload offset and dimensions in auxiliary
+    // nodes, allocated only once the whole node is known to be available.
+    tree->node_count += ndims + 1;
+    if (tree->node_count > tree->max_nodes) {
+        bjd_tree_flag_error(tree, bjd_error_too_big);
+        return false;
+    }
+
+    bjd_node_data_t* aux = bjd_tree_alloc_nodes(tree, ndims + 1);
+    if (aux == NULL)
+        return false;
+    aux[0].value.offset = offset;
+    for (size_t i = 0; i < ndims; ++i)
+        aux[i + 1].value.u = dims[i];
+
+    node->ndims = (uint8_t)ndims;
+    node->value.children = aux;
+    return true;
+}
+
+static bool bjd_tree_parse_node_contents(bjd_tree_t* tree, bjd_node_data_t* node) {
+    bjd_assert(tree->parser.state == bjd_tree_parse_state_in_progress);
+    bjd_assert(node != NULL, "null node?");
+
+    // read the type. we've already accounted for this byte in
+    // possible_nodes_left, so we already know it is in bounds, and we don't
+    // need to reserve it for this node.
+    bjd_assert(tree->data_length > tree->size);
+    uint8_t type = bjd_load_u8(tree->data + tree->size);
+    bjd_log("node type %c\n", type);
+    tree->parser.current_node_reserved = 0;
+    node->elemtype = 0;
+    node->lazy = false;
+    node->ndims = 0;
+
+    // as with bjd_read_tag(), the fastest way to parse a node is to switch
+    // on the marker byte.
+
+    switch (type) {
+
+        // nil
+        case 'Z':
+            node->type = bjd_type_nil;
+            return true;
+
+        // no-op
+        case 'N':
+            node->type = bjd_type_noop;
+            return true;
+
+        // bool
+        case 'F': case 'T':
+            node->type = bjd_type_bool;
+            node->value.b = (type == 'T');
+            return true;
+
+        // float
+        case 'd':
+            if (!bjd_tree_reserve_bytes(tree, sizeof(float)))
+                return false;
+            node->value.f = bjd_load_float_endian(tree->data + tree->size + 1, tree->endian);
+            node->type = bjd_type_float;
+            return true;
+
+        // double
+        case 'D':
+            if (!bjd_tree_reserve_bytes(tree, sizeof(double)))
+                return false;
+            node->value.d = bjd_load_double_endian(tree->data + tree->size + 1, tree->endian);
+            node->type = bjd_type_double;
+            return true;
+
+        // uint8
+        case 'U':
+            node->type = bjd_type_uint;
             if (!bjd_tree_reserve_bytes(tree, sizeof(uint8_t)))
                 return false;
-            node->len = bjd_load_u8(tree->data + tree->size + 1);
-            node->type = bjd_type_str;
-            return bjd_tree_parse_bytes(tree, node);
+            node->value.u = bjd_load_u8(tree->data + tree->size + 1);
+            return true;
 
-        // str16
-        case 0xda:
+        // uint16
+        case 'u':
+            node->type = bjd_type_uint;
             if (!bjd_tree_reserve_bytes(tree, sizeof(uint16_t)))
                 return false;
-            node->len = bjd_load_u16(tree->data + tree->size + 1);
-            node->type = bjd_type_str;
-            return bjd_tree_parse_bytes(tree, node);
+            node->value.u = bjd_load_u16_endian(tree->data + tree->size + 1, tree->endian);
+            return true;
 
-        // str32
-        case 0xdb:
+        // uint32
+        case 'm':
+            node->type = bjd_type_uint;
             if (!bjd_tree_reserve_bytes(tree, sizeof(uint32_t)))
                 return false;
-            node->len = bjd_load_u32(tree->data + tree->size + 1);
-            node->type = bjd_type_str;
-            return bjd_tree_parse_bytes(tree, node);
+            node->value.u = bjd_load_u32_endian(tree->data + tree->size + 1, tree->endian);
+            return true;
 
-        // array16
-        case 0xdc:
-            if (!bjd_tree_reserve_bytes(tree, sizeof(uint16_t)))
+        // uint64
+        case 'M':
+            node->type = bjd_type_uint;
+            if (!bjd_tree_reserve_bytes(tree, sizeof(uint64_t)))
                 return false;
-            node->len = bjd_load_u16(tree->data + tree->size + 1);
-            node->type = bjd_type_array;
-            return bjd_tree_parse_children(tree, node);
+            node->value.u = bjd_load_u64_endian(tree->data + tree->size + 1, tree->endian);
+            return true;
 
-        // array32
-        case 0xdd:
-            if (!bjd_tree_reserve_bytes(tree, sizeof(uint32_t)))
+        // int8
+        case 'i':
+            node->type = bjd_type_int;
+            if (!bjd_tree_reserve_bytes(tree, sizeof(int8_t)))
                 return false;
-            node->len = bjd_load_u32(tree->data + tree->size + 1);
-            node->type = bjd_type_array;
-            return bjd_tree_parse_children(tree, node);
+            node->value.i = bjd_load_i8(tree->data + tree->size + 1);
+            return true;
 
-        // map16
-        case 0xde:
-            if (!bjd_tree_reserve_bytes(tree, sizeof(uint16_t)))
+        // int16
+        case 'I':
+            node->type = bjd_type_int;
+            if (!bjd_tree_reserve_bytes(tree, sizeof(int16_t)))
                 return false;
-            node->len = bjd_load_u16(tree->data + tree->size + 1);
-            node->type = bjd_type_map;
-            return bjd_tree_parse_children(tree, node);
+            node->value.i = bjd_load_i16_endian(tree->data + tree->size + 1, tree->endian);
+            return true;
 
-        // map32
-        case 0xdf:
-            if (!bjd_tree_reserve_bytes(tree, sizeof(uint32_t)))
+        // int32
+        case 'l':
+            node->type = bjd_type_int;
+            if (!bjd_tree_reserve_bytes(tree, sizeof(int32_t)))
                 return false;
-            node->len = bjd_load_u32(tree->data + tree->size + 1);
-            node->type = bjd_type_map;
-            return bjd_tree_parse_children(tree, node);
+            node->value.i = bjd_load_i32_endian(tree->data + tree->size + 1, tree->endian);
+            return true;
 
-        // reserved
-        case 0xc1:
-            bjd_tree_flag_error(tree, bjd_error_invalid);
-            return false;
+        // int64
+        case 'L':
+            node->type = bjd_type_int;
+            if (!bjd_tree_reserve_bytes(tree, sizeof(int64_t)))
+                return false;
+            node->value.i = bjd_load_i64_endian(tree->data + tree->size + 1, tree->endian);
+            return true;
 
-        #if !BJDATA_EXTENSIONS
-        // ext
-        case 0xc7: // fallthrough
-        case 0xc8: // fallthrough
-        case 0xc9: // fallthrough
-        // fixext
-        case 0xd4: // fallthrough
-        case 0xd5: // fallthrough
-        case 0xd6: // fallthrough
-        case 0xd7: // fallthrough
-        case 0xd8:
-            bjd_tree_flag_error(tree, bjd_error_unsupported);
-            return false;
-        #endif
+        // str and high-precision number (both carry a length)
+        case 'S':
+        case 'H':
+            return bjd_tree_parse_str(tree, node);
+
+        // array
+        case '[':
+            return bjd_tree_parse_container(tree, node, bjd_type_array);
+
+        // map
+        case '{':
+            return bjd_tree_parse_container(tree, node, bjd_type_map);
 
-        #if BJDATA_OPTIMIZE_FOR_SIZE
-        // any other bytes should have been handled by the infix switch
         default:
             break;
-        #endif
     }
 
-    bjd_assert(0, "unreachable");
+    // any other byte is not a valid marker
+    bjd_tree_flag_error(tree, bjd_error_invalid);
     return false;
 }
 
+// Parses a key of an optimized map. The key is a string without its 'S'
+// marker, so the first byte of the node is the marker of its length.
+static bool bjd_tree_parse_key(bjd_tree_t* tree, bjd_node_data_t* node) {
+    tree->parser.current_node_reserved = 0;
+    node->elemtype = 0;
+    node->lazy = false;
+    node->ndims = 0;
+
+    uint32_t length;
+    if (!bjd_tree_parse_length_value(tree, tree->data[tree->size], &length))
+        return false;
+    node->type = bjd_type_str;
+    node->len = length;
+    return bjd_tree_parse_bytes(tree, node);
+}
+
 static bool bjd_tree_parse_node(bjd_tree_t* tree, bjd_node_data_t* node) {
     bjd_log("parsing a node at position %i in level %i\n",
             (int)tree->size, (int)tree->parser.level);
 
-    if (!bjd_tree_parse_node_contents(tree, node)) {
+    char packed = tree->parser.stack[tree->parser.level].elemtype;
+
+    bool parsed = (packed != 0) ?
+            bjd_tree_parse_key(tree, node) :
+            bjd_tree_parse_node_contents(tree, node);
+    if (!parsed) {
         bjd_log("node parsing returned false\n");
         return false;
     }
 
+    // A key of an optimized map is followed by its packed value, which is
+    // reserved as part of the key so that the value can be located from
+    // the key's data.
+    if (packed != 0 && !bjd_tree_reserve_bytes(tree, bjd_typed_marker_size(packed)))
+        return false;
+
     tree->parser.possible_nodes_left -= tree->parser.current_node_reserved;
 
     // The reserve for the current node does not include the initial byte
@@ -755,11 +996,16 @@ static bool bjd_tree_parse_node(bjd_tree_t* tree, bjd_node_data_t* node) {
 
     // If the parsed type is a map or array, the reserve includes one byte for
     // each child. We want to subtract these out of possible_nodes_left, but
-    // not out of the current size of the tree.
-    if (node->type == bjd_type_array)
-        node_size -= node->len;
-    else if (node->type == bjd_type_map)
-        node_size -= node->len * 2;
+    // not out of the current size of the tree. (The payload of an optimized
+    // array is part of the node itself, and an optimized map only has a
+    // child for each key. A container whose children are deferred keeps
+    // all of its bytes.)
+    if (!node->lazy) {
+        if (node->type == bjd_type_array && node->elemtype == 0)
+            node_size -= node->len;
+        else if (node->type == bjd_type_map)
+            node_size -= (node->elemtype == 0) ? node->len * 2 : node->len;
+    }
     tree->size += node_size;
 
     bjd_log("parsed a node of type %s of %i bytes and "
@@ -770,10 +1016,241 @@ static bool bjd_tree_parse_node(bjd_tree_t* tree, bjd_node_data_t* node) {
     return true;
 }
 
+#ifdef BJDATA_MALLOC
+// Returns the slot in unsized_nodes in which to gather the next child of
+// the container at the top of the parse stack, or NULL if an error was
+// flagged.
+static bjd_node_data_t* bjd_tree_gather_next(bjd_tree_t* tree) {
+    bjd_tree_parser_t* parser = &tree->parser;
+
+    if (tree->node_count + 1 > tree->max_nodes) {
+        bjd_tree_flag_error(tree, bjd_error_too_big);
+        return NULL;
+    }
+
+    if (parser->unsized_count == parser->unsized_capacity) {
+        size_t new_capacity = (parser->unsized_capacity == 0) ?
+                BJDATA_NODES_PER_PAGE : parser->unsized_capacity * 2;
+        bjd_node_data_t* new_nodes = (bjd_node_data_t*)bjd_allocator_realloc(tree->allocator, parser->unsized_nodes,
+                sizeof(bjd_node_data_t) * parser->unsized_count,
+                sizeof(bjd_node_data_t) * new_capacity);
+        if (new_nodes == NULL) {
+            bjd_tree_flag_error(tree, bjd_error_memory);
+            return NULL;
+        }
+        parser->unsized_nodes = new_nodes;
+        parser->unsized_capacity = new_capacity;
+    }
+
+    return parser->unsized_nodes + parser->unsized_count;
+}
+
+// Reserves the next marker of the unsized container at the top of the parse
+// stack. Returns the node in which to parse its next child, or NULL in out
+// if the marker closes the container.
+static bool bjd_tree_unsized_next(bjd_tree_t* tree, bjd_node_data_t** out) {
+    bjd_tree_parser_t* parser = &tree->parser;
+    bjd_level_t* level = &parser->stack[parser->level];
+
+    // the marker is reserved as a node of its own. it stays reserved if
+    // parsing pauses in the child so that it's not subtracted twice.
+    if (!level->reserved) {
+        parser->current_node_reserved = 0;
+        if (!bjd_tree_reserve_bytes(tree, 1))
+            return false;
+        parser->possible_nodes_left -= 1;
+        parser->current_node_reserved = 0;
+        level->reserved = true;
+    }
+
+    if (tree->data[tree->size] == level->end) {
+        level->reserved = false;
+        tree->size += 1;
+        *out = NULL;
+        return true;
+    }
+
+    *out = bjd_tree_gather_next(tree);
+    return *out != NULL;
+}
+
+// Moves the children of the unsized or projected container at the top of
+// the parse stack to contiguous nodes in the tree, and pops it.
+static bool bjd_tree_unsized_finish(bjd_tree_t* tree) {
+    bjd_tree_parser_t* parser = &tree->parser;
+    bjd_assert(parser->level > 0, "unsized container at the root level?");
+    size_t start = parser->stack[parser->level].start;
+    size_t total = parser->unsized_count - start;
+
+    // the container is the last node parsed in the level below
+    bjd_level_t* parent = &parser->stack[parser->level - 1];
+    bjd_node_data_t* node = bjd_tree_level_gathers(parent) ?
+            parser->unsized_nodes + start - 1 : parent->child - 1;
+
+    // the values of an optimized map are packed after its keys
+    size_t len = total;
+    if (node->type == bjd_type_map && node->elemtype == 0) {
+        if (total % 2 != 0) {
+            bjd_tree_flag_error(tree, bjd_error_invalid);
+            return false;
+        }
+        len = total / 2;
+    }
+    if (len > UINT32_MAX) {
+        bjd_tree_flag_error(tree, bjd_error_too_big);
+        return false;
+    }
+
+    if (total > 0) {
+        bjd_node_data_t* children = bjd_tree_alloc_nodes(tree, total);
+        if (children == NULL)
+            return false;
+        bjd_memcpy(children, parser->unsized_nodes + start, sizeof(bjd_node_data_t) * total);
+        node->value.children = children;
+    }
+    node->len = (uint32_t)len;
+
+    parser->unsized_count = start;
+    --parser->level;
+    return true;
+}
+
+// Resets the paths of the projection that matched a previous child of a
+// projected container at the given depth.
+static void bjd_tree_projection_leave(bjd_tree_t* tree, size_t depth) {
+    for (size_t i = 0; i < tree->projection_count; ++i)
+        if (tree->projection_depth[i] > depth)
+            tree->projection_depth[i] = depth;
+}
+
+// Advances the paths of the projection whose step at the given depth
+// matches a map key, or an array index if key is NULL. Returns true if any
+// path matches.
+static bool bjd_tree_projection_enter(bjd_tree_t* tree, size_t depth,
+        const char* key, size_t length, size_t index)
+{
+    bool matched = false;
+    for (size_t i = 0; i < tree->projection_count; ++i) {
+        if (tree->projection_depth[i] == depth &&
+                bjd_path_step_matches(&tree->projection[i], depth, key, length, index))
+        {
+            tree->projection_depth[i] = depth + 1;
+            matched = true;
+        }
+    }
+    return matched;
+}
+
+// Skips the value at the current position without parsing it into nodes.
+// Its bytes are still checked by a structural scan. If reserved is true,
+// its first byte has already been reserved.
+static bool bjd_tree_skip_value(bjd_tree_t* tree, bool reserved) {
+    bjd_tree_parser_t* parser = &tree->parser;
+    size_t end = tree->size;
+    bjd_error_t error = bjd_scan_value(tree->data, tree->data_length, &end, tree->endian, NULL, 0);
+    if (error != bjd_ok) {
+        bjd_tree_flag_error(tree, error);
+        return false;
+    }
+
+    size_t bytes = end - tree->size - (reserved ? 1 : 0);
+    parser->current_node_reserved = 0;
+    if (!bjd_tree_reserve_bytes(tree, bytes))
+        return false;
+    parser->possible_nodes_left -= bytes;
+    parser->current_node_reserved = 0;
+    tree->size = end;
+    return true;
+}
+
+// Parses the given gathered node and keeps it as a child of the projected
+// container at the top of the parse stack.
+static bool bjd_tree_projected_keep(bjd_tree_t* tree, bjd_node_data_t* node, bool parse) {
+    if (parse && !bjd_tree_parse_node(tree, node))
+        return false;
+    ++tree->parser.unsized_count;
+    ++tree->node_count;
+    return true;
+}
+
+// Reads the next child of the projected container at the top of the parse
+// stack. Map pairs whose keys are not on a path of the projection are
+// skipped, and array elements whose indices are not are replaced by
+// missing nodes so that the indices of the others are kept.
+static bool bjd_tree_projected_next(bjd_tree_t* tree) {
+    bjd_tree_parser_t* parser = &tree->parser;
+    size_t level = parser->level;
+    bjd_node_data_t* node;
+
+    if (parser->stack[level].end != 0) {
+        if (!bjd_tree_unsized_next(tree, &node))
+            return false;
+        if (node == NULL)
+            return bjd_tree_unsized_finish(tree);
+        parser->stack[level].reserved = false;
+    } else {
+        node = bjd_tree_gather_next(tree);
+        if (node == NULL)
+            return false;
+        --parser->stack[level].left;
+    }
+
+    size_t depth = level - 1;
+    size_t index = parser->stack[level].index++;
+    char packed = parser->stack[level].elemtype;
+
+    // the value of a pair whose key was kept
+    bool map = parser->stack[level].map;
+    if (map && packed == 0 && index % 2 == 1)
+        return bjd_tree_projected_keep(tree, node, true);
+
+    bjd_tree_projection_leave(tree, depth);
+
+    if (!map) {
+        if (bjd_tree_projection_enter(tree, depth, NULL, 0, index))
+            return bjd_tree_projected_keep(tree, node, true);
+        if (!bjd_tree_skip_value(tree, true))
+            return false;
+        node->type = bjd_type_missing;
+        node->elemtype = 0;
+        node->lazy = false;
+        node->ndims = 0;
+        node->len = 0;
+        return bjd_tree_projected_keep(tree, node, false);
+    }
+
+    // Keys are parsed so that they can be matched, except for those of
+    // plain maps that are not strings, which can't be on a path. The packed
+    // value of a key of an optimized map is parsed along with it.
+    uint8_t marker = bjd_load_u8(tree->data + tree->size);
+    if (packed != 0 || marker == 'S' || marker == 'H') {
+        if (!bjd_tree_parse_node(tree, node))
+            return false;
+        if (node->type == bjd_type_str && bjd_tree_projection_enter(tree, depth,
+                    tree->data + node->value.offset, node->len, 0))
+            return bjd_tree_projected_keep(tree, node, false);
+        if (packed != 0)
+            return true;
+    } else if (!bjd_tree_skip_value(tree, true)) {
+        return false;
+    }
+
+    // skip the value of the pair. in an unsized map, its first byte is not
+    // reserved yet.
+    ++parser->stack[level].index;
+    if (parser->stack[level].end != 0)
+        return bjd_tree_skip_value(tree, false);
+    --parser->stack[level].left;
+    return bjd_tree_skip_value(tree, true);
+}
+#endif
+
 /*
  * We read nodes in a loop instead of recursively for maximum performance. The
  * stack holds the amount of children left to read in each level of the tree.
  * Parsing can pause and resume when more data becomes available.
+ *
+ * Unsized containers stay on the stack until their closing marker is found.
  */
 static bool bjd_tree_continue_parsing(bjd_tree_t* tree) {
     if (bjd_tree_error(tree) != bjd_ok)
@@ -786,12 +1263,37 @@ static bool bjd_tree_continue_parsing(bjd_tree_t* tree) {
     // we loop parsing nodes until the parse stack is empty. we break
     // by returning out of the function.
     while (true) {
-        bjd_node_data_t* node = parser->stack[parser->level].child;
         size_t level = parser->level;
-        if (!bjd_tree_parse_node(tree, node))
-            return false;
-        --parser->stack[level].left;
-        ++parser->stack[level].child;
+
+        #ifdef BJDATA_MALLOC
+        if (parser->stack[level].projected) {
+            if (!bjd_tree_projected_next(tree))
+                return false;
+        } else if (parser->stack[level].end != 0) {
+            bjd_node_data_t* node;
+            if (!bjd_tree_unsized_next(tree, &node))
+                return false;
+
+            if (node != NULL) {
+                if (!bjd_tree_parse_node(tree, node))
+                    return false;
+                parser->stack[level].reserved = false;
+                ++parser->unsized_count;
+                ++tree->node_count;
+                continue;
+            }
+
+            if (!bjd_tree_unsized_finish(tree))
+                return false;
+        } else
+        #endif
+        {
+            bjd_node_data_t* node = parser->stack[level].child;
+            if (!bjd_tree_parse_node(tree, node))
+                return false;
+            --parser->stack[level].left;
+            ++parser->stack[level].child;
+        }
 
         bjd_assert(bjd_tree_error(tree) == bjd_ok,
                 "bjd_tree_parse_node() should have returned false due to error!");
@@ -802,35 +1304,132 @@ static bool bjd_tree_continue_parsing(bjd_tree_t* tree) {
         // have to loop. but we eventually want to use the parse stack to give
         // better error messages that contain the location of the error, so
         // it needs to be complete.)
-        while (parser->stack[parser->level].left == 0) {
+        while (parser->stack[parser->level].end == 0 && parser->stack[parser->level].left == 0) {
             if (parser->level == 0)
                 return true;
+            #ifdef BJDATA_MALLOC
+            if (parser->stack[parser->level].projected) {
+                if (!bjd_tree_unsized_finish(tree))
+                    return false;
+                continue;
+            }
+            #endif
             --parser->level;
         }
     }
 }
 
+// Releases the nodes of the parsed message. Pages are kept for the next
+// parse up to the page cache size, as is the parsing scratch space.
 static void bjd_tree_cleanup(bjd_tree_t* tree) {
     BJDATA_UNUSED(tree);
 
     #ifdef BJDATA_MALLOC
-    if (tree->parser.stack_owned) {
-        BJDATA_FREE(tree->parser.stack);
-        tree->parser.stack = NULL;
-        tree->parser.stack_owned = false;
+    tree->lazy_index.count = 0;
+
+    // the index table itself is scratch space; only its entries are released
+    if (tree->indexes != NULL) {
+        for (size_t i = 0; i < tree->index_capacity; ++i)
+            if (tree->indexes[i].slots != NULL)
+                bjd_allocator_free(tree->allocator, tree->indexes[i].slots);
+        bjd_memset(tree->indexes, 0, sizeof(bjd_map_index_t) * tree->index_capacity);
+        tree->index_count = 0;
     }
 
     bjd_tree_page_t* page = tree->next;
     while (page != NULL) {
         bjd_tree_page_t* next = page->next;
-        bjd_log("freeing page %p\n", (void*)page);
-        BJDATA_FREE(page);
+        size_t size = bjd_tree_page_size(page->count);
+        if (size <= tree->page_cache_size - tree->free_size) {
+            page->next = tree->free_pages;
+            tree->free_pages = page;
+            tree->free_size += size;
+        } else {
+            bjd_log("freeing page %p\n", (void*)page);
+            bjd_allocator_free(tree->allocator, page);
+        }
         page = next;
     }
     tree->next = NULL;
     #endif
 }
 
+#ifdef BJDATA_MALLOC
+static void bjd_tree_free_scratch(bjd_tree_t* tree) {
+    if (tree->parser.stack_owned) {
+        bjd_allocator_free(tree->allocator, tree->parser.stack);
+        tree->parser.stack = NULL;
+        tree->parser.stack_owned = false;
+    }
+
+    if (tree->parser.unsized_nodes != NULL) {
+        bjd_allocator_free(tree->allocator, tree->parser.unsized_nodes);
+        tree->parser.unsized_nodes = NULL;
+        tree->parser.unsized_capacity = 0;
+    }
+
+    bjd_skip_index_destroy(&tree->lazy_index);
+
+    if (tree->indexes != NULL) {
+        bjd_assert(tree->index_count == 0, "map indexes were not released!");
+        bjd_allocator_free(tree->allocator, tree->indexes);
+        tree->indexes = NULL;
+        tree->index_capacity = 0;
+    }
+}
+
+// If the tree's allocator is an arena that has been reset since the tree
+// last checked, everything the tree kept from it has already been freed:
+// the pages of the last message, the cached pages and the scratch space.
+// They are dropped without being freed.
+static void bjd_tree_check_resets(bjd_tree_t* tree) {
+    size_t resets = bjd_allocator_resets(tree->allocator);
+    if (resets == tree->allocator_resets)
+        return;
+    tree->allocator_resets = resets;
+    bjd_log("dropping memory of tree %p after its arena was reset\n", (void*)tree);
+
+    tree->next = NULL;
+    tree->free_pages = NULL;
+    tree->free_size = 0;
+
+    bjd_tree_parser_t* parser = &tree->parser;
+    if (parser->stack_owned) {
+        parser->stack = NULL;
+        parser->stack_owned = false;
+    }
+    parser->unsized_nodes = NULL;
+    parser->unsized_capacity = 0;
+
+    tree->indexes = NULL;
+    tree->index_capacity = 0;
+    tree->index_count = 0;
+    bjd_memset(&tree->lazy_index, 0, sizeof(tree->lazy_index));
+}
+
+void bjd_tree_set_page_cache_size(bjd_tree_t* tree, size_t size) {
+    tree->page_cache_size = size;
+}
+
+void bjd_tree_trim(bjd_tree_t* tree) {
+    bjd_tree_check_resets(tree);
+
+    bjd_tree_page_t* page = tree->free_pages;
+    while (page != NULL) {
+        bjd_tree_page_t* next = page->next;
+        bjd_log("freeing kept page %p\n", (void*)page);
+        bjd_allocator_free(tree->allocator, page);
+        page = next;
+    }
+    tree->free_pages = NULL;
+    tree->free_size = 0;
+
+    // scratch space is only released between parses
+    if (tree->parser.state != bjd_tree_parse_state_in_progress)
+        bjd_tree_free_scratch(tree);
+}
+#endif
+
 static bool bjd_tree_parse_start(bjd_tree_t* tree) {
     if (bjd_tree_error(tree) != bjd_ok)
         return false;
@@ -839,12 +1438,16 @@ static bool bjd_tree_parse_start(bjd_tree_t* tree) {
     bjd_assert(parser->state != bjd_tree_parse_state_in_progress,
             "previous parsing was not finished!");
 
+    #ifdef BJDATA_MALLOC
+    bjd_tree_check_resets(tree);
+    #endif
     if (parser->state == bjd_tree_parse_state_parsed)
         bjd_tree_cleanup(tree);
 
     bjd_log("starting parse\n");
     tree->parser.state = bjd_tree_parse_state_in_progress;
     tree->parser.current_node_reserved = 0;
+    tree->parser.lazy = false;
 
     // check if we previously parsed a tree
     if (tree->size > 0) {
@@ -882,16 +1485,23 @@ static bool bjd_tree_parse_start(bjd_tree_t* tree) {
     tree->node_count = 1;
 
     #ifdef BJDATA_MALLOC
-    parser->stack = parser->stack_local;
-    parser->stack_owned = false;
-    parser->stack_capacity = sizeof(parser->stack_local) / sizeof(*parser->stack_local);
+    // a parsing stack grown by a previous parse is kept
+    if (!parser->stack_owned) {
+        parser->stack = parser->stack_local;
+        parser->stack_capacity = sizeof(parser->stack_local) / sizeof(*parser->stack_local);
+    }
+    parser->unsized_count = 0;
+
+    // a stream is parsed whole since the data of skipped values can't be
+    // scanned ahead
+    parser->projecting = (tree->projection_count != 0 && tree->read_fn == NULL);
+    for (size_t i = 0; i < tree->projection_count; ++i)
+        tree->projection_depth[i] = 0;
 
     if (tree->pool == NULL) {
 
-        // allocate first page
-        bjd_tree_page_t* page = (bjd_tree_page_t*)BJDATA_MALLOC(BJDATA_PAGE_ALLOC_SIZE);
-        bjd_log("allocated initial page %p of size %i count %i\n",
-                (void*)page, (int)BJDATA_PAGE_ALLOC_SIZE, (int)BJDATA_NODES_PER_PAGE);
+        // get the first page
+        bjd_tree_page_t* page = bjd_tree_page_alloc(tree, 1);
         if (page == NULL) {
             tree->error = bjd_error_memory;
             return false;
@@ -900,7 +1510,7 @@ static bool bjd_tree_parse_start(bjd_tree_t* tree) {
         tree->next = page;
 
         parser->nodes = page->nodes;
-        parser->nodes_left = BJDATA_NODES_PER_PAGE;
+        parser->nodes_left = page->count;
     }
     else
     #endif
@@ -918,6 +1528,9 @@ static bool bjd_tree_parse_start(bjd_tree_t* tree) {
     parser->level = 0;
     parser->stack[0].child = tree->root;
     parser->stack[0].left = 1;
+    parser->stack[0].elemtype = 0;
+    parser->stack[0].end = 0;
+    parser->stack[0].projected = false;
 
     return true;
 }
@@ -961,14 +1574,383 @@ bool bjd_tree_try_parse(bjd_tree_t* tree) {
         if (!bjd_tree_parse_start(tree))
             return false;
 
-    if (!bjd_tree_continue_parsing(tree))
-        return false;
+    if (!bjd_tree_continue_parsing(tree))
+        return false;
+
+    bjd_assert(bjd_tree_error(tree) == bjd_ok);
+    bjd_assert(tree->parser.level == 0);
+    tree->parser.state = bjd_tree_parse_state_parsed;
+    return true;
+}
+
+void bjd_tree_parse_lazy(bjd_tree_t* tree) {
+    if (bjd_tree_error(tree) != bjd_ok)
+        return;
+
+    // A stream can't be scanned ahead, and the data a container was read
+    // from may have moved by the time it is accessed. A projected tree is
+    // parsed eagerly.
+    bool eager = tree->read_fn != NULL || tree->parser.state == bjd_tree_parse_state_in_progress;
+    #ifdef BJDATA_MALLOC
+    eager = eager || tree->projection_count != 0;
+    #endif
+    if (eager) {
+        bjd_tree_parse(tree);
+        return;
+    }
+
+    if (!bjd_tree_parse_start(tree)) {
+        bjd_tree_flag_error(tree, bjd_error_invalid);
+        return;
+    }
+    tree->parser.lazy = true;
+
+    #ifdef BJDATA_MALLOC
+    // the ends of the larger containers are recorded in a single scan. if
+    // it fails, deferring scans each container and finds the error.
+    size_t end = 0;
+    tree->lazy_index.allocator = tree->allocator;
+    if (bjd_scan_value(tree->data, tree->data_length, &end, tree->endian,
+                &tree->lazy_index, BJDATA_NODE_LAZY_INDEX_MIN_SIZE) != bjd_ok)
+        tree->lazy_index.count = 0;
+    #endif
+
+    bjd_tree_parse(tree);
+}
+
+/*
+ * Parses the children of a container of a lazily parsed tree. The parser
+ * is resumed at the offset of the first child with the container below an
+ * empty level at the bottom of the stack, so parsing stops once its
+ * children are done. Any containers among them are deferred in turn.
+ *
+ * Returns false if an error was flagged.
+ */
+static bool bjd_tree_expand(bjd_tree_t* tree, bjd_node_data_t* node) {
+    bjd_tree_parser_t* parser = &tree->parser;
+    bjd_assert(node->lazy, "node is already expanded");
+    bjd_assert(parser->state == bjd_tree_parse_state_parsed,
+            "lazy node in a tree that is not parsed?");
+    if (bjd_tree_error(tree) != bjd_ok)
+        return false;
+
+    size_t size = tree->size;
+    size_t possible_nodes_left = parser->possible_nodes_left;
+
+    parser->state = bjd_tree_parse_state_in_progress;
+    parser->current_node_reserved = 0;
+    parser->possible_nodes_left = tree->data_length - node->value.offset;
+    tree->size = node->value.offset;
+    node->lazy = false;
+
+    parser->level = 0;
+    parser->stack[0].child = node + 1;
+    parser->stack[0].left = 0;
+    parser->stack[0].elemtype = 0;
+    parser->stack[0].end = 0;
+    parser->stack[0].projected = false;
+
+    // only unsized containers are deferred without children
+    bool ok;
+    if (node->len > 0) {
+        ok = bjd_tree_parse_children(tree, node);
+        parser->possible_nodes_left -= parser->current_node_reserved;
+    } else {
+        #ifdef BJDATA_MALLOC
+        parser->unsized_count = 0;
+        ok = bjd_tree_push_unsized(tree, node->type);
+        #else
+        bjd_break("unsized container in a tree without malloc!");
+        ok = false;
+        #endif
+    }
+
+    if (ok && !bjd_tree_continue_parsing(tree) && bjd_tree_error(tree) == bjd_ok)
+        bjd_tree_flag_error(tree, bjd_error_invalid);
+
+    tree->size = size;
+    parser->possible_nodes_left = possible_nodes_left;
+    parser->state = bjd_tree_parse_state_parsed;
+    return bjd_tree_error(tree) == bjd_ok;
+}
+
+// Expands a container of a lazily parsed tree before its children are
+// accessed. Returns false if an error was flagged.
+BJDATA_STATIC_INLINE bool bjd_node_expand(bjd_node_t node) {
+    return !node.data->lazy || bjd_tree_expand(node.tree, node.data);
+}
+
+#if defined(BJDATA_MALLOC) && BJDATA_THREADS
+/*
+ * Parallel parsing
+ *
+ * The elements of a large top-level array are split into ranges of roughly
+ * equal size by a structural scan that only finds where each element ends.
+ * Each range is parsed by a worker tree directly into its slice of the
+ * children of the root, with any deeper nodes in the worker's own pages.
+ * The pages are handed to the tree once all workers are done.
+ *
+ * The scan doesn't check anything the workers check anyway. If it fails
+ * for any reason (including nesting deeper than it can track), the message
+ * is parsed serially instead so that errors are the same.
+ */
+
+typedef struct bjd_tree_worker_t {
+    bjd_tree_t tree;
+    bjd_node_data_t* children;
+    size_t first; // index of the first element of the range
+    size_t count; // number of elements in the range
+    size_t start; // byte offset of the range
+    size_t end; // byte offset of the end of the range
+    pthread_t thread;
+    bool started;
+} bjd_tree_worker_t;
+
+// Scans the elements of the top-level array, splitting them into at most
+// nthreads ranges. Returns the number of ranges, or 0 if the message should
+// be parsed serially.
+static size_t bjd_tree_split(bjd_tree_t* tree, bjd_tree_worker_t* workers, size_t nthreads,
+        size_t* count, size_t* size)
+{
+    const char* data = tree->data;
+    size_t end = tree->data_length;
+    size_t p = 1;
+    bool sized = false;
+    uint64_t total = 0;
+
+    // optimized arrays and arrays with a dimension vector have no elements
+    // worth splitting
+    if (data[0] != BJDATA_MARKER_ARRAY_START || p == end || data[p] == BJDATA_MARKER_TYPE)
+        return 0;
+    if (data[p] == BJDATA_MARKER_COUNT) {
+        ++p;
+        if (p == end || data[p] == BJDATA_MARKER_ARRAY_START)
+            return 0;
+        if (!bjd_scan_length(data, end, &p, tree->endian, &total))
+            return 0;
+        sized = true;
+    }
+
+    size_t target = (end - p) / nthreads;
+    size_t ranges = 0;
+    size_t index = 0;
+    workers[0].start = p;
+    workers[0].first = 0;
+
+    while (true) {
+        if (sized) {
+            if (index == total)
+                break;
+        } else {
+            if (p == end)
+                return 0;
+            if (data[p] == BJDATA_MARKER_ARRAY_END) {
+                ++p;
+                break;
+            }
+        }
+
+        if (bjd_scan_value(data, end, &p, tree->endian, NULL, 0) != bjd_ok)
+            return 0;
+        ++index;
+
+        if (p - workers[ranges].start >= target && ranges + 1 < nthreads) {
+            workers[ranges].count = index - workers[ranges].first;
+            workers[ranges].end = p;
+            ++ranges;
+            workers[ranges].start = p;
+            workers[ranges].first = index;
+        }
+    }
+
+    if (index > UINT32_MAX)
+        return 0;
+    if (index > workers[ranges].first) {
+        workers[ranges].count = index - workers[ranges].first;
+        workers[ranges].end = sized ? p : p - 1;
+        ++ranges;
+    }
+
+    // a single range is no faster than parsing serially
+    if (ranges < 2)
+        return 0;
+
+    *count = index;
+    *size = p;
+    return ranges;
+}
+
+static void bjd_tree_worker_parse(bjd_tree_worker_t* worker) {
+    bjd_tree_t* tree = &worker->tree;
+    bjd_tree_parser_t* parser = &tree->parser;
+
+    // each element has already had its first byte reserved
+    parser->state = bjd_tree_parse_state_in_progress;
+    parser->possible_nodes_left = worker->end - worker->start - worker->count;
+    parser->stack = parser->stack_local;
+    parser->stack_capacity = sizeof(parser->stack_local) / sizeof(*parser->stack_local);
+    tree->size = worker->start;
+
+    bjd_tree_page_t* page = bjd_tree_page_alloc(tree, 1);
+    if (page == NULL) {
+        bjd_tree_flag_error(tree, bjd_error_memory);
+        return;
+    }
+    page->next = NULL;
+    tree->next = page;
+    parser->nodes = page->nodes;
+    parser->nodes_left = page->count;
+
+    parser->level = 0;
+    parser->stack[0].child = worker->children;
+    parser->stack[0].left = worker->count;
+    parser->stack[0].elemtype = 0;
+    parser->stack[0].end = 0;
+    parser->stack[0].projected = false;
+
+    // the range was scanned, so it should parse to exactly its end
+    if (!bjd_tree_continue_parsing(tree) || tree->size != worker->end)
+        bjd_tree_flag_error(tree, bjd_error_invalid);
+    parser->state = bjd_tree_parse_state_parsed;
+}
+
+static void* bjd_tree_worker_run(void* context) {
+    bjd_tree_worker_parse((bjd_tree_worker_t*)context);
+    return NULL;
+}
+
+// Parses the ranges found by bjd_tree_split() on worker threads into the
+// children of the root, and moves the pages of the workers to the tree.
+static void bjd_tree_parse_ranges(bjd_tree_t* tree, bjd_tree_worker_t* workers, size_t ranges,
+        size_t count, size_t size)
+{
+    bjd_tree_parser_t* parser = &tree->parser;
+    bjd_node_data_t* root = tree->root;
+
+    tree->node_count += count;
+    if (tree->node_count > tree->max_nodes) {
+        bjd_tree_flag_error(tree, bjd_error_too_big);
+        return;
+    }
+
+    bjd_node_data_t* children = bjd_tree_alloc_nodes(tree, count);
+    if (children == NULL)
+        return;
+    root->type = bjd_type_array;
+    root->elemtype = 0;
+    root->ndims = 0;
+    root->lazy = false;
+    root->len = (uint32_t)count;
+    root->value.children = children;
+
+    for (size_t i = 0; i < ranges; ++i) {
+        bjd_tree_worker_t* worker = &workers[i];
+        worker->tree.data = tree->data;
+        worker->tree.data_length = worker->end;
+        worker->tree.max_size = tree->max_size;
+        worker->tree.max_nodes = tree->max_nodes - tree->node_count;
+        worker->tree.endian = tree->endian;
+        worker->tree.allocator = tree->allocator;
+        worker->children = children + worker->first;
+    }
+
+    // the last range is parsed on the calling thread, as is any range whose
+    // thread fails to start
+    for (size_t i = 0; i < ranges; ++i) {
+        if (i + 1 < ranges && pthread_create(&workers[i].thread, NULL, bjd_tree_worker_run, &workers[i]) == 0) {
+            workers[i].started = true;
+            continue;
+        }
+        bjd_tree_worker_parse(&workers[i]);
+    }
+
+    for (size_t i = 0; i < ranges; ++i) {
+        bjd_tree_worker_t* worker = &workers[i];
+        if (worker->started)
+            pthread_join(worker->thread, NULL);
+
+        // the first error in the message is the one flagged
+        if (worker->tree.error != bjd_ok)
+            bjd_tree_flag_error(tree, worker->tree.error);
+        tree->node_count += worker->tree.node_count;
+
+        bjd_tree_page_t* page = worker->tree.next;
+        while (page != NULL) {
+            bjd_tree_page_t* next = page->next;
+            page->next = tree->next;
+            tree->next = page;
+            page = next;
+        }
+        worker->tree.next = NULL;
+        bjd_tree_free_scratch(&worker->tree);
+    }
+
+    if (bjd_tree_error(tree) != bjd_ok)
+        return;
+    if (tree->node_count > tree->max_nodes) {
+        bjd_tree_flag_error(tree, bjd_error_too_big);
+        return;
+    }
+
+    tree->size = size;
+    parser->possible_nodes_left = tree->data_length - size;
+    parser->stack[0].left = 0;
+    ++parser->stack[0].child;
+    parser->state = bjd_tree_parse_state_parsed;
+    bjd_log("parsed tree of %i bytes in %i ranges\n", (int)size, (int)ranges);
+}
+#endif
+
+#ifdef BJDATA_MALLOC
+void bjd_tree_parse_parallel(bjd_tree_t* tree, size_t nthreads) {
+    #if BJDATA_THREADS
+    if (bjd_tree_error(tree) != bjd_ok)
+        return;
+
+    // only a whole message in memory can be split, and the root's children
+    // can't be split across a pool. a projected tree is parsed serially, as
+    // is a tree with a custom allocator since it need not be thread-safe.
+    if (tree->read_fn != NULL || tree->pool != NULL || tree->projection_count != 0 ||
+            tree->allocator != NULL || tree->parser.state == bjd_tree_parse_state_in_progress) {
+        bjd_tree_parse(tree);
+        return;
+    }
+
+    if (!bjd_tree_parse_start(tree)) {
+        bjd_tree_flag_error(tree, bjd_error_invalid);
+        return;
+    }
+
+    size_t max_threads = tree->data_length / BJDATA_NODE_PARALLEL_MIN_SIZE;
+    if (nthreads > max_threads)
+        nthreads = max_threads;
+    if (nthreads < 2) {
+        bjd_tree_parse(tree);
+        return;
+    }
+
+    bjd_tree_worker_t* workers = (bjd_tree_worker_t*)bjd_allocator_malloc(tree->allocator,
+            sizeof(bjd_tree_worker_t) * nthreads);
+    if (workers == NULL) {
+        bjd_tree_flag_error(tree, bjd_error_memory);
+        return;
+    }
+    bjd_memset(workers, 0, sizeof(bjd_tree_worker_t) * nthreads);
 
-    bjd_assert(bjd_tree_error(tree) == bjd_ok);
-    bjd_assert(tree->parser.level == 0);
-    tree->parser.state = bjd_tree_parse_state_parsed;
-    return true;
+    size_t count, size;
+    size_t ranges = bjd_tree_split(tree, workers, nthreads, &count, &size);
+    if (ranges == 0)
+        bjd_tree_parse(tree);
+    else
+        bjd_tree_parse_ranges(tree, workers, ranges, count, size);
+
+    bjd_allocator_free(tree->allocator, workers);
+    #else
+    BJDATA_UNUSED(nthreads);
+    bjd_tree_parse(tree);
+    #endif
 }
+#endif
 
 
 
@@ -999,6 +1981,9 @@ static void bjd_tree_init_clear(bjd_tree_t* tree) {
     tree->missing_node.type = bjd_type_missing;
     tree->max_size = SIZE_MAX;
     tree->max_nodes = SIZE_MAX;
+    #ifdef BJDATA_MALLOC
+    tree->page_cache_size = BJDATA_NODE_PAGE_CACHE_SIZE;
+    #endif
 }
 
 #ifdef BJDATA_MALLOC
@@ -1008,6 +1993,9 @@ void bjd_tree_init_data(bjd_tree_t* tree, const char* data, size_t length) {
     BJDATA_STATIC_ASSERT(BJDATA_NODE_PAGE_SIZE >= sizeof(bjd_tree_page_t),
             "BJDATA_NODE_PAGE_SIZE is too small");
 
+    BJDATA_STATIC_ASSERT(!BJDATA_COMPACT_NODES || sizeof(bjd_node_data_t) == 16,
+            "compact nodes should be 16 bytes!");
+
     BJDATA_STATIC_ASSERT(BJDATA_PAGE_ALLOC_SIZE <= BJDATA_NODE_PAGE_SIZE,
             "incorrect page rounding?");
 
@@ -1079,6 +2067,36 @@ void bjd_tree_set_limits(bjd_tree_t* tree, size_t max_message_size, size_t max_m
     tree->max_nodes = max_message_nodes;
 }
 
+#ifdef BJDATA_MALLOC
+void bjd_tree_set_projection(bjd_tree_t* tree, const bjd_path_t* paths, size_t count) {
+    bjd_assert(tree->parser.state != bjd_tree_parse_state_in_progress,
+            "cannot change the projection while parsing!");
+    bjd_assert(count == 0 || paths != NULL, "paths are NULL");
+
+    if (tree->projection_depth != NULL) {
+        BJDATA_FREE(tree->projection_depth);
+        tree->projection_depth = NULL;
+    }
+    tree->projection = NULL;
+    tree->projection_count = 0;
+    if (count == 0)
+        return;
+
+    if (count > SIZE_MAX / sizeof(size_t)) {
+        bjd_tree_flag_error(tree, bjd_error_memory);
+        return;
+    }
+    // like the stream buffer, this outlives messages
+    tree->projection_depth = (size_t*)BJDATA_MALLOC(sizeof(size_t) * count);
+    if (tree->projection_depth == NULL) {
+        bjd_tree_flag_error(tree, bjd_error_memory);
+        return;
+    }
+    tree->projection = paths;
+    tree->projection_count = count;
+}
+#endif
+
 #if BJDATA_STDIO
 typedef struct bjd_file_tree_t {
     char* data;
@@ -1201,10 +2219,44 @@ void bjd_tree_init_filename(bjd_tree_t* tree, const char* filename, size_t max_b
 }
 #endif
 
+#if BJDATA_MMAP
+static void bjd_mmap_tree_teardown(bjd_tree_t* tree) {
+    bjd_file_map_t* map = (bjd_file_map_t*)tree->context;
+    bjd_file_unmap(map);
+    BJDATA_FREE(map);
+}
+
+void bjd_tree_init_mmap(bjd_tree_t* tree, const char* filename, unsigned flags) {
+    bjd_file_map_t* map = (bjd_file_map_t*)BJDATA_MALLOC(sizeof(bjd_file_map_t));
+    if (map == NULL) {
+        bjd_tree_init_error(tree, bjd_error_memory);
+        return;
+    }
+
+    bjd_error_t error = bjd_file_map(map, filename, flags);
+    if (error != bjd_ok) {
+        BJDATA_FREE(map);
+        bjd_tree_init_error(tree, error);
+        return;
+    }
+
+    bjd_tree_init_data(tree, (const char*)map->address, map->size);
+    bjd_tree_set_context(tree, map);
+    bjd_tree_set_teardown(tree, bjd_mmap_tree_teardown);
+}
+#endif
+
 bjd_error_t bjd_tree_destroy(bjd_tree_t* tree) {
+    #ifdef BJDATA_MALLOC
+    bjd_tree_check_resets(tree);
+    #endif
     bjd_tree_cleanup(tree);
 
     #ifdef BJDATA_MALLOC
+    bjd_tree_trim(tree);
+    bjd_tree_free_scratch(tree);
+    if (tree->projection_depth)
+        BJDATA_FREE(tree->projection_depth);
     if (tree->buffer)
         BJDATA_FREE(tree->buffer);
     #endif
@@ -1237,7 +2289,7 @@ void bjd_node_flag_error(bjd_node_t node, bjd_error_t error) {
 }
 
 bjd_tag_t bjd_node_tag(bjd_node_t node) {
-    if (bjd_node_error(node) != bjd_ok)
+    if (bjd_node_error(node) != bjd_ok || !bjd_node_expand(node))
         return bjd_tag_nil();
 
     bjd_tag_t tag = BJDATA_TAG_ZERO;
@@ -1267,8 +2319,14 @@ bjd_tag_t bjd_node_tag(bjd_node_t node) {
             break;
         #endif
 
-        case bjd_type_array:   tag.v.n = node.data->len;  break;
-        case bjd_type_map:     tag.v.n = node.data->len;  break;
+        case bjd_type_array:
+            tag.v.n = node.data->len;
+            tag.elemtype = node.data->elemtype;
+            break;
+        case bjd_type_map:
+            tag.v.n = node.data->len;
+            tag.elemtype = node.data->elemtype;
+            break;
 
         default:
             bjd_assert(0, "unrecognized type %i", (int)node.data->type);
@@ -1280,6 +2338,8 @@ bjd_tag_t bjd_node_tag(bjd_node_t node) {
 #if BJDATA_DEBUG && BJDATA_STDIO
 static void bjd_node_print_element(bjd_node_t node, bjd_print_t* print, size_t depth) {
     bjd_node_data_t* data = node.data;
+    if (!bjd_node_expand(node))
+        return;
     switch (data->type) {
         case bjd_type_str:
             {
@@ -1625,7 +2685,7 @@ char* bjd_node_data_alloc(bjd_node_t node, size_t maxlen) {
         return NULL;
     }
 
-    char* ret = (char*) BJDATA_MALLOC((size_t)node.data->len);
+    char* ret = (char*) bjd_allocator_malloc(node.tree->allocator, (size_t)node.data->len);
     if (ret == NULL) {
         bjd_node_flag_error(node, bjd_error_memory);
         return NULL;
@@ -1661,7 +2721,7 @@ char* bjd_node_cstr_alloc(bjd_node_t node, size_t maxlen) {
         return NULL;
     }
 
-    char* ret = (char*) BJDATA_MALLOC((size_t)(node.data->len + 1));
+    char* ret = (char*) bjd_allocator_malloc(node.tree->allocator, (size_t)(node.data->len + 1));
     if (ret == NULL) {
         bjd_node_flag_error(node, bjd_error_memory);
         return NULL;
@@ -1698,7 +2758,7 @@ char* bjd_node_utf8_cstr_alloc(bjd_node_t node, size_t maxlen) {
         return NULL;
     }
 
-    char* ret = (char*) BJDATA_MALLOC((size_t)(node.data->len + 1));
+    char* ret = (char*) bjd_allocator_malloc(node.tree->allocator, (size_t)(node.data->len + 1));
     if (ret == NULL) {
         bjd_node_flag_error(node, bjd_error_memory);
         return NULL;
@@ -1715,141 +2775,561 @@ char* bjd_node_utf8_cstr_alloc(bjd_node_t node, size_t maxlen) {
  * Compound Node Functions
  */
 
-static bjd_node_data_t* bjd_node_map_int_impl(bjd_node_t node, int64_t num) {
-    if (bjd_node_error(node) != bjd_ok)
+// Returns the packed payload of an optimized array. The payload offset of
+// an ND-array is stored in the first of its auxiliary nodes.
+BJDATA_STATIC_INLINE const char* bjd_node_typed_array_payload(bjd_node_t node) {
+    if (node.data->ndims != 0)
+        return node.tree->data + node.data->value.children[0].value.offset;
+    return node.tree->data + node.data->value.offset;
+}
+
+// Decodes a packed value of an optimized array or map into the given node.
+static void bjd_node_data_load(bjd_node_data_t* data, char marker, const char* p, bjd_endian_t endian) {
+    bjd_memset(data, 0, sizeof(*data));
+    switch (marker) {
+        case 'U': data->type = bjd_type_uint;   data->value.u = bjd_load_u8(p);                    break;
+        case 'u': data->type = bjd_type_uint;   data->value.u = bjd_load_u16_endian(p, endian);    break;
+        case 'm': data->type = bjd_type_uint;   data->value.u = bjd_load_u32_endian(p, endian);    break;
+        case 'M': data->type = bjd_type_uint;   data->value.u = bjd_load_u64_endian(p, endian);    break;
+        case 'i': data->type = bjd_type_int;    data->value.i = bjd_load_i8(p);                    break;
+        case 'I': data->type = bjd_type_int;    data->value.i = bjd_load_i16_endian(p, endian);    break;
+        case 'l': data->type = bjd_type_int;    data->value.i = bjd_load_i32_endian(p, endian);    break;
+        case 'L': data->type = bjd_type_int;    data->value.i = bjd_load_i64_endian(p, endian);    break;
+        case 'd': data->type = bjd_type_float;  data->value.f = bjd_load_float_endian(p, endian);  break;
+        case 'D': data->type = bjd_type_double; data->value.d = bjd_load_double_endian(p, endian); break;
+        default:
+            bjd_assert(0, "invalid element type %i", (int)marker);
+            data->type = bjd_type_nil;
+            break;
+    }
+}
+
+// Returns the key at the given index of a map.
+BJDATA_STATIC_INLINE bjd_node_data_t* bjd_node_map_key_data(bjd_node_t node, size_t index) {
+    return bjd_node_child(node, (node.data->elemtype != 0) ? index : index * 2);
+}
+
+static bjd_node_data_t* bjd_node_elements(bjd_node_t node);
+
+// Returns the value at the given index of a map. The values of an
+// optimized map are created as nodes on first access.
+static bjd_node_t bjd_node_map_value_node(bjd_node_t node, size_t index) {
+    if (node.data->elemtype == 0)
+        return bjd_node(node.tree, bjd_node_child(node, index * 2 + 1));
+    bjd_node_data_t* elements = bjd_node_elements(node);
+    if (elements == NULL)
+        return bjd_tree_nil_node(node.tree);
+    return bjd_node(node.tree, elements + index);
+}
+
+#ifdef BJDATA_MALLOC
+/*
+ * Map indexes
+ *
+ * Integer keys are compared by value regardless of whether they are signed,
+ * so they are hashed as a sign and a magnitude. Keys of other types can't be
+ * looked up so they are not indexed.
+ */
+
+typedef struct bjd_index_key_t {
+    bool str;
+    bool negative;
+    uint64_t u;
+    const char* data;
+    size_t len;
+} bjd_index_key_t;
+
+static uint64_t bjd_index_key_hash(const bjd_index_key_t* key) {
+    uint64_t hash;
+    if (key->str) {
+        // FNV-1a
+        hash = UINT64_C(0xcbf29ce484222325);
+        for (size_t i = 0; i < key->len; ++i) {
+            hash ^= (uint8_t)key->data[i];
+            hash *= UINT64_C(0x100000001b3);
+        }
+    } else {
+        // splitmix64 finalizer
+        hash = key->u ^ (key->negative ? UINT64_C(0x9e3779b97f4a7c15) : 0);
+        hash = (hash ^ (hash >> 30)) * UINT64_C(0xbf58476d1ce4e5b9);
+        hash = (hash ^ (hash >> 27)) * UINT64_C(0x94d049bb133111eb);
+        hash ^= hash >> 31;
+    }
+    return hash;
+}
+
+static bool bjd_index_key_equal(const bjd_index_key_t* left, const bjd_index_key_t* right) {
+    if (left->str != right->str)
+        return false;
+    if (left->str)
+        return left->len == right->len && bjd_memcmp(left->data, right->data, left->len) == 0;
+    return left->negative == right->negative && left->u == right->u;
+}
+
+// Fills in the index key of a key node, returning false if the node can't
+// be indexed.
+static bool bjd_index_key_of(bjd_tree_t* tree, bjd_node_data_t* node, bjd_index_key_t* key) {
+    switch (node->type) {
+        case bjd_type_str:
+            key->str = true;
+            key->data = bjd_node_data_unchecked(bjd_node(tree, node));
+            key->len = node->len;
+            return true;
+        case bjd_type_uint:
+            key->str = false;
+            key->negative = false;
+            key->u = node->value.u;
+            return true;
+        case bjd_type_int:
+            key->str = false;
+            key->negative = node->value.i < 0;
+            key->u = (uint64_t)node->value.i;
+            return true;
+        default:
+            return false;
+    }
+}
+
+BJDATA_STATIC_INLINE size_t bjd_index_hash_map(const bjd_node_data_t* map) {
+    uint64_t hash = (uint64_t)(uintptr_t)map * UINT64_C(0x9e3779b97f4a7c15);
+    return (size_t)(hash >> 32);
+}
+
+// Returns the registry entry for the given map, which is empty if the map
+// has no index.
+static bjd_map_index_t* bjd_index_entry(bjd_tree_t* tree, const bjd_node_data_t* map) {
+    size_t mask = tree->index_capacity - 1;
+    size_t i = bjd_index_hash_map(map) & mask;
+    while (tree->indexes[i].map != NULL && tree->indexes[i].map != map)
+        i = (i + 1) & mask;
+    return &tree->indexes[i];
+}
+
+// Makes room in the registry for one more index, keeping it at most half full.
+static bool bjd_index_reserve(bjd_tree_t* tree) {
+    if ((tree->index_count + 1) * 2 <= tree->index_capacity)
+        return true;
+
+    size_t old_capacity = tree->index_capacity;
+    bjd_map_index_t* old_indexes = tree->indexes;
+    size_t new_capacity = (old_capacity == 0) ? 16 : old_capacity * 2;
+
+    bjd_map_index_t* new_indexes = (bjd_map_index_t*)bjd_allocator_malloc(tree->allocator,
+            sizeof(bjd_map_index_t) * new_capacity);
+    if (new_indexes == NULL)
+        return false;
+    bjd_memset(new_indexes, 0, sizeof(bjd_map_index_t) * new_capacity);
+
+    tree->indexes = new_indexes;
+    tree->index_capacity = new_capacity;
+    for (size_t i = 0; i < old_capacity; ++i)
+        if (old_indexes[i].map != NULL)
+            *bjd_index_entry(tree, old_indexes[i].map) = old_indexes[i];
+
+    if (old_indexes != NULL)
+        bjd_allocator_free(tree->allocator, old_indexes);
+    return true;
+}
+
+// Returns the registry entry for the given container, adding it if it has
+// none. Returns NULL if the registry could not grow.
+static bjd_map_index_t* bjd_index_insert(bjd_tree_t* tree, const bjd_node_data_t* map) {
+    if (tree->index_capacity != 0) {
+        bjd_map_index_t* entry = bjd_index_entry(tree, map);
+        if (entry->map != NULL)
+            return entry;
+    }
+    if (!bjd_index_reserve(tree))
+        return NULL;
+    bjd_map_index_t* entry = bjd_index_entry(tree, map);
+    entry->map = map;
+    ++tree->index_count;
+    return entry;
+}
+
+// Builds the index of a map. Returns NULL if it could not be allocated.
+static bjd_map_index_t* bjd_index_build(bjd_tree_t* tree, bjd_node_data_t* map) {
+    bjd_assert(map->type == bjd_type_map);
+    if (map->len >= BJDATA_INDEX_DUPLICATE)
+        return NULL;
+    bjd_map_index_t* entry = bjd_index_insert(tree, map);
+    if (entry == NULL)
+        return NULL;
+
+    size_t capacity = 16;
+    while (capacity < (size_t)map->len * 2)
+        capacity *= 2;
+    uint32_t* slots = (uint32_t*)bjd_allocator_malloc(tree->allocator, sizeof(uint32_t) * capacity);
+    if (slots == NULL)
+        return NULL;
+    bjd_memset(slots, 0, sizeof(uint32_t) * capacity);
+
+    bjd_node_t node = bjd_node(tree, map);
+    size_t mask = capacity - 1;
+    for (size_t i = 0; i < map->len; ++i) {
+        bjd_index_key_t key;
+        if (!bjd_index_key_of(tree, bjd_node_map_key_data(node, i), &key))
+            continue;
+
+        size_t slot = (size_t)bjd_index_key_hash(&key) & mask;
+        while (slots[slot] != 0) {
+            bjd_index_key_t other;
+            bjd_node_data_t* other_data = bjd_node_map_key_data(node, (slots[slot] & ~BJDATA_INDEX_DUPLICATE) - 1);
+            bjd_index_key_of(tree, other_data, &other);
+            if (bjd_index_key_equal(&key, &other)) {
+                slots[slot] |= BJDATA_INDEX_DUPLICATE;
+                break;
+            }
+            slot = (slot + 1) & mask;
+        }
+        if (slots[slot] == 0)
+            slots[slot] = (uint32_t)(i + 1);
+    }
+
+    entry->slots = slots;
+    entry->mask = mask;
+    return entry;
+}
+
+// Returns the index of the given map, building it if the map is large
+// enough, or NULL if the map should be searched linearly.
+static bjd_map_index_t* bjd_node_map_index(bjd_node_t node) {
+    bjd_tree_t* tree = node.tree;
+    #if BJDATA_NODE_INDEX_MIN_SIZE > 0
+    bool lazy = node.data->len >= BJDATA_NODE_INDEX_MIN_SIZE;
+    #else
+    bool lazy = false;
+    #endif
+    if (!lazy && tree->index_count == 0)
+        return NULL;
+
+    if (tree->index_capacity != 0) {
+        bjd_map_index_t* entry = bjd_index_entry(tree, node.data);
+        if (entry->slots != NULL)
+            return entry;
+    }
+
+    // a failure to build the index is not an error since the map can
+    // still be searched
+    return lazy ? bjd_index_build(tree, node.data) : NULL;
+}
+
+// Finds the pair of the given key using the map's index, returning its index
+// or SIZE_MAX if it is not found. Flags an error if the key occurs more than
+// once.
+static size_t bjd_node_map_index_find(bjd_node_t node, bjd_map_index_t* index,
+        const bjd_index_key_t* key)
+{
+    size_t slot = (size_t)bjd_index_key_hash(key) & index->mask;
+    for (; index->slots[slot] != 0; slot = (slot + 1) & index->mask) {
+        uint32_t value = index->slots[slot];
+        size_t i = (value & ~BJDATA_INDEX_DUPLICATE) - 1;
+
+        bjd_index_key_t other;
+        bjd_index_key_of(node.tree, bjd_node_map_key_data(node, i), &other);
+        if (!bjd_index_key_equal(key, &other))
+            continue;
+
+        if (value & BJDATA_INDEX_DUPLICATE) {
+            bjd_node_flag_error(node, bjd_error_data);
+            return SIZE_MAX;
+        }
+        return i;
+    }
+    return SIZE_MAX;
+}
+
+void bjd_tree_build_index(bjd_tree_t* tree, size_t min_map_size) {
+    if (bjd_tree_error(tree) != bjd_ok)
+        return;
+    if (tree->parser.state != bjd_tree_parse_state_parsed) {
+        bjd_break("Tree has not been parsed!");
+        bjd_tree_flag_error(tree, bjd_error_bug);
+        return;
+    }
+
+    // walk the tree depth-first with an explicit stack of containers
+    size_t capacity = BJDATA_NODE_INITIAL_DEPTH;
+    size_t count = 0;
+    bjd_node_data_t** stack = (bjd_node_data_t**)bjd_allocator_malloc(tree->allocator,
+            sizeof(bjd_node_data_t*) * capacity);
+    if (stack == NULL) {
+        bjd_tree_flag_error(tree, bjd_error_memory);
+        return;
+    }
+    stack[count++] = tree->root;
+
+    while (count > 0) {
+        bjd_node_data_t* data = stack[--count];
+        bjd_node_t node = bjd_node(tree, data);
+        if (!bjd_node_expand(node))
+            break;
+
+        if (data->type == bjd_type_map && data->len > 0 && data->len >= min_map_size &&
+                (tree->index_capacity == 0 || bjd_index_entry(tree, data)->slots == NULL))
+        {
+            if (bjd_index_build(tree, data) == NULL) {
+                bjd_tree_flag_error(tree, bjd_error_memory);
+                break;
+            }
+        }
+
+        // only plain containers have children that may be containers
+        if (data->type != bjd_type_array && data->type != bjd_type_map)
+            continue;
+        if (data->elemtype != 0)
+            continue;
+
+        size_t children = (data->type == bjd_type_map) ? (size_t)data->len * 2 : data->len;
+        if (count + children > capacity) {
+            size_t new_capacity = capacity * 2;
+            while (new_capacity < count + children)
+                new_capacity *= 2;
+            bjd_node_data_t** new_stack = (bjd_node_data_t**)bjd_allocator_realloc(tree->allocator, stack,
+                    sizeof(bjd_node_data_t*) * count, sizeof(bjd_node_data_t*) * new_capacity);
+            if (new_stack == NULL) {
+                bjd_tree_flag_error(tree, bjd_error_memory);
+                break;
+            }
+            stack = new_stack;
+            capacity = new_capacity;
+        }
+        for (size_t i = 0; i < children; ++i)
+            stack[count++] = bjd_node_child(node, i);
+    }
+
+    bjd_allocator_free(tree->allocator, stack);
+}
+#endif
+
+// Returns the nodes of the packed values of an optimized array or map,
+// decoding all of them into nodes allocated in the tree the first time any
+// is accessed. Returns NULL if an error was flagged.
+static bjd_node_data_t* bjd_node_elements(bjd_node_t node) {
+    #ifdef BJDATA_MALLOC
+    bjd_tree_t* tree = node.tree;
+    if (tree->index_capacity != 0) {
+        bjd_map_index_t* entry = bjd_index_entry(tree, node.data);
+        if (entry->elements != NULL)
+            return entry->elements;
+    }
+
+    // the elements count against the node limit, as the children of a
+    // lazily parsed container do when it is expanded
+    size_t count = node.data->len;
+    bjd_assert(count > 0, "optimized container has no elements");
+    tree->node_count += count;
+    if (tree->node_count > tree->max_nodes) {
+        bjd_tree_flag_error(tree, bjd_error_too_big);
+        return NULL;
+    }
+
+    bjd_map_index_t* entry = bjd_index_insert(tree, node.data);
+    if (entry == NULL) {
+        bjd_tree_flag_error(tree, bjd_error_memory);
+        return NULL;
+    }
+    bjd_node_data_t* elements = bjd_tree_alloc_nodes(tree, count);
+    if (elements == NULL)
         return NULL;
 
+    char marker = node.data->elemtype;
+    if (node.data->type == bjd_type_array) {
+        const char* p = bjd_node_typed_array_payload(node);
+        size_t size = bjd_typed_marker_size(marker);
+        for (size_t i = 0; i < count; ++i)
+            bjd_node_data_load(elements + i, marker, p + i * size, tree->endian);
+    } else {
+        // the packed value of a key of an optimized map follows its data
+        for (size_t i = 0; i < count; ++i) {
+            bjd_node_data_t* key = bjd_node_child(node, i);
+            bjd_node_data_load(elements + i, marker,
+                    tree->data + key->value.offset + key->len, tree->endian);
+        }
+    }
+
+    entry->elements = elements;
+    return elements;
+    #else
+    bjd_node_flag_error(node, bjd_error_unsupported);
+    return NULL;
+    #endif
+}
+
+// The map lookups return the index of the pair with the given key, or
+// SIZE_MAX if it is not found or an error occurs.
+
+static size_t bjd_node_map_int_impl(bjd_node_t node, int64_t num) {
+    if (bjd_node_error(node) != bjd_ok)
+        return SIZE_MAX;
+
     if (node.data->type != bjd_type_map) {
         bjd_node_flag_error(node, bjd_error_type);
-        return NULL;
+        return SIZE_MAX;
+    }
+
+    if (!bjd_node_expand(node))
+        return SIZE_MAX;
+
+    #ifdef BJDATA_MALLOC
+    bjd_map_index_t* index = bjd_node_map_index(node);
+    if (index != NULL) {
+        bjd_index_key_t key;
+        key.str = false;
+        key.negative = num < 0;
+        key.u = (uint64_t)num;
+        return bjd_node_map_index_find(node, index, &key);
     }
+    #endif
 
-    bjd_node_data_t* found = NULL;
+    size_t found = SIZE_MAX;
 
     for (size_t i = 0; i < node.data->len; ++i) {
-        bjd_node_data_t* key = bjd_node_child(node, i * 2);
+        bjd_node_data_t* key = bjd_node_map_key_data(node, i);
 
         if ((key->type == bjd_type_int && key->value.i == num) ||
             (key->type == bjd_type_uint && num >= 0 && key->value.u == (uint64_t)num))
         {
-            if (found) {
+            if (found != SIZE_MAX) {
                 bjd_node_flag_error(node, bjd_error_data);
-                return NULL;
+                return SIZE_MAX;
             }
-            found = bjd_node_child(node, i * 2 + 1);
+            found = i;
         }
     }
 
-    if (found)
-        return found;
-
-    return NULL;
+    return found;
 }
 
-static bjd_node_data_t* bjd_node_map_uint_impl(bjd_node_t node, uint64_t num) {
+static size_t bjd_node_map_uint_impl(bjd_node_t node, uint64_t num) {
     if (bjd_node_error(node) != bjd_ok)
-        return NULL;
+        return SIZE_MAX;
 
     if (node.data->type != bjd_type_map) {
         bjd_node_flag_error(node, bjd_error_type);
-        return NULL;
+        return SIZE_MAX;
+    }
+
+    if (!bjd_node_expand(node))
+        return SIZE_MAX;
+
+    #ifdef BJDATA_MALLOC
+    bjd_map_index_t* index = bjd_node_map_index(node);
+    if (index != NULL) {
+        bjd_index_key_t key;
+        key.str = false;
+        key.negative = false;
+        key.u = num;
+        return bjd_node_map_index_find(node, index, &key);
     }
+    #endif
 
-    bjd_node_data_t* found = NULL;
+    size_t found = SIZE_MAX;
 
     for (size_t i = 0; i < node.data->len; ++i) {
-        bjd_node_data_t* key = bjd_node_child(node, i * 2);
+        bjd_node_data_t* key = bjd_node_map_key_data(node, i);
 
         if ((key->type == bjd_type_uint && key->value.u == num) ||
             (key->type == bjd_type_int && key->value.i >= 0 && (uint64_t)key->value.i == num))
         {
-            if (found) {
+            if (found != SIZE_MAX) {
                 bjd_node_flag_error(node, bjd_error_data);
-                return NULL;
+                return SIZE_MAX;
             }
-            found = bjd_node_child(node, i * 2 + 1);
+            found = i;
         }
     }
 
-    if (found)
-        return found;
-
-    return NULL;
+    return found;
 }
 
-static bjd_node_data_t* bjd_node_map_str_impl(bjd_node_t node, const char* str, size_t length) {
+static size_t bjd_node_map_str_impl(bjd_node_t node, const char* str, size_t length) {
     if (bjd_node_error(node) != bjd_ok)
-        return NULL;
+        return SIZE_MAX;
 
     bjd_assert(length == 0 || str != NULL, "str of length %i is NULL", (int)length);
 
     if (node.data->type != bjd_type_map) {
         bjd_node_flag_error(node, bjd_error_type);
-        return NULL;
+        return SIZE_MAX;
     }
 
+    if (!bjd_node_expand(node))
+        return SIZE_MAX;
+
     bjd_tree_t* tree = node.tree;
-    bjd_node_data_t* found = NULL;
+
+    #ifdef BJDATA_MALLOC
+    bjd_map_index_t* index = bjd_node_map_index(node);
+    if (index != NULL) {
+        bjd_index_key_t key;
+        key.str = true;
+        key.data = str;
+        key.len = length;
+        return bjd_node_map_index_find(node, index, &key);
+    }
+    #endif
+
+    size_t found = SIZE_MAX;
 
     for (size_t i = 0; i < node.data->len; ++i) {
-        bjd_node_data_t* key = bjd_node_child(node, i * 2);
+        bjd_node_data_t* key = bjd_node_map_key_data(node, i);
 
         if (key->type == bjd_type_str && key->len == length &&
                 bjd_memcmp(str, bjd_node_data_unchecked(bjd_node(tree, key)), length) == 0) {
-            if (found) {
+            if (found != SIZE_MAX) {
                 bjd_node_flag_error(node, bjd_error_data);
-                return NULL;
+                return SIZE_MAX;
             }
-            found = bjd_node_child(node, i * 2 + 1);
+            found = i;
         }
     }
 
-    if (found)
-        return found;
-
-    return NULL;
+    return found;
 }
 
-static bjd_node_t bjd_node_wrap_lookup(bjd_tree_t* tree, bjd_node_data_t* data) {
-    if (!data) {
+static bjd_node_t bjd_node_wrap_lookup(bjd_node_t node, size_t index) {
+    bjd_tree_t* tree = node.tree;
+    if (index == SIZE_MAX) {
         if (tree->error == bjd_ok)
             bjd_tree_flag_error(tree, bjd_error_data);
         return bjd_tree_nil_node(tree);
     }
-    return bjd_node(tree, data);
+    return bjd_node_map_value_node(node, index);
 }
 
-static bjd_node_t bjd_node_wrap_lookup_optional(bjd_tree_t* tree, bjd_node_data_t* data) {
-    if (!data) {
+static bjd_node_t bjd_node_wrap_lookup_optional(bjd_node_t node, size_t index) {
+    bjd_tree_t* tree = node.tree;
+    if (index == SIZE_MAX) {
         if (tree->error == bjd_ok)
             return bjd_tree_missing_node(tree);
         return bjd_tree_nil_node(tree);
     }
-    return bjd_node(tree, data);
+    return bjd_node_map_value_node(node, index);
 }
 
 bjd_node_t bjd_node_map_int(bjd_node_t node, int64_t num) {
-    return bjd_node_wrap_lookup(node.tree, bjd_node_map_int_impl(node, num));
+    return bjd_node_wrap_lookup(node, bjd_node_map_int_impl(node, num));
 }
 
 bjd_node_t bjd_node_map_int_optional(bjd_node_t node, int64_t num) {
-    return bjd_node_wrap_lookup_optional(node.tree, bjd_node_map_int_impl(node, num));
+    return bjd_node_wrap_lookup_optional(node, bjd_node_map_int_impl(node, num));
 }
 
 bjd_node_t bjd_node_map_uint(bjd_node_t node, uint64_t num) {
-    return bjd_node_wrap_lookup(node.tree, bjd_node_map_uint_impl(node, num));
+    return bjd_node_wrap_lookup(node, bjd_node_map_uint_impl(node, num));
 }
 
 bjd_node_t bjd_node_map_uint_optional(bjd_node_t node, uint64_t num) {
-    return bjd_node_wrap_lookup_optional(node.tree, bjd_node_map_uint_impl(node, num));
+    return bjd_node_wrap_lookup_optional(node, bjd_node_map_uint_impl(node, num));
 }
 
 bjd_node_t bjd_node_map_str(bjd_node_t node, const char* str, size_t length) {
-    return bjd_node_wrap_lookup(node.tree, bjd_node_map_str_impl(node, str, length));
+    return bjd_node_wrap_lookup(node, bjd_node_map_str_impl(node, str, length));
 }
 
 bjd_node_t bjd_node_map_str_optional(bjd_node_t node, const char* str, size_t length) {
-    return bjd_node_wrap_lookup_optional(node.tree, bjd_node_map_str_impl(node, str, length));
+    return bjd_node_wrap_lookup_optional(node, bjd_node_map_str_impl(node, str, length));
 }
 
 bjd_node_t bjd_node_map_cstr(bjd_node_t node, const char* cstr) {
@@ -1863,15 +3343,15 @@ bjd_node_t bjd_node_map_cstr_optional(bjd_node_t node, const char* cstr) {
 }
 
 bool bjd_node_map_contains_int(bjd_node_t node, int64_t num) {
-    return bjd_node_map_int_impl(node, num) != NULL;
+    return bjd_node_map_int_impl(node, num) != SIZE_MAX;
 }
 
 bool bjd_node_map_contains_uint(bjd_node_t node, uint64_t num) {
-    return bjd_node_map_uint_impl(node, num) != NULL;
+    return bjd_node_map_uint_impl(node, num) != SIZE_MAX;
 }
 
 bool bjd_node_map_contains_str(bjd_node_t node, const char* str, size_t length) {
-    return bjd_node_map_str_impl(node, str, length) != NULL;
+    return bjd_node_map_str_impl(node, str, length) != SIZE_MAX;
 }
 
 bool bjd_node_map_contains_cstr(bjd_node_t node, const char* cstr) {
@@ -2281,6 +3761,8 @@ size_t bjd_node_array_length(bjd_node_t node) {
         return 0;
     }
 
+    if (!bjd_node_expand(node))
+        return 0;
     return (size_t)node.data->len;
 }
 
@@ -2293,14 +3775,106 @@ bjd_node_t bjd_node_array_at(bjd_node_t node, size_t index) {
         return bjd_tree_nil_node(node.tree);
     }
 
+    if (!bjd_node_expand(node))
+        return bjd_tree_nil_node(node.tree);
+
     if (index >= node.data->len) {
         bjd_node_flag_error(node, bjd_error_data);
         return bjd_tree_nil_node(node.tree);
     }
 
+    if (node.data->elemtype != 0) {
+        bjd_node_data_t* elements = bjd_node_elements(node);
+        if (elements == NULL)
+            return bjd_tree_nil_node(node.tree);
+        return bjd_node(node.tree, elements + index);
+    }
+
     return bjd_node(node.tree, bjd_node_child(node, index));
 }
 
+char bjd_node_typed_array_type(bjd_node_t node) {
+    if (bjd_node_error(node) != bjd_ok)
+        return 0;
+
+    if (node.data->type != bjd_type_array) {
+        bjd_node_flag_error(node, bjd_error_type);
+        return 0;
+    }
+
+    return node.data->elemtype;
+}
+
+const char* bjd_node_typed_array_data(bjd_node_t node) {
+    if (bjd_node_error(node) != bjd_ok)
+        return NULL;
+
+    if (node.data->type != bjd_type_array || node.data->elemtype == 0) {
+        bjd_node_flag_error(node, bjd_error_type);
+        return NULL;
+    }
+
+    return bjd_node_typed_array_payload(node);
+}
+
+// Decodes the element at the given index of an optimized array into the
+// given node, returning false if an error was flagged.
+static bool bjd_node_typed_array_load(bjd_node_t node, size_t index, bjd_node_data_t* element) {
+    const char* data = bjd_node_typed_array_data(node);
+    if (data == NULL)
+        return false;
+
+    if (index >= node.data->len) {
+        bjd_node_flag_error(node, bjd_error_data);
+        return false;
+    }
+
+    char marker = node.data->elemtype;
+    bjd_node_data_load(element, marker, data + index * bjd_typed_marker_size(marker), node.tree->endian);
+    return true;
+}
+
+uint64_t bjd_node_typed_array_u64_at(bjd_node_t node, size_t index) {
+    bjd_node_data_t element;
+    if (!bjd_node_typed_array_load(node, index, &element))
+        return 0;
+    return bjd_node_u64(bjd_node(node.tree, &element));
+}
+
+int64_t bjd_node_typed_array_i64_at(bjd_node_t node, size_t index) {
+    bjd_node_data_t element;
+    if (!bjd_node_typed_array_load(node, index, &element))
+        return 0;
+    return bjd_node_i64(bjd_node(node.tree, &element));
+}
+
+double bjd_node_typed_array_double_at(bjd_node_t node, size_t index) {
+    bjd_node_data_t element;
+    if (!bjd_node_typed_array_load(node, index, &element))
+        return 0.0;
+    return bjd_node_double(bjd_node(node.tree, &element));
+}
+
+void bjd_node_ndarray_view(bjd_node_t node, bjd_ndarray_view_t* view) {
+    bjd_memset(view, 0, sizeof(*view));
+
+    const char* data = bjd_node_typed_array_data(node);
+    if (data == NULL)
+        return;
+
+    uint32_t dims[BJDATA_NDARRAY_MAX_DIMS];
+    size_t ndims = node.data->ndims;
+    if (ndims == 0) {
+        dims[0] = node.data->len;
+        ndims = 1;
+    } else {
+        for (size_t i = 0; i < ndims; ++i)
+            dims[i] = (uint32_t)node.data->value.children[i + 1].value.u;
+    }
+
+    bjd_ndarray_view_init(view, node.data->elemtype, dims, ndims, data, node.tree->endian);
+}
+
 size_t bjd_node_map_count(bjd_node_t node) {
     if (bjd_node_error(node) != bjd_ok)
         return 0;
@@ -2310,6 +3884,8 @@ size_t bjd_node_map_count(bjd_node_t node) {
         return 0;
     }
 
+    if (!bjd_node_expand(node))
+        return 0;
     return node.data->len;
 }
 
@@ -2323,12 +3899,17 @@ static bjd_node_t bjd_node_map_at(bjd_node_t node, size_t index, size_t offset)
         return bjd_tree_nil_node(node.tree);
     }
 
+    if (!bjd_node_expand(node))
+        return bjd_tree_nil_node(node.tree);
+
     if (index >= node.data->len) {
         bjd_node_flag_error(node, bjd_error_data);
         return bjd_tree_nil_node(node.tree);
     }
 
-    return bjd_node(node.tree, bjd_node_child(node, index * 2 + offset));
+    if (offset == 0)
+        return bjd_node(node.tree, bjd_node_map_key_data(node, index));
+    return bjd_node_map_value_node(node, index);
 }
 
 bjd_node_t bjd_node_map_key_at(bjd_node_t node, size_t index) {
@@ -68,8 +68,7 @@ typedef struct bjd_node_t bjd_node_t;
  * You only need to use this if you intend to provide your own storage
  * for nodes instead of letting the tree allocate it.
  *
- * @ref bjd_node_data_t is 16 bytes on most common architectures (32-bit
- * and 64-bit.)
+ * @ref bjd_node_data_t is 24 bytes on most common 64-bit architectures.
  */
 typedef struct bjd_node_data_t bjd_node_data_t;
 
@@ -140,13 +139,56 @@ typedef void (*bjd_tree_teardown_t)(bjd_tree_t* tree);
 /* Hide internals from documentation */
 /** @cond */
 
+typedef union bjd_node_value_t {
+    bool     b; /* The value if the type is bool. */
+    float    f; /* The value if the type is float. */
+    double   d; /* The value if the type is double. */
+    int64_t  i; /* The value if the type is signed int. */
+    uint64_t u; /* The value if the type is unsigned int. */
+    size_t offset; /* The byte offset for str, bin and ext */
+    bjd_node_data_t* children; /* The children for map or array */
+} bjd_node_value_t;
+
 struct bjd_node_t {
     bjd_node_data_t* data;
     bjd_tree_t* tree;
 };
 
+/*
+ * The stored type of a node. With BJDATA_COMPACT_NODES it is narrowed to a
+ * byte so that, together with the element type and dimensions, it shares
+ * the first four bytes with nothing wasted on padding.
+ */
+#if BJDATA_COMPACT_NODES
+typedef uint8_t bjd_node_type_t;
+#else
+typedef bjd_type_t bjd_node_type_t;
+#endif
+
 struct bjd_node_data_t {
-    bjd_type_t type;
+    bjd_node_type_t type;
+
+    /*
+     * The element type marker if the type is an optimized array, in which
+     * case value.offset is the byte offset of its packed payload; or if the
+     * type is an optimized map, in which case the children are only its
+     * keys, each followed in the data by its packed value; 0 otherwise.
+     */
+    char elemtype;
+
+    /*
+     * The number of dimensions if the type is an optimized ND-array, in
+     * which case value.children points to ndims + 1 auxiliary nodes: the
+     * first holds the payload offset, and the rest each dimension.
+     */
+    uint8_t ndims;
+
+    /*
+     * Whether the type is a map or array of a lazily parsed tree whose
+     * children have not been parsed yet, in which case value.offset is the
+     * byte offset of its first child. See bjd_tree_parse_lazy().
+     */
+    bool lazy;
 
     /*
      * The element count if the type is an array;
@@ -155,20 +197,12 @@ struct bjd_node_data_t {
      */
     uint32_t len;
 
-    union
-    {
-        bool     b; /* The value if the type is bool. */
-        float    f; /* The value if the type is float. */
-        double   d; /* The value if the type is double. */
-        int64_t  i; /* The value if the type is signed int. */
-        uint64_t u; /* The value if the type is unsigned int. */
-        size_t offset; /* The byte offset for str, bin and ext */
-        bjd_node_data_t* children; /* The children for map or array */
-    } value;
+    bjd_node_value_t value;
 };
 
 typedef struct bjd_tree_page_t {
     struct bjd_tree_page_t* next;
+    size_t count; // number of nodes in the page
     bjd_node_data_t nodes[1]; // variable size
 } bjd_tree_page_t;
 
@@ -178,9 +212,20 @@ typedef enum bjd_tree_parse_state_t {
     bjd_tree_parse_state_parsed,
 } bjd_tree_parse_state_t;
 
+#ifdef BJDATA_MALLOC
+typedef struct bjd_map_index_t bjd_map_index_t;
+#endif
+
 typedef struct bjd_level_t {
     bjd_node_data_t* child;
     size_t left; // children left in level
+    char elemtype; // the packed value type if the level is an optimized map
+    char end; // the closing marker if the level is an unsized container, 0 otherwise
+    bool reserved; // whether the next marker of an unsized level has been reserved
+    size_t start; // index of the first child of an unsized level in unsized_nodes
+    bool projected; // whether the level only keeps the children selected by the projection
+    bool map; // whether a projected level is a map
+    size_t index; // the number of children read in a projected level
 } bjd_level_t;
 
 typedef struct bjd_tree_parser_t {
@@ -212,6 +257,10 @@ typedef struct bjd_tree_parser_t {
     size_t current_node_reserved;
     size_t level;
 
+    // Whether the children of containers are left to be parsed on first
+    // access. See bjd_tree_parse_lazy().
+    bool lazy;
+
     #ifdef BJDATA_MALLOC
     // It's much faster to allocate the initial parsing stack inline within the
     // parser. We replace it with a heap allocation if we need to grow it.
@@ -219,6 +268,19 @@ typedef struct bjd_tree_parser_t {
     size_t stack_capacity;
     bool stack_owned;
     bjd_level_t stack_local[BJDATA_NODE_INITIAL_DEPTH];
+
+    // The children of unsized containers are not known in advance, so they
+    // are parsed into this scratch buffer and moved to contiguous nodes when
+    // their closing marker is reached. Open unsized containers share it as a
+    // stack of children.
+    bjd_node_data_t* unsized_nodes;
+    size_t unsized_count;
+    size_t unsized_capacity;
+
+    // Whether the message is parsed with the projection of the tree. The
+    // children of projected containers are gathered like those of unsized
+    // containers, keeping only those selected by the projection.
+    bool projecting;
     #else
     // Without malloc(), we have to reserve a parsing stack the maximum allowed
     // parsing depth.
@@ -235,6 +297,7 @@ struct bjd_tree_t {
     bjd_node_data_t nil_node;     /* a nil node to be returned in case of error */
     bjd_node_data_t missing_node; /* a missing node to be returned in optional lookups */
     bjd_error_t error;
+    bjd_endian_t endian; /* byte order of multi-byte numbers */
 
     #ifdef BJDATA_MALLOC
     char* buffer;
@@ -258,6 +321,33 @@ struct bjd_tree_t {
 
     #ifdef BJDATA_MALLOC
     bjd_tree_page_t* next;
+
+    // pages kept from previous parses for reuse
+    bjd_tree_page_t* free_pages;
+    size_t free_size;
+    size_t page_cache_size;
+
+    // hash indexes of maps and the element nodes of optimized arrays and
+    // maps, in an open-addressed table keyed by container node
+    bjd_map_index_t* indexes;
+    size_t index_capacity;
+    size_t index_count;
+
+    // the ends of the larger containers of a lazily parsed message, so that
+    // deferring a container doesn't rescan it
+    bjd_skip_index_t lazy_index;
+
+    // the resets of the allocator when the tree last checked, to drop the
+    // memory it kept from an arena that has been reset since
+    size_t allocator_resets;
+
+    // the paths selecting the parts of a message to parse, and the number
+    // of steps of each matched by the value being parsed
+    const bjd_path_t* projection;
+    size_t projection_count;
+    size_t* projection_depth;
+
+    const bjd_allocator_t* allocator; // allocator for tree allocations, or NULL
     #endif
 };
 
@@ -413,6 +503,28 @@ BJDATA_INLINE void bjd_tree_init_file(bjd_tree_t* tree, const char* filename, si
 void bjd_tree_init_stdfile(bjd_tree_t* tree, FILE* stdfile, size_t max_bytes, bool close_when_done);
 #endif
 
+#if BJDATA_MMAP
+/**
+ * Initializes a tree to parse the given file by mapping it read-only into
+ * memory. The tree must be destroyed with bjd_tree_destroy(), even if
+ * parsing fails.
+ *
+ * The tree parses directly over the mapping, so strings and binary data
+ * of nodes point into the file's pages and the file is never copied. The
+ * mapping is released by bjd_tree_destroy(). The file must not be
+ * modified or truncated while the tree is in use.
+ *
+ * @ref bjd_error_io is flagged if the file cannot be opened or mapped, and
+ * @ref bjd_error_invalid if it is empty.
+ *
+ * @param tree The tree to initialize
+ * @param filename The path of the file to map
+ * @param flags A combination of @ref bjd_mmap_flags_t hints, or 0. They
+ *        are ignored where not supported.
+ */
+void bjd_tree_init_mmap(bjd_tree_t* tree, const char* filename, unsigned flags);
+#endif
+
 /**
  * @}
  */
@@ -439,6 +551,109 @@ void bjd_tree_init_stdfile(bjd_tree_t* tree, FILE* stdfile, size_t max_bytes, bo
 void bjd_tree_set_limits(bjd_tree_t* tree, size_t max_message_size,
         size_t max_message_nodes);
 
+#ifdef BJDATA_MALLOC
+/**
+ * Sets the maximum total size in bytes of the node pages the tree keeps
+ * for reuse when it parses another message. The default is
+ * @ref BJDATA_NODE_PAGE_CACHE_SIZE.
+ *
+ * Pages beyond this size are freed when the next message is parsed. Pass
+ * 0 to free all pages as soon as they are no longer needed.
+ *
+ * @param tree The tree parser
+ * @param size The maximum size in bytes of kept pages
+ *
+ * @see bjd_tree_trim()
+ */
+void bjd_tree_set_page_cache_size(bjd_tree_t* tree, size_t size);
+
+/**
+ * Frees the node pages and parsing scratch space the tree keeps for reuse
+ * across messages. The current message is not affected.
+ *
+ * This can be used to give back memory while a stream is idle.
+ *
+ * @param tree The tree parser
+ */
+void bjd_tree_trim(bjd_tree_t* tree);
+
+/**
+ * Sets the paths of the values to keep when parsing messages, so that
+ * only the parts of a message on or below these paths are turned into
+ * nodes. Pass a count of 0 to parse whole messages again.
+ *
+ * Pairs of a map whose keys are not on any path are dropped, so they are
+ * missing to lookups such as bjd_node_map_cstr_optional(). Elements of an
+ * array whose indices are not on any path are kept as nodes of type
+ * @ref bjd_type_missing so that the indices of the others do not change.
+ * Values that are dropped are still checked by a fast structural scan;
+ * nesting in them deeper than @ref BJDATA_SCAN_MAX_DEPTH flags
+ * @ref bjd_error_too_big.
+ *
+ * Only messages in memory, as with @ref bjd_tree_init_data() or
+ * @ref bjd_tree_init_mmap(), are projected. Messages read from a stream
+ * are parsed whole. While a projection is set, bjd_tree_parse_lazy() and
+ * bjd_tree_parse_parallel() parse messages eagerly and serially as
+ * bjd_tree_parse() does, with the projection applied.
+ *
+ * Flags @ref bjd_error_memory if the projection could not be allocated.
+ *
+ * @param tree The tree parser
+ * @param paths The compiled paths to keep. They are not copied, so they
+ *        must remain valid as long as the tree parses messages.
+ * @param count The number of paths
+ *
+ * @see bjd_path_compile()
+ */
+void bjd_tree_set_projection(bjd_tree_t* tree, const bjd_path_t* paths,
+        size_t count);
+#endif
+
+/**
+ * Sets the byte order of multi-byte numbers in the messages to parse.
+ *
+ * The default is @ref bjd_endian_little, as specified by BJData Draft 2.
+ * Use @ref bjd_endian_big to parse UBJSON or data from earlier drafts of
+ * BJData.
+ *
+ * This must be called before bjd_tree_parse(). It also applies to the
+ * elements decoded from typed arrays and ND-array views of the tree.
+ *
+ * @param tree The tree parser
+ * @param endian The byte order of the data
+ */
+BJDATA_INLINE void bjd_tree_set_endian(bjd_tree_t* tree, bjd_endian_t endian) {
+    tree->endian = endian;
+}
+
+#ifdef BJDATA_MALLOC
+/**
+ * Sets the allocator for the memory the tree allocates while parsing: node
+ * pages, the parsing stack and map indexes. It is also used for the data
+ * returned by bjd_node_data_alloc() and similar functions. Pass NULL to use
+ * @ref BJDATA_MALLOC. The buffer of a stream tree and the state of a
+ * projection outlive messages, so they always use @ref BJDATA_MALLOC.
+ *
+ * Parsing small messages into a tree backed by a @ref bjd_arena_t that is
+ * reset after each message avoids most calls to malloc() and free(). The
+ * tree can be kept across resets: the next parse notices the reset and
+ * drops the pages and scratch space it kept rather than reusing them. The
+ * nodes of a message (and data allocated from them) must not be used once
+ * the arena is reset.
+ *
+ * This must be called before bjd_tree_parse(). The data read by file
+ * trees on init is not affected.
+ *
+ * @param tree The tree parser
+ * @param allocator The allocator, which must outlive the tree
+ */
+BJDATA_INLINE void bjd_tree_set_allocator(bjd_tree_t* tree, const bjd_allocator_t* allocator) {
+    bjd_assert(tree->parser.state == bjd_tree_parse_state_not_started,
+            "cannot change the allocator after parsing has started");
+    tree->allocator = allocator;
+}
+#endif
+
 /**
  * Parses a Binary JData message into a tree of immutable nodes.
  *
@@ -482,6 +697,85 @@ void bjd_tree_parse(bjd_tree_t* tree);
  */
 bool bjd_tree_try_parse(bjd_tree_t* tree);
 
+#ifdef BJDATA_MALLOC
+/**
+ * Parses a Binary JData message into a tree of immutable nodes, using up to
+ * the given number of threads if the message is a large array.
+ *
+ * The elements of a top-level array (sized or unsized) are split into
+ * ranges of roughly equal size by a fast structural scan, and each range is
+ * parsed on its own thread directly into the children of the root node. The
+ * resulting tree is the same as with bjd_tree_parse(), and so are any
+ * errors.
+ *
+ * The whole message must be in memory, as with @ref bjd_tree_init_data() or
+ * @ref bjd_tree_init_mmap(). Messages of other types, streams, trees with a
+ * node pool or an allocator set with bjd_tree_set_allocator() (which need
+ * not be thread-safe, as a @ref bjd_arena_t is not) and messages smaller
+ * than @ref BJDATA_NODE_PARALLEL_MIN_SIZE per thread are parsed on the
+ * calling thread. This is also the case if @ref BJDATA_THREADS is disabled,
+ * which it is by default.
+ *
+ * @param tree The tree parser
+ * @param nthreads The maximum number of threads to use, including the
+ *        calling thread
+ *
+ * @see bjd_tree_parse()
+ */
+void bjd_tree_parse_parallel(bjd_tree_t* tree, size_t nthreads);
+#endif
+
+/**
+ * Parses a Binary JData message into a tree of immutable nodes whose maps
+ * and arrays are only expanded when they are first accessed.
+ *
+ * The whole message is scanned once to check its structure and to record
+ * the ends of its containers of at least @ref BJDATA_NODE_LAZY_INDEX_MIN_SIZE
+ * bytes, but only the root node is parsed. The children of a map or array are parsed on the first
+ * call that needs them (such as bjd_node_array_at(), bjd_node_map_cstr()
+ * or bjd_node_array_length()), leaving any containers among them to be
+ * expanded in turn. Parts of a message that are never accessed are never
+ * turned into nodes.
+ *
+ * Malformed data is reported by this call as with bjd_tree_parse(), but
+ * errors that depend on the contents of a container rather than its
+ * structure, such as exceeding the node limit set by bjd_tree_set_limits(),
+ * are only flagged on the tree when the container is expanded. Expanding
+ * a container modifies the tree, so a lazily parsed tree must not be
+ * accessed from multiple threads at once.
+ *
+ * The whole message must be in memory, as with @ref bjd_tree_init_data()
+ * or @ref bjd_tree_init_mmap(). A tree reading from a stream is parsed
+ * with bjd_tree_parse() instead.
+ *
+ * @see bjd_tree_parse()
+ */
+void bjd_tree_parse_lazy(bjd_tree_t* tree);
+
+#ifdef BJDATA_MALLOC
+/**
+ * Builds hash indexes for all maps in the tree with at least the given
+ * number of keys, so that key lookups in them (such as with
+ * bjd_node_map_cstr()) take constant time rather than scanning all keys.
+ *
+ * Call this after the tree is parsed and before reading it. If
+ * @ref BJDATA_NODE_INDEX_MIN_SIZE is set, maps with at least that many keys
+ * are also indexed on their first lookup. The indexes are owned by the
+ * tree and freed when the next message is parsed or when the tree is
+ * destroyed. All containers of a tree parsed with bjd_tree_parse_lazy()
+ * are expanded.
+ *
+ * Lookups only read the indexes, so a tree indexed this way can be read
+ * from multiple threads at once.
+ *
+ * Flags @ref bjd_error_memory if the indexes could not be allocated.
+ *
+ * @param tree The parsed tree
+ * @param min_map_size The minimum number of keys of a map to index it
+ */
+void bjd_tree_build_index(bjd_tree_t* tree, size_t min_map_size);
+#endif
+
 /**
  * Returns the root node of the tree, if the tree is not in an error state.
  * Returns a nil node otherwise.
@@ -1071,6 +1365,8 @@ void bjd_node_copy_utf8_cstr(bjd_node_t node, char* buffer, size_t size);
  *
  * The allocated data must be freed with BJDATA_FREE() (or simply free()
  * if BJData's allocator hasn't been customized.)
+ * If an allocator is attached with bjd_tree_set_allocator(), it is
+ * allocated from that instead.
  *
  * @throws bjd_error_type If this node is not a str, bin or ext type
  * @throws bjd_error_too_big If the size of the data is larger than the
@@ -1090,6 +1386,8 @@ char* bjd_node_data_alloc(bjd_node_t node, size_t maxsize);
  *
  * The allocated string must be freed with BJDATA_FREE() (or simply free()
  * if BJData's allocator hasn't been customized.)
+ * If an allocator is attached with bjd_tree_set_allocator(), it is
+ * allocated from that instead.
  *
  * @throws bjd_error_type If this node is not a string or contains NUL bytes
  * @throws bjd_error_too_big If the size of the string plus null-terminator
@@ -1109,6 +1407,8 @@ char* bjd_node_cstr_alloc(bjd_node_t node, size_t maxsize);
  *
  * The allocated string must be freed with BJDATA_FREE() (or simply free()
  * if BJData's allocator hasn't been customized.)
+ * If an allocator is attached with bjd_tree_set_allocator(), it is
+ * allocated from that instead.
  *
  * @throws bjd_error_type If this node is not a string, is not valid UTF-8,
  *     or contains NUL bytes
@@ -1203,9 +1503,94 @@ size_t bjd_node_array_length(bjd_node_t node);
  * is not an array, @ref bjd_error_type is raised and a nil node is returned.
  * If the given index is out of bounds, @ref bjd_error_data is raised and
  * a nil node is returned.
+ *
+ * If the array is an optimized array (see bjd_node_typed_array_type()), its
+ * elements are not stored as nodes when it is parsed. The first call for
+ * an element decodes all of them into nodes allocated in the tree, which
+ * remain valid as long as the tree, as with any other node. Like building
+ * a map index, this modifies the tree. Use bjd_node_typed_array_u64_at()
+ * and friends to read elements without creating nodes.
+ *
+ * @throws bjd_error_unsupported if the array is an optimized array and
+ *     BJDATA_MALLOC is not defined
  */
 bjd_node_t bjd_node_array_at(bjd_node_t node, size_t index);
 
+/**
+ * Returns the element type marker of the given array node if it is an
+ * optimized array (a '$' type and '#' count), or 0 if its elements are
+ * stored individually.
+ *
+ * The marker is one of 'U', 'i', 'u', 'I', 'm', 'l', 'M', 'L', 'd' or 'D'.
+ * Raises bjd_error_type and returns 0 if the given node is not an array.
+ *
+ * @see bjd_node_typed_array_data()
+ */
+char bjd_node_typed_array_type(bjd_node_t node);
+
+/**
+ * Returns a pointer to the packed payload of the given optimized array
+ * node.
+ *
+ * The payload contains bjd_node_array_length() elements of the type given
+ * by bjd_node_typed_array_type(), in the tree's byte order (see
+ * bjd_tree_set_endian()) and without alignment. The pointer is into the
+ * tree's data, so it is valid as long as the tree is.
+ *
+ * Raises bjd_error_type and returns NULL if the given node is not an
+ * optimized array.
+ */
+const char* bjd_node_typed_array_data(bjd_node_t node);
+
+/**
+ * Returns the element at the given index of the given optimized array node
+ * as a uint64_t, decoding it straight from the packed payload without
+ * creating a node.
+ *
+ * @throws bjd_error_type if the node is not an optimized array, or if the
+ *     element is not an integer in range of a uint64_t
+ * @throws bjd_error_data if the given index is out of bounds
+ *
+ * @see bjd_node_array_at()
+ */
+uint64_t bjd_node_typed_array_u64_at(bjd_node_t node, size_t index);
+
+/**
+ * Returns the element at the given index of the given optimized array node
+ * as an int64_t. See bjd_node_typed_array_u64_at().
+ *
+ * @throws bjd_error_type if the node is not an optimized array, or if the
+ *     element is not an integer in range of an int64_t
+ * @throws bjd_error_data if the given index is out of bounds
+ */
+int64_t bjd_node_typed_array_i64_at(bjd_node_t node, size_t index);
+
+/**
+ * Returns the element at the given index of the given optimized array node
+ * as a double, converting integers as bjd_node_double() does. See
+ * bjd_node_typed_array_u64_at().
+ *
+ * @throws bjd_error_type if the node is not an optimized array
+ * @throws bjd_error_data if the given index is out of bounds
+ */
+double bjd_node_typed_array_double_at(bjd_node_t node, size_t index);
+
+/**
+ * Provides a strided view of the packed payload of the given optimized
+ * array node, exposing its dimensions if it is an ND-array (with a
+ * `[$<type>#[<dims>]` header.) An optimized array with a plain count is
+ * viewed as having a single dimension.
+ *
+ * The view points into the tree's data, so it is valid as long as the
+ * tree is. The payload is in the tree's byte order.
+ *
+ * Raises bjd_error_type and zeroes the view if the given node is not an
+ * optimized array.
+ *
+ * @see bjd_ndarray_view_t
+ */
+void bjd_node_ndarray_view(bjd_node_t node, bjd_ndarray_view_t* view);
+
 /**
  * Returns the number of key/value pairs in the given map node. Raises
  * bjd_error_type and returns 0 if the given node is not a map.
@@ -222,3 +222,936 @@ void* bjd_realloc(void* old_ptr, size_t used_size, size_t new_size) {
     return new_ptr;
 }
 #endif
+
+
+
+/*
+ * Bulk conversion kernels
+ */
+
+#if BJDATA_SIMD_X86
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #endif
+    #include <emmintrin.h>
+    #include <tmmintrin.h>
+    #include <immintrin.h>
+#endif
+#if BJDATA_SIMD_NEON
+    #include <arm_neon.h>
+#endif
+
+typedef void (*bjd_convert_fn_t)(char* dest, const char* src, size_t count);
+typedef bool (*bjd_utf8_check_fn_t)(const uint8_t* str, size_t count, bool allow_null);
+
+typedef struct bjd_convert_kernels_t {
+    const char* name;
+    bjd_convert_fn_t swap16;
+    bjd_convert_fn_t swap32;
+    bjd_convert_fn_t swap64;
+    bjd_convert_fn_t widen_u8_u16;
+    bjd_convert_fn_t widen_i8_i16;
+    bjd_convert_fn_t widen_u16_u32;
+    bjd_convert_fn_t widen_i16_i32;
+    bjd_utf8_check_fn_t utf8_check;
+} bjd_convert_kernels_t;
+
+// Scalar kernels. These handle the tail of each SIMD kernel as well.
+
+#if (defined(__GNUC__) || defined(__clang__)) && !BJDATA_NO_BUILTINS
+    #define BJDATA_BSWAP32(x) __builtin_bswap32(x)
+    #define BJDATA_BSWAP64(x) __builtin_bswap64(x)
+#else
+    #define BJDATA_BSWAP32(x) \
+        ((((x) & 0xFF000000u) >> 24) | (((x) & 0x00FF0000u) >>  8) | \
+         (((x) & 0x0000FF00u) <<  8) | (((x) & 0x000000FFu) << 24))
+    #define BJDATA_BSWAP64(x) \
+        (((uint64_t)BJDATA_BSWAP32((uint32_t)(x)) << 32) | \
+          (uint64_t)BJDATA_BSWAP32((uint32_t)((x) >> 32)))
+#endif
+
+static void bjd_convert_swap16_scalar(char* dest, const char* src, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        uint16_t v;
+        bjd_memcpy(&v, src + i * 2, sizeof(v));
+        v = (uint16_t)((v >> 8) | (v << 8));
+        bjd_memcpy(dest + i * 2, &v, sizeof(v));
+    }
+}
+
+static void bjd_convert_swap32_scalar(char* dest, const char* src, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t v;
+        bjd_memcpy(&v, src + i * 4, sizeof(v));
+        v = BJDATA_BSWAP32(v);
+        bjd_memcpy(dest + i * 4, &v, sizeof(v));
+    }
+}
+
+static void bjd_convert_swap64_scalar(char* dest, const char* src, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t v;
+        bjd_memcpy(&v, src + i * 8, sizeof(v));
+        v = BJDATA_BSWAP64(v);
+        bjd_memcpy(dest + i * 8, &v, sizeof(v));
+    }
+}
+
+// Each element is loaded before it is stored, so these work front to back
+// over the overlapping buffers described in bjd_convert_widen().
+#define BJDATA_CONVERT_WIDEN_SCALAR(name, src_t, dest_t) \
+    static void name(char* dest, const char* src, size_t count) { \
+        for (size_t i = 0; i < count; ++i) { \
+            src_t v; \
+            bjd_memcpy(&v, src + i * sizeof(src_t), sizeof(v)); \
+            dest_t w = (dest_t)v; \
+            bjd_memcpy(dest + i * sizeof(dest_t), &w, sizeof(w)); \
+        } \
+    }
+
+BJDATA_CONVERT_WIDEN_SCALAR(bjd_convert_widen_u8_u16_scalar,  uint8_t,  uint16_t)
+BJDATA_CONVERT_WIDEN_SCALAR(bjd_convert_widen_u8_u32_scalar,  uint8_t,  uint32_t)
+BJDATA_CONVERT_WIDEN_SCALAR(bjd_convert_widen_u8_u64_scalar,  uint8_t,  uint64_t)
+BJDATA_CONVERT_WIDEN_SCALAR(bjd_convert_widen_u16_u32_scalar, uint16_t, uint32_t)
+BJDATA_CONVERT_WIDEN_SCALAR(bjd_convert_widen_u16_u64_scalar, uint16_t, uint64_t)
+BJDATA_CONVERT_WIDEN_SCALAR(bjd_convert_widen_u32_u64_scalar, uint32_t, uint64_t)
+BJDATA_CONVERT_WIDEN_SCALAR(bjd_convert_widen_i8_i16_scalar,  int8_t,   int16_t)
+BJDATA_CONVERT_WIDEN_SCALAR(bjd_convert_widen_i8_i32_scalar,  int8_t,   int32_t)
+BJDATA_CONVERT_WIDEN_SCALAR(bjd_convert_widen_i8_i64_scalar,  int8_t,   int64_t)
+BJDATA_CONVERT_WIDEN_SCALAR(bjd_convert_widen_i16_i32_scalar, int16_t,  int32_t)
+BJDATA_CONVERT_WIDEN_SCALAR(bjd_convert_widen_i16_i64_scalar, int16_t,  int64_t)
+BJDATA_CONVERT_WIDEN_SCALAR(bjd_convert_widen_i32_i64_scalar, int32_t,  int64_t)
+
+// Returns the length of the valid UTF-8 sequence at the start of str, or 0
+// if it is invalid or truncated. Overlong encodings, surrogates and code
+// points above U+10FFFF are invalid.
+static size_t bjd_utf8_sequence(const uint8_t* str, size_t count) {
+    uint8_t lead = str[0];
+    if (lead < 0x80)
+        return 1;
+
+    // continuation bytes, and leads that could only encode overlong
+    // two-byte sequences or code points above U+10FFFF
+    if (lead < 0xC2 || lead > 0xF4)
+        return 0;
+
+    if (lead < 0xE0)
+        return (count >= 2 && (str[1] & 0xC0) == 0x80) ? 2 : 0;
+
+    if (lead < 0xF0) {
+        if (count < 3 || (str[1] & 0xC0) != 0x80 || (str[2] & 0xC0) != 0x80)
+            return 0;
+        if (lead == 0xE0 && str[1] < 0xA0) // overlong
+            return 0;
+        if (lead == 0xED && str[1] >= 0xA0) // surrogate
+            return 0;
+        return 3;
+    }
+
+    if (count < 4 || (str[1] & 0xC0) != 0x80 || (str[2] & 0xC0) != 0x80 || (str[3] & 0xC0) != 0x80)
+        return 0;
+    if (lead == 0xF0 && str[1] < 0x90) // overlong
+        return 0;
+    if (lead == 0xF4 && str[1] >= 0x90) // above U+10FFFF
+        return 0;
+    return 4;
+}
+
+// Skips ASCII a word at a time, validating everything else one sequence at
+// a time. This handles the tail of each SIMD kernel as well.
+static bool bjd_utf8_check_scalar(const uint8_t* str, size_t count, bool allow_null) {
+    const uint64_t high = UINT64_C(0x8080808080808080);
+    const uint64_t ones = UINT64_C(0x0101010101010101);
+
+    while (count > 0) {
+        while (count >= 8) {
+            uint64_t v;
+            bjd_memcpy(&v, str, sizeof(v));
+            if (v & high)
+                break;
+            if (!allow_null && ((v - ones) & ~v & high))
+                return false;
+            str += 8;
+            count -= 8;
+        }
+        if (count == 0)
+            break;
+
+        if (!allow_null && str[0] == '\0')
+            return false;
+        size_t length = bjd_utf8_sequence(str, count);
+        if (length == 0)
+            return false;
+        str += length;
+        count -= length;
+    }
+    return true;
+}
+
+#if BJDATA_SIMD_X86 || (BJDATA_SIMD_NEON && defined(__aarch64__))
+/*
+ * The SSSE3, AVX2 and NEON validators classify each byte with three
+ * 16-entry table lookups on the nibbles of the byte and of its predecessor,
+ * as described in "Validating UTF-8 In Less Than One Instruction Per Byte"
+ * (Keiser and Lemire, 2021). Each error bit is set in all three lookups only
+ * if that error occurs for the pair of bytes. Third and fourth bytes of
+ * sequences are matched up with their leads separately.
+ */
+
+#define BJDATA_UTF8_TOO_SHORT   0x01 // 11______ 0_______ or 11______ 11______
+#define BJDATA_UTF8_TOO_LONG    0x02 // 0_______ 10______
+#define BJDATA_UTF8_OVERLONG_3  0x04 // 11100000 100_____
+#define BJDATA_UTF8_TOO_LARGE   0x08 // 11110100 1001____ and above
+#define BJDATA_UTF8_SURROGATE   0x10 // 11101101 101_____
+#define BJDATA_UTF8_OVERLONG_2  0x20 // 1100000_ 10______
+#define BJDATA_UTF8_TOO_LARGE_1000 0x40 // 11110101 1000____ and above
+#define BJDATA_UTF8_OVERLONG_4  0x40 // 11110000 1000____
+#define BJDATA_UTF8_TWO_CONTS   0x80 // 10______ 10______
+#define BJDATA_UTF8_CARRY (BJDATA_UTF8_TOO_SHORT | BJDATA_UTF8_TOO_LONG | BJDATA_UTF8_TWO_CONTS)
+
+// indexed by the high nibble of the previous byte
+static const uint8_t bjd_utf8_byte_1_high[16] = {
+    BJDATA_UTF8_TOO_LONG, BJDATA_UTF8_TOO_LONG, BJDATA_UTF8_TOO_LONG, BJDATA_UTF8_TOO_LONG,
+    BJDATA_UTF8_TOO_LONG, BJDATA_UTF8_TOO_LONG, BJDATA_UTF8_TOO_LONG, BJDATA_UTF8_TOO_LONG,
+    BJDATA_UTF8_TWO_CONTS, BJDATA_UTF8_TWO_CONTS, BJDATA_UTF8_TWO_CONTS, BJDATA_UTF8_TWO_CONTS,
+    BJDATA_UTF8_TOO_SHORT | BJDATA_UTF8_OVERLONG_2,
+    BJDATA_UTF8_TOO_SHORT,
+    BJDATA_UTF8_TOO_SHORT | BJDATA_UTF8_OVERLONG_3 | BJDATA_UTF8_SURROGATE,
+    BJDATA_UTF8_TOO_SHORT | BJDATA_UTF8_TOO_LARGE | BJDATA_UTF8_TOO_LARGE_1000 | BJDATA_UTF8_OVERLONG_4,
+};
+
+// indexed by the low nibble of the previous byte
+static const uint8_t bjd_utf8_byte_1_low[16] = {
+    BJDATA_UTF8_CARRY | BJDATA_UTF8_OVERLONG_3 | BJDATA_UTF8_OVERLONG_2 | BJDATA_UTF8_OVERLONG_4,
+    BJDATA_UTF8_CARRY | BJDATA_UTF8_OVERLONG_2,
+    BJDATA_UTF8_CARRY,
+    BJDATA_UTF8_CARRY,
+    BJDATA_UTF8_CARRY | BJDATA_UTF8_TOO_LARGE,
+    BJDATA_UTF8_CARRY | BJDATA_UTF8_TOO_LARGE | BJDATA_UTF8_TOO_LARGE_1000,
+    BJDATA_UTF8_CARRY | BJDATA_UTF8_TOO_LARGE | BJDATA_UTF8_TOO_LARGE_1000,
+    BJDATA_UTF8_CARRY | BJDATA_UTF8_TOO_LARGE | BJDATA_UTF8_TOO_LARGE_1000,
+    BJDATA_UTF8_CARRY | BJDATA_UTF8_TOO_LARGE | BJDATA_UTF8_TOO_LARGE_1000,
+    BJDATA_UTF8_CARRY | BJDATA_UTF8_TOO_LARGE | BJDATA_UTF8_TOO_LARGE_1000,
+    BJDATA_UTF8_CARRY | BJDATA_UTF8_TOO_LARGE | BJDATA_UTF8_TOO_LARGE_1000,
+    BJDATA_UTF8_CARRY | BJDATA_UTF8_TOO_LARGE | BJDATA_UTF8_TOO_LARGE_1000,
+    BJDATA_UTF8_CARRY | BJDATA_UTF8_TOO_LARGE | BJDATA_UTF8_TOO_LARGE_1000,
+    BJDATA_UTF8_CARRY | BJDATA_UTF8_TOO_LARGE | BJDATA_UTF8_TOO_LARGE_1000 | BJDATA_UTF8_SURROGATE,
+    BJDATA_UTF8_CARRY | BJDATA_UTF8_TOO_LARGE | BJDATA_UTF8_TOO_LARGE_1000,
+    BJDATA_UTF8_CARRY | BJDATA_UTF8_TOO_LARGE | BJDATA_UTF8_TOO_LARGE_1000,
+};
+
+// indexed by the high nibble of the current byte
+static const uint8_t bjd_utf8_byte_2_high[16] = {
+    BJDATA_UTF8_TOO_SHORT, BJDATA_UTF8_TOO_SHORT, BJDATA_UTF8_TOO_SHORT, BJDATA_UTF8_TOO_SHORT,
+    BJDATA_UTF8_TOO_SHORT, BJDATA_UTF8_TOO_SHORT, BJDATA_UTF8_TOO_SHORT, BJDATA_UTF8_TOO_SHORT,
+    BJDATA_UTF8_TOO_LONG | BJDATA_UTF8_OVERLONG_2 | BJDATA_UTF8_TWO_CONTS |
+            BJDATA_UTF8_OVERLONG_3 | BJDATA_UTF8_TOO_LARGE_1000 | BJDATA_UTF8_OVERLONG_4,
+    BJDATA_UTF8_TOO_LONG | BJDATA_UTF8_OVERLONG_2 | BJDATA_UTF8_TWO_CONTS |
+            BJDATA_UTF8_OVERLONG_3 | BJDATA_UTF8_TOO_LARGE,
+    BJDATA_UTF8_TOO_LONG | BJDATA_UTF8_OVERLONG_2 | BJDATA_UTF8_TWO_CONTS |
+            BJDATA_UTF8_SURROGATE | BJDATA_UTF8_TOO_LARGE,
+    BJDATA_UTF8_TOO_LONG | BJDATA_UTF8_OVERLONG_2 | BJDATA_UTF8_TWO_CONTS |
+            BJDATA_UTF8_SURROGATE | BJDATA_UTF8_TOO_LARGE,
+    BJDATA_UTF8_TOO_SHORT, BJDATA_UTF8_TOO_SHORT, BJDATA_UTF8_TOO_SHORT, BJDATA_UTF8_TOO_SHORT,
+};
+
+// A block ending with these bytes or larger ends with a truncated sequence:
+// 1111____ in the third to last byte, 111_____ in the second to last or
+// 11______ in the last.
+static const uint8_t bjd_utf8_incomplete_max[32] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF,
+};
+#endif
+
+static const bjd_convert_kernels_t bjd_convert_kernels_scalar = {
+    "scalar",
+    bjd_convert_swap16_scalar,
+    bjd_convert_swap32_scalar,
+    bjd_convert_swap64_scalar,
+    bjd_convert_widen_u8_u16_scalar,
+    bjd_convert_widen_i8_i16_scalar,
+    bjd_convert_widen_u16_u32_scalar,
+    bjd_convert_widen_i16_i32_scalar,
+    bjd_utf8_check_scalar,
+};
+
+#if BJDATA_SIMD_X86
+
+// SSE2 has no byte shuffle, so bytes are swapped within each 16-bit word
+// with shifts and the words are then reordered.
+
+BJDATA_SIMD_TARGET("sse2")
+BJDATA_STATIC_INLINE __m128i bjd_swap16_sse2(__m128i v) {
+    return _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+}
+
+BJDATA_SIMD_TARGET("sse2")
+static void bjd_convert_swap16_sse2(char* dest, const char* src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+        _mm_storeu_si128((__m128i*)(dest + i * 2), bjd_swap16_sse2(v));
+    }
+    bjd_convert_swap16_scalar(dest + i * 2, src + i * 2, count - i);
+}
+
+BJDATA_SIMD_TARGET("sse2")
+static void bjd_convert_swap32_sse2(char* dest, const char* src, size_t count) {
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = bjd_swap16_sse2(_mm_loadu_si128((const __m128i*)(src + i * 4)));
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        _mm_storeu_si128((__m128i*)(dest + i * 4), v);
+    }
+    bjd_convert_swap32_scalar(dest + i * 4, src + i * 4, count - i);
+}
+
+BJDATA_SIMD_TARGET("sse2")
+static void bjd_convert_swap64_sse2(char* dest, const char* src, size_t count) {
+    size_t i = 0;
+    for (; i + 2 <= count; i += 2) {
+        __m128i v = bjd_swap16_sse2(_mm_loadu_si128((const __m128i*)(src + i * 8)));
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        _mm_storeu_si128((__m128i*)(dest + i * 8), v);
+    }
+    bjd_convert_swap64_scalar(dest + i * 8, src + i * 8, count - i);
+}
+
+// The widening kernels interleave each element with zeroes or with its
+// sign. x86 is little-endian so the result is in host order.
+
+BJDATA_SIMD_TARGET("sse2")
+static void bjd_convert_widen_u8_u16_sse2(char* dest, const char* src, size_t count) {
+    __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dest + i * 2), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128((__m128i*)(dest + i * 2 + 16), _mm_unpackhi_epi8(v, zero));
+    }
+    bjd_convert_widen_u8_u16_scalar(dest + i * 2, src + i, count - i);
+}
+
+BJDATA_SIMD_TARGET("sse2")
+static void bjd_convert_widen_i8_i16_sse2(char* dest, const char* src, size_t count) {
+    __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        __m128i sign = _mm_cmpgt_epi8(zero, v);
+        _mm_storeu_si128((__m128i*)(dest + i * 2), _mm_unpacklo_epi8(v, sign));
+        _mm_storeu_si128((__m128i*)(dest + i * 2 + 16), _mm_unpackhi_epi8(v, sign));
+    }
+    bjd_convert_widen_i8_i16_scalar(dest + i * 2, src + i, count - i);
+}
+
+BJDATA_SIMD_TARGET("sse2")
+static void bjd_convert_widen_u16_u32_sse2(char* dest, const char* src, size_t count) {
+    __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+        _mm_storeu_si128((__m128i*)(dest + i * 4), _mm_unpacklo_epi16(v, zero));
+        _mm_storeu_si128((__m128i*)(dest + i * 4 + 16), _mm_unpackhi_epi16(v, zero));
+    }
+    bjd_convert_widen_u16_u32_scalar(dest + i * 4, src + i * 2, count - i);
+}
+
+BJDATA_SIMD_TARGET("sse2")
+static void bjd_convert_widen_i16_i32_sse2(char* dest, const char* src, size_t count) {
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i * 2));
+        __m128i sign = _mm_srai_epi16(v, 15);
+        _mm_storeu_si128((__m128i*)(dest + i * 4), _mm_unpacklo_epi16(v, sign));
+        _mm_storeu_si128((__m128i*)(dest + i * 4 + 16), _mm_unpackhi_epi16(v, sign));
+    }
+    bjd_convert_widen_i16_i32_scalar(dest + i * 4, src + i * 2, count - i);
+}
+
+// SSSE3 and AVX2 swap bytes with a single shuffle.
+
+#define BJDATA_CONVERT_SWAP_SSSE3(name, size, mask) \
+    BJDATA_SIMD_TARGET("ssse3") \
+    static void name##_ssse3(char* dest, const char* src, size_t count) { \
+        const __m128i shuffle = mask; \
+        size_t i = 0; \
+        for (; i + 16 / size <= count; i += 16 / size) { \
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + i * size)); \
+            _mm_storeu_si128((__m128i*)(dest + i * size), _mm_shuffle_epi8(v, shuffle)); \
+        } \
+        name##_scalar(dest + i * size, src + i * size, count - i); \
+    }
+
+#define BJDATA_CONVERT_SWAP_AVX2(name, size, mask) \
+    BJDATA_SIMD_TARGET("avx2") \
+    static void name##_avx2(char* dest, const char* src, size_t count) { \
+        const __m256i shuffle = _mm256_broadcastsi128_si256(mask); \
+        size_t i = 0; \
+        for (; i + 32 / size <= count; i += 32 / size) { \
+            __m256i v = _mm256_loadu_si256((const __m256i*)(src + i * size)); \
+            _mm256_storeu_si256((__m256i*)(dest + i * size), _mm256_shuffle_epi8(v, shuffle)); \
+        } \
+        name##_scalar(dest + i * size, src + i * size, count - i); \
+    }
+
+// _mm_set_epi8() takes bytes from the highest to the lowest.
+#define BJDATA_SWAP16_MASK _mm_set_epi8(14, 15, 12, 13, 10, 11, 8, 9, 6, 7, 4, 5, 2, 3, 0, 1)
+#define BJDATA_SWAP32_MASK _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3)
+#define BJDATA_SWAP64_MASK _mm_set_epi8(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7)
+
+BJDATA_CONVERT_SWAP_SSSE3(bjd_convert_swap16, 2, BJDATA_SWAP16_MASK)
+BJDATA_CONVERT_SWAP_SSSE3(bjd_convert_swap32, 4, BJDATA_SWAP32_MASK)
+BJDATA_CONVERT_SWAP_SSSE3(bjd_convert_swap64, 8, BJDATA_SWAP64_MASK)
+BJDATA_CONVERT_SWAP_AVX2(bjd_convert_swap16, 2, BJDATA_SWAP16_MASK)
+BJDATA_CONVERT_SWAP_AVX2(bjd_convert_swap32, 4, BJDATA_SWAP32_MASK)
+BJDATA_CONVERT_SWAP_AVX2(bjd_convert_swap64, 8, BJDATA_SWAP64_MASK)
+
+// AVX2 widens half a register of elements at a time.
+#define BJDATA_CONVERT_WIDEN_AVX2(name, src_size, cvt) \
+    BJDATA_SIMD_TARGET("avx2") \
+    static void name##_avx2(char* dest, const char* src, size_t count) { \
+        size_t i = 0; \
+        for (; i + 16 / src_size <= count; i += 16 / src_size) { \
+            __m128i v = _mm_loadu_si128((const __m128i*)(src + i * src_size)); \
+            _mm256_storeu_si256((__m256i*)(dest + i * src_size * 2), cvt(v)); \
+        } \
+        name##_scalar(dest + i * src_size * 2, src + i * src_size, count - i); \
+    }
+
+BJDATA_CONVERT_WIDEN_AVX2(bjd_convert_widen_u8_u16,  1, _mm256_cvtepu8_epi16)
+BJDATA_CONVERT_WIDEN_AVX2(bjd_convert_widen_i8_i16,  1, _mm256_cvtepi8_epi16)
+BJDATA_CONVERT_WIDEN_AVX2(bjd_convert_widen_u16_u32, 2, _mm256_cvtepu16_epi32)
+BJDATA_CONVERT_WIDEN_AVX2(bjd_convert_widen_i16_i32, 2, _mm256_cvtepi16_epi32)
+
+// SSE2 can only skip ASCII quickly. Blocks with other bytes are validated
+// one sequence at a time until the next block.
+BJDATA_SIMD_TARGET("sse2")
+static bool bjd_utf8_check_sse2(const uint8_t* str, size_t count, bool allow_null) {
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    while (count - i >= 64) {
+        __m128i v0 = _mm_loadu_si128((const __m128i*)(str + i));
+        __m128i v1 = _mm_loadu_si128((const __m128i*)(str + i + 16));
+        __m128i v2 = _mm_loadu_si128((const __m128i*)(str + i + 32));
+        __m128i v3 = _mm_loadu_si128((const __m128i*)(str + i + 48));
+        __m128i any = _mm_or_si128(_mm_or_si128(v0, v1), _mm_or_si128(v2, v3));
+        if (_mm_movemask_epi8(any) == 0) {
+            if (!allow_null) {
+                __m128i min = _mm_min_epu8(_mm_min_epu8(v0, v1), _mm_min_epu8(v2, v3));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi8(min, zero)) != 0)
+                    return false;
+            }
+            i += 64;
+            continue;
+        }
+
+        size_t end = i + 64;
+        while (i < end) {
+            if (!allow_null && str[i] == '\0')
+                return false;
+            size_t length = bjd_utf8_sequence(str + i, count - i);
+            if (length == 0)
+                return false;
+            i += length;
+        }
+    }
+    return bjd_utf8_check_scalar(str + i, count - i, allow_null);
+}
+
+// Returns the error bits for a block of 16 bytes given the previous block.
+BJDATA_SIMD_TARGET("ssse3")
+BJDATA_STATIC_INLINE __m128i bjd_utf8_block_ssse3(__m128i input, __m128i prev_input) {
+    const __m128i nibble = _mm_set1_epi8(0x0F);
+    __m128i prev1 = _mm_alignr_epi8(input, prev_input, 15);
+    __m128i byte_1_high = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)bjd_utf8_byte_1_high),
+            _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble));
+    __m128i byte_1_low = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)bjd_utf8_byte_1_low),
+            _mm_and_si128(prev1, nibble));
+    __m128i byte_2_high = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)bjd_utf8_byte_2_high),
+            _mm_and_si128(_mm_srli_epi16(input, 4), nibble));
+    __m128i special = _mm_and_si128(_mm_and_si128(byte_1_high, byte_1_low), byte_2_high);
+
+    // bytes two or three after a three- or four-byte lead must be
+    // continuations. these are the only continuations not already
+    // flagged as TWO_CONTS, so the bit is toggled.
+    __m128i prev2 = _mm_alignr_epi8(input, prev_input, 14);
+    __m128i prev3 = _mm_alignr_epi8(input, prev_input, 13);
+    __m128i third = _mm_subs_epu8(prev2, _mm_set1_epi8((char)(0xE0 - 0x80)));
+    __m128i fourth = _mm_subs_epu8(prev3, _mm_set1_epi8((char)(0xF0 - 0x80)));
+    __m128i must_be_cont = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8((char)0x80));
+    return _mm_xor_si128(must_be_cont, special);
+}
+
+BJDATA_SIMD_TARGET("ssse3")
+static bool bjd_utf8_check_ssse3(const uint8_t* str, size_t count, bool allow_null) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i incomplete_max = _mm_loadu_si128((const __m128i*)(bjd_utf8_incomplete_max + 16));
+    __m128i error = zero;
+    __m128i nulls = zero;
+    __m128i prev = zero;
+    __m128i prev_incomplete = zero;
+    size_t i = 0;
+
+    // ASCII is skipped 64 bytes at a time
+    for (; count - i >= 64; i += 64) {
+        __m128i v0 = _mm_loadu_si128((const __m128i*)(str + i));
+        __m128i v1 = _mm_loadu_si128((const __m128i*)(str + i + 16));
+        __m128i v2 = _mm_loadu_si128((const __m128i*)(str + i + 32));
+        __m128i v3 = _mm_loadu_si128((const __m128i*)(str + i + 48));
+        if (!allow_null) {
+            __m128i min = _mm_min_epu8(_mm_min_epu8(v0, v1), _mm_min_epu8(v2, v3));
+            nulls = _mm_or_si128(nulls, _mm_cmpeq_epi8(min, zero));
+        }
+
+        __m128i any = _mm_or_si128(_mm_or_si128(v0, v1), _mm_or_si128(v2, v3));
+        if (_mm_movemask_epi8(any) == 0) {
+            error = _mm_or_si128(error, prev_incomplete);
+            prev_incomplete = zero;
+        } else {
+            error = _mm_or_si128(error, bjd_utf8_block_ssse3(v0, prev));
+            error = _mm_or_si128(error, bjd_utf8_block_ssse3(v1, v0));
+            error = _mm_or_si128(error, bjd_utf8_block_ssse3(v2, v1));
+            error = _mm_or_si128(error, bjd_utf8_block_ssse3(v3, v2));
+            prev_incomplete = _mm_subs_epu8(v3, incomplete_max);
+        }
+        prev = v3;
+    }
+
+    // the rest is checked 16 bytes at a time, padding the last block with
+    // spaces (which are neither null nor part of a sequence)
+    while (i < count) {
+        __m128i v;
+        if (count - i >= 16) {
+            v = _mm_loadu_si128((const __m128i*)(str + i));
+            i += 16;
+        } else {
+            uint8_t block[16];
+            bjd_memset(block, ' ', sizeof(block));
+            bjd_memcpy(block, str + i, count - i);
+            v = _mm_loadu_si128((const __m128i*)block);
+            i = count;
+        }
+        if (!allow_null)
+            nulls = _mm_or_si128(nulls, _mm_cmpeq_epi8(v, zero));
+        error = _mm_or_si128(error, bjd_utf8_block_ssse3(v, prev));
+        prev_incomplete = _mm_subs_epu8(v, incomplete_max);
+        prev = v;
+    }
+
+    error = _mm_or_si128(_mm_or_si128(error, prev_incomplete), nulls);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(error, zero)) == 0xFFFF;
+}
+
+// The previous bytes of a 32-byte block straddle its two lanes.
+#define BJDATA_UTF8_PREV_AVX2(input, prev_input, n) \
+    _mm256_alignr_epi8(input, _mm256_permute2x128_si256(prev_input, input, 0x21), 16 - (n))
+
+BJDATA_SIMD_TARGET("avx2")
+BJDATA_STATIC_INLINE __m256i bjd_utf8_block_avx2(__m256i input, __m256i prev_input) {
+    const __m256i nibble = _mm256_set1_epi8(0x0F);
+    __m256i prev1 = BJDATA_UTF8_PREV_AVX2(input, prev_input, 1);
+    __m256i byte_1_high = _mm256_shuffle_epi8(
+            _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)bjd_utf8_byte_1_high)),
+            _mm256_and_si256(_mm256_srli_epi16(prev1, 4), nibble));
+    __m256i byte_1_low = _mm256_shuffle_epi8(
+            _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)bjd_utf8_byte_1_low)),
+            _mm256_and_si256(prev1, nibble));
+    __m256i byte_2_high = _mm256_shuffle_epi8(
+            _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)bjd_utf8_byte_2_high)),
+            _mm256_and_si256(_mm256_srli_epi16(input, 4), nibble));
+    __m256i special = _mm256_and_si256(_mm256_and_si256(byte_1_high, byte_1_low), byte_2_high);
+
+    __m256i prev2 = BJDATA_UTF8_PREV_AVX2(input, prev_input, 2);
+    __m256i prev3 = BJDATA_UTF8_PREV_AVX2(input, prev_input, 3);
+    __m256i third = _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xE0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xF0 - 0x80)));
+    __m256i must_be_cont = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+    return _mm256_xor_si256(must_be_cont, special);
+}
+
+BJDATA_SIMD_TARGET("avx2")
+static bool bjd_utf8_check_avx2(const uint8_t* str, size_t count, bool allow_null) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i incomplete_max = _mm256_loadu_si256((const __m256i*)bjd_utf8_incomplete_max);
+    __m256i error = zero;
+    __m256i nulls = zero;
+    __m256i prev = zero;
+    __m256i prev_incomplete = zero;
+    size_t i = 0;
+
+    for (; count - i >= 64; i += 64) {
+        __m256i v0 = _mm256_loadu_si256((const __m256i*)(str + i));
+        __m256i v1 = _mm256_loadu_si256((const __m256i*)(str + i + 32));
+        if (!allow_null)
+            nulls = _mm256_or_si256(nulls, _mm256_cmpeq_epi8(_mm256_min_epu8(v0, v1), zero));
+
+        if (_mm256_movemask_epi8(_mm256_or_si256(v0, v1)) == 0) {
+            error = _mm256_or_si256(error, prev_incomplete);
+            prev_incomplete = zero;
+        } else {
+            error = _mm256_or_si256(error, bjd_utf8_block_avx2(v0, prev));
+            error = _mm256_or_si256(error, bjd_utf8_block_avx2(v1, v0));
+            prev_incomplete = _mm256_subs_epu8(v1, incomplete_max);
+        }
+        prev = v1;
+    }
+
+    while (i < count) {
+        __m256i v;
+        if (count - i >= 32) {
+            v = _mm256_loadu_si256((const __m256i*)(str + i));
+            i += 32;
+        } else {
+            uint8_t block[32];
+            bjd_memset(block, ' ', sizeof(block));
+            bjd_memcpy(block, str + i, count - i);
+            v = _mm256_loadu_si256((const __m256i*)block);
+            i = count;
+        }
+        if (!allow_null)
+            nulls = _mm256_or_si256(nulls, _mm256_cmpeq_epi8(v, zero));
+        error = _mm256_or_si256(error, bjd_utf8_block_avx2(v, prev));
+        prev_incomplete = _mm256_subs_epu8(v, incomplete_max);
+        prev = v;
+    }
+
+    error = _mm256_or_si256(_mm256_or_si256(error, prev_incomplete), nulls);
+    return _mm256_testz_si256(error, error) != 0;
+}
+
+static const bjd_convert_kernels_t bjd_convert_kernels_sse2 = {
+    "sse2",
+    bjd_convert_swap16_sse2,
+    bjd_convert_swap32_sse2,
+    bjd_convert_swap64_sse2,
+    bjd_convert_widen_u8_u16_sse2,
+    bjd_convert_widen_i8_i16_sse2,
+    bjd_convert_widen_u16_u32_sse2,
+    bjd_convert_widen_i16_i32_sse2,
+    bjd_utf8_check_sse2,
+};
+
+static const bjd_convert_kernels_t bjd_convert_kernels_ssse3 = {
+    "ssse3",
+    bjd_convert_swap16_ssse3,
+    bjd_convert_swap32_ssse3,
+    bjd_convert_swap64_ssse3,
+    bjd_convert_widen_u8_u16_sse2,
+    bjd_convert_widen_i8_i16_sse2,
+    bjd_convert_widen_u16_u32_sse2,
+    bjd_convert_widen_i16_i32_sse2,
+    bjd_utf8_check_ssse3,
+};
+
+static const bjd_convert_kernels_t bjd_convert_kernels_avx2 = {
+    "avx2",
+    bjd_convert_swap16_avx2,
+    bjd_convert_swap32_avx2,
+    bjd_convert_swap64_avx2,
+    bjd_convert_widen_u8_u16_avx2,
+    bjd_convert_widen_i8_i16_avx2,
+    bjd_convert_widen_u16_u32_avx2,
+    bjd_convert_widen_i16_i32_avx2,
+    bjd_utf8_check_avx2,
+};
+
+// Kernel sets from fastest to slowest.
+static const bjd_convert_kernels_t* const bjd_convert_kernel_sets[] = {
+    &bjd_convert_kernels_avx2,
+    &bjd_convert_kernels_ssse3,
+    &bjd_convert_kernels_sse2,
+    &bjd_convert_kernels_scalar,
+};
+
+static bool bjd_convert_supported(const bjd_convert_kernels_t* kernels) {
+    bool sse2, ssse3, avx2;
+
+    #if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int max_leaf = info[0];
+    __cpuid(info, 1);
+    sse2 = (info[3] & (1 << 26)) != 0;
+    ssse3 = (info[2] & (1 << 9)) != 0;
+    // AVX2 also needs the OS to save the YMM registers.
+    bool avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 &&
+            (_xgetbv(0) & 6) == 6;
+    avx2 = false;
+    if (avx && max_leaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = (info[1] & (1 << 5)) != 0;
+    }
+    #else
+    __builtin_cpu_init();
+    sse2 = __builtin_cpu_supports("sse2") != 0;
+    ssse3 = __builtin_cpu_supports("ssse3") != 0;
+    avx2 = __builtin_cpu_supports("avx2") != 0;
+    #endif
+
+    if (kernels == &bjd_convert_kernels_avx2)
+        return avx2;
+    if (kernels == &bjd_convert_kernels_ssse3)
+        return ssse3;
+    if (kernels == &bjd_convert_kernels_sse2)
+        return sse2;
+    return true;
+}
+
+#elif BJDATA_SIMD_NEON
+
+#define BJDATA_CONVERT_SWAP_NEON(name, size, rev) \
+    static void name##_neon(char* dest, const char* src, size_t count) { \
+        size_t i = 0; \
+        for (; i + 16 / size <= count; i += 16 / size) { \
+            uint8x16_t v = vld1q_u8((const uint8_t*)(src + i * size)); \
+            vst1q_u8((uint8_t*)(dest + i * size), rev(v)); \
+        } \
+        name##_scalar(dest + i * size, src + i * size, count - i); \
+    }
+
+BJDATA_CONVERT_SWAP_NEON(bjd_convert_swap16, 2, vrev16q_u8)
+BJDATA_CONVERT_SWAP_NEON(bjd_convert_swap32, 4, vrev32q_u8)
+BJDATA_CONVERT_SWAP_NEON(bjd_convert_swap64, 8, vrev64q_u8)
+
+// NEON is only enabled on little-endian ARM, so the widened lanes are
+// stored in host order.
+#define BJDATA_CONVERT_WIDEN_NEON(name, src_size, vec_t, load, store, movl_lo, movl_hi) \
+    static void name##_neon(char* dest, const char* src, size_t count) { \
+        size_t i = 0; \
+        for (; i + 16 / src_size <= count; i += 16 / src_size) { \
+            vec_t v = load((const void*)(src + i * src_size)); \
+            store((void*)(dest + i * src_size * 2), movl_lo(v)); \
+            store((void*)(dest + i * src_size * 2 + 16), movl_hi(v)); \
+        } \
+        name##_scalar(dest + i * src_size * 2, src + i * src_size, count - i); \
+    }
+
+BJDATA_STATIC_INLINE uint16x8_t bjd_movl_lo_u8(uint8x16_t v) {return vmovl_u8(vget_low_u8(v));}
+BJDATA_STATIC_INLINE uint16x8_t bjd_movl_hi_u8(uint8x16_t v) {return vmovl_u8(vget_high_u8(v));}
+BJDATA_STATIC_INLINE int16x8_t  bjd_movl_lo_s8(int8x16_t v)  {return vmovl_s8(vget_low_s8(v));}
+BJDATA_STATIC_INLINE int16x8_t  bjd_movl_hi_s8(int8x16_t v)  {return vmovl_s8(vget_high_s8(v));}
+BJDATA_STATIC_INLINE uint32x4_t bjd_movl_lo_u16(uint16x8_t v) {return vmovl_u16(vget_low_u16(v));}
+BJDATA_STATIC_INLINE uint32x4_t bjd_movl_hi_u16(uint16x8_t v) {return vmovl_u16(vget_high_u16(v));}
+BJDATA_STATIC_INLINE int32x4_t  bjd_movl_lo_s16(int16x8_t v)  {return vmovl_s16(vget_low_s16(v));}
+BJDATA_STATIC_INLINE int32x4_t  bjd_movl_hi_s16(int16x8_t v)  {return vmovl_s16(vget_high_s16(v));}
+
+#define bjd_vld1q_u8(p)  vld1q_u8((const uint8_t*)(p))
+#define bjd_vld1q_s8(p)  vld1q_s8((const int8_t*)(p))
+#define bjd_vld1q_u16(p) vld1q_u16((const uint16_t*)(p))
+#define bjd_vld1q_s16(p) vld1q_s16((const int16_t*)(p))
+#define bjd_vst1q_u16(p, v) vst1q_u16((uint16_t*)(p), v)
+#define bjd_vst1q_s16(p, v) vst1q_s16((int16_t*)(p), v)
+#define bjd_vst1q_u32(p, v) vst1q_u32((uint32_t*)(p), v)
+#define bjd_vst1q_s32(p, v) vst1q_s32((int32_t*)(p), v)
+
+BJDATA_CONVERT_WIDEN_NEON(bjd_convert_widen_u8_u16,  1, uint8x16_t, bjd_vld1q_u8,  bjd_vst1q_u16, bjd_movl_lo_u8,  bjd_movl_hi_u8)
+BJDATA_CONVERT_WIDEN_NEON(bjd_convert_widen_i8_i16,  1, int8x16_t,  bjd_vld1q_s8,  bjd_vst1q_s16, bjd_movl_lo_s8,  bjd_movl_hi_s8)
+BJDATA_CONVERT_WIDEN_NEON(bjd_convert_widen_u16_u32, 2, uint16x8_t, bjd_vld1q_u16, bjd_vst1q_u32, bjd_movl_lo_u16, bjd_movl_hi_u16)
+BJDATA_CONVERT_WIDEN_NEON(bjd_convert_widen_i16_i32, 2, int16x8_t,  bjd_vld1q_s16, bjd_vst1q_s32, bjd_movl_lo_s16, bjd_movl_hi_s16)
+
+// The table lookups need AArch64. 32-bit ARM uses the scalar validator.
+#if defined(__aarch64__)
+static uint8x16_t bjd_utf8_block_neon(uint8x16_t input, uint8x16_t prev_input) {
+    const uint8x16_t nibble = vdupq_n_u8(0x0F);
+    uint8x16_t prev1 = vextq_u8(prev_input, input, 15);
+    uint8x16_t byte_1_high = vqtbl1q_u8(vld1q_u8(bjd_utf8_byte_1_high), vshrq_n_u8(prev1, 4));
+    uint8x16_t byte_1_low = vqtbl1q_u8(vld1q_u8(bjd_utf8_byte_1_low), vandq_u8(prev1, nibble));
+    uint8x16_t byte_2_high = vqtbl1q_u8(vld1q_u8(bjd_utf8_byte_2_high), vshrq_n_u8(input, 4));
+    uint8x16_t special = vandq_u8(vandq_u8(byte_1_high, byte_1_low), byte_2_high);
+
+    uint8x16_t prev2 = vextq_u8(prev_input, input, 14);
+    uint8x16_t prev3 = vextq_u8(prev_input, input, 13);
+    uint8x16_t third = vqsubq_u8(prev2, vdupq_n_u8(0xE0 - 0x80));
+    uint8x16_t fourth = vqsubq_u8(prev3, vdupq_n_u8(0xF0 - 0x80));
+    uint8x16_t must_be_cont = vandq_u8(vorrq_u8(third, fourth), vdupq_n_u8(0x80));
+    return veorq_u8(must_be_cont, special);
+}
+
+static bool bjd_utf8_check_neon(const uint8_t* str, size_t count, bool allow_null) {
+    const uint8x16_t zero = vdupq_n_u8(0);
+    const uint8x16_t incomplete_max = vld1q_u8(bjd_utf8_incomplete_max + 16);
+    uint8x16_t error = zero;
+    uint8x16_t prev = zero;
+    uint8x16_t prev_incomplete = zero;
+    uint8_t min = 0xFF;
+    size_t i = 0;
+
+    for (; count - i >= 64; i += 64) {
+        uint8x16_t v0 = vld1q_u8(str + i);
+        uint8x16_t v1 = vld1q_u8(str + i + 16);
+        uint8x16_t v2 = vld1q_u8(str + i + 32);
+        uint8x16_t v3 = vld1q_u8(str + i + 48);
+        if (!allow_null) {
+            uint8_t block_min = vminvq_u8(vminq_u8(vminq_u8(v0, v1), vminq_u8(v2, v3)));
+            min = (block_min < min) ? block_min : min;
+        }
+
+        if (vmaxvq_u8(vorrq_u8(vorrq_u8(v0, v1), vorrq_u8(v2, v3))) < 0x80) {
+            error = vorrq_u8(error, prev_incomplete);
+            prev_incomplete = zero;
+        } else {
+            error = vorrq_u8(error, bjd_utf8_block_neon(v0, prev));
+            error = vorrq_u8(error, bjd_utf8_block_neon(v1, v0));
+            error = vorrq_u8(error, bjd_utf8_block_neon(v2, v1));
+            error = vorrq_u8(error, bjd_utf8_block_neon(v3, v2));
+            prev_incomplete = vqsubq_u8(v3, incomplete_max);
+        }
+        prev = v3;
+    }
+
+    while (i < count) {
+        uint8x16_t v;
+        if (count - i >= 16) {
+            v = vld1q_u8(str + i);
+            i += 16;
+        } else {
+            uint8_t block[16];
+            bjd_memset(block, ' ', sizeof(block));
+            bjd_memcpy(block, str + i, count - i);
+            v = vld1q_u8(block);
+            i = count;
+        }
+        if (!allow_null) {
+            uint8_t block_min = vminvq_u8(v);
+            min = (block_min < min) ? block_min : min;
+        }
+        error = vorrq_u8(error, bjd_utf8_block_neon(v, prev));
+        prev_incomplete = vqsubq_u8(v, incomplete_max);
+        prev = v;
+    }
+
+    if (!allow_null && min == 0)
+        return false;
+    return vmaxvq_u8(vorrq_u8(error, prev_incomplete)) == 0;
+}
+#else
+#define bjd_utf8_check_neon bjd_utf8_check_scalar
+#endif
+
+static const bjd_convert_kernels_t bjd_convert_kernels_neon = {
+    "neon",
+    bjd_convert_swap16_neon,
+    bjd_convert_swap32_neon,
+    bjd_convert_swap64_neon,
+    bjd_convert_widen_u8_u16_neon,
+    bjd_convert_widen_i8_i16_neon,
+    bjd_convert_widen_u16_u32_neon,
+    bjd_convert_widen_i16_i32_neon,
+    bjd_utf8_check_neon,
+};
+
+static const bjd_convert_kernels_t* const bjd_convert_kernel_sets[] = {
+    &bjd_convert_kernels_neon,
+    &bjd_convert_kernels_scalar,
+};
+
+#define bjd_convert_supported(kernels) (BJDATA_UNUSED(kernels), true)
+
+#else
+
+static const bjd_convert_kernels_t* const bjd_convert_kernel_sets[] = {
+    &bjd_convert_kernels_scalar,
+};
+
+#define bjd_convert_supported(kernels) (BJDATA_UNUSED(kernels), true)
+
+#endif
+
+// Returns the fastest supported kernel set with the given name, or with any
+// name if it is NULL, or NULL if there is none.
+static const bjd_convert_kernels_t* bjd_convert_select(const char* name) {
+    size_t length = (name == NULL) ? 0 : bjd_strlen(name);
+    size_t count = sizeof(bjd_convert_kernel_sets) / sizeof(bjd_convert_kernel_sets[0]);
+    for (size_t i = 0; i < count; ++i) {
+        const bjd_convert_kernels_t* kernels = bjd_convert_kernel_sets[i];
+        if (name != NULL && (bjd_strlen(kernels->name) != length ||
+                    bjd_memcmp(kernels->name, name, length) != 0))
+            continue;
+        if (bjd_convert_supported(kernels))
+            return kernels;
+    }
+    return NULL;
+}
+
+// The kernels are selected the first time they are needed. Concurrent
+// first calls may each select them, so the pointer is loaded and stored
+// atomically. The kernel sets are constant, so no ordering is needed.
+#if defined(__GNUC__) || defined(__clang__)
+static const bjd_convert_kernels_t* bjd_convert_kernels;
+#define BJDATA_CONVERT_LOAD() __atomic_load_n(&bjd_convert_kernels, __ATOMIC_RELAXED)
+#define BJDATA_CONVERT_STORE(kernels) __atomic_store_n(&bjd_convert_kernels, (kernels), __ATOMIC_RELAXED)
+#else
+// Aligned volatile pointer accesses are atomic with MSVC and the other
+// compilers we support.
+static const bjd_convert_kernels_t* volatile bjd_convert_kernels;
+#define BJDATA_CONVERT_LOAD() bjd_convert_kernels
+#define BJDATA_CONVERT_STORE(kernels) (bjd_convert_kernels = (kernels))
+#endif
+
+BJDATA_STATIC_INLINE const bjd_convert_kernels_t* bjd_convert_get_kernels(void) {
+    const bjd_convert_kernels_t* kernels = BJDATA_CONVERT_LOAD();
+    if (BJDATA_UNLIKELY(kernels == NULL)) {
+        kernels = bjd_convert_select(NULL);
+        BJDATA_CONVERT_STORE(kernels);
+    }
+    return kernels;
+}
+
+const char* bjd_convert_kernels_name(void) {
+    return bjd_convert_get_kernels()->name;
+}
+
+bool bjd_convert_use_kernels(const char* name) {
+    const bjd_convert_kernels_t* kernels = bjd_convert_select(name);
+    if (kernels == NULL)
+        return false;
+    BJDATA_CONVERT_STORE(kernels);
+    return true;
+}
+
+void bjd_convert_swap(char* dest, const char* src, size_t size, size_t count) {
+    const bjd_convert_kernels_t* kernels = bjd_convert_get_kernels();
+    switch (size) {
+        case 2: kernels->swap16(dest, src, count); break;
+        case 4: kernels->swap32(dest, src, count); break;
+        default:
+            bjd_assert(size == 8, "invalid element size %i", (int)size);
+            kernels->swap64(dest, src, count);
+            break;
+    }
+}
+
+bool bjd_utf8_validate(const char* str, size_t count, bool allow_null) {
+    // short strings such as keys are not worth setting up vectors for
+    if (count < 16)
+        return bjd_utf8_check_scalar((const uint8_t*)str, count, allow_null);
+    return bjd_convert_get_kernels()->utf8_check((const uint8_t*)str, count, allow_null);
+}
+
+void bjd_convert_widen(char* dest, size_t dest_size, const char* src, size_t src_size,
+        bool is_signed, size_t count)
+{
+    bjd_assert(dest_size > src_size, "cannot widen %i bytes to %i", (int)src_size, (int)dest_size);
+
+    const bjd_convert_kernels_t* kernels = bjd_convert_get_kernels();
+    bjd_convert_fn_t fn;
+
+    // The kernels are indexed by the source and destination sizes.
+    switch (src_size * 16 + dest_size) {
+        case 0x12: fn = is_signed ? kernels->widen_i8_i16 : kernels->widen_u8_u16; break;
+        case 0x14: fn = is_signed ? bjd_convert_widen_i8_i32_scalar : bjd_convert_widen_u8_u32_scalar; break;
+        case 0x18: fn = is_signed ? bjd_convert_widen_i8_i64_scalar : bjd_convert_widen_u8_u64_scalar; break;
+        case 0x24: fn = is_signed ? kernels->widen_i16_i32 : kernels->widen_u16_u32; break;
+        case 0x28: fn = is_signed ? bjd_convert_widen_i16_i64_scalar : bjd_convert_widen_u16_u64_scalar; break;
+        default:
+            bjd_assert(src_size == 4 && dest_size == 8, "invalid sizes %i and %i", (int)src_size, (int)dest_size);
+            fn = is_signed ? bjd_convert_widen_i32_i64_scalar : bjd_convert_widen_u32_u64_scalar;
+            break;
+    }
+
+    fn(dest, src, count);
+}
@@ -596,6 +596,31 @@ BJDATA_EXTERN_C_START
 
 #endif
 
+/*
+ * BJDATA_HOST_BIG_ENDIAN is 1 if the host is known at compile-time to
+ * store multi-byte values in network byte order, and
+ * BJDATA_HOST_LITTLE_ENDIAN is 1 if it is known to store them in
+ * little-endian order. Bulk payloads (such as typed arrays) in the host's
+ * byte order can then be copied as-is instead of being swapped one
+ * element at a time.
+ *
+ * If neither is known, the host is treated as little-endian for bulk
+ * payloads, but individual numbers are assembled byte by byte.
+ */
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    #define BJDATA_HOST_BIG_ENDIAN 1
+#else
+    #define BJDATA_HOST_BIG_ENDIAN 0
+#endif
+
+#if defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    #define BJDATA_HOST_LITTLE_ENDIAN 1
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64) || defined(_M_AMD64) || defined(_M_ARM) || defined(_M_ARM64))
+    #define BJDATA_HOST_LITTLE_ENDIAN 1
+#else
+    #define BJDATA_HOST_LITTLE_ENDIAN 0
+#endif
+
 #if defined(__FLOAT_WORD_ORDER__) && defined(__BYTE_ORDER__)
 
     // We check where possible that the float byte order matches the
@@ -618,6 +643,94 @@ BJDATA_EXTERN_C_START
 #endif
 
 
+
+/*
+ * SIMD support
+ *
+ * BJDATA_SIMD_X86 is 1 if SSE2, SSSE3 and AVX2 kernels can be compiled
+ * without special compiler flags and selected at runtime.
+ * BJDATA_SIMD_NEON is 1 if NEON is enabled at compile-time on a
+ * little-endian target.
+ */
+
+#if BJDATA_SIMD && !BJDATA_NO_BUILTINS
+    #if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+        // The target attribute lets us compile AVX2 intrinsics in a
+        // single function; this requires GCC 4.9 or Clang 3.8.
+        #if defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+            #define BJDATA_SIMD_X86 1
+            #define BJDATA_SIMD_TARGET(isa) __attribute__((target(isa)))
+        #endif
+    #elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+        #define BJDATA_SIMD_X86 1
+        #define BJDATA_SIMD_TARGET(isa) /* nothing */
+    #endif
+
+    // The NEON kernels assume little-endian lanes.
+    #if (defined(__ARM_NEON) || defined(__ARM_NEON__)) && !defined(__ARM_BIG_ENDIAN)
+        #define BJDATA_SIMD_NEON 1
+    #endif
+#endif
+
+#ifndef BJDATA_SIMD_X86
+    #define BJDATA_SIMD_X86 0
+#endif
+#ifndef BJDATA_SIMD_NEON
+    #define BJDATA_SIMD_NEON 0
+#endif
+
+
+
+/*
+ * Bulk conversion kernels
+ *
+ * These convert runs of fixed-size numbers, such as the payload of a typed
+ * array, or validate runs of UTF-8. The fastest implementation supported by
+ * the CPU is picked once, the first time any of them is called.
+ */
+
+/**
+ * Swaps the byte order of count elements of the given size (2, 4 or 8)
+ * from src into dest. dest and src must either be equal or not overlap.
+ */
+void bjd_convert_swap(char* dest, const char* src, size_t size, size_t count);
+
+/**
+ * Widens count integers in host byte order from src_size to dest_size,
+ * sign-extending if is_signed is true. dest_size must be larger than
+ * src_size.
+ *
+ * The buffers may overlap as long as dest neither starts nor ends after
+ * src, as when a payload is read into the tail of its destination and
+ * widened in place front to back.
+ */
+void bjd_convert_widen(char* dest, size_t dest_size, const char* src, size_t src_size,
+        bool is_signed, size_t count);
+
+/**
+ * Returns true if the given bytes are valid UTF-8, without overlong
+ * sequences, surrogates or code points above U+10FFFF. If allow_null is
+ * false, null bytes are also rejected.
+ */
+bool bjd_utf8_validate(const char* str, size_t count, bool allow_null);
+
+/**
+ * Returns the name of the kernels in use: "scalar", "sse2", "ssse3", "avx2"
+ * or "neon".
+ */
+const char* bjd_convert_kernels_name(void);
+
+/**
+ * Switches to the kernels with the given name, or back to the fastest ones
+ * if name is NULL. Returns false if they are not compiled in or not
+ * supported by the CPU.
+ *
+ * This is for comparing kernels in tests and benchmarks. It must not be
+ * called while other threads are converting.
+ */
+bool bjd_convert_use_kernels(const char* name);
+
+
 /*
  * Here we define bjd_assert() and bjd_break(). They both work like a normal
  * assertion function in debug mode, causing a trap or abort. However, on some platforms
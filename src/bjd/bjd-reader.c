@@ -26,6 +26,7 @@
 #if BJDATA_READER
 
 static void bjd_reader_skip_using_fill(bjd_reader_t* reader, size_t count);
+static void bjd_skip_bytes_notrack(bjd_reader_t* reader, size_t count);
 
 void bjd_reader_init(bjd_reader_t* reader, char* buffer, size_t size, size_t count) {
     bjd_assert(buffer != NULL, "buffer is NULL");
@@ -35,9 +36,10 @@ void bjd_reader_init(bjd_reader_t* reader, char* buffer, size_t size, size_t cou
     reader->size = size;
     reader->data = buffer;
     reader->end = buffer + count;
+    reader->position = count;
 
     #if BJDATA_READ_TRACKING
-    bjd_reader_flag_if_error(reader, bjd_track_init(&reader->track));
+    bjd_reader_flag_if_error(reader, bjd_track_init(&reader->track, NULL));
     #endif
 
     bjd_log("===========================\n");
@@ -58,15 +60,57 @@ void bjd_reader_init_data(bjd_reader_t* reader, const char* data, size_t count)
     bjd_memset(reader, 0, sizeof(*reader));
     reader->data = data;
     reader->end = data + count;
+    reader->position = count;
 
     #if BJDATA_READ_TRACKING
-    bjd_reader_flag_if_error(reader, bjd_track_init(&reader->track));
+    bjd_reader_flag_if_error(reader, bjd_track_init(&reader->track, NULL));
     #endif
 
     bjd_log("===========================\n");
     bjd_log("initializing reader with data size %i\n", (int)count);
 }
 
+void bjd_reader_init_resumable(bjd_reader_t* reader, char* buffer, size_t size) {
+    bjd_reader_init(reader, buffer, size, 0);
+    reader->resumable = true;
+
+    if (size < BJDATA_READER_MINIMUM_BUFFER_SIZE) {
+        bjd_break("buffer size is %i, but minimum buffer size for a resumable reader is %i",
+                (int)size, BJDATA_READER_MINIMUM_BUFFER_SIZE);
+        bjd_reader_flag_error(reader, bjd_error_bug);
+    }
+}
+
+size_t bjd_reader_feed(bjd_reader_t* reader, const char* data, size_t count) {
+    bjd_assert(reader->resumable, "cannot feed a reader that is not resumable!");
+    bjd_assert(count == 0 || data != NULL, "data for %i bytes is NULL", (int)count);
+
+    if (reader->error == bjd_would_block)
+        reader->error = bjd_ok;
+    if (bjd_reader_error(reader) != bjd_ok)
+        return 0;
+
+    // move the unread data to the start of the buffer if the new data
+    // doesn't fit after it
+    size_t used = (size_t)(reader->end - reader->buffer);
+    if (count > reader->size - used && reader->data != reader->buffer) {
+        size_t left = (size_t)(reader->end - reader->data);
+        bjd_memmove(reader->buffer, reader->data, left);
+        reader->data = reader->buffer;
+        reader->end = reader->buffer + left;
+        used = left;
+    }
+
+    if (count > reader->size - used)
+        count = reader->size - used;
+    bjd_memcpy(reader->buffer + used, data, count);
+    reader->end += count;
+    reader->position += count;
+    bjd_log("fed %i bytes to resumable reader, %i bytes buffered\n",
+            (int)count, (int)(reader->end - reader->data));
+    return count;
+}
+
 void bjd_reader_set_fill(bjd_reader_t* reader, bjd_reader_fill_t fill) {
     BJDATA_STATIC_ASSERT(BJDATA_READER_MINIMUM_BUFFER_SIZE >= BJDATA_MAXIMUM_TAG_SIZE,
             "minimum buffer size must fit any tag!");
@@ -92,6 +136,12 @@ void bjd_reader_set_skip(bjd_reader_t* reader, bjd_reader_skip_t skip) {
     reader->skip = skip;
 }
 
+void bjd_reader_set_skip_index(bjd_reader_t* reader, const bjd_skip_index_t* index) {
+    reader->skip_index = index;
+    reader->skip_base = reader->position - (size_t)(reader->end - reader->data);
+    reader->skip_cursor = 0;
+}
+
 #if BJDATA_STDIO
 static size_t bjd_file_reader_fill(bjd_reader_t* reader, char* buffer, size_t count) {
     if (feof((FILE *)reader->context)) {
@@ -180,6 +230,53 @@ void bjd_reader_init_filename(bjd_reader_t* reader, const char* filename) {
 }
 #endif
 
+#if BJDATA_MMAP
+static void bjd_mmap_reader_teardown(bjd_reader_t* reader) {
+    bjd_file_map_t* map = (bjd_file_map_t*)reader->context;
+    bjd_file_unmap(map);
+    BJDATA_FREE(map);
+    reader->context = NULL;
+    reader->teardown = NULL;
+}
+
+void bjd_reader_init_mmap(bjd_reader_t* reader, const char* filename, unsigned flags) {
+    bjd_assert(filename != NULL, "filename is NULL");
+
+    bjd_file_map_t* map = (bjd_file_map_t*)BJDATA_MALLOC(sizeof(bjd_file_map_t));
+    if (map == NULL) {
+        bjd_reader_init_error(reader, bjd_error_memory);
+        return;
+    }
+
+    bjd_error_t error = bjd_file_map(map, filename, flags);
+    if (error != bjd_ok) {
+        BJDATA_FREE(map);
+        bjd_reader_init_error(reader, error);
+        return;
+    }
+
+    // the whole file is in memory, so there is no buffer and no fill
+    bjd_reader_init_data(reader, (const char*)map->address, map->size);
+    bjd_reader_set_context(reader, map);
+    bjd_reader_set_teardown(reader, bjd_mmap_reader_teardown);
+}
+#endif
+
+#ifdef BJDATA_MALLOC
+void bjd_reader_set_allocator(bjd_reader_t* reader, const bjd_allocator_t* allocator) {
+    reader->allocator = allocator;
+
+    // the tracking stack is still empty so it is simply recreated
+    #if BJDATA_READ_TRACKING
+    if (reader->error == bjd_ok) {
+        bjd_assert(reader->track.count == 0, "cannot change the allocator after reading has started");
+        bjd_track_destroy(&reader->track, true);
+        bjd_reader_flag_if_error(reader, bjd_track_init(&reader->track, allocator));
+    }
+    #endif
+}
+#endif
+
 bjd_error_t bjd_reader_destroy(bjd_reader_t* reader) {
 
     // clean up tracking, asserting if we're not already in an error state
@@ -219,6 +316,71 @@ void bjd_reader_flag_error(bjd_reader_t* reader, bjd_error_t error) {
     }
 }
 
+// Puts a resumable reader that needs count bytes, more than it has buffered,
+// in the would-block state until more data is fed. Flags bjd_error_too_big
+// instead if they can never fit in its buffer.
+BJDATA_NOINLINE static void bjd_reader_block(bjd_reader_t* reader, size_t count) {
+    bjd_assert(reader->resumable, "reader is not resumable!");
+    if (count > reader->size) {
+        bjd_reader_flag_error(reader, bjd_error_too_big);
+        return;
+    }
+    bjd_log("reader %p needs %i bytes, has %i; waiting for data\n", (void*)reader,
+            (int)count, (int)(reader->end - reader->data));
+    if (reader->error == bjd_ok)
+        reader->error = bjd_would_block;
+}
+
+// Returns false and blocks if a resumable reader has fewer than count bytes
+// buffered. This is checked before a read is tracked so that it can be
+// retried as is.
+BJDATA_STATIC_INLINE bool bjd_reader_wait(bjd_reader_t* reader, size_t count) {
+    if (!reader->resumable || reader->error != bjd_ok ||
+            count <= (size_t)(reader->end - reader->data))
+        return true;
+    bjd_reader_block(reader, count);
+    return false;
+}
+
+void bjd_reader_mark(bjd_reader_t* reader, bjd_reader_mark_t* mark) {
+    mark->data = reader->data;
+    mark->packed_type = reader->packed_type;
+    mark->packed_value_next = reader->packed_value_next;
+    mark->packed_left = reader->packed_left;
+
+    // reads only change the top element of the tracking stack and those
+    // pushed above it
+    #if BJDATA_READ_TRACKING
+    mark->track_count = reader->track.count;
+    if (mark->track_count > 0)
+        mark->track_top = reader->track.elements[mark->track_count - 1];
+    #endif
+}
+
+void bjd_reader_rewind(bjd_reader_t* reader, const bjd_reader_mark_t* mark) {
+    if (reader->error != bjd_would_block)
+        return;
+
+    // if the buffer is already full from the mark, the call can't succeed
+    if ((size_t)(reader->end - mark->data) >= reader->size) {
+        reader->error = bjd_ok;
+        bjd_reader_flag_error(reader, bjd_error_too_big);
+        return;
+    }
+
+    bjd_log("rewinding %i bytes\n", (int)(reader->data - mark->data));
+    reader->data = mark->data;
+    reader->packed_type = mark->packed_type;
+    reader->packed_value_next = mark->packed_value_next;
+    reader->packed_left = mark->packed_left;
+
+    #if BJDATA_READ_TRACKING
+    reader->track.count = mark->track_count;
+    if (mark->track_count > 0)
+        reader->track.elements[mark->track_count - 1] = mark->track_top;
+    #endif
+}
+
 // Loops on the fill function, reading between the minimum and
 // maximum number of bytes and flagging an error if it fails.
 BJDATA_NOINLINE static size_t bjd_fill_range(bjd_reader_t* reader, char* p, size_t min_bytes, size_t max_bytes) {
@@ -242,6 +404,7 @@ BJDATA_NOINLINE static size_t bjd_fill_range(bjd_reader_t* reader, char* p, size
 
         count += read;
     }
+    reader->position += count;
     return count;
 }
 
@@ -254,6 +417,12 @@ BJDATA_NOINLINE bool bjd_reader_ensure_straddle(bjd_reader_t* reader, size_t cou
             "left in buffer. call bjd_reader_ensure() instead",
             (int)count, (int)(reader->end - reader->data));
 
+    // a resumable reader waits for more data to be fed
+    if (reader->resumable) {
+        bjd_reader_block(reader, count);
+        return false;
+    }
+
     // we'll need a fill function to get more data. if there's no
     // fill function, the buffer should contain an entire Binary JData
     // object, so we raise bjd_error_invalid instead of bjd_error_io
@@ -311,6 +480,14 @@ BJDATA_NOINLINE void bjd_read_native_straddle(bjd_reader_t* reader, char* p, siz
         return;
     }
 
+    // a resumable reader waits for more data to be fed. nothing is
+    // consumed until all of it is buffered.
+    if (reader->resumable) {
+        bjd_reader_block(reader, count);
+        bjd_memset(p, 0, count);
+        return;
+    }
+
     // we'll need a fill function to get more data. if there's no
     // fill function, the buffer should contain an entire Binary JData
     // object, so we raise bjd_error_invalid instead of bjd_error_io
@@ -361,6 +538,12 @@ BJDATA_NOINLINE void bjd_read_native_straddle(bjd_reader_t* reader, char* p, siz
 
 BJDATA_NOINLINE static void bjd_skip_bytes_straddle(bjd_reader_t* reader, size_t count) {
 
+    // a resumable reader skips only once all of the data is buffered
+    if (reader->resumable) {
+        bjd_reader_block(reader, count);
+        return;
+    }
+
     // we'll need at least a fill function to skip more data. if there's
     // no fill function, the buffer should contain an entire Binary JData
     // object, so we raise bjd_error_invalid instead of bjd_error_io
@@ -383,6 +566,7 @@ BJDATA_NOINLINE static void bjd_skip_bytes_straddle(bjd_reader_t* reader, size_t
     // fill the buffer and skip from it instead of trying to seek.
     if (reader->skip && count > reader->size / 16) {
         bjd_log("calling skip function for %i bytes\n", (int)count);
+        reader->position += count;
         reader->skip(reader, count);
         return;
     }
@@ -391,12 +575,17 @@ BJDATA_NOINLINE static void bjd_skip_bytes_straddle(bjd_reader_t* reader, size_t
 }
 
 void bjd_skip_bytes(bjd_reader_t* reader, size_t count) {
+    if (!bjd_reader_wait(reader, count))
+        return;
+    bjd_reader_track_bytes(reader, count);
+    bjd_skip_bytes_notrack(reader, count);
+}
+
+static void bjd_skip_bytes_notrack(bjd_reader_t* reader, size_t count) {
     if (bjd_reader_error(reader) != bjd_ok)
         return;
     bjd_log("skip requested for %i bytes\n", (int)count);
 
-    bjd_reader_track_bytes(reader, count);
-
     // check if we have enough in the buffer already
     size_t left = (size_t)(reader->end - reader->data);
     if (left >= count) {
@@ -438,12 +627,16 @@ BJDATA_NOINLINE static void bjd_reader_skip_using_fill(bjd_reader_t* reader, siz
 
 void bjd_read_bytes(bjd_reader_t* reader, char* p, size_t count) {
     bjd_assert(p != NULL, "destination for read of %i bytes is NULL", (int)count);
+    if (!bjd_reader_wait(reader, count))
+        return;
     bjd_reader_track_bytes(reader, count);
     bjd_read_native(reader, p, count);
 }
 
 void bjd_read_utf8(bjd_reader_t* reader, char* p, size_t byte_count) {
     bjd_assert(p != NULL, "destination for read of %i bytes is NULL", (int)byte_count);
+    if (!bjd_reader_wait(reader, byte_count))
+        return;
     bjd_reader_track_str_bytes_all(reader, byte_count);
     bjd_read_native(reader, p, byte_count);
 
@@ -466,6 +659,11 @@ static void bjd_read_cstr_unchecked(bjd_reader_t* reader, char* buf, size_t buff
         return;
     }
 
+    if (!bjd_reader_wait(reader, byte_count)) {
+        buf[0] = 0;
+        return;
+    }
+
     bjd_reader_track_str_bytes_all(reader, byte_count);
     bjd_read_native(reader, buf, byte_count);
     buf[byte_count] = 0;
@@ -506,6 +704,8 @@ static void bjd_read_native_noerrorfn(bjd_reader_t* reader, char* p, size_t coun
 char* bjd_read_bytes_alloc_impl(bjd_reader_t* reader, size_t count, bool null_terminated) {
 
     // track the bytes first in case it jumps
+    if (!bjd_reader_wait(reader, count))
+        return NULL;
     bjd_reader_track_bytes(reader, count);
     if (bjd_reader_error(reader) != bjd_ok)
         return NULL;
@@ -515,7 +715,7 @@ char* bjd_read_bytes_alloc_impl(bjd_reader_t* reader, size_t count, bool null_te
         return NULL;
 
     // allocate data
-    char* data = (char*)BJDATA_MALLOC(count + (null_terminated ? 1 : 0)); // TODO: can this overflow?
+    char* data = (char*)bjd_allocator_malloc(reader->allocator, count + (null_terminated ? 1 : 0)); // TODO: can this overflow?
     if (data == NULL) {
         bjd_reader_flag_error(reader, bjd_error_memory);
         return NULL;
@@ -526,7 +726,7 @@ char* bjd_read_bytes_alloc_impl(bjd_reader_t* reader, size_t count, bool null_te
 
     // report flagged errors
     if (bjd_reader_error(reader) != bjd_ok) {
-        BJDATA_FREE(data);
+        bjd_allocator_free(reader->allocator, data);
         if (reader->error_fn)
             reader->error_fn(reader, bjd_reader_error(reader));
         return NULL;
@@ -560,11 +760,15 @@ static const char* bjd_read_bytes_inplace_notrack(bjd_reader_t* reader, size_t c
 }
 
 const char* bjd_read_bytes_inplace(bjd_reader_t* reader, size_t count) {
+    if (!bjd_reader_wait(reader, count))
+        return NULL;
     bjd_reader_track_bytes(reader, count);
     return bjd_read_bytes_inplace_notrack(reader, count);
 }
 
 const char* bjd_read_utf8_inplace(bjd_reader_t* reader, size_t count) {
+    if (!bjd_reader_wait(reader, count))
+        return NULL;
     bjd_reader_track_str_bytes_all(reader, count);
     const char* str = bjd_read_bytes_inplace_notrack(reader, count);
 
@@ -576,23 +780,235 @@ const char* bjd_read_utf8_inplace(bjd_reader_t* reader, size_t count) {
     return str;
 }
 
+// Parses an integer length or count of the given marker whose value
+// starts at offset pos from reader->data. Returns the number of bytes
+// the value occupies, or 0 on error.
+static size_t bjd_parse_length_value(bjd_reader_t* reader, char marker, size_t pos, uint32_t* length) {
+    size_t size = bjd_typed_marker_size(marker);
+    if (size == 0 || marker == 'd' || marker == 'D') {
+        bjd_reader_flag_error(reader, bjd_error_invalid);
+        return 0;
+    }
+    if (!bjd_reader_ensure(reader, pos + size))
+        return 0;
+
+    bjd_tag_t value = bjd_load_typed(marker, reader->data + pos, reader->endian);
+    if (value.type == bjd_type_int) {
+        if (value.v.i < 0) {
+            bjd_reader_flag_error(reader, bjd_error_invalid);
+            return 0;
+        }
+        value.v.u = (uint64_t)value.v.i;
+    }
+
+    if (value.v.u > UINT32_MAX) {
+        bjd_reader_flag_error(reader, bjd_error_too_big);
+        return 0;
+    }
+
+    *length = (uint32_t)value.v.u;
+    return size;
+}
+
+// Parses an integer length or count starting with its marker at offset
+// pos from reader->data, as follows the '#' of an optimized container or
+// the 'S' of a string. Returns the number of bytes it occupies, or 0 on
+// error.
+static size_t bjd_parse_length(bjd_reader_t* reader, size_t pos, uint32_t* length) {
+    if (!bjd_reader_ensure(reader, pos + 1))
+        return 0;
+    size_t size = bjd_parse_length_value(reader, reader->data[pos], pos + 1, length);
+    return size == 0 ? 0 : 1 + size;
+}
+
+// Parses the dimension vector of an ND-array starting with its '[' at
+// offset pos from reader->data. The vector is itself an array of integers
+// which may be typed, counted, or terminated by ']'. Returns the number of
+// bytes it occupies, or 0 on error.
+static size_t bjd_parse_dims(bjd_reader_t* reader, size_t pos, uint32_t* dims, size_t* ndims) {
+    size_t start = pos++;
+    char elemtype = 0;
+    uint32_t count = 0;
+    bool counted = false;
+
+    if (!bjd_reader_ensure(reader, pos + 1))
+        return 0;
+
+    if (reader->data[pos] == BJDATA_MARKER_TYPE) {
+        if (!bjd_reader_ensure(reader, pos + 3))
+            return 0;
+        elemtype = reader->data[pos + 1];
+        if (reader->data[pos + 2] != BJDATA_MARKER_COUNT) {
+            bjd_reader_flag_error(reader, bjd_error_invalid);
+            return 0;
+        }
+        pos += 2;
+    }
+
+    if (reader->data[pos] == BJDATA_MARKER_COUNT) {
+        size_t size = bjd_parse_length(reader, pos + 1, &count);
+        if (size == 0)
+            return 0;
+        pos += 1 + size;
+        counted = true;
+        if (count > BJDATA_NDARRAY_MAX_DIMS) {
+            bjd_reader_flag_error(reader, bjd_error_unsupported);
+            return 0;
+        }
+    }
+
+    size_t i = 0;
+    while (!counted || i < count) {
+        size_t size;
+        if (elemtype != 0) {
+            size = bjd_parse_length_value(reader, elemtype, pos, &dims[i]);
+        } else {
+            if (!bjd_reader_ensure(reader, pos + 1))
+                return 0;
+            if (!counted && reader->data[pos] == BJDATA_MARKER_ARRAY_END) {
+                ++pos;
+                break;
+            }
+            if (i == BJDATA_NDARRAY_MAX_DIMS) {
+                bjd_reader_flag_error(reader, bjd_error_unsupported);
+                return 0;
+            }
+            size = bjd_parse_length(reader, pos, &dims[i]);
+        }
+        if (size == 0)
+            return 0;
+        pos += size;
+        ++i;
+    }
+
+    if (i == 0) {
+        bjd_reader_flag_error(reader, bjd_error_invalid);
+        return 0;
+    }
+
+    *ndims = i;
+    return pos - start;
+}
+
+// Parses the header of an array or map. The container marker may be
+// followed by a '$' element marker (which requires a count) and a '#'
+// count, which may be a dimension vector for an ND-array. If dims is not
+// NULL, the dimensions are stored in it (a plain count is stored as a
+// single dimension.) Returns the size of the header, or 0 on error.
+static size_t bjd_parse_container(bjd_reader_t* reader, bjd_tag_t* tag, bjd_type_t type,
+        uint32_t* dims, size_t* ndims)
+{
+    size_t pos = 1;
+    char elemtype = 0;
+
+    if (!bjd_reader_ensure(reader, pos + 1))
+        return 0;
+
+    if (reader->data[pos] == BJDATA_MARKER_TYPE) {
+        if (!bjd_reader_ensure(reader, pos + 2))
+            return 0;
+        elemtype = reader->data[pos + 1];
+
+        // only fixed-size numbers can be packed without markers
+        if (bjd_typed_marker_size(elemtype) == 0) {
+            bjd_reader_flag_error(reader, bjd_error_unsupported);
+            return 0;
+        }
+
+        pos += 2;
+        if (!bjd_reader_ensure(reader, pos + 1))
+            return 0;
+
+        // a '$' type must always be followed by a '#' count
+        if (reader->data[pos] != BJDATA_MARKER_COUNT) {
+            bjd_reader_flag_error(reader, bjd_error_invalid);
+            return 0;
+        }
+    }
+
+    // a container without a count is terminated by a closing marker
+    // rather than declaring its size up front
+    if (reader->data[pos] != BJDATA_MARKER_COUNT) {
+        *tag = bjd_tag_make_unsized(type);
+        return pos;
+    }
+
+    if (!bjd_reader_ensure(reader, pos + 2))
+        return 0;
+
+    uint32_t count;
+    size_t size;
+
+    if (reader->data[pos + 1] == BJDATA_MARKER_ARRAY_START && type == bjd_type_array) {
+        uint32_t local_dims[BJDATA_NDARRAY_MAX_DIMS];
+        size_t local_ndims;
+        if (dims == NULL) {
+            dims = local_dims;
+            ndims = &local_ndims;
+        }
+
+        size = bjd_parse_dims(reader, pos + 1, dims, ndims);
+        if (size == 0)
+            return 0;
+
+        // the element count is the product of the dimensions
+        uint64_t total = 1;
+        for (size_t i = 0; i < *ndims; ++i) {
+            total *= dims[i];
+            if (total > UINT32_MAX) {
+                bjd_reader_flag_error(reader, bjd_error_too_big);
+                return 0;
+            }
+        }
+        count = (uint32_t)total;
+
+    } else {
+        size = bjd_parse_length(reader, pos + 1, &count);
+        if (size == 0)
+            return 0;
+        if (dims != NULL) {
+            dims[0] = count;
+            *ndims = 1;
+        }
+    }
+
+    // make sure the payload size of a typed array can be computed
+    if (elemtype != 0 && count > SIZE_MAX / bjd_typed_marker_size(elemtype)) {
+        bjd_reader_flag_error(reader, bjd_error_too_big);
+        return 0;
+    }
+
+    *tag = (type == bjd_type_array) ? bjd_tag_make_array(count) : bjd_tag_make_map(count);
+    tag->elemtype = elemtype;
+    return pos + 1 + size;
+}
+
 static size_t bjd_parse_tag(bjd_reader_t* reader, bjd_tag_t* tag) {
     bjd_assert(reader->error == bjd_ok, "reader cannot be in an error state!");
 
+    // a value of an optimized map has no marker of its own
+    if (reader->packed_value_next) {
+        size_t size = bjd_typed_marker_size(reader->packed_type);
+        if (!bjd_reader_ensure(reader, size))
+            return 0;
+        *tag = bjd_load_typed(reader->packed_type, reader->data, reader->endian);
+        return size;
+    }
+
+    // a key of an optimized map is a string without its 'S' marker
+    if (reader->packed_type != 0) {
+        uint32_t length;
+        size_t size = bjd_parse_length(reader, 0, &length);
+        if (size == 0)
+            return 0;
+        *tag = bjd_tag_make_str(length);
+        return size;
+    }
+
     if (!bjd_reader_ensure(reader, 1))
         return 0;
     uint8_t type = bjd_load_u8(reader->data);
 
-    // unfortunately, by far the fastest way to parse a tag is to switch
-    // on the first byte, and to explicitly list every possible byte. so for
-    // infix types, the list of cases is quite large.
-    //
-    // in size-optimized builds, we switch on the top four bits first to
-    // handle most infix types with a smaller jump table to save space.
-
-    #if BJDATA_OPTIMIZE_FOR_SIZE
-
-    // handle individual type tags
     switch (type) {
         // nil
         case 'Z':
@@ -606,21 +1022,21 @@ static size_t bjd_parse_tag(bjd_reader_t* reader, bjd_tag_t* tag) {
 
         // bool
         case 'F': case 'T':
-            *tag = bjd_tag_make_bool((bool)(type & 1));
+            *tag = bjd_tag_make_bool(type == 'T');
             return 1;
 
         // float
         case 'd':
             if (!bjd_reader_ensure(reader, BJDATA_TAG_SIZE_FLOAT))
                 return 0;
-            *tag = bjd_tag_make_float(bjd_load_float(reader->data + 1));
+            *tag = bjd_tag_make_float(bjd_load_float_endian(reader->data + 1, reader->endian));
             return BJDATA_TAG_SIZE_FLOAT;
 
         // double
         case 'D':
             if (!bjd_reader_ensure(reader, BJDATA_TAG_SIZE_DOUBLE))
                 return 0;
-            *tag = bjd_tag_make_double(bjd_load_double(reader->data + 1));
+            *tag = bjd_tag_make_double(bjd_load_double_endian(reader->data + 1, reader->endian));
             return BJDATA_TAG_SIZE_DOUBLE;
 
         // uint8
@@ -634,21 +1050,21 @@ static size_t bjd_parse_tag(bjd_reader_t* reader, bjd_tag_t* tag) {
         case 'u':
             if (!bjd_reader_ensure(reader, BJDATA_TAG_SIZE_U16))
                 return 0;
-            *tag = bjd_tag_make_uint(bjd_load_u16(reader->data + 1));
+            *tag = bjd_tag_make_uint(bjd_load_u16_endian(reader->data + 1, reader->endian));
             return BJDATA_TAG_SIZE_U16;
 
         // uint32
         case 'm':
             if (!bjd_reader_ensure(reader, BJDATA_TAG_SIZE_U32))
                 return 0;
-            *tag = bjd_tag_make_uint(bjd_load_u32(reader->data + 1));
+            *tag = bjd_tag_make_uint(bjd_load_u32_endian(reader->data + 1, reader->endian));
             return BJDATA_TAG_SIZE_U32;
 
         // uint64
         case 'M':
             if (!bjd_reader_ensure(reader, BJDATA_TAG_SIZE_U64))
                 return 0;
-            *tag = bjd_tag_make_uint(bjd_load_u64(reader->data + 1));
+            *tag = bjd_tag_make_uint(bjd_load_u64_endian(reader->data + 1, reader->endian));
             return BJDATA_TAG_SIZE_U64;
 
         // int8
@@ -662,66 +1078,48 @@ static size_t bjd_parse_tag(bjd_reader_t* reader, bjd_tag_t* tag) {
         case 'I':
             if (!bjd_reader_ensure(reader, BJDATA_TAG_SIZE_I16))
                 return 0;
-            *tag = bjd_tag_make_int(bjd_load_i16(reader->data + 1));
+            *tag = bjd_tag_make_int(bjd_load_i16_endian(reader->data + 1, reader->endian));
             return BJDATA_TAG_SIZE_I16;
 
         // int32
         case 'l':
             if (!bjd_reader_ensure(reader, BJDATA_TAG_SIZE_I32))
                 return 0;
-            *tag = bjd_tag_make_int(bjd_load_i32(reader->data + 1));
+            *tag = bjd_tag_make_int(bjd_load_i32_endian(reader->data + 1, reader->endian));
             return BJDATA_TAG_SIZE_I32;
 
         // int64
         case 'L':
             if (!bjd_reader_ensure(reader, BJDATA_TAG_SIZE_I64))
                 return 0;
-            *tag = bjd_tag_make_int(bjd_load_i64(reader->data + 1));
+            *tag = bjd_tag_make_int(bjd_load_i64_endian(reader->data + 1, reader->endian));
             return BJDATA_TAG_SIZE_I64;
 
-        // str
+        // str and high-precision number (both carry a length)
         case 'S':
-            if (!bjd_reader_ensure(reader, BJDATA_TAG_SIZE_STR8))
-                return 0;
-            *tag = bjd_tag_make_str(bjd_load_u8(reader->data + 1));
-            return BJDATA_TAG_SIZE_STR8;
-
-        // huge
-        case 'H':
-            if (!bjd_reader_ensure(reader, BJDATA_TAG_SIZE_STR8))
+        case 'H': {
+            uint32_t length;
+            size_t size = bjd_parse_length(reader, 1, &length);
+            if (size == 0)
                 return 0;
-            *tag = bjd_tag_make_str(bjd_load_u8(reader->data + 1));
-            return BJDATA_TAG_SIZE_STR8;
+            *tag = bjd_tag_make_str(length);
+            return 1 + size;
+        }
 
         // array
         case '[':
-            if (!bjd_reader_ensure(reader, BJDATA_TAG_SIZE_ARRAY16))
-                return 0;
-            *tag = bjd_tag_make_array(bjd_load_u16(reader->data + 1));
-            return BJDATA_TAG_SIZE_ARRAY16;
+            return bjd_parse_container(reader, tag, bjd_type_array, NULL, NULL);
 
         // map
         case '{':
-            if (!bjd_reader_ensure(reader, BJDATA_TAG_SIZE_MAP16))
-                return 0;
-            *tag = bjd_tag_make_map(bjd_load_u16(reader->data + 1));
-            return BJDATA_TAG_SIZE_MAP16;
-
-        // reserved
-        case 'X':
-            bjd_reader_flag_error(reader, bjd_error_invalid);
-            return 0;
+            return bjd_parse_container(reader, tag, bjd_type_map, NULL, NULL);
 
-        #endif
-
-        #if BJDATA_OPTIMIZE_FOR_SIZE
-        // any other bytes should have been handled by the infix switch
         default:
             break;
-        #endif
     }
 
-    bjd_assert(0, "unreachable");
+    // any other byte is not a valid marker
+    bjd_reader_flag_error(reader, bjd_error_invalid);
     return 0;
 }
 
@@ -731,13 +1129,30 @@ bjd_tag_t bjd_read_tag(bjd_reader_t* reader) {
     // make sure we can read a tag
     if (bjd_reader_error(reader) != bjd_ok)
         return bjd_tag_nil();
-    if (bjd_reader_track_element(reader) != bjd_ok)
-        return bjd_tag_nil();
 
+    // the tag is parsed before it is tracked so that nothing changes if a
+    // resumable reader blocks
     bjd_tag_t tag = BJDATA_TAG_ZERO;
     size_t count = bjd_parse_tag(reader, &tag);
     if (count == 0)
         return bjd_tag_nil();
+    if (bjd_reader_track_element(reader) != bjd_ok)
+        return bjd_tag_nil();
+
+    // The keys and packed values of an optimized map alternate. Keys are
+    // always strings, which means an optimized map cannot nest another one.
+    if (reader->packed_type != 0) {
+        if (reader->packed_value_next) {
+            reader->packed_value_next = false;
+            if (--reader->packed_left == 0)
+                reader->packed_type = 0;
+        } else {
+            reader->packed_value_next = true;
+        }
+    } else if (tag.type == bjd_type_map && tag.elemtype != 0 && tag.v.n > 0) {
+        reader->packed_type = tag.elemtype;
+        reader->packed_left = tag.v.n;
+    }
 
     #if BJDATA_READ_TRACKING
     bjd_error_t track_error = bjd_ok;
@@ -745,7 +1160,13 @@ bjd_tag_t bjd_read_tag(bjd_reader_t* reader) {
     switch (tag.type) {
         case bjd_type_map:
         case bjd_type_array:
-            track_error = bjd_track_push(&reader->track, tag.type, tag.v.n);
+            // the packed payload of a typed array is not made of
+            // elements, so there is nothing to track within it.
+            if (tag.unsized)
+                track_error = bjd_track_push_unsized(&reader->track, tag.type);
+            else
+                track_error = bjd_track_push(&reader->track, tag.type,
+                        (tag.type == bjd_type_array && tag.elemtype != 0) ? 0 : tag.v.n);
             break;
         #if BJDATA_EXTENSIONS
         case bjd_type_ext:
@@ -783,7 +1204,81 @@ bjd_tag_t bjd_peek_tag(bjd_reader_t* reader) {
     return tag;
 }
 
-void bjd_discard(bjd_reader_t* reader) {
+// Consumes the given closing marker if it is next. Returns true if it was
+// consumed or if the reader is in an error state, so that loops over the
+// elements of an unsized container always end.
+static bool bjd_read_end(bjd_reader_t* reader, char marker) {
+    if (bjd_reader_error(reader) != bjd_ok)
+        return true;
+    if (!bjd_reader_ensure(reader, 1))
+        return true;
+    if (reader->data[0] != marker)
+        return false;
+    ++reader->data;
+    return true;
+}
+
+bool bjd_read_array_end(bjd_reader_t* reader) {
+    return bjd_read_end(reader, BJDATA_MARKER_ARRAY_END);
+}
+
+bool bjd_read_map_end(bjd_reader_t* reader) {
+    return bjd_read_end(reader, BJDATA_MARKER_MAP_END);
+}
+
+// Returns the offset in the source of the next byte to be read.
+BJDATA_STATIC_INLINE size_t bjd_reader_offset(bjd_reader_t* reader) {
+    return reader->position - (size_t)(reader->end - reader->data);
+}
+
+// Returns the size of the container starting at the current position if it
+// is in the skip index, or 0 otherwise.
+static size_t bjd_skip_index_find(bjd_reader_t* reader) {
+    const bjd_skip_index_t* index = reader->skip_index;
+    size_t offset = bjd_reader_offset(reader) - reader->skip_base;
+
+    // reads move forward, so the entry is usually at or after the last one
+    // found. we search from there, or before it if we moved back.
+    size_t low = 0;
+    size_t high = index->count;
+    size_t cursor = reader->skip_cursor;
+    if (cursor < high && index->entries[cursor].start <= offset)
+        low = cursor;
+    else
+        high = cursor < high ? cursor : high;
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (index->entries[mid].start < offset)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    reader->skip_cursor = low;
+    if (low == index->count || index->entries[low].start != offset)
+        return 0;
+    return (size_t)(index->entries[low].end - offset);
+}
+
+static void bjd_discard_value(bjd_reader_t* reader) {
+
+    // an indexed container is skipped as a whole. (containers can't be
+    // keys or packed values of an optimized map, so we don't look them up
+    // there.)
+    if (reader->skip_index != NULL && reader->packed_type == 0 && reader->data != reader->end &&
+            (*reader->data == BJDATA_MARKER_ARRAY_START || *reader->data == BJDATA_MARKER_MAP_START))
+    {
+        size_t size = bjd_skip_index_find(reader);
+        if (size != 0) {
+            if (bjd_reader_track_element(reader) != bjd_ok)
+                return;
+            bjd_log("skipping indexed container of %i bytes\n", (int)size);
+            bjd_skip_bytes_notrack(reader, size);
+            return;
+        }
+    }
+
     bjd_tag_t var = bjd_read_tag(reader);
     if (bjd_reader_error(reader))
         return;
@@ -803,8 +1298,19 @@ void bjd_discard(bjd_reader_t* reader) {
             break;
         #endif
         case bjd_type_array: {
+            if (var.elemtype != 0) {
+                bjd_skip_bytes_notrack(reader, var.v.n * bjd_typed_marker_size(var.elemtype));
+                bjd_done_array(reader);
+                break;
+            }
+            if (var.unsized) {
+                while (!bjd_read_array_end(reader))
+                    bjd_discard_value(reader);
+                bjd_done_array(reader);
+                break;
+            }
             for (; var.v.n > 0; --var.v.n) {
-                bjd_discard(reader);
+                bjd_discard_value(reader);
                 if (bjd_reader_error(reader))
                     break;
             }
@@ -812,9 +1318,17 @@ void bjd_discard(bjd_reader_t* reader) {
             break;
         }
         case bjd_type_map: {
+            if (var.unsized) {
+                while (!bjd_read_map_end(reader)) {
+                    bjd_discard_value(reader);
+                    bjd_discard_value(reader);
+                }
+                bjd_done_map(reader);
+                break;
+            }
             for (; var.v.n > 0; --var.v.n) {
-                bjd_discard(reader);
-                bjd_discard(reader);
+                bjd_discard_value(reader);
+                bjd_discard_value(reader);
                 if (bjd_reader_error(reader))
                     break;
             }
@@ -826,6 +1340,548 @@ void bjd_discard(bjd_reader_t* reader) {
     }
 }
 
+void bjd_discard(bjd_reader_t* reader) {
+    bjd_reader_mark_t mark;
+    bjd_reader_mark(reader, &mark);
+    bjd_discard_value(reader);
+    bjd_reader_rewind(reader, &mark);
+}
+
+
+
+/*
+ * Path queries
+ */
+
+typedef struct bjd_path_eval_t {
+    bjd_reader_t* reader;
+    const bjd_path_t* paths;
+    bjd_path_match_t* matches;
+    size_t count;
+    size_t found;
+    size_t base; // the offset in the source at which the evaluation started
+} bjd_path_eval_t;
+
+// Skips the next value. In memory, an array or map is skipped with a
+// structural scan rather than read element by element. (Containers can't
+// be packed values of an optimized map, and if the scan fails, reading
+// the container reports the error.)
+static void bjd_path_skip(bjd_reader_t* reader) {
+    if (reader->fill == NULL && reader->skip_index == NULL && reader->packed_type == 0 &&
+            reader->data != reader->end &&
+            (*reader->data == BJDATA_MARKER_ARRAY_START || *reader->data == BJDATA_MARKER_MAP_START))
+    {
+        size_t pos = 0;
+        if (bjd_scan_value(reader->data, (size_t)(reader->end - reader->data), &pos,
+                    reader->endian, NULL, 0) == bjd_ok)
+        {
+            if (bjd_reader_track_element(reader) != bjd_ok)
+                return;
+            reader->data += pos;
+            return;
+        }
+    }
+    bjd_discard(reader);
+}
+
+// Returns whether a path matched by the current value at the given depth
+// ends there.
+BJDATA_STATIC_INLINE bool bjd_path_active(bjd_path_eval_t* eval, size_t i, size_t depth) {
+    return !eval->matches[i].found && eval->matches[i].depth == depth;
+}
+
+// Advances the paths whose step at the given depth is the given key (or
+// index if key is NULL.) Returns true if any did, in which case the value
+// that follows must be evaluated at the next depth.
+static bool bjd_path_enter(bjd_path_eval_t* eval, size_t depth, const char* key, size_t length,
+        size_t index)
+{
+    bool entered = false;
+    for (size_t i = 0; i < eval->count; ++i) {
+        if (bjd_path_active(eval, i, depth) &&
+                bjd_path_step_matches(&eval->paths[i], depth, key, length, index))
+        {
+            eval->matches[i].depth = depth + 1;
+            entered = true;
+        }
+    }
+    return entered;
+}
+
+// Moves the paths advanced past the given depth back to it.
+static void bjd_path_leave(bjd_path_eval_t* eval, size_t depth) {
+    for (size_t i = 0; i < eval->count; ++i)
+        if (eval->matches[i].depth > depth)
+            eval->matches[i].depth = depth;
+}
+
+// Records the value that ends the paths matched at the given depth.
+static void bjd_path_found(bjd_path_eval_t* eval, size_t depth, bjd_tag_t tag, size_t start) {
+    size_t end = bjd_reader_offset(eval->reader) - eval->base;
+    for (size_t i = 0; i < eval->count; ++i) {
+        if (!bjd_path_active(eval, i, depth) || eval->paths[i].count != depth)
+            continue;
+        eval->matches[i].found = true;
+        eval->matches[i].tag = tag;
+        eval->matches[i].start = start;
+        eval->matches[i].end = end;
+        ++eval->found;
+    }
+}
+
+// Returns whether the length of the given key is that of a key of a path
+// matched at the given depth, so that the key must be compared.
+static bool bjd_path_key_length(bjd_path_eval_t* eval, size_t depth, size_t length) {
+    for (size_t i = 0; i < eval->count; ++i)
+        if (bjd_path_active(eval, i, depth) && eval->paths[i].count > depth &&
+                eval->paths[i].steps[depth].key != NULL &&
+                eval->paths[i].steps[depth].length == length)
+            return true;
+    return false;
+}
+
+static void bjd_path_eval_value(bjd_path_eval_t* eval, size_t depth);
+
+// Finds the elements of an optimized array requested by the paths matched
+// at the given depth. The payload is read forward, one requested element
+// at a time.
+static void bjd_path_eval_typed(bjd_path_eval_t* eval, size_t depth, bjd_tag_t tag) {
+    bjd_reader_t* reader = eval->reader;
+    size_t size = bjd_typed_marker_size(tag.elemtype);
+    size_t next = 0;
+
+    while (bjd_reader_error(reader) == bjd_ok) {
+        size_t index = tag.v.n;
+        for (size_t i = 0; i < eval->count; ++i) {
+            if (!bjd_path_active(eval, i, depth) || eval->paths[i].count != depth + 1 ||
+                    eval->paths[i].steps[depth].key != NULL)
+                continue;
+            size_t step = eval->paths[i].steps[depth].index;
+            if (step >= next && step < index)
+                index = step;
+        }
+        if (index == tag.v.n)
+            break;
+
+        bjd_skip_bytes_notrack(reader, (index - next) * size);
+        size_t start = bjd_reader_offset(reader) - eval->base;
+        const char* p = bjd_read_bytes_inplace_notrack(reader, size);
+        if (p == NULL)
+            break;
+        bjd_path_enter(eval, depth, NULL, 0, index);
+        bjd_path_found(eval, depth + 1, bjd_load_typed(tag.elemtype, p, reader->endian), start);
+        bjd_path_leave(eval, depth);
+        next = index + 1;
+    }
+
+    bjd_skip_bytes_notrack(reader, (tag.v.n - next) * size);
+    bjd_done_array(reader);
+}
+
+static void bjd_path_eval_array(bjd_path_eval_t* eval, size_t depth, bjd_tag_t tag) {
+    bjd_reader_t* reader = eval->reader;
+    if (tag.elemtype != 0) {
+        bjd_path_eval_typed(eval, depth, tag);
+        return;
+    }
+
+    for (size_t i = 0; tag.unsized ? !bjd_read_array_end(reader) : i < tag.v.n; ++i) {
+        if (bjd_path_enter(eval, depth, NULL, 0, i)) {
+            bjd_path_eval_value(eval, depth + 1);
+            bjd_path_leave(eval, depth);
+        } else {
+            bjd_path_skip(reader);
+        }
+        if (bjd_reader_error(reader) != bjd_ok)
+            return;
+    }
+    bjd_done_array(reader);
+}
+
+static void bjd_path_eval_map(bjd_path_eval_t* eval, size_t depth, bjd_tag_t tag) {
+    bjd_reader_t* reader = eval->reader;
+
+    for (size_t i = 0; tag.unsized ? !bjd_read_map_end(reader) : i < tag.v.n; ++i) {
+        bool entered = false;
+
+        // only a string key of the length of a path key is compared
+        bjd_tag_t key = bjd_peek_tag(reader);
+        if (key.type == bjd_type_str && bjd_path_key_length(eval, depth, key.v.l)) {
+            bjd_read_tag(reader);
+            const char* bytes = bjd_read_bytes_inplace(reader, key.v.l);
+            bjd_done_str(reader);
+            if (bjd_reader_error(reader) != bjd_ok)
+                return;
+            entered = bjd_path_enter(eval, depth, bytes, key.v.l, 0);
+        } else {
+            bjd_discard(reader);
+        }
+
+        if (entered) {
+            bjd_path_eval_value(eval, depth + 1);
+            bjd_path_leave(eval, depth);
+        } else {
+            bjd_path_skip(reader);
+        }
+        if (bjd_reader_error(reader) != bjd_ok)
+            return;
+    }
+    bjd_done_map(reader);
+}
+
+// Evaluates the next value for the paths matched at the given depth.
+static void bjd_path_eval_value(bjd_path_eval_t* eval, size_t depth) {
+    bjd_reader_t* reader = eval->reader;
+    size_t start = bjd_reader_offset(reader) - eval->base;
+
+    bool ends = false;
+    bool continues = false;
+    for (size_t i = 0; i < eval->count; ++i) {
+        if (!bjd_path_active(eval, i, depth))
+            continue;
+        if (eval->paths[i].count == depth)
+            ends = true;
+        else
+            continues = true;
+    }
+
+    // only an array or map is descended into
+    bjd_tag_t tag = bjd_peek_tag(reader);
+    if (tag.type != bjd_type_array && tag.type != bjd_type_map)
+        continues = false;
+
+    if (!continues) {
+        bjd_path_skip(reader);
+    } else {
+        bjd_read_tag(reader);
+        if (tag.type == bjd_type_array)
+            bjd_path_eval_array(eval, depth, tag);
+        else
+            bjd_path_eval_map(eval, depth, tag);
+    }
+
+    if (ends && bjd_reader_error(reader) == bjd_ok)
+        bjd_path_found(eval, depth, tag, start);
+}
+
+size_t bjd_path_eval(bjd_reader_t* reader, const bjd_path_t* paths, size_t count,
+        bjd_path_match_t* matches)
+{
+    bjd_memset(matches, 0, sizeof(*matches) * count);
+    if (bjd_reader_error(reader) != bjd_ok)
+        return 0;
+
+    bjd_path_eval_t eval;
+    eval.reader = reader;
+    eval.paths = paths;
+    eval.matches = matches;
+    eval.count = count;
+    eval.found = 0;
+    eval.base = bjd_reader_offset(reader);
+
+    bjd_path_eval_value(&eval, 0);
+    return eval.found;
+}
+
+bjd_error_t bjd_path_eval_data(const char* data, size_t size, bjd_endian_t endian,
+        const bjd_path_t* paths, size_t count, bjd_path_match_t* matches)
+{
+    bjd_reader_t reader;
+    bjd_reader_init_data(&reader, data, size);
+    bjd_reader_set_endian(&reader, endian);
+    bjd_path_eval(&reader, paths, count, matches);
+    return bjd_reader_destroy(&reader);
+}
+
+/*
+ * Typed array functions
+ */
+
+// Stores a number into host memory as the given fixed-size marker.
+// Returns false if the value is not a number, or if it is out of range
+// for an integer destination. (Floating point destinations accept any
+// number, as with bjd_expect_float() and bjd_expect_double().)
+static bool bjd_store_typed_host(char marker, char* p, bjd_tag_t value) {
+    if (marker == 'd' || marker == 'D') {
+        double d;
+        switch (value.type) {
+            case bjd_type_int:    d = (double)value.v.i; break;
+            case bjd_type_uint:   d = (double)value.v.u; break;
+            case bjd_type_float:  d = (double)value.v.f; break;
+            case bjd_type_double: d = value.v.d;         break;
+            default: return false;
+        }
+        if (marker == 'd') {
+            float f = (float)d;
+            bjd_memcpy(p, &f, sizeof(f));
+        } else {
+            bjd_memcpy(p, &d, sizeof(d));
+        }
+        return true;
+    }
+
+    int64_t min;
+    uint64_t max;
+    switch (marker) {
+        case 'U': min = 0;         max = UINT8_MAX;  break;
+        case 'i': min = INT8_MIN;  max = INT8_MAX;   break;
+        case 'u': min = 0;         max = UINT16_MAX; break;
+        case 'I': min = INT16_MIN; max = INT16_MAX;  break;
+        case 'm': min = 0;         max = UINT32_MAX; break;
+        case 'l': min = INT32_MIN; max = INT32_MAX;  break;
+        case 'M': min = 0;         max = UINT64_MAX; break;
+        default:
+            bjd_assert(marker == 'L', "invalid marker %c", marker);
+            min = INT64_MIN;
+            max = INT64_MAX;
+            break;
+    }
+
+    uint64_t u;
+    if (value.type == bjd_type_int) {
+        if (value.v.i < min || (value.v.i > 0 && (uint64_t)value.v.i > max))
+            return false;
+        u = (uint64_t)value.v.i;
+    } else if (value.type == bjd_type_uint) {
+        if (value.v.u > max)
+            return false;
+        u = value.v.u;
+    } else {
+        return false;
+    }
+
+    // negative values are truncated in two's complement
+    switch (bjd_typed_marker_size(marker)) {
+        case 1: { uint8_t  v = (uint8_t) u; bjd_memcpy(p, &v, sizeof(v)); break; }
+        case 2: { uint16_t v = (uint16_t)u; bjd_memcpy(p, &v, sizeof(v)); break; }
+        case 4: { uint32_t v = (uint32_t)u; bjd_memcpy(p, &v, sizeof(v)); break; }
+        default: bjd_memcpy(p, &u, sizeof(u)); break;
+    }
+    return true;
+}
+
+// Converts count payload elements in the given byte order at src into
+// host order at dest. The buffers may overlap as long as dest does not
+// start after src and each destination element is at least as large as a
+// source element; each element is fully loaded before it is stored.
+// Returns false if any value does not fit the destination type.
+static bool bjd_convert_typed(char dest_marker, char* dest, char src_marker, const char* src,
+        size_t count, bjd_endian_t endian)
+{
+    size_t dest_size = bjd_typed_marker_size(dest_marker);
+    size_t src_size = bjd_typed_marker_size(src_marker);
+    for (size_t i = 0; i < count; ++i) {
+        bjd_tag_t value = bjd_load_typed(src_marker, src + i * src_size, endian);
+        if (!bjd_store_typed_host(dest_marker, dest + i * dest_size, value))
+            return false;
+    }
+    return true;
+}
+
+// Returns the signedness of an integer marker in is_signed, or false if
+// the marker is not an integer.
+static bool bjd_typed_marker_integer(char marker, bool* is_signed) {
+    switch (marker) {
+        case 'U': case 'u': case 'm': case 'M': *is_signed = false; return true;
+        case 'i': case 'I': case 'l': case 'L': *is_signed = true;  return true;
+        default: return false;
+    }
+}
+
+// Returns whether every src_marker value can be converted to dest_marker
+// by zero- or sign-extension alone, in which case is_signed is set to
+// whether it must be sign-extended.
+static bool bjd_typed_marker_widens(char src_marker, char dest_marker, bool* is_signed) {
+    bool dest_signed;
+    if (!bjd_typed_marker_integer(src_marker, is_signed) ||
+            !bjd_typed_marker_integer(dest_marker, &dest_signed))
+        return false;
+    if (bjd_typed_marker_size(dest_marker) <= bjd_typed_marker_size(src_marker))
+        return false;
+
+    // signed values may be negative so they can only widen to signed
+    return !*is_signed || dest_signed;
+}
+
+// Reads the packed payload of a typed array into out, converting it
+// from src_marker to dest_marker.
+static void bjd_read_typed_payload(bjd_reader_t* reader, char src_marker, size_t count,
+        char dest_marker, char* out)
+{
+    size_t src_size = bjd_typed_marker_size(src_marker);
+    size_t dest_size = bjd_typed_marker_size(dest_marker);
+
+    if (dest_size >= src_size) {
+        // The raw payload is read into the tail of the destination. This
+        // lets bjd_read_native() pull large payloads straight from the fill
+        // function rather than through the buffer. It is then converted
+        // front to back in place, so widened elements only ever overwrite
+        // source elements that have already been converted.
+        char* raw = out + count * (dest_size - src_size);
+        bjd_read_native(reader, raw, count * src_size);
+        if (bjd_reader_error(reader) != bjd_ok)
+            return;
+
+        // When the payload is already in host order it is used as-is.
+        bool swap = src_size > 1 && reader->endian != BJDATA_HOST_ENDIAN;
+
+        if (src_marker == dest_marker) {
+            if (swap)
+                bjd_convert_swap(out, out, src_size, count);
+            return;
+        }
+
+        // Plain integer widening needs no range checks, so the raw payload
+        // is swapped into host order and widened in bulk.
+        bool is_signed;
+        if (bjd_typed_marker_widens(src_marker, dest_marker, &is_signed)) {
+            if (swap)
+                bjd_convert_swap(raw, raw, src_size, count);
+            bjd_convert_widen(out, dest_size, raw, src_size, is_signed, count);
+            return;
+        }
+
+        if (!bjd_convert_typed(dest_marker, out, src_marker, raw, count, reader->endian))
+            bjd_reader_flag_error(reader, bjd_error_type);
+        return;
+    }
+
+    // When narrowing, the payload does not fit in the destination so we
+    // convert it out of the buffer as it is filled.
+    while (count > 0) {
+        if (!bjd_reader_ensure(reader, src_size))
+            return;
+
+        size_t n = (size_t)(reader->end - reader->data) / src_size;
+        if (n > count)
+            n = count;
+
+        if (!bjd_convert_typed(dest_marker, out, src_marker, reader->data, n, reader->endian)) {
+            bjd_reader_flag_error(reader, bjd_error_type);
+            return;
+        }
+
+        reader->data += n * src_size;
+        out += n * dest_size;
+        count -= n;
+    }
+}
+
+static size_t bjd_read_typed_array_value(bjd_reader_t* reader, char marker, void* out, size_t max_count) {
+    size_t size = bjd_typed_marker_size(marker);
+    if (size == 0) {
+        bjd_break("'%c' is not a valid typed array element marker", marker);
+        bjd_reader_flag_error(reader, bjd_error_bug);
+        return 0;
+    }
+    bjd_assert(max_count == 0 || out != NULL, "out pointer for %i elements is NULL", (int)max_count);
+
+    bjd_tag_t tag = bjd_read_tag(reader);
+    if (bjd_reader_error(reader) != bjd_ok)
+        return 0;
+    if (tag.type != bjd_type_array) {
+        bjd_reader_flag_error(reader, bjd_error_type);
+        return 0;
+    }
+    if (tag.v.n > max_count) {
+        bjd_reader_flag_error(reader, bjd_error_too_big);
+        return 0;
+    }
+
+    uint32_t count = tag.v.n;
+    if (tag.elemtype != 0) {
+        bjd_read_typed_payload(reader, tag.elemtype, tag.v.n, marker, (char*)out);
+    } else if (tag.unsized) {
+        // elements are read until the closing marker
+        char* p = (char*)out;
+        while (!bjd_read_array_end(reader)) {
+            if (count == max_count) {
+                bjd_reader_flag_error(reader, bjd_error_too_big);
+                break;
+            }
+            bjd_tag_t value = bjd_read_tag(reader);
+            if (bjd_reader_error(reader) != bjd_ok)
+                break;
+            if (!bjd_store_typed_host(marker, p + count * size, value)) {
+                bjd_reader_flag_error(reader, bjd_error_type);
+                break;
+            }
+            ++count;
+        }
+    } else {
+        // an ordinary array, in which each element has its own marker
+        char* p = (char*)out;
+        for (uint32_t i = 0; i < tag.v.n; ++i) {
+            bjd_tag_t value = bjd_read_tag(reader);
+            if (bjd_reader_error(reader) != bjd_ok)
+                break;
+            if (!bjd_store_typed_host(marker, p + i * size, value)) {
+                bjd_reader_flag_error(reader, bjd_error_type);
+                break;
+            }
+        }
+    }
+
+    if (bjd_reader_error(reader) != bjd_ok)
+        return 0;
+    bjd_done_array(reader);
+    return count;
+}
+
+size_t bjd_read_typed_array(bjd_reader_t* reader, char marker, void* out, size_t max_count) {
+    bjd_reader_mark_t mark;
+    bjd_reader_mark(reader, &mark);
+    size_t count = bjd_read_typed_array_value(reader, marker, out, max_count);
+    bjd_reader_rewind(reader, &mark);
+    return count;
+}
+
+static void bjd_read_ndarray_value(bjd_reader_t* reader, bjd_ndarray_view_t* view) {
+    bjd_memset(view, 0, sizeof(*view));
+
+    if (bjd_reader_error(reader) != bjd_ok)
+        return;
+    if (bjd_reader_track_element(reader) != bjd_ok)
+        return;
+
+    if (!bjd_reader_ensure(reader, 1))
+        return;
+    if (reader->packed_value_next || reader->data[0] != BJDATA_MARKER_ARRAY_START) {
+        bjd_reader_flag_error(reader, bjd_error_type);
+        return;
+    }
+
+    bjd_tag_t tag = BJDATA_TAG_ZERO;
+    uint32_t dims[BJDATA_NDARRAY_MAX_DIMS];
+    size_t ndims = 0;
+    size_t size = bjd_parse_container(reader, &tag, bjd_type_array, dims, &ndims);
+    if (size == 0)
+        return;
+
+    // only packed payloads can be viewed
+    if (tag.elemtype == 0) {
+        bjd_reader_flag_error(reader, bjd_error_type);
+        return;
+    }
+    reader->data += size;
+
+    // the payload is consumed along with the header, so as with
+    // bjd_write_typed_array() nothing is pushed for tracking.
+    const char* data = bjd_read_bytes_inplace_notrack(reader,
+            tag.v.n * bjd_typed_marker_size(tag.elemtype));
+    if (bjd_reader_error(reader) != bjd_ok)
+        return;
+
+    bjd_ndarray_view_init(view, tag.elemtype, dims, ndims, data, reader->endian);
+}
+
+void bjd_read_ndarray(bjd_reader_t* reader, bjd_ndarray_view_t* view) {
+    bjd_reader_mark_t mark;
+    bjd_reader_mark(reader, &mark);
+    bjd_read_ndarray_value(reader, view);
+    bjd_reader_rewind(reader, &mark);
+}
+
 #if BJDATA_EXTENSIONS
 bjd_timestamp_t bjd_read_timestamp(bjd_reader_t* reader, size_t size) {
     bjd_timestamp_t timestamp = {0, 0};
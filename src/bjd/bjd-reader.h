@@ -160,6 +160,21 @@ struct bjd_reader_t {
     const char* end;    /* The end of available data (in the buffer, if it is used) */
 
     bjd_error_t error;  /* Error state */
+    bjd_endian_t endian; /* Byte order of multi-byte numbers */
+    bool resumable;     /* Whether the reader waits for data from bjd_reader_feed() */
+
+    char packed_type;       /* The value type of the optimized map being read, or 0 */
+    bool packed_value_next; /* Whether the next element is a packed value of that map */
+    uint32_t packed_left;   /* The number of packed values left in that map */
+
+    size_t position;        /* The offset in the source of the end of the available data */
+    const bjd_skip_index_t* skip_index; /* Index of containers to skip, or NULL */
+    size_t skip_base;       /* The offset in the source of the start of the indexed data */
+    size_t skip_cursor;     /* The index entry at or after the last lookup */
+
+    #ifdef BJDATA_MALLOC
+    const bjd_allocator_t* allocator; /* Allocator for reader allocations, or NULL */
+    #endif
 
     #if BJDATA_READ_TRACKING
     bjd_track_t track; /* Stack of map/array/str/bin/ext reads */
@@ -201,6 +216,51 @@ void bjd_reader_init_error(bjd_reader_t* reader, bjd_error_t error);
  */
 void bjd_reader_init_data(bjd_reader_t* reader, const char* data, size_t count);
 
+/**
+ * Initializes a resumable BJData reader with the given buffer, which starts
+ * out empty. Data is pushed into the buffer with bjd_reader_feed() as it
+ * arrives, so a single thread can read from many non-blocking streams.
+ *
+ * When a read needs more data than has been fed, the reader is put in the
+ * @ref bjd_would_block state instead of flagging an error, and the read
+ * returns nil or zero as if an error had occurred. Nothing is consumed, so
+ * once more data is fed the same call can be made again to pick up exactly
+ * where it left off. This holds for bjd_read_tag(), bjd_peek_tag(), the
+ * byte and string reading and skipping functions, bjd_discard(),
+ * bjd_read_typed_array(), bjd_read_ndarray() and the Expect API functions,
+ * including those that read a string, binary or enum along with its tag.
+ * A loop on bjd_read_array_end() or bjd_read_map_end() ends when the
+ * reader blocks, so the state must be checked after it.
+ *
+ * Everything one call reads must fit in the buffer at once, including a
+ * whole value passed to bjd_discard(). @ref bjd_error_too_big is flagged
+ * if it can't. Read or skip long strings in chunks to stay within it.
+ *
+ * @param reader The BJData reader.
+ * @param buffer The buffer in which to keep data fed to the reader.
+ * @param size The size of the buffer. It must be at least
+ *        @ref BJDATA_READER_MINIMUM_BUFFER_SIZE.
+ *
+ * @see bjd_reader_feed()
+ */
+void bjd_reader_init_resumable(bjd_reader_t* reader, char* buffer, size_t size);
+
+/**
+ * Pushes data into the buffer of a resumable reader, clearing the
+ * @ref bjd_would_block state.
+ *
+ * Data that has been read is dropped from the buffer to make room. As much
+ * of the given data as fits is copied, and the rest should be fed again
+ * once the reader has consumed more.
+ *
+ * @param reader A reader initialized with bjd_reader_init_resumable().
+ * @param data The data to append.
+ * @param count The number of bytes pointed to by data.
+ * @return The number of bytes copied, or 0 if the reader is in an error
+ *         state.
+ */
+size_t bjd_reader_feed(bjd_reader_t* reader, const char* data, size_t count);
+
 #if BJDATA_STDIO
 /**
  * Initializes an BJData reader that reads from a file.
@@ -235,6 +295,28 @@ BJDATA_INLINE void bjd_reader_init_file(bjd_reader_t* reader, const char* filena
 void bjd_reader_init_stdfile(bjd_reader_t* reader, FILE* stdfile, bool close_when_done);
 #endif
 
+#if BJDATA_MMAP
+/**
+ * Initializes an BJData reader that reads a file by mapping it read-only
+ * into memory.
+ *
+ * The reader spans the whole mapping, so it never needs to fill a buffer:
+ * bjd_read_bytes_inplace() and bjd_read_utf8_inplace() succeed for data of
+ * any size without copying, and skipping data is free. The mapping is
+ * released by bjd_reader_destroy(). The file must not be modified or
+ * truncated while the reader is in use.
+ *
+ * @ref bjd_error_io is flagged if the file cannot be opened or mapped, and
+ * @ref bjd_error_invalid if it is empty.
+ *
+ * @param reader The BJData reader.
+ * @param filename The path of the file to map.
+ * @param flags A combination of @ref bjd_mmap_flags_t hints, or 0. They
+ *        are ignored where not supported.
+ */
+void bjd_reader_init_mmap(bjd_reader_t* reader, const char* filename, unsigned flags);
+#endif
+
 /**
  * @def bjd_reader_init_stack(reader)
  * @hideinitializer
@@ -265,7 +347,8 @@ void bjd_reader_init_stdfile(bjd_reader_t* reader, FILE* stdfile, bool close_whe
  * This will assert in tracking mode if the reader is not in an error
  * state and has any incomplete reads. If you want to cancel reading
  * in the middle of a document, you need to flag an error on the reader
- * before destroying it (such as bjd_error_data).
+ * before destroying it (such as bjd_error_data). A resumable reader that
+ * is waiting for data returns @ref bjd_would_block.
  *
  * @see bjd_read_tag()
  * @see bjd_reader_flag_error()
@@ -343,6 +426,27 @@ void bjd_reader_set_fill(bjd_reader_t* reader, bjd_reader_fill_t fill);
  */
 void bjd_reader_set_skip(bjd_reader_t* reader, bjd_reader_skip_t skip);
 
+/**
+ * Attaches a skip index to the reader, so that bjd_discard() skips the
+ * indexed arrays and maps without reading their contents. With a skip
+ * function (see bjd_reader_set_skip()), discarded containers of a stream
+ * need not be read from the source at all.
+ *
+ * The offsets of the index are relative to the current position of the
+ * reader, so this is normally called right after the reader is
+ * initialized. Pass NULL to detach the index.
+ *
+ * The index must match the data and outlive its use by the reader. Its
+ * entries are found by binary search starting from the last lookup, so a
+ * reader that moves forward through the data finds each in constant time.
+ *
+ * @param reader The BJData reader.
+ * @param index The skip index, or NULL.
+ *
+ * @see bjd_skip_index_build()
+ */
+void bjd_reader_set_skip_index(bjd_reader_t* reader, const bjd_skip_index_t* index);
+
 /**
  * Sets the error function to call when an error is flagged on the reader.
  *
@@ -373,6 +477,43 @@ BJDATA_INLINE void bjd_reader_set_teardown(bjd_reader_t* reader, bjd_reader_tear
     reader->teardown = teardown;
 }
 
+/**
+ * Sets the byte order of multi-byte numbers in the data being read.
+ *
+ * The default is @ref bjd_endian_little, as specified by BJData Draft 2.
+ * Use @ref bjd_endian_big to read UBJSON or data from earlier drafts of
+ * BJData.
+ *
+ * When this matches the byte order of the host, typed array payloads are
+ * read straight into the destination with no per-element work.
+ *
+ * This should be called before any data is read.
+ *
+ * @param reader The BJData reader.
+ * @param endian The byte order of the data.
+ */
+BJDATA_INLINE void bjd_reader_set_endian(bjd_reader_t* reader, bjd_endian_t endian) {
+    reader->endian = endian;
+}
+
+#ifdef BJDATA_MALLOC
+/**
+ * Sets the allocator for memory the reader allocates: the tracking stack
+ * and the data returned by allocating functions such as
+ * bjd_read_bytes_alloc() and bjd_expect_cstr_alloc(). Pass NULL to use
+ * @ref BJDATA_MALLOC.
+ *
+ * The buffers of readers that own them, such as file readers, are not
+ * affected.
+ *
+ * This should be called before any data is read.
+ *
+ * @param reader The BJData reader.
+ * @param allocator The allocator, which must outlive the reader.
+ */
+void bjd_reader_set_allocator(bjd_reader_t* reader, const bjd_allocator_t* allocator);
+#endif
+
 /**
  * @}
  */
@@ -451,6 +592,10 @@ size_t bjd_reader_remaining(bjd_reader_t* reader, const char** data);
  * extension type), additional reads are required to get the contained
  * data, and the corresponding done function must be called when done.
  *
+ * An array or map may have no count (see bjd_tag_is_unsized()), in which
+ * case its elements are read until bjd_read_array_end() or
+ * bjd_read_map_end() returns true.
+ *
  * @note Maps in JSON are unordered, so it is recommended not to expect
  * a specific ordering for your map values in case your data is converted
  * to/from JSON.
@@ -481,6 +626,37 @@ bjd_tag_t bjd_read_tag(bjd_reader_t* reader);
  */
 bjd_tag_t bjd_peek_tag(bjd_reader_t* reader);
 
+/**
+ * Reads the closing ']' of an array without a count, if it is next.
+ *
+ * An array read by bjd_read_tag() for which bjd_tag_is_unsized() is true
+ * has no count; its elements are read until this returns true, after which
+ * bjd_done_array() must be called as usual:
+ *
+ * @code{.c}
+ * while (!bjd_read_array_end(reader))
+ *     read_element(reader);
+ * bjd_done_array(reader);
+ * @endcode
+ *
+ * This also returns true if the reader is in an error state, so such a
+ * loop always ends.
+ *
+ * @see bjd_start_array_unsized()
+ */
+bool bjd_read_array_end(bjd_reader_t* reader);
+
+/**
+ * Reads the closing '}' of a map without a count, if it is next.
+ *
+ * This works like bjd_read_array_end(). It should only be called before
+ * a key, never between a key and its value, and bjd_done_map() must be
+ * called once it returns true.
+ *
+ * @see bjd_start_map_unsized()
+ */
+bool bjd_read_map_end(bjd_reader_t* reader);
+
 /**
  * @}
  */
@@ -615,6 +791,8 @@ char* bjd_read_bytes_alloc_impl(bjd_reader_t* reader, size_t count, bool null_te
  *
  * The allocated string must be freed with BJDATA_FREE() (or simply free()
  * if BJData's allocator hasn't been customized.)
+ * If an allocator is attached with bjd_reader_set_allocator(), it is
+ * allocated from that instead.
  *
  * Returns NULL if any error occurs, or if count is zero.
  */
@@ -729,6 +907,69 @@ BJDATA_INLINE bool bjd_should_read_bytes_inplace(bjd_reader_t* reader, size_t co
 bjd_timestamp_t bjd_read_timestamp(bjd_reader_t* reader, size_t size);
 #endif
 
+/**
+ * @}
+ */
+
+/**
+ * @name Typed Array Functions
+ * @{
+ */
+
+/**
+ * Reads an entire array of numbers into the given buffer, converting each
+ * element to the type of the given marker, and returns the element count.
+ *
+ * An optimized array (with a `[$<type>#<count>` header) is decoded in a
+ * single pass over its packed payload. Large payloads are read directly
+ * from the fill function into the given buffer where possible. An ordinary
+ * array is also accepted as long as all of its elements are numbers.
+ *
+ * Elements are converted as with the Expect API: integers are range
+ * checked, and floating point destinations accept any number.
+ *
+ * You must NOT call bjd_done_array() after calling this; the array is
+ * complete when this returns.
+ *
+ * @param reader The reader
+ * @param marker The destination element marker: one of 'U', 'i', 'u', 'I',
+ *        'm', 'l', 'M', 'L', 'd' (float) or 'D' (double)
+ * @param out The buffer in which to store elements in host byte order. It
+ *        must be suitably sized for max_count elements of the given type.
+ * @param max_count The maximum number of elements to read
+ *
+ * @throws bjd_error_type if the value is not an array, or if any element is
+ * not a number or does not fit in the destination type.
+ * @throws bjd_error_too_big if the array has more than max_count elements.
+ */
+size_t bjd_read_typed_array(bjd_reader_t* reader, char marker, void* out, size_t max_count);
+
+/**
+ * Reads an optimized array in place and provides a strided view of it,
+ * exposing its dimensions if it is an ND-array (with a `[$<type>#[<dims>]`
+ * header.) An optimized array with a plain count is viewed as having a
+ * single dimension.
+ *
+ * The view points into the reader's buffer, so it is only valid until the
+ * next read, and the whole payload must fit in the buffer as with
+ * bjd_read_bytes_inplace(). The payload is left in the reader's byte
+ * order (see bjd_reader_set_endian().)
+ *
+ * You must NOT call bjd_done_array() after calling this; the array is
+ * complete when this returns.
+ *
+ * @param reader The reader
+ * @param view The view to fill. It is zeroed on error.
+ *
+ * @throws bjd_error_type if the value is not an optimized array.
+ * @throws bjd_error_too_big if the payload does not fit in the buffer.
+ * @throws bjd_error_unsupported if the array has more than
+ * @ref BJDATA_NDARRAY_MAX_DIMS dimensions.
+ *
+ * @see bjd_ndarray_view_t
+ */
+void bjd_read_ndarray(bjd_reader_t* reader, bjd_ndarray_view_t* view);
+
 /**
  * @}
  */
@@ -812,10 +1053,110 @@ BJDATA_INLINE void bjd_done_ext(bjd_reader_t* reader) {
 
 /**
  * Reads and discards the next object. This will read and discard all
- * contained data as well if it is a compound type.
+ * contained data as well if it is a compound type, unless it is an array
+ * or map found in the skip index of the reader (see
+ * bjd_reader_set_skip_index()), in which case it is skipped as a whole.
  */
 void bjd_discard(bjd_reader_t* reader);
 
+/**
+ * @}
+ */
+
+/**
+ * @name Path Queries
+ *
+ * A path query finds a value nested in a message by a sequence of map keys
+ * and array indices, such as @c "a.b[3].c", while reading the message in a
+ * single forward pass. Only the containers along the path are descended
+ * into; everything else is skipped without allocating anything.
+ *
+ * Several compiled paths can be evaluated at once, each yielding the tag
+ * of its value and the offsets of its encoding:
+ *
+ * @code{.c}
+ * bjd_path_t paths[2];
+ * bjd_path_compile(&paths[0], "user.name");
+ * bjd_path_compile(&paths[1], "items[0].price");
+ *
+ * bjd_path_match_t matches[2];
+ * bjd_path_eval_data(data, size, bjd_endian_little, paths, 2, matches);
+ * if (matches[0].found && matches[0].tag.type == bjd_type_str)
+ *     use_name(data + matches[0].end - matches[0].tag.v.l, matches[0].tag.v.l);
+ * @endcode
+ *
+ * @{
+ */
+
+/**
+ * The result of evaluating a path query.
+ *
+ * @see bjd_path_eval()
+ */
+typedef struct bjd_path_match_t {
+    /** Whether the path was found in the message. */
+    bool found;
+
+    /**
+     * The tag of the value. The tag of an array or map is its header, as
+     * returned by bjd_read_tag().
+     */
+    bjd_tag_t tag;
+
+    /**
+     * The offset of the first byte of the value, relative to the position
+     * of the reader when the evaluation started.
+     */
+    size_t start;
+
+    /** The offset of the byte following the value. */
+    size_t end;
+
+    /** @cond */
+    size_t depth; /* The number of steps matched by the current value */
+    /** @endcond */
+} bjd_path_match_t;
+
+/**
+ * Reads the next value from the reader, evaluating the given paths over it.
+ *
+ * Arrays and maps are only descended into if one of the paths continues
+ * through them. Other values are skipped: a reader over data in memory
+ * skips arrays and maps with a structural scan, and bjd_discard() skips
+ * those in the skip index of a reader (see bjd_reader_set_skip_index()).
+ * If a key appears more than once in a map, its first value is found.
+ *
+ * The reader is left after the value. If an error occurs, it is flagged on
+ * the reader and the matches found so far are kept.
+ *
+ * @param reader The BJData reader.
+ * @param paths The compiled paths to evaluate.
+ * @param count The number of paths.
+ * @param matches The results of the paths, one for each path.
+ *
+ * @return The number of paths found.
+ */
+size_t bjd_path_eval(bjd_reader_t* reader, const bjd_path_t* paths, size_t count,
+        bjd_path_match_t* matches);
+
+/**
+ * Evaluates the given paths over the first value in a buffer.
+ *
+ * This is bjd_path_eval() with a reader over the buffer, so the offsets of
+ * the matches are offsets in the buffer.
+ *
+ * @param data The Binary JData message.
+ * @param size The size of the message in bytes.
+ * @param endian The byte order of multi-byte numbers in the message.
+ * @param paths The compiled paths to evaluate.
+ * @param count The number of paths.
+ * @param matches The results of the paths, one for each path.
+ *
+ * @return @ref bjd_ok, or the error that stopped the evaluation.
+ */
+bjd_error_t bjd_path_eval_data(const char* data, size_t size, bjd_endian_t endian,
+        const bjd_path_t* paths, size_t count, bjd_path_match_t* matches);
+
 /**
  * @}
  */
@@ -951,6 +1292,29 @@ BJDATA_INLINE bjd_error_t bjd_reader_track_str_bytes_all(bjd_reader_t* reader, s
     return BJDATA_READER_TRACK(reader, bjd_track_str_bytes_all(&reader->track, true, count));
 }
 
+// The state of a reader before a call that reads more than one element, so
+// that a resumable reader can be rewound if the call blocks partway. The
+// data it read is still in the buffer since only bjd_reader_feed() moves it.
+typedef struct bjd_reader_mark_t {
+    const char* data;
+    char packed_type;
+    bool packed_value_next;
+    uint32_t packed_left;
+    #if BJDATA_READ_TRACKING
+    size_t track_count;
+    bjd_track_element_t track_top;
+    #endif
+} bjd_reader_mark_t;
+
+// Marks the state of the reader before a call that reads more than one
+// element.
+void bjd_reader_mark(bjd_reader_t* reader, bjd_reader_mark_t* mark);
+
+// Rewinds a reader to the mark if the call since blocked, so that it can be
+// made again once more data is fed. Flags bjd_error_too_big instead if the
+// buffer is already full from the mark.
+void bjd_reader_rewind(bjd_reader_t* reader, const bjd_reader_mark_t* mark);
+
 #endif
 
 
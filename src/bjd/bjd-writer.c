@@ -19,10 +19,22 @@
  * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+// writev() is POSIX, which strict C99 modes hide
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200112L
+#endif
+
 #define BJDATA_INTERNAL 1
 
 #include "bjd-writer.h"
 
+#if BJDATA_WRITER && BJDATA_IOV
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
 #if BJDATA_WRITER
 
 #if BJDATA_WRITE_TRACKING
@@ -36,9 +48,19 @@ void bjd_writer_track_push(bjd_writer_t* writer, bjd_type_t type, uint32_t count
         bjd_writer_flag_if_error(writer, bjd_track_push(&writer->track, type, count));
 }
 
+void bjd_writer_track_push_unsized(bjd_writer_t* writer, bjd_type_t type) {
+    if (writer->error == bjd_ok)
+        bjd_writer_flag_if_error(writer, bjd_track_push_unsized(&writer->track, type));
+}
+
 void bjd_writer_track_pop(bjd_writer_t* writer, bjd_type_t type) {
     if (writer->error == bjd_ok)
-        bjd_writer_flag_if_error(writer, bjd_track_pop(&writer->track, type));
+        bjd_writer_flag_if_error(writer, bjd_track_pop_sized(&writer->track, type, false));
+}
+
+void bjd_writer_track_pop_unsized(bjd_writer_t* writer, bjd_type_t type) {
+    if (writer->error == bjd_ok)
+        bjd_writer_flag_if_error(writer, bjd_track_pop_sized(&writer->track, type, true));
 }
 
 void bjd_writer_track_element(bjd_writer_t* writer) {
@@ -65,6 +87,18 @@ static void bjd_writer_clear(bjd_writer_t* writer) {
     writer->current = NULL;
     writer->end = NULL;
     writer->error = bjd_ok;
+    writer->endian = bjd_endian_little;
+    writer->typed_map_marker = 0;
+
+    #ifdef BJDATA_MALLOC
+    writer->auto_typed = false;
+    writer->auto_pending = false;
+    writer->auto_count = 0;
+    writer->auto_total = 0;
+    writer->auto_capacity = 0;
+    writer->auto_values = NULL;
+    writer->allocator = NULL;
+    #endif
 
     #if BJDATA_WRITE_TRACKING
     bjd_memset(&writer->track, 0, sizeof(writer->track));
@@ -79,7 +113,7 @@ void bjd_writer_init(bjd_writer_t* writer, char* buffer, size_t size) {
     writer->end = writer->buffer + size;
 
     #if BJDATA_WRITE_TRACKING
-    bjd_writer_flag_if_error(writer, bjd_track_init(&writer->track));
+    bjd_writer_flag_if_error(writer, bjd_track_init(&writer->track, NULL));
     #endif
 
     bjd_log("===========================\n");
@@ -97,8 +131,6 @@ void bjd_writer_init_error(bjd_writer_t* writer, bjd_error_t error) {
 void bjd_writer_set_flush(bjd_writer_t* writer, bjd_writer_flush_t flush) {
     BJDATA_STATIC_ASSERT(BJDATA_WRITER_MINIMUM_BUFFER_SIZE >= BJDATA_MAXIMUM_TAG_SIZE,
             "minimum buffer size must fit any tag!");
-    BJDATA_STATIC_ASSERT(31 + BJDATA_TAG_SIZE_FIXSTR >= BJDATA_WRITER_MINIMUM_BUFFER_SIZE,
-            "minimum buffer size must fit the largest possible fixstr!");
 
     if (bjd_writer_buffer_size(writer) < BJDATA_WRITER_MINIMUM_BUFFER_SIZE) {
         bjd_break("buffer size is %i, but minimum buffer size for flush is %i",
@@ -168,7 +200,7 @@ static void bjd_growable_writer_flush(bjd_writer_t* writer, const char* data, si
     bjd_log("flush growing buffer size from %i to %i\n", (int)size, (int)new_size);
 
     // grow the buffer
-    char* new_buffer = (char*)bjd_realloc(writer->buffer, used, new_size);
+    char* new_buffer = (char*)bjd_allocator_realloc(writer->allocator, writer->buffer, used, new_size);
     if (new_buffer == NULL) {
         bjd_writer_flag_error(writer, bjd_error_memory);
         return;
@@ -201,9 +233,9 @@ static void bjd_growable_writer_teardown(bjd_writer_t* writer) {
             // do this so we enforce it ourselves.
             size_t size = (used != 0) ? used : 1;
 
-            char* buffer = (char*)bjd_realloc(writer->buffer, used, size);
+            char* buffer = (char*)bjd_allocator_realloc(writer->allocator, writer->buffer, used, size);
             if (!buffer) {
-                BJDATA_FREE(writer->buffer);
+                bjd_allocator_free(writer->allocator, writer->buffer);
                 bjd_writer_flag_error(writer, bjd_error_memory);
                 return;
             }
@@ -216,7 +248,7 @@ static void bjd_growable_writer_teardown(bjd_writer_t* writer) {
         writer->buffer = NULL;
 
     } else if (writer->buffer) {
-        BJDATA_FREE(writer->buffer);
+        bjd_allocator_free(writer->allocator, writer->buffer);
         writer->buffer = NULL;
     }
 
@@ -248,6 +280,181 @@ void bjd_writer_init_growable(bjd_writer_t* writer, char** target_data, size_t*
     bjd_writer_set_flush(writer, bjd_growable_writer_flush);
     bjd_writer_set_teardown(writer, bjd_growable_writer_teardown);
 }
+
+typedef struct bjd_chunked_writer_t {
+    bjd_chunks_t* target; /* Where to place the chunks on destroy */
+    bjd_chunk_t* chunks;
+    size_t count;
+    size_t capacity;
+    size_t size;
+} bjd_chunked_writer_t;
+
+// Appends a filled buffer to the list of chunks, taking ownership of it.
+static bool bjd_chunked_writer_append(bjd_writer_t* writer, char* data, size_t size) {
+    bjd_chunked_writer_t* chunked_writer = (bjd_chunked_writer_t*)writer->context;
+
+    if (chunked_writer->count == chunked_writer->capacity) {
+        size_t capacity = (chunked_writer->capacity == 0) ? 8 : chunked_writer->capacity * 2;
+        bjd_chunk_t* chunks = (bjd_chunk_t*)bjd_allocator_realloc(writer->allocator, chunked_writer->chunks,
+                chunked_writer->count * sizeof(bjd_chunk_t), capacity * sizeof(bjd_chunk_t));
+        if (chunks == NULL) {
+            bjd_writer_flag_error(writer, bjd_error_memory);
+            return false;
+        }
+        chunked_writer->chunks = chunks;
+        chunked_writer->capacity = capacity;
+    }
+
+    bjd_chunk_t* chunk = &chunked_writer->chunks[chunked_writer->count++];
+    chunk->data = data;
+    chunk->size = size;
+    chunked_writer->size += size;
+    return true;
+}
+
+// Replaces the buffer, which must already have been appended, with a new
+// chunk of at least the given size.
+static bool bjd_chunked_writer_next(bjd_writer_t* writer, size_t min_size) {
+    size_t size = bjd_writer_buffer_size(writer);
+    size = (size >= BJDATA_CHUNK_MAX_SIZE / 2) ? BJDATA_CHUNK_MAX_SIZE : size * 2;
+    if (size < min_size)
+        size = min_size;
+
+    bjd_log("new chunk of size %i\n", (int)size);
+
+    char* buffer = (char*)bjd_allocator_malloc(writer->allocator, size);
+    if (buffer == NULL) {
+        writer->buffer = NULL;
+        writer->current = NULL;
+        writer->end = NULL;
+        bjd_writer_flag_error(writer, bjd_error_memory);
+        return false;
+    }
+
+    writer->buffer = buffer;
+    writer->current = buffer;
+    writer->end = buffer + size;
+    return true;
+}
+
+static void bjd_chunked_writer_flush(bjd_writer_t* writer, const char* data, size_t count) {
+
+    // As with bjd_growable_writer_flush(), this is either a flush of a full
+    // buffer, a flush of extra data that does not fit in the buffer, or the
+    // final flush of the buffer during teardown.
+
+    if (data == writer->buffer) {
+
+        // teardown, do nothing; the buffer is collected by the teardown
+        if (bjd_writer_buffer_used(writer) == count)
+            return;
+
+        // if there is still room for any tag the data stays in the buffer
+        // and the caller fills the rest of it
+        if (bjd_writer_buffer_size(writer) - count >= BJDATA_WRITER_MINIMUM_BUFFER_SIZE) {
+            writer->current = writer->buffer + count;
+            return;
+        }
+
+        // otherwise the buffer becomes a chunk
+        if (bjd_chunked_writer_append(writer, writer->buffer, count))
+            bjd_chunked_writer_next(writer, 0);
+        return;
+    }
+
+    // extra data fills the rest of the buffer, and the remainder goes in a
+    // chunk large enough to hold it
+    size_t left = bjd_writer_buffer_left(writer);
+    bjd_memcpy(writer->current, data, left);
+    data += left;
+    count -= left;
+
+    if (!bjd_chunked_writer_append(writer, writer->buffer, bjd_writer_buffer_size(writer)))
+        return;
+    if (!bjd_chunked_writer_next(writer, count))
+        return;
+
+    bjd_memcpy(writer->current, data, count);
+    writer->current += count;
+}
+
+static void bjd_chunked_writer_teardown(bjd_writer_t* writer) {
+    bjd_chunked_writer_t* chunked_writer = (bjd_chunked_writer_t*)writer->context;
+
+    // the last chunk is kept as-is rather than shrunk to avoid a copy
+    if (bjd_writer_error(writer) == bjd_ok && bjd_writer_buffer_used(writer) != 0) {
+        if (bjd_chunked_writer_append(writer, writer->buffer, bjd_writer_buffer_used(writer)))
+            writer->buffer = NULL;
+    }
+
+    if (writer->buffer) {
+        bjd_allocator_free(writer->allocator, writer->buffer);
+        writer->buffer = NULL;
+    }
+
+    if (bjd_writer_error(writer) == bjd_ok) {
+        bjd_chunks_t* target = chunked_writer->target;
+        target->chunks = chunked_writer->chunks;
+        target->count = chunked_writer->count;
+        target->size = chunked_writer->size;
+        target->allocator = writer->allocator;
+    } else {
+        for (size_t i = 0; i < chunked_writer->count; ++i)
+            bjd_allocator_free(writer->allocator, chunked_writer->chunks[i].data);
+        if (chunked_writer->chunks)
+            bjd_allocator_free(writer->allocator, chunked_writer->chunks);
+    }
+
+    bjd_allocator_free(writer->allocator, chunked_writer);
+    writer->context = NULL;
+}
+
+void bjd_writer_init_chunked(bjd_writer_t* writer, bjd_chunks_t* chunks) {
+    bjd_assert(chunks != NULL, "cannot initialize writer without a destination for the chunks");
+    bjd_memset(chunks, 0, sizeof(*chunks));
+
+    bjd_chunked_writer_t* chunked_writer = (bjd_chunked_writer_t*)BJDATA_MALLOC(sizeof(bjd_chunked_writer_t));
+    if (chunked_writer == NULL) {
+        bjd_writer_init_error(writer, bjd_error_memory);
+        return;
+    }
+    bjd_memset(chunked_writer, 0, sizeof(*chunked_writer));
+    chunked_writer->target = chunks;
+
+    size_t capacity = BJDATA_BUFFER_SIZE;
+    char* buffer = (char*)BJDATA_MALLOC(capacity);
+    if (buffer == NULL) {
+        BJDATA_FREE(chunked_writer);
+        bjd_writer_init_error(writer, bjd_error_memory);
+        return;
+    }
+
+    bjd_writer_init(writer, buffer, capacity);
+    bjd_writer_set_context(writer, chunked_writer);
+    bjd_writer_set_flush(writer, bjd_chunked_writer_flush);
+    bjd_writer_set_teardown(writer, bjd_chunked_writer_teardown);
+}
+
+char* bjd_chunks_concat(const bjd_chunks_t* chunks) {
+    char* data = (char*)bjd_allocator_malloc(chunks->allocator, chunks->size != 0 ? chunks->size : 1);
+    if (data == NULL)
+        return NULL;
+
+    char* p = data;
+    for (size_t i = 0; i < chunks->count; ++i) {
+        bjd_memcpy(p, chunks->chunks[i].data, chunks->chunks[i].size);
+        p += chunks->chunks[i].size;
+    }
+    return data;
+}
+
+void bjd_chunks_destroy(bjd_chunks_t* chunks) {
+    for (size_t i = 0; i < chunks->count; ++i)
+        bjd_allocator_free(chunks->allocator, chunks->chunks[i].data);
+    if (chunks->chunks)
+        bjd_allocator_free(chunks->allocator, chunks->chunks);
+    bjd_memset(chunks, 0, sizeof(*chunks));
+}
 #endif
 
 #if BJDATA_STDIO
@@ -259,7 +466,7 @@ static void bjd_file_writer_flush(bjd_writer_t* writer, const char* buffer, size
 }
 
 static void bjd_file_writer_teardown(bjd_writer_t* writer) {
-    BJDATA_FREE(writer->buffer);
+    bjd_allocator_free(writer->allocator, writer->buffer);
     writer->buffer = NULL;
     writer->context = NULL;
 }
@@ -310,6 +517,368 @@ void bjd_writer_init_filename(bjd_writer_t* writer, const char* filename) {
 }
 #endif
 
+#if BJDATA_IOV
+typedef struct bjd_iov_writer_t {
+    bjd_iov_t* target;     /* Where to place the segments on destroy */
+    char* mark;            /* Start of the buffered data not yet in a segment */
+    struct iovec* vectors;
+    size_t count;
+    size_t capacity;
+    void** chunks;
+    size_t chunk_count;
+    size_t chunk_capacity;
+} bjd_iov_writer_t;
+
+// Appends a segment to the iov writer. Data that directly follows the
+// previous segment extends it instead.
+static bool bjd_iov_writer_push(bjd_writer_t* writer, const char* data, size_t count) {
+    bjd_iov_writer_t* iov_writer = (bjd_iov_writer_t*)writer->context;
+    if (count == 0)
+        return true;
+
+    if (iov_writer->count > 0) {
+        struct iovec* last = &iov_writer->vectors[iov_writer->count - 1];
+        if ((const char*)last->iov_base + last->iov_len == data) {
+            last->iov_len += count;
+            return true;
+        }
+    }
+
+    if (iov_writer->count == iov_writer->capacity) {
+        size_t capacity = (iov_writer->capacity == 0) ? 8 : iov_writer->capacity * 2;
+        struct iovec* vectors = (struct iovec*)bjd_allocator_realloc(writer->allocator, iov_writer->vectors,
+                iov_writer->count * sizeof(struct iovec), capacity * sizeof(struct iovec));
+        if (vectors == NULL) {
+            bjd_writer_flag_error(writer, bjd_error_memory);
+            return false;
+        }
+        iov_writer->vectors = vectors;
+        iov_writer->capacity = capacity;
+    }
+
+    struct iovec* vector = &iov_writer->vectors[iov_writer->count++];
+    vector->iov_base = (void*)(uintptr_t)data;
+    vector->iov_len = count;
+    return true;
+}
+
+// Takes ownership of a buffer that segments point into.
+static bool bjd_iov_writer_keep(bjd_writer_t* writer, void* chunk) {
+    bjd_iov_writer_t* iov_writer = (bjd_iov_writer_t*)writer->context;
+
+    if (iov_writer->chunk_count == iov_writer->chunk_capacity) {
+        size_t capacity = (iov_writer->chunk_capacity == 0) ? 8 : iov_writer->chunk_capacity * 2;
+        void** chunks = (void**)bjd_allocator_realloc(writer->allocator, iov_writer->chunks,
+                iov_writer->chunk_count * sizeof(void*), capacity * sizeof(void*));
+        if (chunks == NULL) {
+            bjd_writer_flag_error(writer, bjd_error_memory);
+            return false;
+        }
+        iov_writer->chunks = chunks;
+        iov_writer->chunk_capacity = capacity;
+    }
+
+    iov_writer->chunks[iov_writer->chunk_count++] = chunk;
+    return true;
+}
+
+static void bjd_iov_writer_flush(bjd_writer_t* writer, const char* data, size_t count) {
+    bjd_iov_writer_t* iov_writer = (bjd_iov_writer_t*)writer->context;
+
+    // As with bjd_growable_writer_flush(), this is either a flush of a full
+    // buffer, a flush of extra data that does not fit in the buffer, or the
+    // final flush of the buffer during teardown.
+
+    if (data == writer->buffer) {
+
+        // teardown, do nothing; the buffer is collected by the teardown
+        if (bjd_writer_buffer_used(writer) == count)
+            return;
+
+        // the buffer is full. its data is closed into a segment and it is
+        // replaced rather than grown so that existing segments stay valid.
+        if (!bjd_iov_writer_push(writer, iov_writer->mark,
+                    (size_t)(writer->buffer + count - iov_writer->mark)))
+            return;
+
+        char* buffer = (char*)bjd_allocator_malloc(writer->allocator, BJDATA_BUFFER_SIZE);
+        if (buffer == NULL) {
+            bjd_writer_flag_error(writer, bjd_error_memory);
+            return;
+        }
+        if (!bjd_iov_writer_keep(writer, writer->buffer)) {
+            bjd_allocator_free(writer->allocator, buffer);
+            return;
+        }
+
+        writer->buffer = buffer;
+        writer->current = buffer;
+        writer->end = buffer + BJDATA_BUFFER_SIZE;
+        iov_writer->mark = buffer;
+        return;
+    }
+
+    // extra data may not outlive the writer so it gets a chunk of its own
+    char* chunk = (char*)bjd_allocator_malloc(writer->allocator, count);
+    if (chunk == NULL) {
+        bjd_writer_flag_error(writer, bjd_error_memory);
+        return;
+    }
+    if (!bjd_iov_writer_keep(writer, chunk)) {
+        bjd_allocator_free(writer->allocator, chunk);
+        return;
+    }
+    bjd_memcpy(chunk, data, count);
+    bjd_iov_writer_push(writer, chunk, count);
+}
+
+// Closes the buffered data into a segment and appends the caller's data
+// after it without copying.
+static void bjd_iov_writer_reference(bjd_writer_t* writer, const char* data, size_t count) {
+    bjd_iov_writer_t* iov_writer = (bjd_iov_writer_t*)writer->context;
+    bjd_log("referencing %i bytes at %p\n", (int)count, data);
+
+    if (bjd_iov_writer_push(writer, iov_writer->mark, (size_t)(writer->current - iov_writer->mark)) &&
+            bjd_iov_writer_push(writer, data, count))
+        iov_writer->mark = writer->current;
+}
+
+static void bjd_iov_writer_teardown(bjd_writer_t* writer) {
+    bjd_iov_writer_t* iov_writer = (bjd_iov_writer_t*)writer->context;
+
+    if (bjd_writer_error(writer) == bjd_ok) {
+        size_t used = bjd_writer_buffer_used(writer);
+        if (bjd_iov_writer_push(writer, iov_writer->mark, (size_t)(writer->current - iov_writer->mark)) &&
+                used != 0 && bjd_iov_writer_keep(writer, writer->buffer))
+            writer->buffer = NULL;
+    }
+
+    if (writer->buffer) {
+        bjd_allocator_free(writer->allocator, writer->buffer);
+        writer->buffer = NULL;
+    }
+
+    if (bjd_writer_error(writer) == bjd_ok) {
+        bjd_iov_t* target = iov_writer->target;
+        target->vectors = iov_writer->vectors;
+        target->count = iov_writer->count;
+        target->chunks = iov_writer->chunks;
+        target->chunk_count = iov_writer->chunk_count;
+        target->allocator = writer->allocator;
+    } else {
+        for (size_t i = 0; i < iov_writer->chunk_count; ++i)
+            bjd_allocator_free(writer->allocator, iov_writer->chunks[i]);
+        if (iov_writer->chunks)
+            bjd_allocator_free(writer->allocator, iov_writer->chunks);
+        if (iov_writer->vectors)
+            bjd_allocator_free(writer->allocator, iov_writer->vectors);
+    }
+
+    bjd_allocator_free(writer->allocator, iov_writer);
+    writer->context = NULL;
+}
+
+void bjd_writer_init_iov(bjd_writer_t* writer, bjd_iov_t* iov) {
+    bjd_assert(iov != NULL, "cannot initialize writer without a destination for the segments");
+    bjd_memset(iov, 0, sizeof(*iov));
+
+    bjd_iov_writer_t* iov_writer = (bjd_iov_writer_t*)BJDATA_MALLOC(sizeof(bjd_iov_writer_t));
+    if (iov_writer == NULL) {
+        bjd_writer_init_error(writer, bjd_error_memory);
+        return;
+    }
+    bjd_memset(iov_writer, 0, sizeof(*iov_writer));
+    iov_writer->target = iov;
+
+    size_t capacity = BJDATA_BUFFER_SIZE;
+    char* buffer = (char*)BJDATA_MALLOC(capacity);
+    if (buffer == NULL) {
+        BJDATA_FREE(iov_writer);
+        bjd_writer_init_error(writer, bjd_error_memory);
+        return;
+    }
+    iov_writer->mark = buffer;
+
+    bjd_writer_init(writer, buffer, capacity);
+    bjd_writer_set_context(writer, iov_writer);
+    bjd_writer_set_flush(writer, bjd_iov_writer_flush);
+    bjd_writer_set_teardown(writer, bjd_iov_writer_teardown);
+}
+
+void bjd_iov_destroy(bjd_iov_t* iov) {
+    for (size_t i = 0; i < iov->chunk_count; ++i)
+        bjd_allocator_free(iov->allocator, iov->chunks[i]);
+    if (iov->chunks)
+        bjd_allocator_free(iov->allocator, iov->chunks);
+    if (iov->vectors)
+        bjd_allocator_free(iov->allocator, iov->vectors);
+    bjd_memset(iov, 0, sizeof(*iov));
+}
+
+typedef struct bjd_fd_writer_t {
+    int fd;
+} bjd_fd_writer_t;
+
+// Writes all of the given segments, retrying after short writes. The
+// segments are modified to track progress.
+static void bjd_fd_writer_writev(bjd_writer_t* writer, struct iovec* vectors, int count) {
+    bjd_fd_writer_t* fd_writer = (bjd_fd_writer_t*)bjd_writer_get_reserved(writer);
+
+    while (count > 0) {
+        ssize_t written = writev(fd_writer->fd, vectors, count);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            bjd_writer_flag_error(writer, bjd_error_io);
+            return;
+        }
+
+        size_t left = (size_t)written;
+        while (count > 0 && left >= vectors->iov_len) {
+            left -= vectors->iov_len;
+            ++vectors;
+            --count;
+        }
+        if (count > 0) {
+            vectors->iov_base = (char*)vectors->iov_base + left;
+            vectors->iov_len -= left;
+        }
+    }
+}
+
+static void bjd_fd_writer_flush(bjd_writer_t* writer, const char* data, size_t count) {
+    struct iovec vector;
+    vector.iov_base = (void*)(uintptr_t)data;
+    vector.iov_len = count;
+    bjd_fd_writer_writev(writer, &vector, 1);
+}
+
+// Writes the buffered data followed by the caller's data in one call.
+static void bjd_fd_writer_reference(bjd_writer_t* writer, const char* data, size_t count) {
+    struct iovec vectors[2];
+    vectors[0].iov_base = writer->buffer;
+    vectors[0].iov_len = bjd_writer_buffer_used(writer);
+    vectors[1].iov_base = (void*)(uintptr_t)data;
+    vectors[1].iov_len = count;
+
+    writer->current = writer->buffer;
+    bjd_fd_writer_writev(writer, vectors, 2);
+}
+
+static void bjd_fd_writer_teardown(bjd_writer_t* writer) {
+    bjd_allocator_free(writer->allocator, writer->buffer);
+    writer->buffer = NULL;
+}
+
+void bjd_writer_init_fd(bjd_writer_t* writer, int fd) {
+    size_t capacity = BJDATA_BUFFER_SIZE;
+    char* buffer = (char*)BJDATA_MALLOC(capacity);
+    if (buffer == NULL) {
+        bjd_writer_init_error(writer, bjd_error_memory);
+        return;
+    }
+
+    BJDATA_STATIC_ASSERT(sizeof(bjd_fd_writer_t) <= sizeof(writer->reserved),
+            "not enough reserved space for fd writer!");
+    bjd_fd_writer_t* fd_writer = (bjd_fd_writer_t*)bjd_writer_get_reserved(writer);
+    fd_writer->fd = fd;
+
+    bjd_writer_init(writer, buffer, capacity);
+    bjd_writer_set_flush(writer, bjd_fd_writer_flush);
+    bjd_writer_set_teardown(writer, bjd_fd_writer_teardown);
+}
+#endif
+
+#ifdef BJDATA_MALLOC
+// Returns true if the writer's buffer was allocated by one of the above
+// init functions and is freed by its teardown.
+static bool bjd_writer_owns_buffer(bjd_writer_t* writer) {
+    if (writer->teardown == bjd_growable_writer_teardown || writer->teardown == bjd_chunked_writer_teardown)
+        return true;
+    #if BJDATA_STDIO
+    if (writer->teardown == bjd_file_writer_teardown || writer->teardown == bjd_file_writer_teardown_close)
+        return true;
+    #endif
+    #if BJDATA_IOV
+    if (writer->teardown == bjd_iov_writer_teardown || writer->teardown == bjd_fd_writer_teardown)
+        return true;
+    #endif
+    return false;
+}
+
+// Returns the size of the context allocated by one of the above init
+// functions and freed by its teardown, or 0 if it has none.
+static size_t bjd_writer_owned_context_size(bjd_writer_t* writer) {
+    if (writer->teardown == bjd_chunked_writer_teardown)
+        return sizeof(bjd_chunked_writer_t);
+    #if BJDATA_IOV
+    if (writer->teardown == bjd_iov_writer_teardown)
+        return sizeof(bjd_iov_writer_t);
+    #endif
+    return 0;
+}
+
+void bjd_writer_set_allocator(bjd_writer_t* writer, const bjd_allocator_t* allocator) {
+    if (writer->error != bjd_ok)
+        return;
+    bjd_assert(bjd_writer_buffer_used(writer) == 0 && !writer->auto_pending,
+            "cannot change the allocator after writing has started");
+
+    // a buffer and context allocated on init are replaced so that they can
+    // be grown and freed with the new allocator. nothing has been written,
+    // so the context doesn't own anything yet.
+    size_t context_size = bjd_writer_owned_context_size(writer);
+    void* context = NULL;
+    if (context_size != 0) {
+        context = bjd_allocator_malloc(allocator, context_size);
+        if (context == NULL) {
+            bjd_writer_flag_error(writer, bjd_error_memory);
+            return;
+        }
+        bjd_memcpy(context, writer->context, context_size);
+    }
+
+    if (bjd_writer_owns_buffer(writer)) {
+        size_t size = bjd_writer_buffer_size(writer);
+        char* buffer = (char*)bjd_allocator_malloc(allocator, size);
+        if (buffer == NULL) {
+            if (context)
+                bjd_allocator_free(allocator, context);
+            bjd_writer_flag_error(writer, bjd_error_memory);
+            return;
+        }
+        bjd_allocator_free(writer->allocator, writer->buffer);
+        writer->buffer = buffer;
+        writer->current = buffer;
+        writer->end = buffer + size;
+    }
+
+    if (context) {
+        bjd_allocator_free(writer->allocator, writer->context);
+        writer->context = context;
+    }
+
+    #if BJDATA_IOV
+    if (writer->teardown == bjd_iov_writer_teardown)
+        ((bjd_iov_writer_t*)writer->context)->mark = writer->buffer;
+    #endif
+
+    if (writer->auto_values) {
+        bjd_allocator_free(writer->allocator, writer->auto_values);
+        writer->auto_values = NULL;
+        writer->auto_capacity = 0;
+    }
+
+    // the tracking stack is still empty so it is simply recreated
+    #if BJDATA_WRITE_TRACKING
+    bjd_track_destroy(&writer->track, true);
+    bjd_writer_flag_if_error(writer, bjd_track_init(&writer->track, allocator));
+    #endif
+
+    writer->allocator = allocator;
+}
+#endif
+
 void bjd_writer_flag_error(bjd_writer_t* writer, bjd_error_t error) {
     bjd_log("writer %p setting error %i: %s\n", (void*)writer, (int)error, bjd_error_to_string(error));
 
@@ -436,8 +1005,62 @@ BJDATA_STATIC_INLINE void bjd_write_native(bjd_writer_t* writer, const char* p,
     }
 }
 
+// Writes a payload from the caller's memory. Vectored writers reference
+// large payloads in place rather than copying them.
+static void bjd_write_borrowed(bjd_writer_t* writer, const char* p, size_t count) {
+    #if BJDATA_IOV
+    if (count >= BJDATA_IOV_REFERENCE_MIN && bjd_writer_error(writer) == bjd_ok) {
+        if (writer->flush == bjd_iov_writer_flush) {
+            bjd_iov_writer_reference(writer, p, count);
+            return;
+        }
+        if (writer->flush == bjd_fd_writer_flush) {
+            bjd_fd_writer_reference(writer, p, count);
+            return;
+        }
+    }
+    #endif
+    bjd_write_native(writer, p, count);
+}
+
+#ifdef BJDATA_MALLOC
+static void bjd_writer_auto_push(bjd_writer_t* writer, bjd_tag_t value);
+BJDATA_NOINLINE static void bjd_writer_auto_flush_plain(bjd_writer_t* writer);
+#endif
+
+// Buffers a number written into an array that may be promoted to a typed
+// array. Returns false if no such array is open, in which case the number
+// must be written normally.
+BJDATA_STATIC_INLINE bool bjd_writer_auto_take(bjd_writer_t* writer, bjd_tag_t value) {
+    #ifdef BJDATA_MALLOC
+    if (BJDATA_UNLIKELY(writer->auto_pending)) {
+        bjd_writer_auto_push(writer, value);
+        return true;
+    }
+    #else
+    BJDATA_UNUSED(writer);
+    BJDATA_UNUSED(value);
+    #endif
+    return false;
+}
+
+// Writes out any array buffered for promotion to a typed array in its
+// plain encoding. This must be called before writing any element that
+// cannot be part of a typed array.
+BJDATA_STATIC_INLINE void bjd_writer_auto_flush(bjd_writer_t* writer) {
+    #ifdef BJDATA_MALLOC
+    if (BJDATA_UNLIKELY(writer->auto_pending))
+        bjd_writer_auto_flush_plain(writer);
+    #else
+    BJDATA_UNUSED(writer);
+    #endif
+}
+
 bjd_error_t bjd_writer_destroy(bjd_writer_t* writer) {
 
+    // an incomplete auto-typed array is written as-is so that no data is lost
+    bjd_writer_auto_flush(writer);
+
     // clean up tracking, asserting if we're not already in an error state
     #if BJDATA_WRITE_TRACKING
     bjd_track_destroy(&writer->track, writer->error != bjd_ok);
@@ -454,6 +1077,13 @@ bjd_error_t bjd_writer_destroy(bjd_writer_t* writer) {
         writer->teardown = NULL;
     }
 
+    #ifdef BJDATA_MALLOC
+    if (writer->auto_values) {
+        bjd_allocator_free(writer->allocator, writer->auto_values);
+        writer->auto_values = NULL;
+    }
+    #endif
+
     return writer->error;
 }
 
@@ -465,6 +1095,7 @@ void bjd_write_tag(bjd_writer_t* writer, bjd_tag_t value) {
             return;
 
         case bjd_type_nil:    bjd_write_nil   (writer);            return;
+        case bjd_type_noop:   bjd_write_noop  (writer);            return;
         case bjd_type_bool:   bjd_write_bool  (writer, value.v.b); return;
         case bjd_type_float:  bjd_write_float (writer, value.v.f); return;
         case bjd_type_double: bjd_write_double(writer, value.v.d); return;
@@ -489,185 +1120,135 @@ void bjd_write_tag(bjd_writer_t* writer, bjd_tag_t value) {
 }
 
 BJDATA_STATIC_INLINE void bjd_write_byte_element(bjd_writer_t* writer, char value) {
+    bjd_writer_auto_flush(writer);
     bjd_writer_track_element(writer);
     if (BJDATA_LIKELY(bjd_writer_buffer_left(writer) >= 1) || bjd_writer_ensure(writer, 1))
         *(writer->current++) = value;
 }
 
 void bjd_write_nil(bjd_writer_t* writer) {
-    bjd_write_byte_element(writer, (char)0xc0);
+    bjd_write_byte_element(writer, 'Z');
+}
+
+void bjd_write_noop(bjd_writer_t* writer) {
+    bjd_write_byte_element(writer, 'N');
 }
 
 void bjd_write_bool(bjd_writer_t* writer, bool value) {
-    bjd_write_byte_element(writer, (char)(0xc2 | (value ? 1 : 0)));
+    bjd_write_byte_element(writer, value ? 'T' : 'F');
 }
 
 void bjd_write_true(bjd_writer_t* writer) {
-    bjd_write_byte_element(writer, (char)0xc3);
+    bjd_write_byte_element(writer, 'T');
 }
 
 void bjd_write_false(bjd_writer_t* writer) {
-    bjd_write_byte_element(writer, (char)0xc2);
+    bjd_write_byte_element(writer, 'F');
 }
 
 void bjd_write_object_bytes(bjd_writer_t* writer, const char* data, size_t bytes) {
+    bjd_writer_auto_flush(writer);
     bjd_writer_track_element(writer);
     bjd_write_native(writer, data, bytes);
 }
 
 /*
  * Encode functions
+ *
+ * These encode a marker and its value into p and return the number of
+ * bytes written, which is at most BJDATA_MAXIMUM_TAG_SIZE.
  */
 
-BJDATA_STATIC_INLINE void bjd_encode_fixuint(char* p, uint8_t value) {
-    bjd_assert(value <= 127);
-    bjd_store_u8(p, value);
-}
-
-BJDATA_STATIC_INLINE void bjd_encode_u8(char* p, uint8_t value) {
-    bjd_assert(value > 127);
-    bjd_store_u8(p, 0xcc);
-    bjd_store_u8(p + 1, value);
+// Encodes an unsigned integer with the smallest marker that holds it.
+static size_t bjd_encode_uint(char* p, uint64_t value, bjd_endian_t endian) {
+    if (value <= UINT8_MAX) {
+        p[0] = 'U';
+        bjd_store_u8(p + 1, (uint8_t)value);
+        return BJDATA_TAG_SIZE_U8;
+    }
+    if (value <= UINT16_MAX) {
+        p[0] = 'u';
+        bjd_store_u16_endian(p + 1, (uint16_t)value, endian);
+        return BJDATA_TAG_SIZE_U16;
+    }
+    if (value <= UINT32_MAX) {
+        p[0] = 'm';
+        bjd_store_u32_endian(p + 1, (uint32_t)value, endian);
+        return BJDATA_TAG_SIZE_U32;
+    }
+    p[0] = 'M';
+    bjd_store_u64_endian(p + 1, value, endian);
+    return BJDATA_TAG_SIZE_U64;
+}
+
+// Encodes a signed integer with the smallest marker that holds it.
+// Non-negative values use the unsigned markers, which hold more.
+static size_t bjd_encode_int(char* p, int64_t value, bjd_endian_t endian) {
+    if (value >= 0)
+        return bjd_encode_uint(p, (uint64_t)value, endian);
+    if (value >= INT8_MIN) {
+        p[0] = 'i';
+        bjd_store_i8(p + 1, (int8_t)value);
+        return BJDATA_TAG_SIZE_I8;
+    }
+    if (value >= INT16_MIN) {
+        p[0] = 'I';
+        bjd_store_u16_endian(p + 1, (uint16_t)value, endian);
+        return BJDATA_TAG_SIZE_I16;
+    }
+    if (value >= INT32_MIN) {
+        p[0] = 'l';
+        bjd_store_u32_endian(p + 1, (uint32_t)value, endian);
+        return BJDATA_TAG_SIZE_I32;
+    }
+    p[0] = 'L';
+    bjd_store_u64_endian(p + 1, (uint64_t)value, endian);
+    return BJDATA_TAG_SIZE_I64;
 }
 
-BJDATA_STATIC_INLINE void bjd_encode_u16(char* p, uint16_t value) {
-    bjd_assert(value > UINT8_MAX);
-    bjd_store_u8(p, 0xcd);
-    bjd_store_u16(p + 1, value);
+static size_t bjd_encode_float(char* p, float value, bjd_endian_t endian) {
+    p[0] = 'd';
+    bjd_store_float_endian(p + 1, value, endian);
+    return BJDATA_TAG_SIZE_FLOAT;
 }
 
-BJDATA_STATIC_INLINE void bjd_encode_u32(char* p, uint32_t value) {
-    bjd_assert(value > UINT16_MAX);
-    bjd_store_u8(p, 0xce);
-    bjd_store_u32(p + 1, value);
+static size_t bjd_encode_double(char* p, double value, bjd_endian_t endian) {
+    p[0] = 'D';
+    bjd_store_double_endian(p + 1, value, endian);
+    return BJDATA_TAG_SIZE_DOUBLE;
 }
 
-BJDATA_STATIC_INLINE void bjd_encode_u64(char* p, uint64_t value) {
-    bjd_assert(value > UINT32_MAX);
-    bjd_store_u8(p, 0xcf);
-    bjd_store_u64(p + 1, value);
+// Encodes a string marker and its length.
+static size_t bjd_encode_str(char* p, uint32_t length, bjd_endian_t endian) {
+    p[0] = 'S';
+    return 1 + bjd_encode_uint(p + 1, length, endian);
 }
 
-BJDATA_STATIC_INLINE void bjd_encode_fixint(char* p, int8_t value) {
-    // this can encode positive or negative fixints
-    bjd_assert(value >= -32);
-    bjd_store_i8(p, value);
+// Encodes an optimized container header (e.g. "[$d#" followed by the
+// count) into p, using the smallest unsigned integer marker that can
+// hold the count. Returns the number of bytes written, which is at
+// most BJDATA_TYPED_HEADER_MAX_SIZE.
+static size_t bjd_encode_typed_header(char* p, char container, char marker, uint64_t count,
+        bjd_endian_t endian)
+{
+    p[0] = container;
+    p[1] = BJDATA_MARKER_TYPE;
+    p[2] = marker;
+    p[3] = BJDATA_MARKER_COUNT;
+    return 4 + bjd_encode_uint(p + 4, count, endian);
 }
 
-BJDATA_STATIC_INLINE void bjd_encode_i8(char* p, int8_t value) {
-    bjd_assert(value < -32);
-    bjd_store_u8(p, 0xd0);
-    bjd_store_i8(p + 1, value);
+// Encodes a counted container header such as "[#U\x03".
+static size_t bjd_encode_container(char* p, char container, uint32_t count, bjd_endian_t endian) {
+    p[0] = container;
+    p[1] = BJDATA_MARKER_COUNT;
+    return 2 + bjd_encode_uint(p + 2, count, endian);
 }
 
-BJDATA_STATIC_INLINE void bjd_encode_i16(char* p, int16_t value) {
-    bjd_assert(value < INT8_MIN);
-    bjd_store_u8(p, 0xd1);
-    bjd_store_i16(p + 1, value);
-}
-
-BJDATA_STATIC_INLINE void bjd_encode_i32(char* p, int32_t value) {
-    bjd_assert(value < INT16_MIN);
-    bjd_store_u8(p, 0xd2);
-    bjd_store_i32(p + 1, value);
-}
-
-BJDATA_STATIC_INLINE void bjd_encode_i64(char* p, int64_t value) {
-    bjd_assert(value < INT32_MIN);
-    bjd_store_u8(p, 0xd3);
-    bjd_store_i64(p + 1, value);
-}
-
-BJDATA_STATIC_INLINE void bjd_encode_float(char* p, float value) {
-    bjd_store_u8(p, 0xca);
-    bjd_store_float(p + 1, value);
-}
-
-BJDATA_STATIC_INLINE void bjd_encode_double(char* p, double value) {
-    bjd_store_u8(p, 0xcb);
-    bjd_store_double(p + 1, value);
-}
-
-BJDATA_STATIC_INLINE void bjd_encode_fixarray(char* p, uint8_t count) {
-    bjd_assert(count <= 15);
-    bjd_store_u8(p, (uint8_t)(0x90 | count));
-}
-
-BJDATA_STATIC_INLINE void bjd_encode_array16(char* p, uint16_t count) {
-    bjd_assert(count > 15);
-    bjd_store_u8(p, 0xdc);
-    bjd_store_u16(p + 1, count);
-}
-
-BJDATA_STATIC_INLINE void bjd_encode_array32(char* p, uint32_t count) {
-    bjd_assert(count > UINT16_MAX);
-    bjd_store_u8(p, 0xdd);
-    bjd_store_u32(p + 1, count);
-}
-
-BJDATA_STATIC_INLINE void bjd_encode_fixmap(char* p, uint8_t count) {
-    bjd_assert(count <= 15);
-    bjd_store_u8(p, (uint8_t)(0x80 | count));
-}
-
-BJDATA_STATIC_INLINE void bjd_encode_map16(char* p, uint16_t count) {
-    bjd_assert(count > 15);
-    bjd_store_u8(p, 0xde);
-    bjd_store_u16(p + 1, count);
-}
-
-BJDATA_STATIC_INLINE void bjd_encode_map32(char* p, uint32_t count) {
-    bjd_assert(count > UINT16_MAX);
-    bjd_store_u8(p, 0xdf);
-    bjd_store_u32(p + 1, count);
-}
-
-BJDATA_STATIC_INLINE void bjd_encode_fixstr(char* p, uint8_t count) {
-    bjd_assert(count <= 31);
-    bjd_store_u8(p, (uint8_t)(0xa0 | count));
-}
-
-BJDATA_STATIC_INLINE void bjd_encode_str8(char* p, uint8_t count) {
-    bjd_assert(count > 31);
-    bjd_store_u8(p, 0xd9);
-    bjd_store_u8(p + 1, count);
-}
-
-BJDATA_STATIC_INLINE void bjd_encode_str16(char* p, uint16_t count) {
-    // we might be encoding a raw in compatibility mode, so we
-    // allow count to be in the range [32, UINT8_MAX].
-    bjd_assert(count > 31);
-    bjd_store_u8(p, 0xda);
-    bjd_store_u16(p + 1, count);
-}
-
-BJDATA_STATIC_INLINE void bjd_encode_str32(char* p, uint32_t count) {
-    bjd_assert(count > UINT16_MAX);
-    bjd_store_u8(p, 0xdb);
-    bjd_store_u32(p + 1, count);
-}
-
-BJDATA_STATIC_INLINE void bjd_encode_bin8(char* p, uint8_t count) {
-    bjd_store_u8(p, 0xc4);
-    bjd_store_u8(p + 1, count);
-}
-
-BJDATA_STATIC_INLINE void bjd_encode_bin16(char* p, uint16_t count) {
-    bjd_assert(count > UINT8_MAX);
-    bjd_store_u8(p, 0xc5);
-    bjd_store_u16(p + 1, count);
-}
-
-BJDATA_STATIC_INLINE void bjd_encode_bin32(char* p, uint32_t count) {
-    bjd_assert(count > UINT16_MAX);
-    bjd_store_u8(p, 0xc6);
-    bjd_store_u32(p + 1, count);
-}
-
-#if BJDATA_EXTENSIONS
-BJDATA_STATIC_INLINE void bjd_encode_fixext1(char* p, int8_t exttype) {
-    bjd_store_u8(p, 0xd4);
-    bjd_store_i8(p + 1, exttype);
+#if BJDATA_EXTENSIONS
+BJDATA_STATIC_INLINE void bjd_encode_fixext1(char* p, int8_t exttype) {
+    bjd_store_u8(p, 0xd4);
+    bjd_store_i8(p + 1, exttype);
 }
 
 BJDATA_STATIC_INLINE void bjd_encode_fixext2(char* p, int8_t exttype) {
@@ -737,184 +1318,77 @@ BJDATA_STATIC_INLINE void bjd_encode_timestamp_12(char* p, int64_t seconds, uint
  * Write functions
  */
 
-// This is a macro wrapper to the encode functions to encode
-// directly into the buffer. If bjd_writer_ensure() fails
-// it will flag an error so we don't have to do anything.
-#define BJDATA_WRITE_ENCODED(encode_fn, size, ...) do {                                                 \
-    if (BJDATA_LIKELY(bjd_writer_buffer_left(writer) >= size) || bjd_writer_ensure(writer, size)) { \
-        BJDATA_EXPAND(encode_fn(writer->current, __VA_ARGS__));                                         \
-        writer->current += size;                                                                       \
-    }                                                                                                  \
+// This is a macro wrapper to the encode functions to encode directly into
+// the buffer when it has room for the largest possible tag. Otherwise the
+// tag is encoded on the stack and written normally, which flushes if
+// necessary or flags an error.
+#define BJDATA_WRITE_ENCODED(encode_fn, ...) do {                                      \
+    if (BJDATA_LIKELY(bjd_writer_buffer_left(writer) >= BJDATA_MAXIMUM_TAG_SIZE)) {     \
+        writer->current += BJDATA_EXPAND(encode_fn(writer->current, __VA_ARGS__));     \
+    } else {                                                                           \
+        char encoded[BJDATA_MAXIMUM_TAG_SIZE];                                         \
+        bjd_write_native(writer, encoded, BJDATA_EXPAND(encode_fn(encoded, __VA_ARGS__))); \
+    }                                                                                  \
 } while (0)
 
 void bjd_write_u8(bjd_writer_t* writer, uint8_t value) {
-    #if BJDATA_OPTIMIZE_FOR_SIZE
     bjd_write_u64(writer, value);
-    #else
-    bjd_writer_track_element(writer);
-    if (value <= 127) {
-        BJDATA_WRITE_ENCODED(bjd_encode_fixuint, BJDATA_TAG_SIZE_FIXUINT, value);
-    } else {
-        BJDATA_WRITE_ENCODED(bjd_encode_u8, BJDATA_TAG_SIZE_U8, value);
-    }
-    #endif
 }
 
 void bjd_write_u16(bjd_writer_t* writer, uint16_t value) {
-    #if BJDATA_OPTIMIZE_FOR_SIZE
     bjd_write_u64(writer, value);
-    #else
-    bjd_writer_track_element(writer);
-    if (value <= 127) {
-        BJDATA_WRITE_ENCODED(bjd_encode_fixuint, BJDATA_TAG_SIZE_FIXUINT, (uint8_t)value);
-    } else if (value <= UINT8_MAX) {
-        BJDATA_WRITE_ENCODED(bjd_encode_u8, BJDATA_TAG_SIZE_U8, (uint8_t)value);
-    } else {
-        BJDATA_WRITE_ENCODED(bjd_encode_u16, BJDATA_TAG_SIZE_U16, value);
-    }
-    #endif
 }
 
 void bjd_write_u32(bjd_writer_t* writer, uint32_t value) {
-    #if BJDATA_OPTIMIZE_FOR_SIZE
     bjd_write_u64(writer, value);
-    #else
-    bjd_writer_track_element(writer);
-    if (value <= 127) {
-        BJDATA_WRITE_ENCODED(bjd_encode_fixuint, BJDATA_TAG_SIZE_FIXUINT, (uint8_t)value);
-    } else if (value <= UINT8_MAX) {
-        BJDATA_WRITE_ENCODED(bjd_encode_u8, BJDATA_TAG_SIZE_U8, (uint8_t)value);
-    } else if (value <= UINT16_MAX) {
-        BJDATA_WRITE_ENCODED(bjd_encode_u16, BJDATA_TAG_SIZE_U16, (uint16_t)value);
-    } else {
-        BJDATA_WRITE_ENCODED(bjd_encode_u32, BJDATA_TAG_SIZE_U32, value);
-    }
-    #endif
+}
+
+static void bjd_write_u64_notrack(bjd_writer_t* writer, uint64_t value) {
+    BJDATA_WRITE_ENCODED(bjd_encode_uint, value, writer->endian);
 }
 
 void bjd_write_u64(bjd_writer_t* writer, uint64_t value) {
+    if (bjd_writer_auto_take(writer, bjd_tag_make_uint(value)))
+        return;
     bjd_writer_track_element(writer);
-
-    if (value <= 127) {
-        BJDATA_WRITE_ENCODED(bjd_encode_fixuint, BJDATA_TAG_SIZE_FIXUINT, (uint8_t)value);
-    } else if (value <= UINT8_MAX) {
-        BJDATA_WRITE_ENCODED(bjd_encode_u8, BJDATA_TAG_SIZE_U8, (uint8_t)value);
-    } else if (value <= UINT16_MAX) {
-        BJDATA_WRITE_ENCODED(bjd_encode_u16, BJDATA_TAG_SIZE_U16, (uint16_t)value);
-    } else if (value <= UINT32_MAX) {
-        BJDATA_WRITE_ENCODED(bjd_encode_u32, BJDATA_TAG_SIZE_U32, (uint32_t)value);
-    } else {
-        BJDATA_WRITE_ENCODED(bjd_encode_u64, BJDATA_TAG_SIZE_U64, value);
-    }
+    bjd_write_u64_notrack(writer, value);
 }
 
 void bjd_write_i8(bjd_writer_t* writer, int8_t value) {
-    #if BJDATA_OPTIMIZE_FOR_SIZE
     bjd_write_i64(writer, value);
-    #else
-    bjd_writer_track_element(writer);
-    if (value >= -32) {
-        // we encode positive and negative fixints together
-        BJDATA_WRITE_ENCODED(bjd_encode_fixint, BJDATA_TAG_SIZE_FIXINT, (int8_t)value);
-    } else {
-        BJDATA_WRITE_ENCODED(bjd_encode_i8, BJDATA_TAG_SIZE_I8, (int8_t)value);
-    }
-    #endif
 }
 
 void bjd_write_i16(bjd_writer_t* writer, int16_t value) {
-    #if BJDATA_OPTIMIZE_FOR_SIZE
     bjd_write_i64(writer, value);
-    #else
-    bjd_writer_track_element(writer);
-    if (value >= -32) {
-        if (value <= 127) {
-            // we encode positive and negative fixints together
-            BJDATA_WRITE_ENCODED(bjd_encode_fixint, BJDATA_TAG_SIZE_FIXINT, (int8_t)value);
-        } else if (value <= UINT8_MAX) {
-            BJDATA_WRITE_ENCODED(bjd_encode_u8, BJDATA_TAG_SIZE_U8, (uint8_t)value);
-        } else {
-            BJDATA_WRITE_ENCODED(bjd_encode_u16, BJDATA_TAG_SIZE_U16, (uint16_t)value);
-        }
-    } else if (value >= INT8_MIN) {
-        BJDATA_WRITE_ENCODED(bjd_encode_i8, BJDATA_TAG_SIZE_I8, (int8_t)value);
-    } else {
-        BJDATA_WRITE_ENCODED(bjd_encode_i16, BJDATA_TAG_SIZE_I16, (int16_t)value);
-    }
-    #endif
 }
 
 void bjd_write_i32(bjd_writer_t* writer, int32_t value) {
-    #if BJDATA_OPTIMIZE_FOR_SIZE
     bjd_write_i64(writer, value);
-    #else
-    bjd_writer_track_element(writer);
-    if (value >= -32) {
-        if (value <= 127) {
-            // we encode positive and negative fixints together
-            BJDATA_WRITE_ENCODED(bjd_encode_fixint, BJDATA_TAG_SIZE_FIXINT, (int8_t)value);
-        } else if (value <= UINT8_MAX) {
-            BJDATA_WRITE_ENCODED(bjd_encode_u8, BJDATA_TAG_SIZE_U8, (uint8_t)value);
-        } else if (value <= UINT16_MAX) {
-            BJDATA_WRITE_ENCODED(bjd_encode_u16, BJDATA_TAG_SIZE_U16, (uint16_t)value);
-        } else {
-            BJDATA_WRITE_ENCODED(bjd_encode_u32, BJDATA_TAG_SIZE_U32, (uint32_t)value);
-        }
-    } else if (value >= INT8_MIN) {
-        BJDATA_WRITE_ENCODED(bjd_encode_i8, BJDATA_TAG_SIZE_I8, (int8_t)value);
-    } else if (value >= INT16_MIN) {
-        BJDATA_WRITE_ENCODED(bjd_encode_i16, BJDATA_TAG_SIZE_I16, (int16_t)value);
-    } else {
-        BJDATA_WRITE_ENCODED(bjd_encode_i32, BJDATA_TAG_SIZE_I32, value);
-    }
-    #endif
+}
+
+static void bjd_write_i64_notrack(bjd_writer_t* writer, int64_t value) {
+    BJDATA_WRITE_ENCODED(bjd_encode_int, value, writer->endian);
 }
 
 void bjd_write_i64(bjd_writer_t* writer, int64_t value) {
-    #if BJDATA_OPTIMIZE_FOR_SIZE
-    if (value > 127) {
-        // for non-fix positive ints we call the u64 writer to save space
-        bjd_write_u64(writer, (uint64_t)value);
+    if (bjd_writer_auto_take(writer, bjd_tag_make_int(value)))
         return;
-    }
-    #endif
-
     bjd_writer_track_element(writer);
-    if (value >= -32) {
-        #if BJDATA_OPTIMIZE_FOR_SIZE
-        BJDATA_WRITE_ENCODED(bjd_encode_fixint, BJDATA_TAG_SIZE_FIXINT, (int8_t)value);
-        #else
-        if (value <= 127) {
-            BJDATA_WRITE_ENCODED(bjd_encode_fixint, BJDATA_TAG_SIZE_FIXINT, (int8_t)value);
-        } else if (value <= UINT8_MAX) {
-            BJDATA_WRITE_ENCODED(bjd_encode_u8, BJDATA_TAG_SIZE_U8, (uint8_t)value);
-        } else if (value <= UINT16_MAX) {
-            BJDATA_WRITE_ENCODED(bjd_encode_u16, BJDATA_TAG_SIZE_U16, (uint16_t)value);
-        } else if (value <= UINT32_MAX) {
-            BJDATA_WRITE_ENCODED(bjd_encode_u32, BJDATA_TAG_SIZE_U32, (uint32_t)value);
-        } else {
-            BJDATA_WRITE_ENCODED(bjd_encode_u64, BJDATA_TAG_SIZE_U64, (uint64_t)value);
-        }
-        #endif
-    } else if (value >= INT8_MIN) {
-        BJDATA_WRITE_ENCODED(bjd_encode_i8, BJDATA_TAG_SIZE_I8, (int8_t)value);
-    } else if (value >= INT16_MIN) {
-        BJDATA_WRITE_ENCODED(bjd_encode_i16, BJDATA_TAG_SIZE_I16, (int16_t)value);
-    } else if (value >= INT32_MIN) {
-        BJDATA_WRITE_ENCODED(bjd_encode_i32, BJDATA_TAG_SIZE_I32, (int32_t)value);
-    } else {
-        BJDATA_WRITE_ENCODED(bjd_encode_i64, BJDATA_TAG_SIZE_I64, value);
-    }
+    bjd_write_i64_notrack(writer, value);
 }
 
 void bjd_write_float(bjd_writer_t* writer, float value) {
+    if (bjd_writer_auto_take(writer, bjd_tag_make_float(value)))
+        return;
     bjd_writer_track_element(writer);
-    BJDATA_WRITE_ENCODED(bjd_encode_float, BJDATA_TAG_SIZE_FLOAT, value);
+    BJDATA_WRITE_ENCODED(bjd_encode_float, value, writer->endian);
 }
 
 void bjd_write_double(bjd_writer_t* writer, double value) {
+    if (bjd_writer_auto_take(writer, bjd_tag_make_double(value)))
+        return;
     bjd_writer_track_element(writer);
-    BJDATA_WRITE_ENCODED(bjd_encode_double, BJDATA_TAG_SIZE_DOUBLE, value);
+    BJDATA_WRITE_ENCODED(bjd_encode_double, value, writer->endian);
 }
 
 #if BJDATA_EXTENSIONS
@@ -933,6 +1407,7 @@ void bjd_write_timestamp(bjd_writer_t* writer, int64_t seconds, uint32_t nanosec
         return;
     }
 
+    bjd_writer_auto_flush(writer);
     bjd_writer_track_element(writer);
 
     if (seconds < 0 || seconds >= (INT64_C(1) << 34)) {
@@ -945,80 +1420,88 @@ void bjd_write_timestamp(bjd_writer_t* writer, int64_t seconds, uint32_t nanosec
 }
 #endif
 
+static void bjd_start_array_notrack(bjd_writer_t* writer, uint32_t count) {
+    BJDATA_WRITE_ENCODED(bjd_encode_container, BJDATA_MARKER_ARRAY_START, count, writer->endian);
+}
+
+#ifdef BJDATA_MALLOC
+static bool bjd_writer_auto_start(bjd_writer_t* writer, uint32_t count);
+#endif
+
 void bjd_start_array(bjd_writer_t* writer, uint32_t count) {
+    bjd_writer_auto_flush(writer);
     bjd_writer_track_element(writer);
 
-    if (count <= 15) {
-        BJDATA_WRITE_ENCODED(bjd_encode_fixarray, BJDATA_TAG_SIZE_FIXARRAY, (uint8_t)count);
-    } else if (count <= UINT16_MAX) {
-        BJDATA_WRITE_ENCODED(bjd_encode_array16, BJDATA_TAG_SIZE_ARRAY16, (uint16_t)count);
-    } else {
-        BJDATA_WRITE_ENCODED(bjd_encode_array32, BJDATA_TAG_SIZE_ARRAY32, (uint32_t)count);
+    // In auto-typed mode the header is deferred until we know whether
+    // the elements can be packed.
+    #ifdef BJDATA_MALLOC
+    if (!writer->auto_typed || !bjd_writer_auto_start(writer, count))
+    #endif
+    {
+        bjd_start_array_notrack(writer, count);
     }
 
     bjd_writer_track_push(writer, bjd_type_array, count);
 }
 
 void bjd_start_map(bjd_writer_t* writer, uint32_t count) {
+    bjd_writer_auto_flush(writer);
     bjd_writer_track_element(writer);
 
-    if (count <= 15) {
-        BJDATA_WRITE_ENCODED(bjd_encode_fixmap, BJDATA_TAG_SIZE_FIXMAP, (uint8_t)count);
-    } else if (count <= UINT16_MAX) {
-        BJDATA_WRITE_ENCODED(bjd_encode_map16, BJDATA_TAG_SIZE_MAP16, (uint16_t)count);
-    } else {
-        BJDATA_WRITE_ENCODED(bjd_encode_map32, BJDATA_TAG_SIZE_MAP32, (uint32_t)count);
-    }
+    BJDATA_WRITE_ENCODED(bjd_encode_container, BJDATA_MARKER_MAP_START, count, writer->endian);
 
     bjd_writer_track_push(writer, bjd_type_map, count);
 }
 
-static void bjd_start_str_notrack(bjd_writer_t* writer, uint32_t count) {
-    if (count <= 31) {
-        BJDATA_WRITE_ENCODED(bjd_encode_fixstr, BJDATA_TAG_SIZE_FIXSTR, (uint8_t)count);
+// Writes the end marker of an unsized container, which is not an element.
+static void bjd_write_end_marker(bjd_writer_t* writer, char marker) {
+    if (BJDATA_LIKELY(bjd_writer_buffer_left(writer) >= 1) || bjd_writer_ensure(writer, 1))
+        *(writer->current++) = marker;
+}
 
-    // str8 is only supported in v5 or later.
-    } else if (count <= UINT8_MAX
-            #if BJDATA_COMPATIBILITY
-            && writer->version >= bjd_version_v5
-            #endif
-            ) {
-        BJDATA_WRITE_ENCODED(bjd_encode_str8, BJDATA_TAG_SIZE_STR8, (uint8_t)count);
+void bjd_start_array_unsized(bjd_writer_t* writer) {
+    bjd_write_byte_element(writer, BJDATA_MARKER_ARRAY_START);
+    bjd_writer_track_push_unsized(writer, bjd_type_array);
+}
 
-    } else if (count <= UINT16_MAX) {
-        BJDATA_WRITE_ENCODED(bjd_encode_str16, BJDATA_TAG_SIZE_STR16, (uint16_t)count);
-    } else {
-        BJDATA_WRITE_ENCODED(bjd_encode_str32, BJDATA_TAG_SIZE_STR32, (uint32_t)count);
-    }
+void bjd_finish_array_unsized(bjd_writer_t* writer) {
+    bjd_writer_auto_flush(writer);
+    bjd_writer_track_pop_unsized(writer, bjd_type_array);
+    bjd_write_end_marker(writer, BJDATA_MARKER_ARRAY_END);
 }
 
-static void bjd_start_bin_notrack(bjd_writer_t* writer, uint32_t count) {
-    #if BJDATA_COMPATIBILITY
-    // In the v4 spec, there was only the raw type for any kind of
-    // variable-length data. In v4 mode, we support the bin functions,
-    // but we produce an old-style raw.
-    if (writer->version <= bjd_version_v4) {
-        bjd_start_str_notrack(writer, count);
-        return;
-    }
-    #endif
+void bjd_start_map_unsized(bjd_writer_t* writer) {
+    bjd_write_byte_element(writer, BJDATA_MARKER_MAP_START);
+    bjd_writer_track_push_unsized(writer, bjd_type_map);
+}
 
-    if (count <= UINT8_MAX) {
-        BJDATA_WRITE_ENCODED(bjd_encode_bin8, BJDATA_TAG_SIZE_BIN8, (uint8_t)count);
-    } else if (count <= UINT16_MAX) {
-        BJDATA_WRITE_ENCODED(bjd_encode_bin16, BJDATA_TAG_SIZE_BIN16, (uint16_t)count);
-    } else {
-        BJDATA_WRITE_ENCODED(bjd_encode_bin32, BJDATA_TAG_SIZE_BIN32, (uint32_t)count);
-    }
+void bjd_finish_map_unsized(bjd_writer_t* writer) {
+    bjd_writer_auto_flush(writer);
+    bjd_writer_track_pop_unsized(writer, bjd_type_map);
+    bjd_write_end_marker(writer, BJDATA_MARKER_MAP_END);
+}
+
+static void bjd_start_str_notrack(bjd_writer_t* writer, uint32_t count) {
+    BJDATA_WRITE_ENCODED(bjd_encode_str, count, writer->endian);
+}
+
+// BJData has no binary type. Binary data is written as an optimized array
+// of uint8, which is how other BJData encoders represent it.
+static void bjd_start_bin_notrack(bjd_writer_t* writer, uint32_t count) {
+    char header[BJDATA_TYPED_HEADER_MAX_SIZE];
+    bjd_write_native(writer, header, bjd_encode_typed_header(header,
+                BJDATA_MARKER_ARRAY_START, 'U', count, writer->endian));
 }
 
 void bjd_start_str(bjd_writer_t* writer, uint32_t count) {
+    bjd_writer_auto_flush(writer);
     bjd_writer_track_element(writer);
     bjd_start_str_notrack(writer, count);
     bjd_writer_track_push(writer, bjd_type_str, count);
 }
 
 void bjd_start_bin(bjd_writer_t* writer, uint32_t count) {
+    bjd_writer_auto_flush(writer);
     bjd_writer_track_element(writer);
     bjd_start_bin_notrack(writer, count);
     bjd_writer_track_push(writer, bjd_type_huge, count);
@@ -1034,6 +1517,7 @@ void bjd_start_ext(bjd_writer_t* writer, int8_t exttype, uint32_t count) {
     }
     #endif
 
+    bjd_writer_auto_flush(writer);
     bjd_writer_track_element(writer);
 
     if (count == 1) {
@@ -1067,56 +1551,20 @@ void bjd_start_ext(bjd_writer_t* writer, int8_t exttype, uint32_t count) {
 void bjd_write_str(bjd_writer_t* writer, const char* data, uint32_t count) {
     bjd_assert(data != NULL, "data for string of length %i is NULL", (int)count);
 
-    #if BJDATA_OPTIMIZE_FOR_SIZE
-    bjd_writer_track_element(writer);
-    bjd_start_str_notrack(writer, count);
-    bjd_write_native(writer, data, count);
-    #else
-
+    bjd_writer_auto_flush(writer);
     bjd_writer_track_element(writer);
 
-    if (count <= 31) {
-        // The minimum buffer size when using a flush function is guaranteed to
-        // fit the largest possible fixstr.
-        size_t size = count + BJDATA_TAG_SIZE_FIXSTR;
-        if (BJDATA_LIKELY(bjd_writer_buffer_left(writer) >= size) || bjd_writer_ensure(writer, size)) {
-            char* BJDATA_RESTRICT p = writer->current;
-            bjd_encode_fixstr(p, (uint8_t)count);
-            bjd_memcpy(p + BJDATA_TAG_SIZE_FIXSTR, data, count);
-            writer->current += count + BJDATA_TAG_SIZE_FIXSTR;
-        }
-        return;
-    }
-
-    if (count <= UINT8_MAX
-            #if BJDATA_COMPATIBILITY
-            && writer->version >= bjd_version_v5
-            #endif
-            ) {
-        if (count + BJDATA_TAG_SIZE_STR8 <= bjd_writer_buffer_left(writer)) {
-            char* BJDATA_RESTRICT p = writer->current;
-            bjd_encode_str8(p, (uint8_t)count);
-            bjd_memcpy(p + BJDATA_TAG_SIZE_STR8, data, count);
-            writer->current += count + BJDATA_TAG_SIZE_STR8;
-        } else {
-            BJDATA_WRITE_ENCODED(bjd_encode_str8, BJDATA_TAG_SIZE_STR8, (uint8_t)count);
-            bjd_write_native(writer, data, count);
-        }
+    // Short strings are encoded with their header in a single space check.
+    if (bjd_writer_buffer_left(writer) >= (size_t)count + BJDATA_MAXIMUM_TAG_SIZE) {
+        char* BJDATA_RESTRICT p = writer->current;
+        size_t header_size = bjd_encode_str(p, count, writer->endian);
+        bjd_memcpy(p + header_size, data, count);
+        writer->current += header_size + count;
         return;
     }
 
-    // str16 and str32 are likely to be a significant fraction of the buffer
-    // size, so we don't bother with a combined space check in order to
-    // minimize code size.
-    if (count <= UINT16_MAX) {
-        BJDATA_WRITE_ENCODED(bjd_encode_str16, BJDATA_TAG_SIZE_STR16, (uint16_t)count);
-        bjd_write_native(writer, data, count);
-    } else {
-        BJDATA_WRITE_ENCODED(bjd_encode_str32, BJDATA_TAG_SIZE_STR32, (uint32_t)count);
-        bjd_write_native(writer, data, count);
-    }
-
-    #endif
+    bjd_start_str_notrack(writer, count);
+    bjd_write_native(writer, data, count);
 }
 
 void bjd_write_bin(bjd_writer_t* writer, const char* data, uint32_t count) {
@@ -1138,7 +1586,7 @@ void bjd_write_ext(bjd_writer_t* writer, int8_t exttype, const char* data, uint3
 void bjd_write_bytes(bjd_writer_t* writer, const char* data, size_t count) {
     bjd_assert(data != NULL, "data pointer for %i bytes is NULL", (int)count);
     bjd_writer_track_bytes(writer, count);
-    bjd_write_native(writer, data, count);
+    bjd_write_borrowed(writer, data, count);
 }
 
 void bjd_write_cstr(bjd_writer_t* writer, const char* cstr) {
@@ -1182,5 +1630,370 @@ void bjd_write_utf8_cstr_or_nil(bjd_writer_t* writer, const char* cstr) {
         bjd_write_nil(writer);
 }
 
+
+
+/*
+ * Optimized container functions
+ */
+
+// Writes count multi-byte elements from host memory, swapping their
+// byte order directly in the write buffer with the bulk swap kernel.
+// The buffer is filled and flushed as many times as needed.
+BJDATA_NOINLINE static void bjd_write_swapped(bjd_writer_t* writer, const char* p, size_t size, size_t count) {
+    while (count > 0) {
+        if (bjd_writer_error(writer) != bjd_ok)
+            return;
+        if (bjd_writer_buffer_left(writer) < size && !bjd_writer_ensure(writer, size))
+            return;
+
+        size_t n = bjd_writer_buffer_left(writer) / size;
+        if (n > count)
+            n = count;
+
+        bjd_convert_swap(writer->current, p, size, n);
+        writer->current += n * size;
+        p += n * size;
+        count -= n;
+    }
+}
+
+// Writes count elements of the given size from host memory as a packed
+// payload in the writer's byte order. If borrowed is true the data belongs
+// to the caller and may be referenced by a vectored writer.
+static void bjd_write_typed_payload(bjd_writer_t* writer, size_t size, const void* data, size_t count, bool borrowed) {
+    // data may be NULL for an empty array
+    if (count == 0)
+        return;
+
+    if (size > 1 && writer->endian != BJDATA_HOST_ENDIAN) {
+        bjd_write_swapped(writer, (const char*)data, size, count);
+        return;
+    }
+
+    // The payload is already in the output byte order so it is copied as
+    // one block. Large payloads are flushed straight from the caller's
+    // memory.
+    if (borrowed)
+        bjd_write_borrowed(writer, (const char*)data, size * count);
+    else
+        bjd_write_native(writer, (const char*)data, size * count);
+}
+
+void bjd_write_typed_array(bjd_writer_t* writer, char marker, const void* data, size_t count) {
+    size_t size = bjd_typed_marker_size(marker);
+    if (size == 0) {
+        bjd_break("'%c' is not a valid typed array element marker", marker);
+        bjd_writer_flag_error(writer, bjd_error_bug);
+        return;
+    }
+    bjd_assert(count == 0 || data != NULL, "data pointer for typed array of %i elements is NULL", (int)count);
+
+    if (count > SIZE_MAX / size) {
+        bjd_writer_flag_error(writer, bjd_error_too_big);
+        return;
+    }
+
+    // The whole array is a single element of its parent; its contents
+    // are implied by the header so nothing is pushed for tracking.
+    bjd_writer_auto_flush(writer);
+    bjd_writer_track_element(writer);
+
+    char header[BJDATA_TYPED_HEADER_MAX_SIZE];
+    size_t header_size = bjd_encode_typed_header(header, BJDATA_MARKER_ARRAY_START, marker, count, writer->endian);
+    bjd_write_native(writer, header, header_size);
+    bjd_write_typed_payload(writer, size, data, count, true);
+}
+
+void bjd_start_ndarray(bjd_writer_t* writer, char marker, size_t ndims, const size_t* dims) {
+    if (bjd_typed_marker_size(marker) == 0) {
+        bjd_break("'%c' is not a valid typed array element marker", marker);
+        bjd_writer_flag_error(writer, bjd_error_bug);
+        return;
+    }
+    if (ndims == 0 || ndims > BJDATA_NDARRAY_MAX_DIMS) {
+        bjd_break("invalid number of dimensions %i", (int)ndims);
+        bjd_writer_flag_error(writer, bjd_error_bug);
+        return;
+    }
+
+    // The element count must fit in a uint32_t to be readable, and the
+    // dimension vector uses the smallest marker that holds every dimension.
+    uint64_t count = 1;
+    size_t max = 0;
+    for (size_t i = 0; i < ndims; ++i) {
+        count *= dims[i];
+        if (dims[i] > UINT32_MAX || count > UINT32_MAX) {
+            bjd_writer_flag_error(writer, bjd_error_too_big);
+            return;
+        }
+        if (dims[i] > max)
+            max = dims[i];
+    }
+
+    bjd_writer_auto_flush(writer);
+    bjd_writer_track_element(writer);
+
+    char dims_marker = (max <= UINT8_MAX) ? 'U' : (max <= UINT16_MAX) ? 'u' : 'm';
+    size_t dims_size = bjd_typed_marker_size(dims_marker);
+
+    // "[$<marker>#" "[$<dims_marker>#U<ndims>" followed by packed dimensions
+    char header[4 + 6 + BJDATA_NDARRAY_MAX_DIMS * sizeof(uint32_t)];
+    header[0] = BJDATA_MARKER_ARRAY_START;
+    header[1] = BJDATA_MARKER_TYPE;
+    header[2] = marker;
+    header[3] = BJDATA_MARKER_COUNT;
+    header[4] = BJDATA_MARKER_ARRAY_START;
+    header[5] = BJDATA_MARKER_TYPE;
+    header[6] = dims_marker;
+    header[7] = BJDATA_MARKER_COUNT;
+    header[8] = 'U';
+    bjd_store_u8(header + 9, (uint8_t)ndims);
+    char* p = header + 10;
+    for (size_t i = 0; i < ndims; ++i) {
+        switch (dims_marker) {
+            case 'U': bjd_store_u8(p, (uint8_t)dims[i]); break;
+            case 'u': bjd_store_u16_endian(p, (uint16_t)dims[i], writer->endian); break;
+            default:  bjd_store_u32_endian(p, (uint32_t)dims[i], writer->endian); break;
+        }
+        p += dims_size;
+    }
+    bjd_write_native(writer, header, (size_t)(p - header));
+
+    // The payload is tracked like the bytes of a bin, counting elements.
+    bjd_writer_track_push(writer, bjd_type_huge, (uint32_t)count);
+}
+
+void bjd_write_ndarray_elements(bjd_writer_t* writer, char marker, const void* data, size_t count) {
+    size_t size = bjd_typed_marker_size(marker);
+    if (size == 0) {
+        bjd_break("'%c' is not a valid typed array element marker", marker);
+        bjd_writer_flag_error(writer, bjd_error_bug);
+        return;
+    }
+    bjd_assert(count == 0 || data != NULL, "data pointer for %i elements is NULL", (int)count);
+
+    if (count > SIZE_MAX / size) {
+        bjd_writer_flag_error(writer, bjd_error_too_big);
+        return;
+    }
+
+    bjd_writer_track_bytes(writer, count);
+    bjd_write_typed_payload(writer, size, data, count, true);
+}
+
+void bjd_write_ndarray(bjd_writer_t* writer, char marker, size_t ndims, const size_t* dims, const void* data) {
+    bjd_start_ndarray(writer, marker, ndims, dims);
+    if (bjd_writer_error(writer) != bjd_ok)
+        return;
+
+    size_t count = 1;
+    for (size_t i = 0; i < ndims; ++i)
+        count *= dims[i];
+    bjd_write_ndarray_elements(writer, marker, data, count);
+    bjd_finish_ndarray(writer);
+}
+
+void bjd_start_typed_map(bjd_writer_t* writer, char marker, uint32_t count) {
+    if (bjd_typed_marker_size(marker) == 0) {
+        bjd_break("'%c' is not a valid typed map value marker", marker);
+        bjd_writer_flag_error(writer, bjd_error_bug);
+        return;
+    }
+
+    bjd_writer_auto_flush(writer);
+    bjd_writer_track_element(writer);
+
+    char header[BJDATA_TYPED_HEADER_MAX_SIZE];
+    size_t header_size = bjd_encode_typed_header(header, BJDATA_MARKER_MAP_START, marker, count, writer->endian);
+    bjd_write_native(writer, header, header_size);
+
+    bjd_writer_track_push(writer, bjd_type_map, count);
+    writer->typed_map_marker = marker;
+}
+
+void bjd_write_typed_map_key(bjd_writer_t* writer, const char* key, uint32_t length) {
+    if (writer->typed_map_marker == 0) {
+        bjd_break("key written outside of a typed map");
+        bjd_writer_flag_error(writer, bjd_error_bug);
+        return;
+    }
+    bjd_assert(key != NULL, "data for key of length %i is NULL", (int)length);
+
+    // the key is a string without its 'S' marker
+    bjd_writer_track_element(writer);
+    BJDATA_WRITE_ENCODED(bjd_encode_uint, length, writer->endian);
+    bjd_write_native(writer, key, length);
+}
+
+void bjd_write_typed_map_key_cstr(bjd_writer_t* writer, const char* key) {
+    bjd_assert(key != NULL, "key pointer is NULL");
+    size_t length = bjd_strlen(key);
+    if (length > UINT32_MAX)
+        bjd_writer_flag_error(writer, bjd_error_invalid);
+    bjd_write_typed_map_key(writer, key, (uint32_t)length);
+}
+
+void bjd_write_typed_map_value(bjd_writer_t* writer, char marker, const void* value) {
+    // Optimized maps can't be nested in one another, so the last one opened
+    // is the one being written.
+    if (marker == 0 || marker != writer->typed_map_marker) {
+        bjd_break("value marker '%c' does not match the typed map marker '%c'",
+                marker, writer->typed_map_marker);
+        bjd_writer_flag_error(writer, bjd_error_bug);
+        return;
+    }
+    bjd_assert(value != NULL, "value pointer is NULL");
+
+    size_t size = bjd_typed_marker_size(marker);
+
+    bjd_writer_track_element(writer);
+    bjd_write_typed_payload(writer, size, value, 1, true);
+}
+
+#ifdef BJDATA_MALLOC
+// Begins buffering the elements of an array of the given count for
+// promotion to a typed array. Returns false if the array should be
+// written normally instead.
+static bool bjd_writer_auto_start(bjd_writer_t* writer, uint32_t count) {
+    // A typed header costs more than it saves on arrays of fewer than
+    // two elements.
+    if (count < 2 || count > BJDATA_AUTO_TYPED_MAX || writer->error != bjd_ok)
+        return false;
+
+    if (count > writer->auto_capacity) {
+        // nothing from a previous array needs to be preserved
+        bjd_tag_t* values = (bjd_tag_t*)bjd_allocator_realloc(writer->allocator, writer->auto_values,
+                0, count * sizeof(bjd_tag_t));
+        if (values == NULL)
+            return false;
+        writer->auto_values = values;
+        writer->auto_capacity = count;
+    }
+
+    writer->auto_pending = true;
+    writer->auto_count = 0;
+    writer->auto_total = count;
+    return true;
+}
+
+// Returns the smallest typed array element marker that can hold every
+// buffered element, or 0 if they do not share one.
+static char bjd_writer_auto_marker(const bjd_tag_t* values, uint32_t count) {
+    bjd_type_t type = values[0].type;
+    int64_t min = 0;
+    uint64_t max = 0;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        bjd_tag_t value = values[i];
+        switch (value.type) {
+            case bjd_type_int:
+                if (type != bjd_type_int && type != bjd_type_uint)
+                    return 0;
+                if (value.v.i < 0) {
+                    if (value.v.i < min)
+                        min = value.v.i;
+                } else if ((uint64_t)value.v.i > max) {
+                    max = (uint64_t)value.v.i;
+                }
+                break;
+            case bjd_type_uint:
+                if (type != bjd_type_int && type != bjd_type_uint)
+                    return 0;
+                if (value.v.u > max)
+                    max = value.v.u;
+                break;
+            default:
+                if (value.type != type)
+                    return 0;
+                break;
+        }
+    }
+
+    if (type == bjd_type_float)
+        return 'd';
+    if (type == bjd_type_double)
+        return 'D';
+
+    if (min >= 0) {
+        if (max <= UINT8_MAX)  return 'U';
+        if (max <= UINT16_MAX) return 'u';
+        if (max <= UINT32_MAX) return 'm';
+        return 'M';
+    }
+
+    if (max > INT64_MAX)
+        return 0;
+    if (min >= INT8_MIN  && max <= INT8_MAX)  return 'i';
+    if (min >= INT16_MIN && max <= INT16_MAX) return 'I';
+    if (min >= INT32_MIN && max <= INT32_MAX) return 'l';
+    return 'L';
+}
+
+// Writes the buffered elements as a plain array.
+BJDATA_NOINLINE static void bjd_writer_auto_flush_plain(bjd_writer_t* writer) {
+    writer->auto_pending = false;
+    bjd_start_array_notrack(writer, writer->auto_total);
+
+    for (uint32_t i = 0; i < writer->auto_count; ++i) {
+        bjd_tag_t value = writer->auto_values[i];
+        switch (value.type) {
+            case bjd_type_int:    bjd_write_i64_notrack(writer, value.v.i); break;
+            case bjd_type_uint:   bjd_write_u64_notrack(writer, value.v.u); break;
+            case bjd_type_float:  BJDATA_WRITE_ENCODED(bjd_encode_float, value.v.f, writer->endian); break;
+            case bjd_type_double: BJDATA_WRITE_ENCODED(bjd_encode_double, value.v.d, writer->endian); break;
+            default:
+                bjd_break("unexpected buffered type %i", (int)value.type);
+                bjd_writer_flag_error(writer, bjd_error_bug);
+                return;
+        }
+    }
+}
+
+// Writes the buffered elements as a typed array of the given marker.
+static void bjd_writer_auto_flush_typed(bjd_writer_t* writer, char marker) {
+    writer->auto_pending = false;
+    size_t size = bjd_typed_marker_size(marker);
+    uint32_t count = writer->auto_count;
+
+    // The elements are packed in host order over the buffered tags, front
+    // to back. Each packed element is no larger than a tag, so it only
+    // overwrites tags that have already been packed.
+    char* p = (char*)writer->auto_values;
+    for (uint32_t i = 0; i < count; ++i) {
+        bjd_tag_t value = writer->auto_values[i];
+        char* dest = p + i * size;
+        switch (marker) {
+            case 'U': { uint8_t  v = (uint8_t) value.v.u; bjd_memcpy(dest, &v, sizeof(v)); break; }
+            case 'u': { uint16_t v = (uint16_t)value.v.u; bjd_memcpy(dest, &v, sizeof(v)); break; }
+            case 'm': { uint32_t v = (uint32_t)value.v.u; bjd_memcpy(dest, &v, sizeof(v)); break; }
+            case 'M': { uint64_t v =           value.v.u; bjd_memcpy(dest, &v, sizeof(v)); break; }
+            case 'i': { int8_t   v = (int8_t)  value.v.i; bjd_memcpy(dest, &v, sizeof(v)); break; }
+            case 'I': { int16_t  v = (int16_t) value.v.i; bjd_memcpy(dest, &v, sizeof(v)); break; }
+            case 'l': { int32_t  v = (int32_t) value.v.i; bjd_memcpy(dest, &v, sizeof(v)); break; }
+            case 'L': { int64_t  v =           value.v.i; bjd_memcpy(dest, &v, sizeof(v)); break; }
+            case 'd': bjd_memcpy(dest, &value.v.f, sizeof(value.v.f)); break;
+            default:  bjd_memcpy(dest, &value.v.d, sizeof(value.v.d)); break;
+        }
+    }
+
+    char header[BJDATA_TYPED_HEADER_MAX_SIZE];
+    size_t header_size = bjd_encode_typed_header(header, BJDATA_MARKER_ARRAY_START, marker, count, writer->endian);
+    bjd_write_native(writer, header, header_size);
+    bjd_write_typed_payload(writer, size, p, count, false);
+}
+
+static void bjd_writer_auto_push(bjd_writer_t* writer, bjd_tag_t value) {
+    bjd_writer_track_element(writer);
+    writer->auto_values[writer->auto_count++] = value;
+    if (writer->auto_count < writer->auto_total)
+        return;
+
+    char marker = bjd_writer_auto_marker(writer->auto_values, writer->auto_count);
+    if (marker == 0)
+        bjd_writer_auto_flush_plain(writer);
+    else
+        bjd_writer_auto_flush_typed(writer, marker);
+}
 #endif
 
+#endif
@@ -121,6 +121,8 @@ struct bjd_writer_t {
     char* current;        /* Current position within the buffer */
     char* end;            /* The end of the buffer */
     bjd_error_t error;  /* Error state */
+    bjd_endian_t endian; /* Byte order of multi-byte numbers */
+    char typed_map_marker; /* Value marker of the last map opened with bjd_start_typed_map() */
 
     #if BJDATA_WRITE_TRACKING
     bjd_track_t track; /* Stack of map/array/str/bin/ext writes */
@@ -130,12 +132,23 @@ struct bjd_writer_t {
     /* Reserved. You can use this space to allocate a custom
      * context in order to reduce heap allocations. */
     void* reserved[2];
+
+    bool auto_typed;          /* Whether arrays are promoted to typed arrays when possible */
+    bool auto_pending;        /* Whether the elements of an array are being buffered */
+    uint32_t auto_count;      /* The number of buffered elements */
+    uint32_t auto_total;      /* The element count of the buffered array */
+    uint32_t auto_capacity;   /* The capacity of auto_values */
+    bjd_tag_t* auto_values;   /* The buffered elements */
+
+    const bjd_allocator_t* allocator; /* Allocator for writer allocations, or NULL */
     #endif
 };
 
 #if BJDATA_WRITE_TRACKING
 void bjd_writer_track_push(bjd_writer_t* writer, bjd_type_t type, uint32_t count);
+void bjd_writer_track_push_unsized(bjd_writer_t* writer, bjd_type_t type);
 void bjd_writer_track_pop(bjd_writer_t* writer, bjd_type_t type);
+void bjd_writer_track_pop_unsized(bjd_writer_t* writer, bjd_type_t type);
 void bjd_writer_track_element(bjd_writer_t* writer);
 void bjd_writer_track_bytes(bjd_writer_t* writer, size_t count);
 #else
@@ -144,10 +157,18 @@ BJDATA_INLINE void bjd_writer_track_push(bjd_writer_t* writer, bjd_type_t type,
     BJDATA_UNUSED(type);
     BJDATA_UNUSED(count);
 }
+BJDATA_INLINE void bjd_writer_track_push_unsized(bjd_writer_t* writer, bjd_type_t type) {
+    BJDATA_UNUSED(writer);
+    BJDATA_UNUSED(type);
+}
 BJDATA_INLINE void bjd_writer_track_pop(bjd_writer_t* writer, bjd_type_t type) {
     BJDATA_UNUSED(writer);
     BJDATA_UNUSED(type);
 }
+BJDATA_INLINE void bjd_writer_track_pop_unsized(bjd_writer_t* writer, bjd_type_t type) {
+    BJDATA_UNUSED(writer);
+    BJDATA_UNUSED(type);
+}
 BJDATA_INLINE void bjd_writer_track_element(bjd_writer_t* writer) {
     BJDATA_UNUSED(writer);
 }
@@ -188,7 +209,8 @@ void bjd_writer_init(bjd_writer_t* writer, char* buffer, size_t size);
  * and will remain NULL if an error occurs.
  *
  * The allocated data must be freed with BJDATA_FREE() (or simply free()
- * if BJData's allocator hasn't been customized.)
+ * if BJData's allocator hasn't been customized.) If an allocator is attached
+ * with bjd_writer_set_allocator(), it is allocated from that instead.
  *
  * @throws bjd_error_memory if the buffer fails to grow when
  * flushing.
@@ -198,6 +220,63 @@ void bjd_writer_init(bjd_writer_t* writer, char* buffer, size_t size);
  * @param size Where to write the size of the data.
  */
 void bjd_writer_init_growable(bjd_writer_t* writer, char** data, size_t* size);
+
+/**
+ * A contiguous piece of the output of a chunked writer.
+ */
+typedef struct bjd_chunk_t {
+    char* data;  /* The bytes of the chunk */
+    size_t size; /* The number of bytes in the chunk */
+} bjd_chunk_t;
+
+/**
+ * The output of a writer initialized with bjd_writer_init_chunked(). The
+ * message is the concatenation of the chunks in order.
+ *
+ * @see bjd_chunks_concat()
+ * @see bjd_chunks_destroy()
+ */
+typedef struct bjd_chunks_t {
+    bjd_chunk_t* chunks; /* The chunks of the message */
+    size_t count;        /* The number of chunks */
+    size_t size;         /* The total size of the message */
+    const bjd_allocator_t* allocator; /* The allocator of the chunks, or NULL */
+} bjd_chunks_t;
+
+/**
+ * Initializes an BJData writer that writes into a list of chunks.
+ *
+ * Unlike bjd_writer_init_growable(), data that has been written is never
+ * moved. When a chunk is full a new one is allocated, starting at
+ * @ref BJDATA_BUFFER_SIZE bytes and doubling up to @ref BJDATA_CHUNK_MAX_SIZE.
+ * This bounds the memory overhead of building very large messages.
+ *
+ * The chunks are placed in the given struct if and when the writer is
+ * destroyed without error. It is empty during writing, and will remain
+ * empty if an error occurs. It must be freed with bjd_chunks_destroy().
+ *
+ * @throws bjd_error_memory if a chunk fails to allocate.
+ *
+ * @param writer The BJData writer.
+ * @param chunks Where to place the chunks.
+ */
+void bjd_writer_init_chunked(bjd_writer_t* writer, bjd_chunks_t* chunks);
+
+/**
+ * Copies the chunks of a message into a single allocated buffer, or returns
+ * NULL if allocation fails. The chunks are not modified.
+ *
+ * The returned data is allocated with the allocator of the chunks. If it is
+ * NULL, the data must be freed with BJDATA_FREE() (or simply free() if
+ * BJData's allocator hasn't been customized.) It is non-null even if the
+ * message is empty.
+ */
+char* bjd_chunks_concat(const bjd_chunks_t* chunks);
+
+/**
+ * Frees the chunks filled by a chunked writer.
+ */
+void bjd_chunks_destroy(bjd_chunks_t* chunks);
 #endif
 
 /**
@@ -242,6 +321,72 @@ BJDATA_INLINE void bjd_writer_init_file(bjd_writer_t* writer, const char* filena
 void bjd_writer_init_stdfile(bjd_writer_t* writer, FILE* stdfile, bool close_when_done);
 #endif
 
+#if BJDATA_IOV
+struct iovec;
+
+/**
+ * The output of a writer initialized with bjd_writer_init_iov().
+ *
+ * The message is the concatenation of the segments in order. Segments
+ * either point into chunks of encoded data owned by this struct, or into
+ * payloads borrowed from the caller, which must remain valid for as long
+ * as the segments are used.
+ *
+ * @see bjd_iov_destroy()
+ */
+typedef struct bjd_iov_t {
+    struct iovec* vectors; /* The segments of the message */
+    size_t count;          /* The number of segments */
+    void** chunks;         /* The buffers owned by the segments */
+    size_t chunk_count;    /* The number of owned buffers */
+    const bjd_allocator_t* allocator; /* The allocator of the buffers, or NULL */
+} bjd_iov_t;
+
+/**
+ * Initializes an BJData writer that produces a list of segments suitable
+ * for writev() or sendmsg() rather than a contiguous buffer.
+ *
+ * Payloads of at least @ref BJDATA_IOV_REFERENCE_MIN bytes passed to
+ * bjd_write_bytes() (and so bjd_write_bin() and bjd_write_ext()) or to the
+ * typed array functions are referenced in place rather than copied. Such
+ * payloads must not be modified or freed until the segments are no longer
+ * needed. Everything else is encoded into buffers that are never moved.
+ *
+ * The segments are placed in the given iov if and when the writer is
+ * destroyed without error. The iov is empty during writing, and will
+ * remain empty if an error occurs. It must be freed with bjd_iov_destroy().
+ *
+ * @throws bjd_error_memory if a buffer or the segment list fails to grow.
+ *
+ * @param writer The BJData writer.
+ * @param iov Where to place the segments.
+ */
+void bjd_writer_init_iov(bjd_writer_t* writer, bjd_iov_t* iov);
+
+/**
+ * Frees the buffers and segment list of an iov filled by a writer. Borrowed
+ * payloads are not touched.
+ */
+void bjd_iov_destroy(bjd_iov_t* iov);
+
+/**
+ * Initializes an BJData writer that writes to a file descriptor.
+ *
+ * Payloads of at least @ref BJDATA_IOV_REFERENCE_MIN bytes are written
+ * straight from the caller's memory together with the buffered data in a
+ * single writev() call. All data has been written to the descriptor when
+ * each write function returns, except what remains in the buffer.
+ *
+ * The descriptor is not closed when the writer is destroyed.
+ *
+ * @throws bjd_error_memory if allocation fails
+ * @throws bjd_error_io if writing fails
+ *
+ * @see bjd_writer_flush_message
+ */
+void bjd_writer_init_fd(bjd_writer_t* writer, int fd);
+#endif
+
 /** @cond */
 
 #define bjd_writer_init_stack_line_ex(line, writer) \
@@ -383,6 +528,72 @@ BJDATA_INLINE void bjd_writer_set_teardown(bjd_writer_t* writer, bjd_writer_tear
     writer->teardown = teardown;
 }
 
+/**
+ * Sets the byte order of multi-byte numbers in optimized container
+ * headers and payloads.
+ *
+ * The default is @ref bjd_endian_little, as specified by BJData Draft 2.
+ * Use @ref bjd_endian_big to write data for UBJSON or earlier drafts of
+ * BJData.
+ *
+ * When this matches the byte order of the host, typed array payloads are
+ * copied to the output as-is with no per-element work.
+ *
+ * This should be called before anything is written.
+ *
+ * @param writer The BJData writer.
+ * @param endian The byte order to write.
+ */
+BJDATA_INLINE void bjd_writer_set_endian(bjd_writer_t* writer, bjd_endian_t endian) {
+    writer->endian = endian;
+}
+
+#ifdef BJDATA_MALLOC
+/**
+ * Sets the allocator for memory the writer allocates: the buffers of
+ * writers that own them (such as growable, chunked, file and fd writers),
+ * the state of chunked and vectored writers, the auto-typed array buffer
+ * and the tracking stack. Pass NULL to use @ref BJDATA_MALLOC.
+ *
+ * The buffer and state allocated when the writer was initialized are moved
+ * to the allocator, so everything the writer owns is freed with it.
+ *
+ * The output of growable, chunked and vectored writers is allocated from
+ * it as well, so it must outlive that output.
+ *
+ * This should be called before anything is written.
+ *
+ * @param writer The BJData writer.
+ * @param allocator The allocator.
+ */
+void bjd_writer_set_allocator(bjd_writer_t* writer, const bjd_allocator_t* allocator);
+#endif
+
+#ifdef BJDATA_MALLOC
+/**
+ * Enables or disables auto-typed mode, in which arrays of numbers are
+ * written as optimized arrays (with a `$type#count` header) when possible.
+ *
+ * In this mode, the elements of each array started with bjd_start_array()
+ * are buffered rather than written immediately, up to
+ * @ref BJDATA_AUTO_TYPED_MAX elements. Once the last element is written,
+ * if they are all integers or all floats or all doubles, they are packed
+ * as an optimized array using the smallest element type that holds every
+ * value. Otherwise, or as soon as any other kind of element is written,
+ * the array is written in its plain encoding.
+ *
+ * This does not change how the array must be written: it is still
+ * finished with bjd_finish_array(). It is disabled by default, and only
+ * available when @ref BJDATA_MALLOC is defined.
+ *
+ * @param writer The BJData writer.
+ * @param auto_typed Whether to promote arrays to optimized arrays.
+ */
+BJDATA_INLINE void bjd_writer_set_auto_typed(bjd_writer_t* writer, bool auto_typed) {
+    writer->auto_typed = auto_typed;
+}
+#endif
+
 /**
  * @}
  */
@@ -553,7 +764,10 @@ void bjd_write_false(bjd_writer_t* writer);
 /** Writes a nil. */
 void bjd_write_nil(bjd_writer_t* writer);
 
-/** Write a pre-encoded messagepack object */
+/** Writes a no-op, which readers skip when it is an array element. */
+void bjd_write_noop(bjd_writer_t* writer);
+
+/** Write a pre-encoded BJData object */
 void bjd_write_object_bytes(bjd_writer_t* writer, const char* data, size_t bytes);
 
 #if BJDATA_EXTENSIONS
@@ -648,9 +862,235 @@ BJDATA_INLINE void bjd_finish_array(bjd_writer_t* writer) {
  * @see bjd_start_map()
  */
 BJDATA_INLINE void bjd_finish_map(bjd_writer_t* writer) {
+    // an optimized map can't contain another map, so any map being
+    // finished closes the optimized map if one is open
+    writer->typed_map_marker = 0;
     bjd_writer_track_pop(writer, bjd_type_map);
 }
 
+/**
+ * Opens an array without a count.
+ *
+ * Any number of elements may be written, after which the array must be
+ * closed with bjd_finish_array_unsized(). This writes the closing ']'
+ * marker, so the producer never needs to know the number of elements in
+ * advance.
+ *
+ * @see bjd_read_array_end()
+ */
+void bjd_start_array_unsized(bjd_writer_t* writer);
+
+/**
+ * Closes an array opened with bjd_start_array_unsized().
+ */
+void bjd_finish_array_unsized(bjd_writer_t* writer);
+
+/**
+ * Opens a map without a count.
+ *
+ * Any number of key/value pairs may be written, after which the map must
+ * be closed with bjd_finish_map_unsized(), which writes the closing '}'
+ * marker.
+ *
+ * @see bjd_read_map_end()
+ */
+void bjd_start_map_unsized(bjd_writer_t* writer);
+
+/**
+ * Closes a map opened with bjd_start_map_unsized().
+ */
+void bjd_finish_map_unsized(bjd_writer_t* writer);
+
+/**
+ * @}
+ */
+
+/**
+ * @name Typed Array Functions
+ * @{
+ */
+
+/**
+ * Writes an optimized array of fixed-size numbers in one call.
+ *
+ * This emits a single `[$<marker>#<count>` header followed by the payload
+ * of all elements packed contiguously, rather than one marker per element.
+ * Large payloads are flushed directly from the given data without passing
+ * through the write buffer.
+ *
+ * The array is complete when this returns; it counts as a single element
+ * of its parent, and you should not call bjd_finish_array() after it.
+ *
+ * @param writer The writer
+ * @param marker The element marker: one of 'U', 'i', 'u', 'I', 'm', 'l',
+ *        'M', 'L', 'd' (float32) or 'D' (float64)
+ * @param data The elements, in host byte order
+ * @param count The number of elements (not bytes) in data
+ *
+ * @throws bjd_error_bug if the marker is not a fixed-size numeric marker
+ */
+void bjd_write_typed_array(bjd_writer_t* writer, char marker, const void* data, size_t count);
+
+/** Writes an optimized array of uint8_t. @see bjd_write_typed_array() */
+BJDATA_INLINE void bjd_write_u8_array(bjd_writer_t* writer, const uint8_t* data, size_t count) {
+    bjd_write_typed_array(writer, 'U', data, count);
+}
+
+/** Writes an optimized array of int8_t. @see bjd_write_typed_array() */
+BJDATA_INLINE void bjd_write_i8_array(bjd_writer_t* writer, const int8_t* data, size_t count) {
+    bjd_write_typed_array(writer, 'i', data, count);
+}
+
+/** Writes an optimized array of uint16_t. @see bjd_write_typed_array() */
+BJDATA_INLINE void bjd_write_u16_array(bjd_writer_t* writer, const uint16_t* data, size_t count) {
+    bjd_write_typed_array(writer, 'u', data, count);
+}
+
+/** Writes an optimized array of int16_t. @see bjd_write_typed_array() */
+BJDATA_INLINE void bjd_write_i16_array(bjd_writer_t* writer, const int16_t* data, size_t count) {
+    bjd_write_typed_array(writer, 'I', data, count);
+}
+
+/** Writes an optimized array of uint32_t. @see bjd_write_typed_array() */
+BJDATA_INLINE void bjd_write_u32_array(bjd_writer_t* writer, const uint32_t* data, size_t count) {
+    bjd_write_typed_array(writer, 'm', data, count);
+}
+
+/** Writes an optimized array of int32_t. @see bjd_write_typed_array() */
+BJDATA_INLINE void bjd_write_i32_array(bjd_writer_t* writer, const int32_t* data, size_t count) {
+    bjd_write_typed_array(writer, 'l', data, count);
+}
+
+/** Writes an optimized array of uint64_t. @see bjd_write_typed_array() */
+BJDATA_INLINE void bjd_write_u64_array(bjd_writer_t* writer, const uint64_t* data, size_t count) {
+    bjd_write_typed_array(writer, 'M', data, count);
+}
+
+/** Writes an optimized array of int64_t. @see bjd_write_typed_array() */
+BJDATA_INLINE void bjd_write_i64_array(bjd_writer_t* writer, const int64_t* data, size_t count) {
+    bjd_write_typed_array(writer, 'L', data, count);
+}
+
+/** Writes an optimized array of float. @see bjd_write_typed_array() */
+BJDATA_INLINE void bjd_write_f32_array(bjd_writer_t* writer, const float* data, size_t count) {
+    bjd_write_typed_array(writer, 'd', data, count);
+}
+
+/** Writes an optimized array of double. @see bjd_write_typed_array() */
+BJDATA_INLINE void bjd_write_f64_array(bjd_writer_t* writer, const double* data, size_t count) {
+    bjd_write_typed_array(writer, 'D', data, count);
+}
+
+/**
+ * Opens an N-dimensional optimized array.
+ *
+ * This emits a `[$<marker>#[<dims>]` header, where the dimension vector is
+ * itself written as a compact typed array. The elements must then be
+ * written in row-major order (the last dimension varies fastest) with one
+ * or more calls to bjd_write_ndarray_elements(), for a total of the
+ * product of all dimensions, and bjd_finish_ndarray() must be called when
+ * done.
+ *
+ * The array counts as a single element of its parent.
+ *
+ * @param writer The writer
+ * @param marker The element marker, as with bjd_write_typed_array()
+ * @param ndims The number of dimensions, at most @ref BJDATA_NDARRAY_MAX_DIMS
+ * @param dims The length of each dimension
+ *
+ * @throws bjd_error_bug if the marker or number of dimensions is invalid
+ * @throws bjd_error_too_big if the total element count does not fit in
+ * a uint32_t
+ *
+ * @see bjd_write_ndarray()
+ */
+void bjd_start_ndarray(bjd_writer_t* writer, char marker, size_t ndims, const size_t* dims);
+
+/**
+ * Writes count elements of an ND-array opened with bjd_start_ndarray().
+ * The marker must match the one given to bjd_start_ndarray().
+ *
+ * @param writer The writer
+ * @param marker The element marker
+ * @param data The elements, in host byte order
+ * @param count The number of elements (not bytes) in data
+ */
+void bjd_write_ndarray_elements(bjd_writer_t* writer, char marker, const void* data, size_t count);
+
+/**
+ * Finishes writing an ND-array.
+ *
+ * This will track writes to ensure that the correct number of elements are written.
+ *
+ * @see bjd_start_ndarray()
+ */
+BJDATA_INLINE void bjd_finish_ndarray(bjd_writer_t* writer) {
+    bjd_writer_track_pop(writer, bjd_type_huge);
+}
+
+/**
+ * Writes an entire N-dimensional optimized array in one call. The data
+ * must contain the product of all dimensions elements in row-major order.
+ *
+ * You should not call bjd_finish_ndarray() after calling this; this
+ * performs both start and finish.
+ *
+ * @see bjd_start_ndarray()
+ */
+void bjd_write_ndarray(bjd_writer_t* writer, char marker, size_t ndims, const size_t* dims, const void* data);
+
+/**
+ * Opens an optimized map whose values are all fixed-size numbers.
+ *
+ * This emits a `{$<marker>#<count>` header. `count` key/value pairs must
+ * follow: each key is written with bjd_write_typed_map_key(), which omits
+ * the 'S' marker of the key as BJData requires, and each value with
+ * bjd_write_typed_map_value(), which packs the value without a marker of
+ * its own. bjd_finish_map() must be called when done.
+ *
+ * @param writer The writer
+ * @param marker The value marker, as with bjd_write_typed_array()
+ * @param count The number of key/value pairs
+ *
+ * @throws bjd_error_bug if the marker is not a fixed-size numeric marker
+ *
+ * @see bjd_expect_typed_map_max()
+ */
+void bjd_start_typed_map(bjd_writer_t* writer, char marker, uint32_t count);
+
+/**
+ * Writes a key of an optimized map opened with bjd_start_typed_map(). The
+ * key is written as a length followed by its bytes, with no 'S' marker.
+ *
+ * @param writer The writer
+ * @param key The bytes of the key
+ * @param length The length of the key in bytes
+ *
+ * @throws bjd_error_bug if no typed map is open
+ */
+void bjd_write_typed_map_key(bjd_writer_t* writer, const char* key, uint32_t length);
+
+/**
+ * Writes a null-terminated key of an optimized map opened with
+ * bjd_start_typed_map(). See bjd_write_typed_map_key().
+ *
+ * @throws bjd_error_invalid if the key is longer than UINT32_MAX bytes
+ * @throws bjd_error_bug if no typed map is open
+ */
+void bjd_write_typed_map_key_cstr(bjd_writer_t* writer, const char* key);
+
+/**
+ * Writes a value of an optimized map opened with bjd_start_typed_map().
+ * The marker must match the one given to bjd_start_typed_map().
+ *
+ * @param writer The writer
+ * @param marker The value marker
+ * @param value A pointer to the value, in host byte order
+ *
+ * @throws bjd_error_bug if the marker does not match the one of the map
+ */
+void bjd_write_typed_map_value(bjd_writer_t* writer, char marker, const void* value);
+
 /**
  * @}
  */
@@ -745,7 +1185,8 @@ void bjd_write_utf8_cstr(bjd_writer_t* writer, const char* cstr);
 void bjd_write_utf8_cstr_or_nil(bjd_writer_t* writer, const char* cstr);
 
 /**
- * Writes a binary blob.
+ * Writes a binary blob. BJData has no binary type, so it is written as an
+ * optimized array of uint8 (`[$U#`).
  *
  * To stream a binary blob in chunks, use bjd_start_bin() instead.
  *
@@ -796,7 +1237,8 @@ void bjd_start_str(bjd_writer_t* writer, uint32_t count);
 /**
  * Opens a binary blob. `count` bytes should be written with calls to
  * bjd_write_bytes(), and bjd_finish_bin() should be called
- * when done.
+ * when done. As with bjd_write_bin(), the blob is an optimized array of
+ * uint8.
  */
 void bjd_start_bin(bjd_writer_t* writer, uint32_t count);
 
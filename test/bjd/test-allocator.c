@@ -0,0 +1,382 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-allocator.h"
+
+#ifdef BJDATA_MALLOC
+
+#if BJDATA_IOV
+#include <sys/uio.h>
+#endif
+
+#if BJDATA_WRITER
+// Writes an unsized array of small typed arrays, enough to need several
+// node pages and buffer flushes.
+static void test_allocator_message(bjd_writer_t* writer, uint32_t seed) {
+    bjd_start_array_unsized(writer);
+    for (uint32_t i = 0; i < 2000; ++i) {
+        uint32_t values[2] = {seed + i, seed * i};
+        bjd_write_u32_array(writer, values, 2);
+    }
+    bjd_finish_array_unsized(writer);
+}
+
+static void test_allocator_writer(bool reallocate) {
+    char* expected;
+    size_t expected_size;
+    bjd_writer_t writer;
+    bjd_writer_init_growable(&writer, &expected, &expected_size);
+    test_allocator_message(&writer, 1);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+
+    // the output of a growable writer comes from its allocator
+    test_counter_t counter;
+    test_counter_init(&counter, reallocate);
+    char* data;
+    size_t size;
+    bjd_writer_init_growable(&writer, &data, &size);
+    bjd_writer_set_allocator(&writer, &counter.allocator);
+    test_allocator_message(&writer, 1);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    TEST_TRUE(counter.total > 0);
+    TEST_TRUE(counter.outstanding == 1, "%i allocations outstanding", (int)counter.outstanding);
+    TEST_TRUE(size == expected_size && memcmp(data, expected, size) == 0);
+    test_counter_deallocate(&counter, data);
+
+    // so are chunks and their concatenation. the buffer and state of the
+    // writer (and its tracking stack) move to the allocator.
+    size_t owned = BJDATA_WRITE_TRACKING ? 3 : 2;
+    bjd_chunks_t chunks;
+    bjd_writer_init_chunked(&writer, &chunks);
+    bjd_writer_set_allocator(&writer, &counter.allocator);
+    TEST_TRUE(counter.outstanding == owned, "%i allocations outstanding", (int)counter.outstanding);
+    test_allocator_message(&writer, 1);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    TEST_TRUE(chunks.allocator == &counter.allocator);
+    data = bjd_chunks_concat(&chunks);
+    TEST_TRUE(data != NULL && chunks.size == expected_size);
+    if (data && chunks.size == expected_size)
+        TEST_TRUE(memcmp(data, expected, expected_size) == 0);
+    test_counter_deallocate(&counter, data);
+    bjd_chunks_destroy(&chunks);
+    TEST_TRUE(counter.outstanding == 0, "%i allocations outstanding", (int)counter.outstanding);
+
+    #if BJDATA_IOV
+    // as are the segments of a vectored writer and its state
+    bjd_iov_t iov;
+    bjd_writer_init_iov(&writer, &iov);
+    bjd_writer_set_allocator(&writer, &counter.allocator);
+    TEST_TRUE(counter.outstanding == owned, "%i allocations outstanding", (int)counter.outstanding);
+    test_allocator_message(&writer, 1);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    TEST_TRUE(iov.allocator == &counter.allocator);
+    size_t iov_size = 0;
+    for (size_t i = 0; i < iov.count; ++i)
+        iov_size += iov.vectors[i].iov_len;
+    TEST_TRUE(iov_size == expected_size);
+    bjd_iov_destroy(&iov);
+    TEST_TRUE(counter.outstanding == 0, "%i allocations outstanding", (int)counter.outstanding);
+
+    bjd_writer_init_iov(&writer, &iov);
+    bjd_writer_set_allocator(&writer, &counter.allocator);
+    test_allocator_message(&writer, 1);
+    bjd_writer_flag_error(&writer, bjd_error_data);
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_data);
+    TEST_TRUE(counter.outstanding == 0, "%i allocations outstanding", (int)counter.outstanding);
+    #endif
+
+    // a failing writer frees everything
+    bjd_writer_init_growable(&writer, &data, &size);
+    bjd_writer_set_allocator(&writer, &counter.allocator);
+    test_allocator_message(&writer, 1);
+    bjd_writer_flag_error(&writer, bjd_error_data);
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_data);
+    TEST_TRUE(counter.outstanding == 0, "%i allocations outstanding", (int)counter.outstanding);
+
+    BJDATA_FREE(expected);
+}
+#endif
+
+#if BJDATA_NODE && BJDATA_WRITER
+static void test_allocator_check_tree(bjd_tree_t* tree, uint32_t seed) {
+    bjd_tree_parse(tree);
+    bjd_node_t root = bjd_tree_root(tree);
+    TEST_TRUE(bjd_node_array_length(root) == 2000);
+    bjd_node_t last = bjd_node_array_at(root, 1999);
+    TEST_TRUE(bjd_node_u32(bjd_node_array_at(last, 0)) == seed + 1999);
+    TEST_TRUE(bjd_node_u32(bjd_node_array_at(last, 1)) == seed * 1999);
+}
+
+static void test_allocator_tree(bool reallocate) {
+    char* data;
+    size_t size;
+    bjd_writer_t writer;
+    bjd_writer_init_growable(&writer, &data, &size);
+    test_allocator_message(&writer, 7);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+
+    test_counter_t counter;
+    test_counter_init(&counter, reallocate);
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, data, size);
+    bjd_tree_set_allocator(&tree, &counter.allocator);
+    test_allocator_check_tree(&tree, 7);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+    TEST_TRUE(counter.total > 0);
+    TEST_TRUE(counter.outstanding == 0, "%i allocations outstanding", (int)counter.outstanding);
+
+    BJDATA_FREE(data);
+}
+
+static void test_allocator_arena_tree(void) {
+    char* data[3];
+    size_t size[3];
+    for (uint32_t i = 0; i < 3; ++i) {
+        bjd_writer_t writer;
+        bjd_writer_init_growable(&writer, &data[i], &size[i]);
+        test_allocator_message(&writer, i);
+        TEST_WRITER_DESTROY_NOERROR(&writer);
+    }
+
+    // each message is parsed into a tree backed by the arena, which is
+    // reset in between
+    bjd_arena_t arena;
+    bjd_arena_init(&arena, 4096);
+    for (int round = 0; round < 6; ++round) {
+        uint32_t i = (uint32_t)round % 3;
+        bjd_tree_t tree;
+        bjd_tree_init_data(&tree, data[i], size[i]);
+        bjd_tree_set_allocator(&tree, bjd_arena_allocator(&arena));
+        test_allocator_check_tree(&tree, i);
+        TEST_TREE_DESTROY_NOERROR(&tree);
+        bjd_arena_reset(&arena);
+    }
+    bjd_arena_destroy(&arena);
+
+    for (int i = 0; i < 3; ++i)
+        BJDATA_FREE(data[i]);
+}
+
+#define TEST_ALLOCATOR_DEPTH 200
+#define TEST_ALLOCATOR_KEYS 100
+#define TEST_ALLOCATOR_FILL 0x5A
+#define TEST_ALLOCATOR_FILL_SIZE 1024
+#define TEST_ALLOCATOR_FILL_COUNT 512
+
+// Writes a message of a kind that needs node pages, unsized scratch, a
+// grown parse stack or a map index.
+static void test_allocator_kind(bjd_writer_t* writer, int kind, uint32_t seed) {
+    if (kind == 0) {
+        test_allocator_message(writer, seed);
+    } else if (kind == 1) {
+        for (int i = 0; i < TEST_ALLOCATOR_DEPTH; ++i)
+            bjd_start_array(writer, 1);
+        bjd_write_u32(writer, seed);
+        for (int i = 0; i < TEST_ALLOCATOR_DEPTH; ++i)
+            bjd_finish_array(writer);
+    } else {
+        bjd_start_map(writer, TEST_ALLOCATOR_KEYS);
+        for (uint32_t i = 0; i < TEST_ALLOCATOR_KEYS; ++i) {
+            char key[16];
+            snprintf(key, sizeof(key), "k%u", (unsigned)i);
+            bjd_write_cstr(writer, key);
+            bjd_write_u32(writer, seed + i);
+        }
+        bjd_finish_map(writer);
+    }
+}
+
+static void test_allocator_check_kind(bjd_tree_t* tree, int kind, uint32_t seed) {
+    bjd_node_t root = bjd_tree_root(tree);
+    if (kind == 0) {
+        TEST_TRUE(bjd_node_array_length(root) == 2000);
+        bjd_node_t last = bjd_node_array_at(root, 1999);
+        TEST_TRUE(bjd_node_u32(bjd_node_array_at(last, 0)) == seed + 1999);
+        TEST_TRUE(bjd_node_u32(bjd_node_array_at(last, 1)) == seed * 1999);
+    } else if (kind == 1) {
+        bjd_node_t node = root;
+        for (int i = 0; i < TEST_ALLOCATOR_DEPTH; ++i)
+            node = bjd_node_array_at(node, 0);
+        TEST_TRUE(bjd_node_u32(node) == seed);
+    } else {
+        bjd_tree_build_index(tree, 1);
+        TEST_TRUE(bjd_node_u32(bjd_node_map_cstr(root, "k99")) == seed + 99);
+        TEST_TRUE(bjd_node_u32(bjd_node_map_cstr(root, "k0")) == seed);
+    }
+    TEST_TRUE(bjd_tree_error(tree) == bjd_ok);
+}
+
+static size_t test_allocator_read(bjd_tree_t* tree, char* buffer, size_t count) {
+    test_source_t* source = (test_source_t*)bjd_tree_context(tree);
+    size_t left = source->size - source->pos;
+    if (count > left)
+        count = left;
+    if (count > source->max_chunk)
+        count = source->max_chunk;
+    memcpy(buffer, source->data + source->pos, count);
+    source->pos += count;
+    return count;
+}
+
+// A stream or data tree is kept while its arena is reset after each
+// message. The memory handed out by the arena after a reset is filled, so
+// that a tree reusing what it kept from before the reset corrupts either
+// the fill or its own nodes.
+static void test_allocator_arena_reuse(bool stream, bool lazy) {
+    enum { messages = 12 };
+    char* data;
+    size_t size;
+    bjd_writer_t writer;
+    bjd_writer_init_growable(&writer, &data, &size);
+    for (int m = 0; m < messages; ++m)
+        test_allocator_kind(&writer, m % 3, (uint32_t)m);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+
+    bjd_arena_t arena;
+    bjd_arena_init(&arena, 64 * 1024);
+    test_source_t source = {data, size, 0, 1000};
+    bjd_tree_t tree;
+    if (stream)
+        bjd_tree_init_stream(&tree, test_allocator_read, &source, size, 100000);
+    else
+        bjd_tree_init_data(&tree, data, size);
+    bjd_tree_set_allocator(&tree, bjd_arena_allocator(&arena));
+
+    // the fill is made of small allocations so that it covers the blocks
+    // the arena kept rather than getting a block of its own
+    char* fill[TEST_ALLOCATOR_FILL_COUNT];
+    bool filled = false;
+    for (int m = 0; m < messages; ++m) {
+        if (lazy)
+            bjd_tree_parse_lazy(&tree);
+        else
+            bjd_tree_parse(&tree);
+        test_allocator_check_kind(&tree, m % 3, (uint32_t)m);
+
+        if (filled) {
+            bool intact = true;
+            for (size_t i = 0; i < TEST_ALLOCATOR_FILL_COUNT; ++i)
+                for (size_t j = 0; j < TEST_ALLOCATOR_FILL_SIZE; ++j)
+                    intact &= fill[i][j] == TEST_ALLOCATOR_FILL;
+            TEST_TRUE(intact, "message %i overwrote arena memory", m);
+        }
+
+        bjd_arena_reset(&arena);
+        const bjd_allocator_t* allocator = bjd_arena_allocator(&arena);
+        for (size_t i = 0; i < TEST_ALLOCATOR_FILL_COUNT; ++i) {
+            fill[i] = (char*)allocator->allocate(allocator->context, TEST_ALLOCATOR_FILL_SIZE);
+            TEST_TRUE(fill[i] != NULL);
+            memset(fill[i], TEST_ALLOCATOR_FILL, TEST_ALLOCATOR_FILL_SIZE);
+        }
+        filled = true;
+    }
+
+    TEST_TREE_DESTROY_NOERROR(&tree);
+    bjd_arena_destroy(&arena);
+    BJDATA_FREE(data);
+}
+#endif
+
+#if BJDATA_EXPECT
+static void test_allocator_reader(void) {
+    static const char data[] = "[SU\x05hello]";
+    test_counter_t counter;
+    test_counter_init(&counter, true);
+
+    bjd_reader_t reader;
+    bjd_reader_init_data(&reader, data, sizeof(data) - 1);
+    bjd_reader_set_allocator(&reader, &counter.allocator);
+    bjd_expect_array_unsized(&reader);
+    char* str = bjd_expect_cstr_alloc(&reader, 100);
+    TEST_TRUE(str != NULL && strcmp(str, "hello") == 0);
+    TEST_TRUE(bjd_read_array_end(&reader));
+    bjd_done_array(&reader);
+    TEST_READER_DESTROY_NOERROR(&reader);
+
+    TEST_TRUE(counter.outstanding == 1, "%i allocations outstanding", (int)counter.outstanding);
+    if (str)
+        test_counter_deallocate(&counter, str);
+}
+#endif
+
+static void test_allocator_arena(void) {
+    bjd_arena_t arena;
+    bjd_arena_init(&arena, 256);
+    const bjd_allocator_t* allocator = bjd_arena_allocator(&arena);
+    void* context = allocator->context;
+
+    // allocations are distinct, aligned and writable
+    char* a = (char*)allocator->allocate(context, 10);
+    char* b = (char*)allocator->allocate(context, 1);
+    TEST_TRUE(a != NULL && b != NULL && b >= a + 10);
+    TEST_TRUE((uintptr_t)a % sizeof(void*) == 0 && (uintptr_t)b % sizeof(void*) == 0);
+    memset(a, 1, 10);
+    memset(b, 2, 1);
+
+    // the most recent allocation can be freed and resized in place
+    allocator->deallocate(context, b);
+    char* c = (char*)allocator->allocate(context, 20);
+    TEST_TRUE(c == b);
+    memset(c, 3, 20);
+    char* d = (char*)allocator->reallocate(context, c, 20, 100);
+    TEST_TRUE(d == c);
+    TEST_TRUE(d[19] == 3);
+
+    // older allocations are copied when resized
+    char* e = (char*)allocator->reallocate(context, a, 10, 40);
+    TEST_TRUE(e != NULL && e != a && e[9] == 1);
+
+    // allocations larger than a block get a block of their own
+    char* f = (char*)allocator->allocate(context, 10000);
+    TEST_TRUE(f != NULL);
+    if (f)
+        memset(f, 4, 10000);
+
+    // resetting reuses the blocks from the start
+    bjd_arena_reset(&arena);
+    char* g = (char*)allocator->allocate(context, 10);
+    TEST_TRUE(g == a);
+    char* h = (char*)allocator->allocate(context, 5000);
+    TEST_TRUE(h == f);
+
+    bjd_arena_destroy(&arena);
+}
+
+void test_allocator(void) {
+    #if BJDATA_WRITER
+    test_allocator_writer(true);
+    test_allocator_writer(false);
+    #endif
+    #if BJDATA_NODE && BJDATA_WRITER
+    test_allocator_tree(true);
+    test_allocator_tree(false);
+    test_allocator_arena_tree();
+    test_allocator_arena_reuse(true, false);
+    test_allocator_arena_reuse(false, false);
+    test_allocator_arena_reuse(false, true);
+    #endif
+    #if BJDATA_EXPECT
+    test_allocator_reader();
+    #endif
+    test_allocator_arena();
+}
+
+#endif
@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-auto-typed.h"
+
+#if BJDATA_WRITER && defined(BJDATA_MALLOC)
+
+typedef void (*test_auto_fn_t)(bjd_writer_t* writer);
+
+static void test_auto_write(test_auto_fn_t fn, bool auto_typed, char** data, size_t* size) {
+    bjd_writer_t writer;
+    bjd_writer_init_growable(&writer, data, size);
+    bjd_writer_set_auto_typed(&writer, auto_typed);
+    fn(&writer);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+}
+
+#define TEST_AUTO_WRITE(fn, auto_typed, expected) do { \
+    char* test_data; \
+    size_t test_size; \
+    test_auto_write(fn, auto_typed, &test_data, &test_size); \
+    TEST_BYTES_EQUAL(test_data, test_size, expected); \
+    BJDATA_FREE(test_data); \
+} while (0)
+
+#define TEST_AUTO_TYPED(fn, expected) TEST_AUTO_WRITE(fn, true, expected)
+
+// Checks an array that is not promoted, which both modes write the same.
+#define TEST_AUTO_PLAIN(fn, expected) do { \
+    TEST_AUTO_WRITE(fn, false, expected); \
+    TEST_AUTO_WRITE(fn, true, expected); \
+} while (0)
+
+static void test_auto_u8(bjd_writer_t* writer) {
+    bjd_start_array(writer, 3);
+    bjd_write_u8(writer, 0);
+    bjd_write_int(writer, 7);
+    bjd_write_uint(writer, 255);
+    bjd_finish_array(writer);
+}
+
+static void test_auto_i8(bjd_writer_t* writer) {
+    bjd_start_array(writer, 2);
+    bjd_write_i8(writer, -128);
+    bjd_write_u8(writer, 127);
+    bjd_finish_array(writer);
+}
+
+static void test_auto_i16(bjd_writer_t* writer) {
+    bjd_start_array(writer, 3);
+    bjd_write_u8(writer, 1);
+    bjd_write_i8(writer, -1);
+    bjd_write_u16(writer, 300);
+    bjd_finish_array(writer);
+}
+
+static void test_auto_u32(bjd_writer_t* writer) {
+    bjd_start_array(writer, 2);
+    bjd_write_u32(writer, 0x10000);
+    bjd_write_u8(writer, 1);
+    bjd_finish_array(writer);
+}
+
+static void test_auto_u64(bjd_writer_t* writer) {
+    bjd_start_array(writer, 2);
+    bjd_write_u64(writer, UINT64_MAX);
+    bjd_write_u8(writer, 0);
+    bjd_finish_array(writer);
+}
+
+static void test_auto_float(bjd_writer_t* writer) {
+    bjd_start_array(writer, 2);
+    bjd_write_float(writer, 1.0f);
+    bjd_write_float(writer, -2.0f);
+    bjd_finish_array(writer);
+}
+
+static void test_auto_double(bjd_writer_t* writer) {
+    bjd_start_array(writer, 2);
+    bjd_write_double(writer, 1.0);
+    bjd_write_double(writer, 0.5);
+    bjd_finish_array(writer);
+}
+
+// Inner arrays are promoted even though the outer one is not.
+static void test_auto_nested(bjd_writer_t* writer) {
+    bjd_start_array(writer, 2);
+    test_auto_u8(writer);
+    test_auto_i8(writer);
+    bjd_finish_array(writer);
+}
+
+static void test_auto_mixed_number(bjd_writer_t* writer) {
+    bjd_start_array(writer, 2);
+    bjd_write_u8(writer, 1);
+    bjd_write_double(writer, 1.0);
+    bjd_finish_array(writer);
+}
+
+static void test_auto_mixed_nil(bjd_writer_t* writer) {
+    bjd_start_array(writer, 3);
+    bjd_write_u8(writer, 1);
+    bjd_write_u8(writer, 2);
+    bjd_write_nil(writer);
+    bjd_finish_array(writer);
+}
+
+static void test_auto_single(bjd_writer_t* writer) {
+    bjd_start_array(writer, 1);
+    bjd_write_u8(writer, 1);
+    bjd_finish_array(writer);
+}
+
+static void test_auto_too_long(bjd_writer_t* writer) {
+    bjd_start_array(writer, BJDATA_AUTO_TYPED_MAX + 1);
+    for (size_t i = 0; i <= BJDATA_AUTO_TYPED_MAX; ++i)
+        bjd_write_u8(writer, (uint8_t)i);
+    bjd_finish_array(writer);
+}
+
+void test_auto_typed(void) {
+    TEST_AUTO_TYPED(test_auto_u8, "[$U#U\x03\x00\x07\xFF");
+    TEST_AUTO_TYPED(test_auto_i8, "[$i#U\x02\x80\x7F");
+    TEST_AUTO_TYPED(test_auto_i16, "[$I#U\x03\x01\x00\xFF\xFF\x2C\x01");
+    TEST_AUTO_TYPED(test_auto_u32, "[$m#U\x02\x00\x00\x01\x00\x01\x00\x00\x00");
+    TEST_AUTO_TYPED(test_auto_u64, "[$M#U\x02\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF\x00\x00\x00\x00\x00\x00\x00\x00");
+    TEST_AUTO_TYPED(test_auto_float, "[$d#U\x02\x00\x00\x80\x3F\x00\x00\x00\xC0");
+    TEST_AUTO_TYPED(test_auto_double, "[$D#U\x02\x00\x00\x00\x00\x00\x00\xF0\x3F\x00\x00\x00\x00\x00\x00\xE0\x3F");
+
+    TEST_AUTO_TYPED(test_auto_nested, "[#U\x02" "[$U#U\x03\x00\x07\xFF" "[$i#U\x02\x80\x7F");
+
+    // arrays that are not promoted are written with a marker per element,
+    // as are all arrays when auto-typed mode is off
+    TEST_AUTO_WRITE(test_auto_u8, false, "[#U\x03" "U\x00" "U\x07" "U\xFF");
+    TEST_AUTO_PLAIN(test_auto_mixed_number, "[#U\x02" "U\x01" "D\x00\x00\x00\x00\x00\x00\xF0\x3F");
+    TEST_AUTO_PLAIN(test_auto_mixed_nil, "[#U\x03" "U\x01" "U\x02" "Z");
+    TEST_AUTO_PLAIN(test_auto_single, "[#U\x01" "U\x01");
+
+    // an array too long to buffer is written as it goes
+    char* data;
+    size_t size;
+    size_t count = BJDATA_AUTO_TYPED_MAX + 1;
+    test_auto_write(test_auto_too_long, true, &data, &size);
+    TEST_TRUE(count <= UINT16_MAX && size == 5 + count * 2);
+    TEST_TRUE(memcmp(data, "[#u", 3) == 0 && bjd_load_u16_endian(data + 3, bjd_endian_little) == count);
+    bool elements = true;
+    for (size_t i = 0; i < count && size == 5 + count * 2; ++i)
+        if (data[5 + i * 2] != 'U' || (uint8_t)data[6 + i * 2] != (uint8_t)i)
+            elements = false;
+    TEST_TRUE(elements, "the elements of a long array are not written as uint8");
+    BJDATA_FREE(data);
+}
+
+#endif
+
@@ -0,0 +1,122 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-chunked.h"
+
+#if BJDATA_WRITER && defined(BJDATA_MALLOC)
+
+// Writes a message of the given number of small elements, with a payload
+// of the given size in the middle.
+static void test_chunked_message(bjd_writer_t* writer, size_t elements, const char* payload, size_t payload_size) {
+    bjd_start_array_unsized(writer);
+    for (size_t i = 0; i < elements; ++i) {
+        bjd_write_u32(writer, (uint32_t)(i * 2654435761u));
+        if (i == elements / 2)
+            bjd_write_bin(writer, payload, (uint32_t)payload_size);
+    }
+    if (elements == 0)
+        bjd_write_bin(writer, payload, (uint32_t)payload_size);
+    bjd_finish_array_unsized(writer);
+}
+
+static void test_chunked_compare(size_t elements, const char* payload, size_t payload_size) {
+    char* expected;
+    size_t expected_size;
+    bjd_writer_t writer;
+    bjd_writer_init_growable(&writer, &expected, &expected_size);
+    test_chunked_message(&writer, elements, payload, payload_size);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+
+    bjd_chunks_t chunks;
+    bjd_writer_init_chunked(&writer, &chunks);
+    test_chunked_message(&writer, elements, payload, payload_size);
+    TEST_TRUE(chunks.count == 0 && chunks.size == 0, "chunks should not be available before destroy");
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+
+    // the chunks are non-empty and add up to the message
+    size_t total = 0;
+    bool empty = false;
+    for (size_t i = 0; i < chunks.count; ++i) {
+        total += chunks.chunks[i].size;
+        empty |= chunks.chunks[i].size == 0;
+    }
+    TEST_TRUE(!empty);
+    TEST_TRUE(total == chunks.size && total == expected_size,
+            "chunks hold %i bytes, expected %i", (int)total, (int)expected_size);
+
+    char* data = bjd_chunks_concat(&chunks);
+    TEST_TRUE(data != NULL);
+    if (data && total == expected_size)
+        TEST_TRUE(memcmp(data, expected, expected_size) == 0,
+                "chunked output of %i elements with a %i byte payload does not match",
+                (int)elements, (int)payload_size);
+
+    BJDATA_FREE(data);
+    bjd_chunks_destroy(&chunks);
+    BJDATA_FREE(expected);
+}
+
+static void test_chunked_empty(void) {
+    bjd_chunks_t chunks;
+    bjd_writer_t writer;
+    bjd_writer_init_chunked(&writer, &chunks);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    TEST_TRUE(chunks.count == 0 && chunks.size == 0);
+
+    // concatenating an empty message still allocates
+    char* data = bjd_chunks_concat(&chunks);
+    TEST_TRUE(data != NULL);
+    BJDATA_FREE(data);
+    bjd_chunks_destroy(&chunks);
+}
+
+static void test_chunked_error(void) {
+    // the chunks stay empty if the writer fails
+    bjd_chunks_t chunks;
+    bjd_writer_t writer;
+    bjd_writer_init_chunked(&writer, &chunks);
+    test_chunked_message(&writer, BJDATA_BUFFER_SIZE, "", 0);
+    bjd_writer_flag_error(&writer, bjd_error_data);
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_data);
+    TEST_TRUE(chunks.count == 0 && chunks.size == 0);
+    bjd_chunks_destroy(&chunks);
+}
+
+void test_chunked(void) {
+    static const size_t element_counts[] = {0, 1, 100, BJDATA_BUFFER_SIZE, 200000};
+    static const size_t payload_sizes[] = {0, 10, BJDATA_BUFFER_SIZE - 1, BJDATA_BUFFER_SIZE + 1,
+            BJDATA_CHUNK_MAX_SIZE * 3 + 7};
+
+    size_t max_payload = payload_sizes[sizeof(payload_sizes) / sizeof(payload_sizes[0]) - 1];
+    char* payload = (char*)malloc(max_payload);
+    for (size_t i = 0; i < max_payload; ++i)
+        payload[i] = (char)test_rand();
+
+    for (size_t e = 0; e < sizeof(element_counts) / sizeof(element_counts[0]); ++e)
+        for (size_t p = 0; p < sizeof(payload_sizes) / sizeof(payload_sizes[0]); ++p)
+            test_chunked_compare(element_counts[e], payload, payload_sizes[p]);
+
+    test_chunked_empty();
+    test_chunked_error();
+    free(payload);
+}
+
+#endif
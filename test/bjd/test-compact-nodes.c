@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-compact-nodes.h"
+
+#if BJDATA_NODE
+
+static void test_compact_nodes_values(void) {
+    static const char data[] =
+        "[#U\x10"
+        "ZTF"
+        "i\x80"
+        "U\xFF"
+        "I\x00\x80"
+        "u\xFF\xFF"
+        "l\x00\x00\x00\x80"
+        "m\xFF\xFF\xFF\xFF"
+        "L\x00\x00\x00\x00\x00\x00\x00\x80"
+        "M\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF"
+        "d\x00\x00\xC0\x3F"
+        "D\x00\x00\x00\x00\x00\x00\x04\xC0"
+        "SU\x05hello"
+        "{#U\x01SU\x01" "aSU\x02hi"
+        "[$U#U\x03\x01\x02\x03";
+
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, data, sizeof(data) - 1);
+    bjd_tree_parse(&tree);
+    bjd_node_t root = bjd_tree_root(&tree);
+    TEST_TRUE(bjd_node_array_length(root) == 16);
+
+    TEST_TRUE(bjd_node_type(bjd_node_array_at(root, 0)) == bjd_type_nil);
+    TEST_TRUE(bjd_node_bool(bjd_node_array_at(root, 1)) == true);
+    TEST_TRUE(bjd_node_bool(bjd_node_array_at(root, 2)) == false);
+    TEST_TRUE(bjd_node_i8(bjd_node_array_at(root, 3)) == INT8_MIN);
+    TEST_TRUE(bjd_node_u8(bjd_node_array_at(root, 4)) == UINT8_MAX);
+    TEST_TRUE(bjd_node_i16(bjd_node_array_at(root, 5)) == INT16_MIN);
+    TEST_TRUE(bjd_node_u16(bjd_node_array_at(root, 6)) == UINT16_MAX);
+    TEST_TRUE(bjd_node_i32(bjd_node_array_at(root, 7)) == INT32_MIN);
+    TEST_TRUE(bjd_node_u32(bjd_node_array_at(root, 8)) == UINT32_MAX);
+
+    // values wider than 32 bits are kept whole
+    TEST_TRUE(bjd_node_i64(bjd_node_array_at(root, 9)) == INT64_MIN);
+    TEST_TRUE(bjd_node_u64(bjd_node_array_at(root, 10)) == UINT64_MAX);
+    TEST_TRUE(bjd_node_float_strict(bjd_node_array_at(root, 11)) == 1.5f);
+    TEST_TRUE(bjd_node_double_strict(bjd_node_array_at(root, 12)) == -2.5);
+
+    bjd_node_t str = bjd_node_array_at(root, 13);
+    TEST_TRUE(bjd_node_type(str) == bjd_type_str);
+    TEST_TRUE(bjd_node_strlen(str) == 5 && memcmp(bjd_node_str(str), "hello", 5) == 0);
+
+    bjd_node_t map = bjd_node_array_at(root, 14);
+    TEST_TRUE(bjd_node_map_count(map) == 1);
+    str = bjd_node_map_cstr(map, "a");
+    TEST_TRUE(bjd_node_strlen(str) == 2 && memcmp(bjd_node_str(str), "hi", 2) == 0);
+
+    bjd_node_t typed = bjd_node_array_at(root, 15);
+    TEST_TRUE(bjd_node_array_length(typed) == 3);
+    TEST_TRUE(bjd_node_u8(bjd_node_array_at(typed, 2)) == 3);
+
+    TEST_TREE_DESTROY_NOERROR(&tree);
+}
+
+// A long unsized array of 64-bit values spans many node pages.
+static void test_compact_nodes_pages(void) {
+    const size_t count = 10000;
+    size_t size = 1 + count * 9 + 1;
+    char* data = (char*)malloc(size);
+    char* p = data;
+    *p++ = '[';
+    for (size_t i = 0; i < count; ++i) {
+        *p++ = 'M';
+        bjd_store_u64_endian(p, UINT64_C(0x123456789) * i, bjd_endian_little);
+        p += 8;
+    }
+    *p++ = ']';
+
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, data, size);
+    bjd_tree_parse(&tree);
+    bjd_node_t root = bjd_tree_root(&tree);
+    TEST_TRUE(bjd_node_array_length(root) == count);
+    bool match = true;
+    for (size_t i = 0; i < count; ++i)
+        match &= bjd_node_u64(bjd_node_array_at(root, i)) == UINT64_C(0x123456789) * i;
+    TEST_TRUE(match);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+    free(data);
+}
+
+void test_compact_nodes(void) {
+    #if BJDATA_COMPACT_NODES
+    TEST_TRUE(sizeof(bjd_node_data_t) == 16, "compact nodes are %i bytes", (int)sizeof(bjd_node_data_t));
+    #endif
+    test_compact_nodes_values();
+    test_compact_nodes_pages();
+}
+
+#endif
@@ -0,0 +1,209 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-convert.h"
+
+#define TEST_CONVERT_MAX_COUNT 300
+
+static const char* test_kernel_names[] = {"scalar", "sse2", "ssse3", "avx2", "neon"};
+
+static const size_t test_widen_sizes[][2] = {{1, 2}, {1, 4}, {1, 8}, {2, 4}, {2, 8}, {4, 8}};
+
+static void test_fill_random(char* buffer, size_t size) {
+    for (size_t i = 0; i < size; ++i)
+        buffer[i] = (char)test_rand();
+}
+
+// Fills the buffer with valid UTF-8 of one to four bytes per code point.
+static void test_fill_utf8(char* buffer, size_t size) {
+    static const char* samples[] = {"a", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80"};
+    size_t i = 0;
+    while (i < size) {
+        const char* sample = samples[test_rand() % 4];
+        size_t length = strlen(sample);
+        if (i + length > size) {
+            sample = "a";
+            length = 1;
+        }
+        memcpy(buffer + i, sample, length);
+        i += length;
+    }
+}
+
+static uint64_t test_load_host(const char* p, size_t size, bool is_signed) {
+    uint64_t value = 0;
+    switch (size) {
+        case 1: value = is_signed ? (uint64_t)(int64_t)(int8_t)*p : (uint8_t)*p; break;
+        case 2: { uint16_t v; memcpy(&v, p, 2); value = is_signed ? (uint64_t)(int64_t)(int16_t)v : v; break; }
+        case 4: { uint32_t v; memcpy(&v, p, 4); value = is_signed ? (uint64_t)(int64_t)(int32_t)v : v; break; }
+        default: memcpy(&value, p, 8); break;
+    }
+    return value;
+}
+
+static void test_store_host(char* p, size_t size, uint64_t value) {
+    switch (size) {
+        case 2: { uint16_t v = (uint16_t)value; memcpy(p, &v, 2); break; }
+        case 4: { uint32_t v = (uint32_t)value; memcpy(p, &v, 4); break; }
+        default: memcpy(p, &value, 8); break;
+    }
+}
+
+static void test_convert_scalar_reference(void) {
+    static char src[TEST_CONVERT_MAX_COUNT * 8], expected[TEST_CONVERT_MAX_COUNT * 8],
+            actual[TEST_CONVERT_MAX_COUNT * 8];
+    TEST_TRUE(bjd_convert_use_kernels("scalar"));
+    TEST_TRUE(strcmp(bjd_convert_kernels_name(), "scalar") == 0);
+
+    for (size_t count = 0; count <= 40; ++count) {
+        for (size_t size = 2; size <= 8; size *= 2) {
+            test_fill_random(src, count * size);
+            for (size_t i = 0; i < count; ++i)
+                for (size_t b = 0; b < size; ++b)
+                    expected[i * size + b] = src[i * size + size - 1 - b];
+            bjd_convert_swap(actual, src, size, count);
+            TEST_TRUE(memcmp(expected, actual, count * size) == 0, "scalar swap%i of %i elements is wrong",
+                    (int)size * 8, (int)count);
+        }
+
+        for (size_t i = 0; i < sizeof(test_widen_sizes) / sizeof(test_widen_sizes[0]); ++i) {
+            size_t src_size = test_widen_sizes[i][0];
+            size_t dest_size = test_widen_sizes[i][1];
+            for (int is_signed = 0; is_signed < 2; ++is_signed) {
+                test_fill_random(src, count * src_size);
+                for (size_t j = 0; j < count; ++j)
+                    test_store_host(expected + j * dest_size, dest_size,
+                            test_load_host(src + j * src_size, src_size, is_signed != 0));
+                bjd_convert_widen(actual, dest_size, src, src_size, is_signed != 0, count);
+                TEST_TRUE(memcmp(expected, actual, count * dest_size) == 0,
+                        "scalar widen of %i elements from %i to %i bytes is wrong",
+                        (int)count, (int)src_size, (int)dest_size);
+            }
+        }
+    }
+
+    static const struct {
+        const char* str;
+        bool valid;
+    } utf8[] = {
+        {"", true},
+        {"plain ascii", true},
+        {"\xC3\xA9t\xC3\xA9", true},
+        {"\xE2\x82\xAC", true},
+        {"\xF0\x9F\x98\x80", true},
+        {"\xF4\x8F\xBF\xBF", true},   // U+10FFFF
+        {"\xEF\xBF\xBF", true},       // U+FFFF
+        {"\xC0\xAF", false},          // overlong
+        {"\xE0\x80\xAF", false},      // overlong
+        {"\xF0\x80\x80\xAF", false},  // overlong
+        {"\xED\xA0\x80", false},      // surrogate
+        {"\xF4\x90\x80\x80", false},  // above U+10FFFF
+        {"\xF5\x80\x80\x80", false},
+        {"\x80", false},              // lone continuation
+        {"\xC3", false},              // truncated
+        {"\xE2\x82", false},
+        {"\xC3\x28", false},          // bad continuation
+        {"\xFF", false},
+    };
+    for (size_t i = 0; i < sizeof(utf8) / sizeof(utf8[0]); ++i)
+        TEST_TRUE(bjd_utf8_validate(utf8[i].str, strlen(utf8[i].str), false) == utf8[i].valid,
+                "scalar UTF-8 validation of case %i is wrong", (int)i);
+
+    // null bytes
+    TEST_TRUE(bjd_utf8_validate("a\0b", 3, true));
+    TEST_TRUE(!bjd_utf8_validate("a\0b", 3, false));
+}
+
+static bool test_utf8_valid(const char* kernels, const char* str, size_t count, bool allow_null) {
+    bjd_convert_use_kernels(kernels);
+    return bjd_utf8_validate(str, count, allow_null);
+}
+
+static void test_convert_kernels(const char* name) {
+    static char src[TEST_CONVERT_MAX_COUNT * 8], expected[TEST_CONVERT_MAX_COUNT * 8],
+            actual[TEST_CONVERT_MAX_COUNT * 8];
+    bool match = true;
+
+    for (size_t count = 0; count <= TEST_CONVERT_MAX_COUNT; ++count) {
+        for (size_t size = 2; size <= 8; size *= 2) {
+            test_fill_random(src, count * size);
+
+            bjd_convert_use_kernels("scalar");
+            bjd_convert_swap(expected, src, size, count);
+            bjd_convert_use_kernels(name);
+            bjd_convert_swap(actual, src, size, count);
+            match &= memcmp(expected, actual, count * size) == 0;
+
+            // in place
+            memcpy(actual, src, count * size);
+            bjd_convert_swap(actual, actual, size, count);
+            match &= memcmp(expected, actual, count * size) == 0;
+        }
+
+        for (size_t i = 0; i < sizeof(test_widen_sizes) / sizeof(test_widen_sizes[0]); ++i) {
+            size_t src_size = test_widen_sizes[i][0];
+            size_t dest_size = test_widen_sizes[i][1];
+            for (int is_signed = 0; is_signed < 2; ++is_signed) {
+                test_fill_random(src, count * src_size);
+
+                bjd_convert_use_kernels("scalar");
+                bjd_convert_widen(expected, dest_size, src, src_size, is_signed != 0, count);
+                bjd_convert_use_kernels(name);
+                bjd_convert_widen(actual, dest_size, src, src_size, is_signed != 0, count);
+                match &= memcmp(expected, actual, count * dest_size) == 0;
+
+                // in place from the tail, as the reader does
+                char* tail = actual + count * (dest_size - src_size);
+                memmove(tail, src, count * src_size);
+                bjd_convert_widen(actual, dest_size, tail, src_size, is_signed != 0, count);
+                match &= memcmp(expected, actual, count * dest_size) == 0;
+            }
+        }
+
+        // valid text, then single corrupted bytes and nulls
+        test_fill_utf8(src, count);
+        for (int trial = 0; trial < 4; ++trial) {
+            if (trial > 0 && count > 0)
+                src[test_rand() % count] = (trial == 3) ? 0 : (char)test_rand();
+            for (int allow_null = 0; allow_null < 2; ++allow_null)
+                match &= test_utf8_valid("scalar", src, count, allow_null != 0) ==
+                        test_utf8_valid(name, src, count, allow_null != 0);
+        }
+    }
+
+    TEST_TRUE(match, "%s kernels do not match the scalar kernels", name);
+}
+
+void test_convert(void) {
+    test_convert_scalar_reference();
+
+    for (size_t i = 1; i < sizeof(test_kernel_names) / sizeof(test_kernel_names[0]); ++i) {
+        const char* name = test_kernel_names[i];
+        if (!bjd_convert_use_kernels(name))
+            continue;
+        TEST_TRUE(strcmp(bjd_convert_kernels_name(), name) == 0);
+        test_convert_kernels(name);
+    }
+
+    TEST_TRUE(!bjd_convert_use_kernels("unknown"));
+    TEST_TRUE(bjd_convert_use_kernels(NULL));
+}
+
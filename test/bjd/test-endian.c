@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-endian.h"
+
+#if BJDATA_EXPECT
+static void test_endian_expect(void) {
+    static const char data[] =
+        "I\x01\x02"
+        "m\x01\x02\x03\x04"
+        "M\x01\x02\x03\x04\x05\x06\x07\x08"
+        "D\x3F\xF8\x00\x00\x00\x00\x00\x00"
+        "[#u\x00\x02" "U\x01" "U\x02";
+    bjd_reader_t reader;
+
+    bjd_reader_init_data(&reader, data, sizeof(data) - 1);
+    bjd_reader_set_endian(&reader, bjd_endian_big);
+    TEST_TRUE(bjd_expect_i16(&reader) == 0x0102);
+    TEST_TRUE(bjd_expect_u32(&reader) == 0x01020304);
+    TEST_TRUE(bjd_expect_u64(&reader) == UINT64_C(0x0102030405060708));
+    TEST_TRUE(bjd_expect_double(&reader) == 1.5);
+    TEST_TRUE(bjd_expect_array(&reader) == 2);
+    TEST_TRUE(bjd_expect_u8(&reader) == 1);
+    TEST_TRUE(bjd_expect_u8(&reader) == 2);
+    bjd_done_array(&reader);
+    TEST_READER_DESTROY_NOERROR(&reader);
+
+    // the same bytes in little endian, the default
+    bjd_reader_init_data(&reader, data, sizeof(data) - 1);
+    TEST_TRUE(bjd_expect_i16(&reader) == 0x0201);
+    TEST_TRUE(bjd_expect_u32(&reader) == 0x04030201);
+    TEST_TRUE(bjd_expect_u64(&reader) == UINT64_C(0x0807060504030201));
+    TEST_TRUE(bjd_expect_double(&reader) != 1.5);
+    TEST_READER_DESTROY_NOERROR(&reader);
+}
+#endif
+
+#if BJDATA_WRITER
+// Typed payloads in the host byte order are copied, and others swapped,
+// so each order must give the other's bytes reversed per element.
+static void test_endian_writer(void) {
+    static const uint32_t values[] = {0x01020304, 0xA0B0C0D0};
+    char* little;
+    char* big;
+    size_t little_size, big_size;
+    bjd_writer_t writer;
+
+    bjd_writer_init_growable(&writer, &little, &little_size);
+    bjd_write_u32_array(&writer, values, 2);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+
+    bjd_writer_init_growable(&writer, &big, &big_size);
+    bjd_writer_set_endian(&writer, bjd_endian_big);
+    bjd_write_u32_array(&writer, values, 2);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+
+    TEST_BYTES_EQUAL(little, little_size, "[$m#U\x02\x04\x03\x02\x01\xD0\xC0\xB0\xA0");
+    TEST_BYTES_EQUAL(big, big_size, "[$m#U\x02\x01\x02\x03\x04\xA0\xB0\xC0\xD0");
+    BJDATA_FREE(little);
+    BJDATA_FREE(big);
+
+    // wide counts and dimensions
+    size_t dims[] = {300, 1};
+    static uint8_t zeros[300];
+    bjd_writer_init_growable(&writer, &big, &big_size);
+    bjd_writer_set_endian(&writer, bjd_endian_big);
+    bjd_write_ndarray(&writer, 'U', 2, dims, zeros);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    TEST_TRUE(big_size == 14 + 300);
+    TEST_TRUE(memcmp(big, "[$U#[$u#U\x02\x01\x2C\x00\x01", 14) == 0);
+
+    #if BJDATA_NODE
+    bjd_tree_t tree;
+    bjd_ndarray_view_t view;
+    bjd_tree_init_data(&tree, big, big_size);
+    bjd_tree_set_endian(&tree, bjd_endian_big);
+    bjd_tree_parse(&tree);
+    bjd_node_ndarray_view(bjd_tree_root(&tree), &view);
+    TEST_TRUE(view.ndims == 2 && view.dims[0] == 300 && view.dims[1] == 1);
+    TEST_TRUE(view.endian == bjd_endian_big);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+    #endif
+
+    BJDATA_FREE(big);
+}
+#endif
+
+#if BJDATA_NODE
+static void test_endian_node(void) {
+    static const char data[] = "[#U\x03" "u\x01\x02" "l\xFF\xFF\xFF\xFE" "d\x3F\xC0\x00\x00";
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, data, sizeof(data) - 1);
+    bjd_tree_set_endian(&tree, bjd_endian_big);
+    bjd_tree_parse(&tree);
+    bjd_node_t root = bjd_tree_root(&tree);
+    TEST_TRUE(bjd_node_u16(bjd_node_array_at(root, 0)) == 0x0102);
+    TEST_TRUE(bjd_node_i32(bjd_node_array_at(root, 1)) == -2);
+    TEST_TRUE(bjd_node_float(bjd_node_array_at(root, 2)) == 1.5f);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+}
+#endif
+
+void test_endian(void) {
+    #if BJDATA_EXPECT
+    test_endian_expect();
+    #endif
+    #if BJDATA_WRITER
+    test_endian_writer();
+    #endif
+    #if BJDATA_NODE
+    test_endian_node();
+    #endif
+}
+
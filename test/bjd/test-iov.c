@@ -0,0 +1,220 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-iov.h"
+
+#if BJDATA_IOV
+
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char* test_iov_filename = "bjd-test-iov-file";
+
+static char test_iov_payload[100000];
+static float test_iov_floats[5000];
+
+// Writes a message mixing small values with payloads on both sides of the
+// reference threshold.
+static void test_iov_message(bjd_writer_t* writer) {
+    bjd_start_array_unsized(writer);
+    bjd_write_bin(writer, test_iov_payload, sizeof(test_iov_payload));
+    bjd_write_str(writer, test_iov_payload, 5);
+    bjd_write_typed_array(writer, 'd', test_iov_floats, 5000);
+    bjd_write_bin(writer, test_iov_payload + 1, BJDATA_IOV_REFERENCE_MIN - 1);
+    bjd_write_bin(writer, test_iov_payload + 2, BJDATA_IOV_REFERENCE_MIN);
+    bjd_write_u32(writer, 123456);
+    bjd_write_bin(writer, test_iov_payload + 3, 100);
+    bjd_write_str(writer, test_iov_payload + 4, 9000);
+    bjd_write_u8_array(writer, (const uint8_t*)test_iov_payload, 0);
+    bjd_finish_array_unsized(writer);
+}
+
+#if BJDATA_IOV_REFERENCE_MIN <= UINT8_MAX + 1 || BJDATA_IOV_REFERENCE_MIN > UINT16_MAX
+#error "the expected message assumes payloads at the threshold have uint16 lengths"
+#endif
+
+// Appends a header and a payload to the expected message.
+static char* test_iov_put(char* p, const char* header, size_t header_size, const void* payload, size_t size) {
+    memcpy(p, header, header_size);
+    memcpy(p + header_size, payload, size);
+    return p + header_size + size;
+}
+
+#define TEST_IOV_PUT(p, header, payload, size) \
+    (p = test_iov_put(p, header, sizeof(header) - 1, payload, size))
+
+// Appends a binary with a uint16 length to the expected message.
+static char* test_iov_put_bin16(char* p, const char* payload, size_t size) {
+    const char header[] = {'[', '$', 'U', '#', 'u', (char)(size & 0xFF), (char)(size >> 8)};
+    return test_iov_put(p, header, sizeof(header), payload, size);
+}
+
+// Builds the BJData bytes of test_iov_message() by hand and returns their
+// size.
+static size_t test_iov_expected(char* data) {
+    char* p = data;
+    *p++ = '[';
+    TEST_IOV_PUT(p, "[$U#m\xA0\x86\x01\x00", test_iov_payload, sizeof(test_iov_payload));
+    TEST_IOV_PUT(p, "SU\x05", test_iov_payload, 5);
+    TEST_IOV_PUT(p, "[$d#u\x88\x13", "", 0);
+    for (size_t i = 0; i < 5000; ++i) {
+        uint32_t bits;
+        memcpy(&bits, &test_iov_floats[i], sizeof(bits));
+        for (size_t j = 0; j < 4; ++j)
+            *p++ = (char)(bits >> (j * 8));
+    }
+    p = test_iov_put_bin16(p, test_iov_payload + 1, BJDATA_IOV_REFERENCE_MIN - 1);
+    p = test_iov_put_bin16(p, test_iov_payload + 2, BJDATA_IOV_REFERENCE_MIN);
+    TEST_IOV_PUT(p, "m\x40\xE2\x01\x00", "", 0);
+    TEST_IOV_PUT(p, "[$U#U\x64", test_iov_payload + 3, 100);
+    TEST_IOV_PUT(p, "Su\x28\x23", test_iov_payload + 4, 9000);
+    TEST_IOV_PUT(p, "[$U#U\x00", "", 0);
+    *p++ = ']';
+    return (size_t)(p - data);
+}
+
+static bool test_iov_borrowed(const void* pointer) {
+    const char* p = (const char*)pointer;
+    return (p >= test_iov_payload && p < test_iov_payload + sizeof(test_iov_payload)) ||
+        (p >= (const char*)test_iov_floats && p < (const char*)(test_iov_floats + 5000));
+}
+
+static void test_iov_segments(const char* expected, size_t expected_size) {
+    bjd_iov_t iov;
+    bjd_writer_t writer;
+    bjd_writer_init_iov(&writer, &iov);
+    test_iov_message(&writer);
+    TEST_TRUE(iov.count == 0, "segments should not be available before destroy");
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+
+    char* joined = (char*)malloc(expected_size);
+    size_t size = 0;
+    size_t borrowed = 0;
+    bool fits = true;
+    for (size_t i = 0; i < iov.count; ++i) {
+        const struct iovec* vector = &iov.vectors[i];
+        if (size + vector->iov_len > expected_size) {
+            fits = false;
+            break;
+        }
+        memcpy(joined + size, vector->iov_base, vector->iov_len);
+        size += vector->iov_len;
+        if (test_iov_borrowed(vector->iov_base))
+            ++borrowed;
+    }
+    TEST_TRUE(fits && size == expected_size, "segments total %i bytes, expected %i",
+            (int)size, (int)expected_size);
+    TEST_TRUE(memcmp(joined, expected, size) == 0);
+
+    // the large binary, the typed array and the binary at the threshold are
+    // referenced; strings and smaller payloads are copied
+    TEST_TRUE(borrowed == 3, "%i segments are borrowed", (int)borrowed);
+
+    free(joined);
+    bjd_iov_destroy(&iov);
+}
+
+static void test_iov_errors(void) {
+    // the iov stays empty if the writer fails
+    bjd_iov_t iov;
+    bjd_writer_t writer;
+    bjd_writer_init_iov(&writer, &iov);
+    bjd_start_array_unsized(&writer);
+    bjd_write_bin(&writer, test_iov_payload, sizeof(test_iov_payload));
+    bjd_writer_flag_error(&writer, bjd_error_data);
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_data);
+    TEST_TRUE(iov.count == 0 && iov.chunk_count == 0);
+    bjd_iov_destroy(&iov);
+
+    // an empty message
+    bjd_writer_init_iov(&writer, &iov);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    size_t total = 0;
+    for (size_t i = 0; i < iov.count; ++i)
+        total += iov.vectors[i].iov_len;
+    TEST_TRUE(total == 0);
+    bjd_iov_destroy(&iov);
+
+    // a descriptor that can't be written
+    bjd_writer_init_fd(&writer, -1);
+    test_iov_message(&writer);
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_io);
+}
+
+static void test_iov_fd(const char* expected, size_t expected_size) {
+    int fd = open(test_iov_filename, O_CREAT | O_TRUNC | O_WRONLY, 0644);
+    TEST_TRUE(fd >= 0, "failed to open %s for writing", test_iov_filename);
+    if (fd < 0)
+        return;
+    bjd_writer_t writer;
+    bjd_writer_init_fd(&writer, fd);
+    test_iov_message(&writer);
+    test_iov_message(&writer);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    close(fd);
+
+    // the file holds the message twice
+    char* data = (char*)malloc(expected_size * 2 + 1);
+    FILE* file = fopen(test_iov_filename, "rb");
+    TEST_TRUE(file != NULL);
+    size_t size = 0;
+    if (file) {
+        size = fread(data, 1, expected_size * 2 + 1, file);
+        fclose(file);
+    }
+    TEST_TRUE(size == expected_size * 2);
+    if (size == expected_size * 2) {
+        TEST_TRUE(memcmp(data, expected, expected_size) == 0);
+        TEST_TRUE(memcmp(data + expected_size, expected, expected_size) == 0);
+    }
+    free(data);
+    remove(test_iov_filename);
+}
+
+void test_iov(void) {
+    for (size_t i = 0; i < sizeof(test_iov_payload); ++i)
+        test_iov_payload[i] = (char)('a' + i % 26);
+    for (size_t i = 0; i < 5000; ++i)
+        test_iov_floats[i] = (float)i * 0.25f;
+
+    char* expected = (char*)malloc(sizeof(test_iov_payload) * 2);
+    size_t expected_size = test_iov_expected(expected);
+
+    // the growable writer writes the same message
+    char* data;
+    size_t size;
+    bjd_writer_t writer;
+    bjd_writer_init_growable(&writer, &data, &size);
+    test_iov_message(&writer);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    TEST_TRUE(size == expected_size && memcmp(data, expected, size) == 0,
+            "the message does not match the expected bytes");
+    BJDATA_FREE(data);
+
+    test_iov_segments(expected, expected_size);
+    test_iov_fd(expected, expected_size);
+    test_iov_errors();
+
+    free(expected);
+}
+
+#endif
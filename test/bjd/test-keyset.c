@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-keyset.h"
+
+#if BJDATA_EXPECT
+
+static char test_keyset_buffers[BJDATA_KEYSET_MAX_KEYS][16];
+static const char* test_keyset_strings[BJDATA_KEYSET_MAX_KEYS];
+
+// Fills the test strings with "", "a", "b", ..., then "k3", "k4", ... so
+// that many have the same length.
+static void test_keyset_fill(size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        if (i == 0)
+            test_keyset_buffers[i][0] = '\0';
+        else if (i < 3)
+            snprintf(test_keyset_buffers[i], sizeof(test_keyset_buffers[i]), "%c", (char)('a' + i - 1));
+        else
+            snprintf(test_keyset_buffers[i], sizeof(test_keyset_buffers[i]), "k%i", (int)i);
+        test_keyset_strings[i] = test_keyset_buffers[i];
+    }
+}
+
+static void test_keyset_find(size_t count) {
+    test_keyset_fill(count);
+    bjd_keyset_t keyset;
+    bjd_keyset_init(&keyset, test_keyset_strings, count);
+    TEST_TRUE(bjd_keyset_count(&keyset) == count);
+
+    bool match = true;
+    for (size_t i = 0; i < count; ++i)
+        match &= bjd_keyset_find(&keyset, test_keyset_strings[i], strlen(test_keyset_strings[i])) == i;
+    TEST_TRUE(match, "strings not found in a key set of %i strings", (int)count);
+
+    // near misses
+    TEST_TRUE(bjd_keyset_find(&keyset, "k", 1) == count);
+    TEST_TRUE(bjd_keyset_find(&keyset, "k3x", 3) == count);
+    TEST_TRUE(bjd_keyset_find(&keyset, "k30000", 6) == count);
+    TEST_TRUE(bjd_keyset_find(&keyset, "c", 1) == count);
+    if (count > 3)
+        TEST_TRUE(bjd_keyset_find(&keyset, "k3", 1) == count);
+}
+
+static void test_keyset_duplicates(void) {
+    const char* strings[] = {"x", "y", "x"};
+    bjd_keyset_t keyset;
+    bjd_keyset_init(&keyset, strings, 3);
+    TEST_TRUE(bjd_keyset_find(&keyset, "x", 1) == 0);
+    TEST_TRUE(bjd_keyset_find(&keyset, "y", 1) == 1);
+}
+
+// bjd_expect_enum_keyset() must agree with bjd_expect_enum().
+static void test_keyset_enum(void) {
+    size_t count = BJDATA_KEYSET_MAX_KEYS;
+    test_keyset_fill(count);
+    bjd_keyset_t keyset;
+    bjd_keyset_init(&keyset, test_keyset_strings, count);
+
+    bool match = true;
+    for (int trial = 0; trial < 200; ++trial) {
+        char str[32];
+        int n = snprintf(str, sizeof(str), "k%i", (int)(test_rand() % (count * 2)));
+        char data[40] = {'S', 'U', (char)n};
+        memcpy(data + 3, str, (size_t)n);
+
+        bjd_reader_t reader;
+        bjd_reader_init_data(&reader, data, 3 + (size_t)n);
+        size_t expected = bjd_expect_enum_optional(&reader, test_keyset_strings, count);
+        TEST_READER_DESTROY_NOERROR(&reader);
+
+        bjd_reader_init_data(&reader, data, 3 + (size_t)n);
+        size_t actual = bjd_expect_enum_optional_keyset(&reader, &keyset);
+        TEST_READER_DESTROY_NOERROR(&reader);
+        match &= expected == actual;
+    }
+    TEST_TRUE(match);
+
+    // a string not in the set
+    bjd_reader_t reader;
+    bjd_reader_init_data(&reader, "SU\x01z", 4);
+    TEST_TRUE(bjd_expect_enum_keyset(&reader, &keyset) == count);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_type);
+}
+
+static void test_keyset_keys(void) {
+    const char* keys[] = {"id", "name", "tags"};
+    bjd_keyset_t keyset;
+    bjd_keyset_init(&keyset, keys, 3);
+    bool found[3] = {false, false, false};
+
+    static const char data[] = "{#U\x02" "SU\x04" "tags" "U\x01" "SU\x02" "id" "U\x02";
+    bjd_reader_t reader;
+    bjd_reader_init_data(&reader, data, sizeof(data) - 1);
+    TEST_TRUE(bjd_expect_map(&reader) == 2);
+    TEST_TRUE(bjd_expect_key_keyset(&reader, &keyset, found) == 2);
+    bjd_discard(&reader);
+    TEST_TRUE(bjd_expect_key_keyset(&reader, &keyset, found) == 0);
+    bjd_discard(&reader);
+    bjd_done_map(&reader);
+    TEST_READER_DESTROY_NOERROR(&reader);
+    TEST_TRUE(found[0] && !found[1] && found[2]);
+
+    // a duplicate key
+    static const char duplicate[] = "{#U\x02" "SU\x02" "id" "U\x01" "SU\x02" "id" "U\x02";
+    memset(found, 0, sizeof(found));
+    bjd_reader_init_data(&reader, duplicate, sizeof(duplicate) - 1);
+    bjd_expect_map(&reader);
+    bjd_expect_key_keyset(&reader, &keyset, found);
+    bjd_discard(&reader);
+    TEST_TRUE(bjd_expect_key_keyset(&reader, &keyset, found) == 3);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_invalid);
+}
+
+static void test_keyset_too_many(void) {
+    static const char* strings[BJDATA_KEYSET_MAX_KEYS + 1];
+    test_keyset_fill(BJDATA_KEYSET_MAX_KEYS);
+    for (size_t i = 0; i < BJDATA_KEYSET_MAX_KEYS; ++i)
+        strings[i] = test_keyset_strings[i];
+    strings[BJDATA_KEYSET_MAX_KEYS] = "extra";
+
+    bjd_keyset_t keyset;
+    TEST_BREAK((bjd_keyset_init(&keyset, strings, BJDATA_KEYSET_MAX_KEYS + 1), true));
+    TEST_TRUE(bjd_keyset_count(&keyset) == 0);
+
+    bjd_reader_t reader;
+    bjd_reader_init_data(&reader, "SU\x01" "a", 4);
+    TEST_BREAK((bjd_expect_enum_keyset(&reader, &keyset), true));
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_bug);
+}
+
+void test_keyset(void) {
+    // the test build sets a maximum that is not a power of two
+    static const size_t counts[] = {0, 1, 2, 3, 4, 7, 8, 9, 33, BJDATA_KEYSET_MAX_KEYS};
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i)
+        if (counts[i] <= BJDATA_KEYSET_MAX_KEYS)
+            test_keyset_find(counts[i]);
+    test_keyset_duplicates();
+    test_keyset_enum();
+    test_keyset_keys();
+    test_keyset_too_many();
+}
+
+#endif
+
@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-lazy.h"
+
+#if BJDATA_NODE
+
+// Writes a top-level array of random elements followed by a nil message.
+static size_t test_lazy_message(char* data, bool sized, uint32_t count) {
+    char* p = data;
+    *p++ = '[';
+    if (sized) {
+        *p++ = '#';
+        *p++ = 'l';
+        bjd_store_u32_endian(p, count, bjd_endian_little);
+        p += 4;
+    }
+    for (uint32_t i = 0; i < count; ++i)
+        p = test_random_value(p, 0);
+    if (!sized)
+        *p++ = ']';
+    *p++ = 'Z';
+    return (size_t)(p - data);
+}
+
+// Parses the data eagerly and lazily. Once the lazy tree has been walked
+// entirely, it must match the eager tree or have flagged the same error.
+// Returns the error.
+static bjd_error_t test_lazy_compare(const char* data, size_t size, size_t max_nodes) {
+    bjd_tree_t eager, lazy;
+    bjd_tree_init_data(&eager, data, size);
+    bjd_tree_init_data(&lazy, data, size);
+    if (max_nodes) {
+        bjd_tree_set_limits(&eager, size, max_nodes);
+        bjd_tree_set_limits(&lazy, size, max_nodes);
+    }
+    bjd_tree_parse(&eager);
+    bjd_tree_parse_lazy(&lazy);
+
+    bjd_error_t error = bjd_tree_error(&eager);
+    if (bjd_tree_error(&lazy) == bjd_ok) {
+        bjd_node_t root = bjd_tree_root(&lazy);
+        if (error == bjd_ok)
+            TEST_TRUE(test_node_equal(bjd_tree_root(&eager), root), "lazy tree of %i bytes differs", (int)size);
+        else
+            test_node_equal(root, root);
+    }
+    TEST_ERROR_IS(bjd_tree_error(&lazy), error);
+
+    // the next message follows
+    if (error == bjd_ok) {
+        bjd_tree_parse_lazy(&lazy);
+        TEST_TRUE(bjd_tree_error(&lazy) == bjd_ok);
+        TEST_TRUE(bjd_node_type(bjd_tree_root(&lazy)) == bjd_type_nil);
+    }
+
+    bjd_tree_destroy(&eager);
+    bjd_tree_destroy(&lazy);
+    return error;
+}
+
+static void test_lazy_random(void) {
+    char* data = (char*)malloc(8 + 20000 * TEST_RANDOM_VALUE_MAX_SIZE);
+    test_rand_seed(22);
+
+    for (int trial = 0; trial < 500; ++trial) {
+        size_t size = test_lazy_message(data, trial % 2 == 0, test_rand() % 6);
+        TEST_ERROR_IS(test_lazy_compare(data, size, 0), bjd_ok);
+    }
+    for (int sized = 0; sized < 2; ++sized) {
+        size_t size = test_lazy_message(data, sized != 0, 20000);
+        TEST_ERROR_IS(test_lazy_compare(data, size, 0), bjd_ok);
+    }
+
+    // corrupt bytes are found, at the latest when their container is
+    // expanded
+    for (int trial = 0; trial < 50; ++trial) {
+        size_t size = test_lazy_message(data, trial % 2 == 0, 1 + test_rand() % 20);
+        data[1 + test_rand() % (size - 2)] = (trial % 3 == 0) ? '[' : 'X';
+        test_lazy_compare(data, size, 0);
+    }
+
+    free(data);
+}
+
+static void test_lazy_errors(void) {
+    // malformed structure is found by the parse
+    static const char float_key[] = "[{$U#U\x01" "d\x00\x00\x80\x3F" "a\x02]";
+    static const char odd_map[] = "[{SU\x01kZSU\x01j}]";
+    static const char truncated[] = "[[ZZZZ]";
+    static const char* malformed[] = {float_key, odd_map, truncated};
+    static const size_t malformed_sizes[] = {sizeof(float_key) - 1, sizeof(odd_map) - 1, sizeof(truncated) - 1};
+
+    for (size_t i = 0; i < sizeof(malformed) / sizeof(malformed[0]); ++i) {
+        bjd_tree_t tree;
+        bjd_tree_init_data(&tree, malformed[i], malformed_sizes[i]);
+        bjd_tree_parse_lazy(&tree);
+        TEST_TREE_DESTROY_ERROR(&tree, bjd_error_invalid);
+    }
+
+    // the node limit is only exceeded when the container is expanded
+    static const char nodes[] = "[[ZZZZ]]";
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, nodes, sizeof(nodes) - 1);
+    bjd_tree_set_limits(&tree, 1000, 4);
+    bjd_tree_parse_lazy(&tree);
+    TEST_TRUE(bjd_tree_error(&tree) == bjd_ok);
+    bjd_node_t inner = bjd_node_array_at(bjd_tree_root(&tree), 0);
+    TEST_TRUE(bjd_tree_error(&tree) == bjd_ok);
+    bjd_node_array_length(inner);
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_too_big);
+    TEST_ERROR_IS(test_lazy_compare(nodes, sizeof(nodes) - 1, 4), bjd_error_too_big);
+}
+
+// Only the containers on the way to a value are expanded, so a lookup
+// succeeds with a pool too small for the whole message.
+static void test_lazy_pool(void) {
+    static const char data[] =
+        "{#U\x02"
+        "SU\x01" "a" "[#U\x01SU\x01" "x"
+        "SU\x01" "b" "{#U\x01SU\x01" "cU\x07";
+    bjd_node_data_t pool[7];
+    bjd_tree_t tree;
+    bjd_tree_init_pool(&tree, data, sizeof(data) - 1, pool, sizeof(pool) / sizeof(pool[0]));
+    bjd_tree_parse_lazy(&tree);
+    bjd_node_t root = bjd_tree_root(&tree);
+    TEST_TRUE(bjd_node_u8(bjd_node_map_cstr(bjd_node_map_cstr(root, "b"), "c")) == 7);
+    TEST_TRUE(bjd_tree_error(&tree) == bjd_ok);
+
+    // expanding the other array needs more nodes than are left
+    bjd_node_array_length(bjd_node_map_cstr(root, "a"));
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_too_big);
+
+    // as does parsing eagerly
+    bjd_tree_init_pool(&tree, data, sizeof(data) - 1, pool, sizeof(pool) / sizeof(pool[0]));
+    bjd_tree_parse(&tree);
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_too_big);
+
+    // the same message parses whole with enough nodes
+    bjd_node_data_t big_pool[16];
+    bjd_tree_init_pool(&tree, data, sizeof(data) - 1, big_pool, sizeof(big_pool) / sizeof(big_pool[0]));
+    bjd_tree_parse_lazy(&tree);
+    root = bjd_tree_root(&tree);
+    TEST_TRUE(bjd_node_strlen(bjd_node_array_at(bjd_node_map_cstr(root, "a"), 0)) == 1);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+}
+
+#ifdef BJDATA_MALLOC
+static void test_lazy_index(void) {
+    static const char data[] = "[{SU\x01" "aU\x01" "SU\x01" "bU\x02" "SU\x01" "cU\x03}]";
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, data, sizeof(data) - 1);
+    bjd_tree_parse_lazy(&tree);
+    bjd_tree_build_index(&tree, 1);
+    bjd_node_t map = bjd_node_array_at(bjd_tree_root(&tree), 0);
+    TEST_TRUE(bjd_node_u8(bjd_node_map_cstr(map, "c")) == 3);
+    TEST_TRUE(bjd_node_u8(bjd_node_map_cstr(map, "a")) == 1);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+}
+
+// Each level of a deep message holds a large typed array and the next level,
+// so every level is large enough for its end to be recorded up front. (A
+// typed array is skipped whole, so it isn't recorded.) A nil message
+// follows.
+static void test_lazy_deep(void) {
+    enum { depth = 40, payload = 300 };
+    char* data = (char*)malloc(depth * (payload + 16) + 2);
+    char* p = data;
+    for (int i = 0; i < depth; ++i) {
+        memcpy(p, "[#U\x02" "[$U#I", 9);
+        p += 9;
+        bjd_store_u16_endian(p, payload, bjd_endian_little);
+        p += 2;
+        memset(p, i, payload);
+        p += payload;
+    }
+    *p++ = 'Z';
+    *p++ = 'Z';
+    size_t size = (size_t)(p - data);
+
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, data, size);
+    bjd_tree_parse_lazy(&tree);
+    TEST_TRUE(tree.lazy_index.count == depth);
+    bjd_node_t node = bjd_tree_root(&tree);
+    for (int i = 0; i < depth; ++i) {
+        TEST_TRUE(bjd_node_u8(bjd_node_array_at(bjd_node_array_at(node, 0), payload - 1)) == i);
+        node = bjd_node_array_at(node, 1);
+    }
+    TEST_TRUE(bjd_node_is_nil(node));
+    TEST_TREE_DESTROY_NOERROR(&tree);
+
+    TEST_TRUE(test_lazy_compare(data, size, 0) == bjd_ok);
+    free(data);
+}
+#endif
+
+void test_lazy(void) {
+    test_lazy_random();
+    test_lazy_errors();
+    test_lazy_pool();
+    #ifdef BJDATA_MALLOC
+    test_lazy_index();
+    test_lazy_deep();
+    #endif
+}
+
+#endif
@@ -0,0 +1,178 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-mmap.h"
+
+#if BJDATA_MMAP
+
+#define TEST_MMAP_STR_SIZE 100000
+#define TEST_MMAP_DOUBLES 50000
+
+static const char* test_mmap_filename = "bjd-test-mmap-file";
+static const char* test_mmap_blank_filename = "bjd-test-mmap-blank-file";
+static const char* test_mmap_missing_filename = "bjd-test-mmap-missing-file";
+
+// [long string, [$D#m doubles], true]
+static char* test_mmap_data(size_t* size) {
+    *size = 4 + 6 + TEST_MMAP_STR_SIZE + 9 + TEST_MMAP_DOUBLES * 8 + 1;
+    char* data = (char*)malloc(*size);
+    char* p = data;
+
+    memcpy(p, "[#U\x03", 4);
+    p += 4;
+    memcpy(p, "Sm", 2);
+    bjd_store_u32_endian(p + 2, TEST_MMAP_STR_SIZE, bjd_endian_little);
+    p += 6;
+    for (size_t i = 0; i < TEST_MMAP_STR_SIZE; ++i)
+        *p++ = (char)('a' + i % 26);
+
+    memcpy(p, "[$D#m", 5);
+    bjd_store_u32_endian(p + 5, TEST_MMAP_DOUBLES, bjd_endian_little);
+    p += 9;
+    for (size_t i = 0; i < TEST_MMAP_DOUBLES; ++i) {
+        double value = (double)i * 0.5;
+        uint64_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        bjd_store_u64_endian(p, bits, bjd_endian_little);
+        p += 8;
+    }
+
+    *p++ = 'T';
+    TEST_TRUE((size_t)(p - data) == *size);
+    return data;
+}
+
+static void test_mmap_write_file(const char* filename, const char* data, size_t size) {
+    FILE* file = fopen(filename, "wb");
+    TEST_TRUE(file != NULL, "failed to open %s for writing", filename);
+    if (size > 0)
+        TEST_TRUE(fwrite(data, 1, size, file) == size);
+    fclose(file);
+}
+
+#if BJDATA_NODE
+static void test_mmap_tree(const char* data, size_t size) {
+    static const unsigned flags[] = {0, bjd_mmap_sequential, bjd_mmap_willneed,
+            bjd_mmap_sequential | bjd_mmap_willneed};
+
+    for (size_t f = 0; f < sizeof(flags) / sizeof(flags[0]); ++f) {
+        bjd_tree_t tree;
+        bjd_tree_init_mmap(&tree, test_mmap_filename, flags[f]);
+        bjd_tree_parse(&tree);
+        bjd_node_t root = bjd_tree_root(&tree);
+        TEST_TRUE(bjd_tree_size(&tree) == size);
+
+        // strings and payloads point into the mapping
+        bjd_node_t str = bjd_node_array_at(root, 0);
+        TEST_TRUE(bjd_node_data_len(str) == TEST_MMAP_STR_SIZE);
+        TEST_TRUE(bjd_node_str(str) != data + 10);
+        TEST_TRUE(memcmp(bjd_node_str(str), data + 10, TEST_MMAP_STR_SIZE) == 0);
+
+        bjd_node_t doubles = bjd_node_array_at(root, 1);
+        TEST_TRUE(bjd_node_array_length(doubles) == TEST_MMAP_DOUBLES);
+        TEST_TRUE(memcmp(bjd_node_typed_array_data(doubles), data + 10 + TEST_MMAP_STR_SIZE + 9,
+                TEST_MMAP_DOUBLES * 8) == 0);
+        TEST_TRUE(bjd_node_double(bjd_node_array_at(doubles, TEST_MMAP_DOUBLES - 1)) ==
+                (TEST_MMAP_DOUBLES - 1) * 0.5);
+        TEST_TRUE(bjd_node_bool(bjd_node_array_at(root, 2)));
+        TEST_TREE_DESTROY_NOERROR(&tree);
+    }
+
+    bjd_tree_t tree;
+    bjd_tree_init_mmap(&tree, test_mmap_blank_filename, 0);
+    bjd_tree_parse(&tree);
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_invalid);
+
+    bjd_tree_init_mmap(&tree, test_mmap_missing_filename, 0);
+    bjd_tree_parse(&tree);
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_io);
+}
+#endif
+
+#if BJDATA_EXPECT
+static void test_mmap_reader(const char* data) {
+    double* doubles = (double*)malloc(TEST_MMAP_DOUBLES * sizeof(double));
+
+    // in-place reads larger than any reader buffer
+    bjd_reader_t reader;
+    bjd_reader_init_mmap(&reader, test_mmap_filename, bjd_mmap_sequential);
+    TEST_TRUE(bjd_expect_array(&reader) == 3);
+    TEST_TRUE(bjd_expect_str(&reader) == TEST_MMAP_STR_SIZE);
+    const char* str = bjd_read_bytes_inplace(&reader, TEST_MMAP_STR_SIZE);
+    TEST_TRUE(str != NULL);
+    if (str)
+        TEST_TRUE(memcmp(str, data + 10, TEST_MMAP_STR_SIZE) == 0);
+    bjd_done_str(&reader);
+    TEST_TRUE(bjd_expect_f64_array(&reader, doubles, TEST_MMAP_DOUBLES) == TEST_MMAP_DOUBLES);
+    TEST_TRUE(doubles[0] == 0.0);
+    TEST_TRUE(doubles[TEST_MMAP_DOUBLES - 1] == (TEST_MMAP_DOUBLES - 1) * 0.5);
+    bjd_expect_true(&reader);
+    bjd_done_array(&reader);
+    TEST_READER_DESTROY_NOERROR(&reader);
+
+    // skipping and discarding
+    bjd_reader_init_mmap(&reader, test_mmap_filename, 0);
+    TEST_TRUE(bjd_expect_array(&reader) == 3);
+    TEST_TRUE(bjd_expect_str(&reader) == TEST_MMAP_STR_SIZE);
+    bjd_skip_bytes(&reader, TEST_MMAP_STR_SIZE);
+    bjd_done_str(&reader);
+    bjd_discard(&reader);
+    bjd_expect_true(&reader);
+    bjd_done_array(&reader);
+    TEST_READER_DESTROY_NOERROR(&reader);
+
+    // reading past the end of the mapping
+    bjd_reader_init_mmap(&reader, test_mmap_filename, 0);
+    bjd_discard(&reader);
+    bjd_discard(&reader);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_invalid);
+
+    bjd_reader_init_mmap(&reader, test_mmap_blank_filename, 0);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_invalid);
+
+    bjd_reader_init_mmap(&reader, test_mmap_missing_filename, 0);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_io);
+
+    free(doubles);
+}
+#endif
+
+void test_mmap(void) {
+    size_t size;
+    char* data = test_mmap_data(&size);
+    test_mmap_write_file(test_mmap_filename, data, size);
+    test_mmap_write_file(test_mmap_blank_filename, NULL, 0);
+    remove(test_mmap_missing_filename);
+
+    #if BJDATA_NODE
+    test_mmap_tree(data, size);
+    #endif
+    #if BJDATA_EXPECT
+    test_mmap_reader(data);
+    #endif
+
+    remove(test_mmap_filename);
+    remove(test_mmap_blank_filename);
+    free(data);
+}
+
+#endif
+
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-ndarray.h"
+
+#if BJDATA_WRITER
+
+static const size_t test_ndarray_dims[] = {2, 3, 4};
+
+// Element (i, j, k) of the test volume.
+static int32_t test_ndarray_value(size_t i, size_t j, size_t k) {
+    return (int32_t)(i * 100 + j * 10 + k) - 50;
+}
+
+static void test_ndarray_write(bjd_endian_t endian, char** data, size_t* size) {
+    int32_t values[24];
+    size_t n = 0;
+    for (size_t i = 0; i < 2; ++i)
+        for (size_t j = 0; j < 3; ++j)
+            for (size_t k = 0; k < 4; ++k)
+                values[n++] = test_ndarray_value(i, j, k);
+
+    bjd_writer_t writer;
+    bjd_writer_init_growable(&writer, data, size);
+    bjd_writer_set_endian(&writer, endian);
+    bjd_write_ndarray(&writer, 'l', 3, test_ndarray_dims, values);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+
+    // writing the elements in pieces gives the same output
+    char* pieces;
+    size_t pieces_size;
+    bjd_writer_init_growable(&writer, &pieces, &pieces_size);
+    bjd_writer_set_endian(&writer, endian);
+    bjd_start_ndarray(&writer, 'l', 3, test_ndarray_dims);
+    bjd_write_ndarray_elements(&writer, 'l', values, 5);
+    bjd_write_ndarray_elements(&writer, 'l', values + 5, 0);
+    bjd_write_ndarray_elements(&writer, 'l', values + 5, 19);
+    bjd_finish_ndarray(&writer);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    TEST_TRUE(pieces_size == *size && memcmp(pieces, *data, *size) == 0);
+    BJDATA_FREE(pieces);
+}
+
+static void test_ndarray_check_view(const bjd_ndarray_view_t* view, bjd_endian_t endian) {
+    TEST_TRUE(view->type == 'l');
+    TEST_TRUE(view->size == 4);
+    TEST_TRUE(view->ndims == 3);
+    TEST_TRUE(view->dims[0] == 2 && view->dims[1] == 3 && view->dims[2] == 4);
+    TEST_TRUE(view->strides[0] == 48 && view->strides[1] == 16 && view->strides[2] == 4);
+    TEST_TRUE(view->endian == endian);
+    TEST_TRUE(bjd_ndarray_view_count(view) == 24);
+
+    bool match = true;
+    size_t index[3];
+    for (index[0] = 0; index[0] < 2; ++index[0]) {
+        for (index[1] = 0; index[1] < 3; ++index[1]) {
+            for (index[2] = 0; index[2] < 4; ++index[2]) {
+                int32_t expected = test_ndarray_value(index[0], index[1], index[2]);
+                match &= bjd_load_i32_endian(bjd_ndarray_view_at(view, index), endian) == expected;
+                bjd_tag_t tag = bjd_ndarray_view_element(view, index);
+                match &= bjd_tag_type(&tag) == bjd_type_int && bjd_tag_int_value(&tag) == expected;
+            }
+        }
+    }
+    TEST_TRUE(match, "view elements do not match");
+
+    // the second plane, then its last two columns
+    bjd_ndarray_view_t plane;
+    TEST_TRUE(bjd_ndarray_view_select(view, 0, 1, &plane));
+    TEST_TRUE(plane.ndims == 2 && plane.dims[0] == 3 && plane.dims[1] == 4);
+    TEST_TRUE(bjd_ndarray_view_slice(&plane, 1, 2, 2, &plane));
+    TEST_TRUE(plane.ndims == 2 && plane.dims[0] == 3 && plane.dims[1] == 2);
+    TEST_TRUE(bjd_ndarray_view_count(&plane) == 6);
+    match = true;
+    for (index[0] = 0; index[0] < 3; ++index[0])
+        for (index[1] = 0; index[1] < 2; ++index[1])
+            match &= bjd_load_i32_endian(bjd_ndarray_view_at(&plane, index), endian) ==
+                    test_ndarray_value(1, index[0], index[1] + 2);
+    TEST_TRUE(match, "sliced view elements do not match");
+
+    // out of bounds selections leave the output unchanged
+    bjd_ndarray_view_t unchanged = plane;
+    TEST_TRUE(!bjd_ndarray_view_select(view, 3, 0, &plane));
+    TEST_TRUE(!bjd_ndarray_view_select(view, 0, 2, &plane));
+    TEST_TRUE(!bjd_ndarray_view_slice(view, 1, 2, 2, &plane));
+    TEST_TRUE(memcmp(&unchanged, &plane, sizeof(plane)) == 0);
+
+    // a single dimension can't be selected away
+    bjd_ndarray_view_t row;
+    TEST_TRUE(bjd_ndarray_view_select(view, 0, 0, &row));
+    TEST_TRUE(bjd_ndarray_view_select(&row, 0, 0, &row));
+    TEST_TRUE(row.ndims == 1 && row.dims[0] == 4);
+    TEST_TRUE(!bjd_ndarray_view_select(&row, 0, 0, &row));
+}
+
+static void test_ndarray_views(bjd_endian_t endian) {
+    char* data;
+    size_t size;
+    test_ndarray_write(endian, &data, &size);
+
+    static const char header[] = "[$l#[$U#U\x03\x02\x03\x04";
+    TEST_TRUE(size == sizeof(header) - 1 + 24 * 4);
+    TEST_TRUE(memcmp(data, header, sizeof(header) - 1) == 0);
+
+    #if BJDATA_READER
+    bjd_reader_t reader;
+    bjd_ndarray_view_t view;
+    bjd_reader_init_data(&reader, data, size);
+    bjd_reader_set_endian(&reader, endian);
+    bjd_read_ndarray(&reader, &view);
+    TEST_TRUE(view.data == data + sizeof(header) - 1);
+    test_ndarray_check_view(&view, endian);
+    TEST_READER_DESTROY_NOERROR(&reader);
+    #endif
+
+    #if BJDATA_NODE
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, data, size);
+    bjd_tree_set_endian(&tree, endian);
+    bjd_tree_parse(&tree);
+    bjd_node_t root = bjd_tree_root(&tree);
+    TEST_TRUE(bjd_node_array_length(root) == 24);
+    TEST_TRUE(bjd_node_i32(bjd_node_array_at(root, 23)) == test_ndarray_value(1, 2, 3));
+    bjd_node_ndarray_view(root, &view);
+    test_ndarray_check_view(&view, endian);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+    #endif
+
+    BJDATA_FREE(data);
+}
+
+static void test_ndarray_plain(void) {
+    #if BJDATA_NODE
+    // an optimized array with a plain count is viewed in one dimension
+    bjd_tree_t tree;
+    bjd_ndarray_view_t view;
+    bjd_tree_init_data(&tree, "[$U#U\x03\x01\x02\x03", 9);
+    bjd_tree_parse(&tree);
+    bjd_node_ndarray_view(bjd_tree_root(&tree), &view);
+    TEST_TRUE(view.ndims == 1 && view.dims[0] == 3 && view.strides[0] == 1);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+
+    // an ordinary array has no view
+    bjd_tree_init_data(&tree, "[#U\x01U\x01", 6);
+    bjd_tree_parse(&tree);
+    bjd_node_ndarray_view(bjd_tree_root(&tree), &view);
+    TEST_TRUE(view.ndims == 0 && view.data == NULL);
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_type);
+    #endif
+}
+
+static void test_ndarray_errors(void) {
+    char buffer[64];
+    bjd_writer_t writer;
+    size_t dims[BJDATA_NDARRAY_MAX_DIMS + 1] = {1, 1, 1, 1, 1, 1, 1, 1, 1};
+
+    bjd_writer_init(&writer, buffer, sizeof(buffer));
+    TEST_BREAK((bjd_start_ndarray(&writer, 'l', 0, dims), true));
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_bug);
+
+    bjd_writer_init(&writer, buffer, sizeof(buffer));
+    TEST_BREAK((bjd_start_ndarray(&writer, 'l', BJDATA_NDARRAY_MAX_DIMS + 1, dims), true));
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_bug);
+
+    bjd_writer_init(&writer, buffer, sizeof(buffer));
+    TEST_BREAK((bjd_start_ndarray(&writer, 'C', 1, dims), true));
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_bug);
+
+    // the element count must fit in 32 bits
+    size_t big[2] = {0x10000, 0x10000};
+    bjd_writer_init(&writer, buffer, sizeof(buffer));
+    bjd_start_ndarray(&writer, 'U', 2, big);
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_too_big);
+}
+
+void test_ndarray(void) {
+    test_ndarray_views(bjd_endian_little);
+    test_ndarray_views(bjd_endian_big);
+    test_ndarray_plain();
+    test_ndarray_errors();
+}
+
+#endif
+
@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-node-index.h"
+
+#if BJDATA_NODE && defined(BJDATA_MALLOC)
+
+// Builds an array of one map with count keys "k0", "k1", ... whose values
+// are their indices, then an unsized map with int keys, optionally
+// repeating one string key.
+static char* test_index_data(size_t count, bool duplicate, size_t* size) {
+    size_t capacity = 32 + count * 16;
+    char* data = (char*)malloc(capacity);
+    char* p = data;
+    size_t pairs = count + (duplicate ? 1 : 0);
+
+    memcpy(p, "[#U\x02{#u", 7);
+    p += 7;
+    bjd_store_u16_endian(p, (uint16_t)pairs, bjd_endian_little);
+    p += 2;
+    for (size_t i = 0; i < pairs; ++i) {
+        char key[16];
+        int length = snprintf(key, sizeof(key), "k%i", (int)(i == count ? count / 2 : i));
+        *p++ = 'S';
+        *p++ = 'U';
+        *p++ = (char)length;
+        memcpy(p, key, (size_t)length);
+        p += length;
+        *p++ = 'I';
+        bjd_store_u16_endian(p, (uint16_t)i, bjd_endian_little);
+        p += 2;
+    }
+
+    // {1: true, -1: false}
+    memcpy(p, "{U\x01Ti\xFF" "F}", 8);
+    p += 8;
+
+    *size = (size_t)(p - data);
+    TEST_TRUE(*size <= capacity);
+    return data;
+}
+
+static void test_node_index_lookups(size_t count, bool indexed) {
+    size_t size;
+    char* data = test_index_data(count, false, &size);
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, data, size);
+    bjd_tree_parse(&tree);
+    if (indexed)
+        bjd_tree_build_index(&tree, 0);
+    bjd_node_t map = bjd_node_array_at(bjd_tree_root(&tree), 0);
+    TEST_TRUE(bjd_node_map_count(map) == count);
+
+    bool match = true;
+    for (size_t i = 0; i < count; ++i) {
+        char key[16];
+        snprintf(key, sizeof(key), "k%i", (int)i);
+        match &= bjd_node_u16(bjd_node_map_cstr(map, key)) == i;
+        match &= bjd_node_map_contains_cstr(map, key);
+    }
+    TEST_TRUE(match, "lookups do not match in a map of %i keys %s an index",
+            (int)count, indexed ? "with" : "without");
+
+    TEST_TRUE(!bjd_node_map_contains_cstr(map, "k"));
+    TEST_TRUE(bjd_node_is_missing(bjd_node_map_cstr_optional(map, "missing")));
+    TEST_TRUE(!bjd_node_map_contains_str(map, "k1", 1));
+
+    bjd_node_t ints = bjd_node_array_at(bjd_tree_root(&tree), 1);
+    TEST_TRUE(bjd_node_bool(bjd_node_map_int(ints, 1)) == true);
+    TEST_TRUE(bjd_node_bool(bjd_node_map_uint(ints, 1)) == true);
+    TEST_TRUE(bjd_node_bool(bjd_node_map_int(ints, -1)) == false);
+    TEST_TRUE(!bjd_node_map_contains_uint(ints, 2));
+    TEST_TREE_DESTROY_NOERROR(&tree);
+
+    // a missing key flags an error
+    bjd_tree_init_data(&tree, data, size);
+    bjd_tree_parse(&tree);
+    if (indexed)
+        bjd_tree_build_index(&tree, 0);
+    map = bjd_node_array_at(bjd_tree_root(&tree), 0);
+    TEST_TRUE(bjd_node_is_nil(bjd_node_map_cstr(map, "missing")));
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_data);
+
+    free(data);
+}
+
+static void test_node_index_duplicates(size_t count, bool indexed) {
+    size_t size;
+    char* data = test_index_data(count, true, &size);
+    char key[16];
+    snprintf(key, sizeof(key), "k%i", (int)(count / 2));
+
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, data, size);
+    bjd_tree_parse(&tree);
+    if (indexed)
+        bjd_tree_build_index(&tree, 0);
+    bjd_node_t map = bjd_node_array_at(bjd_tree_root(&tree), 0);
+
+    // other keys are found
+    if (count / 2 != 0) {
+        TEST_TRUE(bjd_node_u16(bjd_node_map_cstr(map, "k0")) == 0);
+        TEST_TRUE(bjd_tree_error(&tree) == bjd_ok);
+    }
+
+    // the duplicated key is an error
+    bjd_node_map_cstr(map, key);
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_data);
+    free(data);
+}
+
+// Lookups do not modify an indexed tree, so it can be read again with the
+// same results after any number of lookups.
+static void test_node_index_reuse(void) {
+    size_t size;
+    char* data = test_index_data(500, false, &size);
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, data, size);
+    bjd_tree_parse(&tree);
+    bjd_tree_build_index(&tree, 100);
+    bjd_node_t map = bjd_node_array_at(bjd_tree_root(&tree), 0);
+
+    bool match = true;
+    for (int round = 0; round < 3; ++round)
+        for (size_t i = 0; i < 500; i += 7) {
+            char key[16];
+            snprintf(key, sizeof(key), "k%i", (int)i);
+            match &= bjd_node_u16(bjd_node_map_cstr(map, key)) == i;
+        }
+    TEST_TRUE(match);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+    free(data);
+}
+
+void test_node_index(void) {
+    static const size_t counts[] = {1, 2, 15, 100, 2000};
+    for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); ++i) {
+        test_node_index_lookups(counts[i], false);
+        test_node_index_lookups(counts[i], true);
+        test_node_index_duplicates(counts[i], false);
+        test_node_index_duplicates(counts[i], true);
+    }
+    test_node_index_reuse();
+}
+
+#endif
+
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-page-cache.h"
+
+#if BJDATA_NODE && BJDATA_WRITER && defined(BJDATA_MALLOC)
+
+#define TEST_PAGE_CACHE_MESSAGES 10
+
+// Messages alternate between many nodes and few.
+static uint32_t test_page_cache_length(int message) {
+    return (message % 2 == 0) ? 3000 : 10;
+}
+
+// Writes the given number of messages, each an unsized array of small
+// typed arrays.
+static void test_page_cache_messages(char** data, size_t* size) {
+    bjd_writer_t writer;
+    bjd_writer_init_growable(&writer, data, size);
+    for (int m = 0; m < TEST_PAGE_CACHE_MESSAGES; ++m) {
+        bjd_start_array_unsized(&writer);
+        for (uint32_t i = 0; i < test_page_cache_length(m); ++i) {
+            uint16_t values[2] = {(uint16_t)m, (uint16_t)i};
+            bjd_write_u16_array(&writer, values, 2);
+        }
+        bjd_finish_array_unsized(&writer);
+    }
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+}
+
+static void test_page_cache_check(bjd_tree_t* tree, int message) {
+    bjd_node_t root = bjd_tree_root(tree);
+    uint32_t length = test_page_cache_length(message);
+    TEST_TRUE(bjd_node_array_length(root) == length);
+    bjd_node_t last = bjd_node_array_at(root, length - 1);
+    TEST_TRUE(bjd_node_u16(bjd_node_array_at(last, 0)) == message);
+    TEST_TRUE(bjd_node_u16(bjd_node_array_at(last, 1)) == length - 1);
+    TEST_TRUE(bjd_tree_error(tree) == bjd_ok);
+}
+
+// Parses all messages, checking that once the largest message has been
+// parsed no more allocations are made, or if nothing is cached that each
+// large message allocates.
+static void test_page_cache_parse(bjd_tree_t* tree, test_counter_t* counter, bool cached) {
+    for (int m = 0; m < TEST_PAGE_CACHE_MESSAGES; ++m) {
+        size_t total = counter->total;
+        bjd_tree_parse(tree);
+        test_page_cache_check(tree, m);
+        size_t allocations = counter->total - total;
+        if (cached && m >= 2)
+            TEST_TRUE(allocations == 0, "message %i made %i allocations", m, (int)allocations);
+        if (!cached && m >= 2 && test_page_cache_length(m) > 1000)
+            TEST_TRUE(allocations > 0, "message %i made no allocations", m);
+    }
+}
+
+static void test_page_cache_data(const char* data, size_t size) {
+    bool cached = false;
+    do {
+        cached = !cached;
+        test_counter_t counter;
+        test_counter_init(&counter, true);
+        bjd_tree_t tree;
+        bjd_tree_init_data(&tree, data, size);
+        bjd_tree_set_allocator(&tree, &counter.allocator);
+        bjd_tree_set_page_cache_size(&tree, cached ? 1024 * 1024 : 0);
+        test_page_cache_parse(&tree, &counter, cached);
+        TEST_TREE_DESTROY_NOERROR(&tree);
+        TEST_TRUE(counter.outstanding == 0, "%i allocations outstanding", (int)counter.outstanding);
+    } while (cached);
+}
+
+static size_t test_page_cache_read(bjd_tree_t* tree, char* buffer, size_t count) {
+    test_source_t* source = (test_source_t*)bjd_tree_context(tree);
+    size_t left = source->size - source->pos;
+    if (count > left)
+        count = left;
+    if (count > 1000)
+        count = 1000;
+    memcpy(buffer, source->data + source->pos, count);
+    source->pos += count;
+    return count;
+}
+
+static void test_page_cache_stream(const char* data, size_t size) {
+    test_source_t source = {data, size, 0, 0};
+    test_counter_t counter;
+    test_counter_init(&counter, true);
+    bjd_tree_t tree;
+    bjd_tree_init_stream(&tree, test_page_cache_read, &source, size, 100000);
+    bjd_tree_set_allocator(&tree, &counter.allocator);
+    bjd_tree_set_page_cache_size(&tree, 1024 * 1024);
+    test_page_cache_parse(&tree, &counter, true);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+    TEST_TRUE(counter.outstanding == 0, "%i allocations outstanding", (int)counter.outstanding);
+}
+
+static void test_page_cache_trim(const char* data, size_t size) {
+    test_counter_t counter;
+    test_counter_init(&counter, true);
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, data, size);
+    bjd_tree_set_allocator(&tree, &counter.allocator);
+    bjd_tree_set_page_cache_size(&tree, 1024 * 1024);
+
+    // after a small message, the pages of the large one are kept until
+    // the tree is trimmed
+    bjd_tree_parse(&tree);
+    bjd_tree_parse(&tree);
+    size_t outstanding = counter.outstanding;
+    bjd_tree_trim(&tree);
+    TEST_TRUE(counter.outstanding < outstanding);
+    test_page_cache_check(&tree, 1);
+
+    // the next large message allocates again
+    size_t total = counter.total;
+    bjd_tree_parse(&tree);
+    test_page_cache_check(&tree, 2);
+    TEST_TRUE(counter.total > total);
+
+    TEST_TREE_DESTROY_NOERROR(&tree);
+    TEST_TRUE(counter.outstanding == 0, "%i allocations outstanding", (int)counter.outstanding);
+}
+
+void test_page_cache(void) {
+    char* data;
+    size_t size;
+    test_page_cache_messages(&data, &size);
+    test_page_cache_data(data, size);
+    test_page_cache_stream(data, size);
+    test_page_cache_trim(data, size);
+    BJDATA_FREE(data);
+}
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-parallel.h"
+
+#if BJDATA_NODE && defined(BJDATA_MALLOC)
+
+// Writes a top-level array of random elements followed by a nil message.
+static size_t test_parallel_message(char* data, bool sized, uint32_t count) {
+    char* p = data;
+    *p++ = '[';
+    if (sized) {
+        *p++ = '#';
+        *p++ = 'l';
+        bjd_store_u32_endian(p, count, bjd_endian_little);
+        p += 4;
+    }
+    for (uint32_t i = 0; i < count; ++i)
+        p = test_random_value(p, 0);
+    if (!sized)
+        *p++ = ']';
+    *p++ = 'Z';
+    return (size_t)(p - data);
+}
+
+// Parses the data serially and in parallel, expecting the same tree or
+// the same error, and then the trailing nil message. Returns the error.
+static bjd_error_t test_parallel_compare(const char* data, size_t size, size_t nthreads, const bjd_allocator_t* allocator) {
+    bjd_tree_t serial, parallel;
+    bjd_tree_init_data(&serial, data, size);
+    bjd_tree_parse(&serial);
+    bjd_tree_init_data(&parallel, data, size);
+    if (allocator)
+        bjd_tree_set_allocator(&parallel, allocator);
+    bjd_tree_parse_parallel(&parallel, nthreads);
+
+    bjd_error_t error = bjd_tree_error(&serial);
+    TEST_ERROR_IS(bjd_tree_error(&parallel), error);
+    if (error == bjd_ok && bjd_tree_error(&parallel) == bjd_ok) {
+        TEST_TRUE(test_node_equal(bjd_tree_root(&serial), bjd_tree_root(&parallel)),
+                "parallel tree of %i bytes on %i threads differs", (int)size, (int)nthreads);
+        TEST_TRUE(bjd_tree_size(&serial) == bjd_tree_size(&parallel));
+
+        bjd_tree_parse(&parallel);
+        TEST_TRUE(bjd_tree_error(&parallel) == bjd_ok);
+        TEST_TRUE(bjd_node_type(bjd_tree_root(&parallel)) == bjd_type_nil);
+    }
+
+    bjd_tree_destroy(&serial);
+    bjd_tree_destroy(&parallel);
+    return error;
+}
+
+void test_parallel(void) {
+    static const uint32_t counts[] = {0, 1, 10, 20000};
+    static const size_t threads[] = {1, 2, 3, 8};
+
+    char* data = (char*)malloc(8 + 20000 * TEST_RANDOM_VALUE_MAX_SIZE);
+    test_rand_seed(20);
+
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+        for (int sized = 0; sized < 2; ++sized) {
+            size_t size = test_parallel_message(data, sized != 0, counts[c]);
+            for (size_t t = 0; t < sizeof(threads) / sizeof(threads[0]); ++t)
+                TEST_ERROR_IS(test_parallel_compare(data, size, threads[t], NULL), bjd_ok);
+        }
+    }
+
+    // corrupt bytes are found wherever they are, with the same error
+    for (int trial = 0; trial < 8; ++trial) {
+        size_t size = test_parallel_message(data, trial % 2 == 0, 20000);
+        data[1 + test_rand() % (size - 2)] = (trial < 4) ? 'X' : '[';
+        test_parallel_compare(data, size, 8, NULL);
+    }
+
+    // a count larger than the elements and the trailing message
+    size_t size = test_parallel_message(data, true, 20000);
+    bjd_store_u32_endian(data + 3, 20002, bjd_endian_little);
+    TEST_ERROR_IS(test_parallel_compare(data, size, 8, NULL), bjd_error_invalid);
+
+    // deep nesting in the elements
+    char* p = data;
+    *p++ = '[';
+    for (int i = 0; i < 100000; ++i) {
+        memcpy(p, "[[]]", 4);
+        p += 4;
+    }
+    for (int i = 0; i < 100; ++i)
+        *p++ = '[';
+    for (int i = 0; i < 100; ++i)
+        *p++ = ']';
+    *p++ = ']';
+    *p++ = 'Z';
+    TEST_ERROR_IS(test_parallel_compare(data, (size_t)(p - data), 4, NULL), bjd_ok);
+
+    // trees with an allocator are parsed on the calling thread
+    size = test_parallel_message(data, false, 20000);
+    bjd_arena_t arena;
+    bjd_arena_init(&arena, 0);
+    TEST_ERROR_IS(test_parallel_compare(data, size, 8, bjd_arena_allocator(&arena)), bjd_ok);
+    bjd_arena_destroy(&arena);
+
+    free(data);
+}
+
+#endif
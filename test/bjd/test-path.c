@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-path.h"
+
+#if BJDATA_READER
+
+// {"a": {"b": [1, 2, 3, {"c": "hi"}], "x": [$U#3 7 8 9]},
+//  "k.y": {$U#2 "p": 5, "q": 6}, "u": {"z": -3}}
+static const char test_path_doc[] =
+    "{SU\x01" "a" "{#U\x02"
+        "SU\x01" "b" "[U\x01U\x02U\x03{SU\x01" "cSU\x02hi}]"
+        "SU\x01" "x" "[$U#U\x03\x07\x08\x09"
+    "SU\x03" "k.y" "{$U#U\x02U\x01p\x05U\x01q\x06"
+    "SU\x01" "u" "{SU\x01zi\xFD}"
+    "}";
+
+typedef struct test_path_case_t {
+    const char* expr;
+    bool found;
+    bjd_type_t type;
+    size_t start;
+    size_t end;
+} test_path_case_t;
+
+static void test_path_cases(void) {
+    static const test_path_case_t cases[] = {
+        {"a.b[3].c",  true,  bjd_type_str,   25, 30},
+        {"a.b[0]",    true,  bjd_type_uint,  14, 16},
+        {"a.b[2]",    true,  bjd_type_uint,  18, 20},
+        {"a.x[0]",    true,  bjd_type_uint,  42, 43},
+        {"a.x[2]",    true,  bjd_type_uint,  44, 45},
+        {"[\"k.y\"].q", true, bjd_type_uint, 64, 65},
+        {"[\"k.y\"]", true,  bjd_type_map,   51, 65},
+        {"u.z",       true,  bjd_type_int,   74, 76},
+        {"a",         true,  bjd_type_map,    5, 45},
+        {"a.b",       true,  bjd_type_array, 13, 32},
+        {"",          true,  bjd_type_map,    0, 78},
+        {"a.b[4]",    false, bjd_type_missing, 0, 0},
+        {"a.x[3]",    false, bjd_type_missing, 0, 0},
+        {"nope",      false, bjd_type_missing, 0, 0},
+        {"a.b.c",     false, bjd_type_missing, 0, 0},
+        {"a.x.y",     false, bjd_type_missing, 0, 0},
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i) {
+        const test_path_case_t* c = &cases[i];
+        bjd_path_t path;
+        TEST_ERROR_IS(bjd_path_compile(&path, c->expr), bjd_ok);
+        bjd_path_match_t match;
+        TEST_ERROR_IS(bjd_path_eval_data(test_path_doc, sizeof(test_path_doc) - 1, bjd_endian_little,
+                    &path, 1, &match), bjd_ok);
+        TEST_TRUE(match.found == c->found, "path \"%s\" found %i", c->expr, (int)match.found);
+        if (match.found && c->found) {
+            TEST_TRUE(match.tag.type == c->type && match.start == c->start && match.end == c->end,
+                    "path \"%s\" is %s at %i..%i", c->expr, bjd_type_to_string(match.tag.type),
+                    (int)match.start, (int)match.end);
+        }
+    }
+
+    // the tag holds the value
+    bjd_path_t paths[3];
+    bjd_path_compile(&paths[0], "a.b[3].c");
+    bjd_path_compile(&paths[1], "u.z");
+    bjd_path_compile(&paths[2], "a.x[1]");
+    bjd_path_match_t matches[3];
+    TEST_ERROR_IS(bjd_path_eval_data(test_path_doc, sizeof(test_path_doc) - 1, bjd_endian_little,
+                paths, 3, matches), bjd_ok);
+    TEST_TRUE(matches[0].tag.v.l == 2 && memcmp(test_path_doc + matches[0].end - 2, "hi", 2) == 0);
+    TEST_TRUE(matches[1].tag.v.i == -3);
+    TEST_TRUE(matches[2].tag.v.u == 8);
+}
+
+static void test_path_compile_errors(void) {
+    static const char* invalid[] = {"a..b", ".a", "a.", "a[", "a[x]", "a[1]b", "a.[0]",
+        "a.b[99999999999]", "[\"a"};
+    bjd_path_t path;
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i)
+        TEST_TRUE(bjd_path_compile(&path, invalid[i]) == bjd_error_invalid,
+                "path \"%s\" should not compile", invalid[i]);
+
+    char expr[BJDATA_PATH_MAX_STEPS * 2 + 2];
+    size_t length = 0;
+    for (int i = 0; i <= BJDATA_PATH_MAX_STEPS; ++i) {
+        if (i > 0)
+            expr[length++] = '.';
+        expr[length++] = 'a';
+    }
+    expr[length] = '\0';
+    TEST_ERROR_IS(bjd_path_compile(&path, expr), bjd_error_too_big);
+
+    // the maximum number of steps is fine
+    expr[length - 2] = '\0';
+    TEST_ERROR_IS(bjd_path_compile(&path, expr), bjd_ok);
+}
+
+static void test_path_reader(void) {
+    static const char* exprs[] = {"u.z", "a.b[3].c", "a.x[1]", "missing"};
+    bjd_path_t paths[4];
+    for (size_t i = 0; i < 4; ++i)
+        bjd_path_compile(&paths[i], exprs[i]);
+
+    // each call evaluates one message, with offsets from where it started
+    size_t size = sizeof(test_path_doc) - 1;
+    char* twice = (char*)malloc(size * 2);
+    memcpy(twice, test_path_doc, size);
+    memcpy(twice + size, test_path_doc, size);
+
+    bjd_reader_t reader;
+    bjd_reader_init_data(&reader, twice, size * 2);
+    for (int pass = 0; pass < 2; ++pass) {
+        bjd_path_match_t matches[4];
+        TEST_TRUE(bjd_path_eval(&reader, paths, 4, matches) == 3);
+        TEST_TRUE(matches[0].found && matches[0].start == 74 && matches[0].end == 76);
+        TEST_TRUE(matches[1].found && matches[1].start == 25 && matches[1].end == 30);
+        TEST_TRUE(matches[2].found && matches[2].start == 43 && matches[2].end == 44);
+        TEST_TRUE(!matches[3].found);
+    }
+    TEST_TRUE(bjd_reader_remaining(&reader, NULL) == 0);
+    TEST_READER_DESTROY_NOERROR(&reader);
+    free(twice);
+
+    // a truncated message keeps the matches found before the error
+    bjd_path_t path;
+    bjd_path_match_t match;
+    bjd_path_compile(&path, "u.z");
+    TEST_ERROR_IS(bjd_path_eval_data(test_path_doc, size - 3, bjd_endian_little, &path, 1, &match),
+            bjd_error_invalid);
+    TEST_TRUE(!match.found);
+    bjd_path_compile(&path, "a.b[1]");
+    TEST_ERROR_IS(bjd_path_eval_data(test_path_doc, size - 3, bjd_endian_little, &path, 1, &match),
+            bjd_error_invalid);
+    TEST_TRUE(match.found && match.tag.v.u == 2);
+}
+
+#if BJDATA_NODE
+// Picks a random route from the node down through the tree, appending its
+// expression. Routes stop at empty keys, which paths can't name.
+static bjd_node_t test_path_route(bjd_node_t node, char* expr, int depth) {
+    bjd_type_t type = bjd_node_type(node);
+    if (depth > 0 && test_rand() % 4 == 0)
+        return node;
+
+    if (type == bjd_type_array && bjd_node_array_length(node) > 0) {
+        size_t i = test_rand() % bjd_node_array_length(node);
+        sprintf(expr + strlen(expr), "[%i]", (int)i);
+        return test_path_route(bjd_node_array_at(node, i), expr, depth + 1);
+    }
+
+    if (type == bjd_type_map && bjd_node_map_count(node) > 0) {
+        size_t i = test_rand() % bjd_node_map_count(node);
+        bjd_node_t key = bjd_node_map_key_at(node, i);
+        if (bjd_node_strlen(key) == 0)
+            return node;
+        sprintf(expr + strlen(expr), "%s%.*s", *expr ? "." : "", (int)bjd_node_strlen(key), bjd_node_str(key));
+        return test_path_route(bjd_node_map_value_at(node, i), expr, depth + 1);
+    }
+
+    return node;
+}
+
+// Finds random routes through random messages with a tree, then checks that
+// path queries over the data and over a reader filling in small chunks
+// find them in one pass.
+static void test_path_random(void) {
+    char* data = (char*)malloc(2 + 4 * (6 + TEST_RANDOM_VALUE_MAX_SIZE));
+    char buffer[64];
+    test_rand_seed(23);
+
+    for (int trial = 0; trial < 500; ++trial) {
+        char* p = data;
+        *p++ = '{';
+        uint32_t count = 1 + test_rand() % 4;
+        for (uint32_t k = 0; k < count; ++k) {
+            memcpy(p, "SU\x02k", 4);
+            p[4] = (char)('0' + k);
+            p = test_random_value(p + 5, 0);
+        }
+        *p++ = '}';
+        size_t size = (size_t)(p - data);
+
+        bjd_tree_t tree;
+        bjd_tree_init_data(&tree, data, size);
+        bjd_tree_parse(&tree);
+
+        char exprs[3][256];
+        bjd_path_t paths[3];
+        bjd_node_t nodes[3];
+        for (int i = 0; i < 3; ++i) {
+            exprs[i][0] = '\0';
+            nodes[i] = test_path_route(bjd_tree_root(&tree), exprs[i], 0);
+            TEST_ERROR_IS(bjd_path_compile(&paths[i], exprs[i]), bjd_ok);
+        }
+
+        bjd_path_match_t matches[3], source_matches[3];
+        TEST_ERROR_IS(bjd_path_eval_data(data, size, bjd_endian_little, paths, 3, matches), bjd_ok);
+
+        test_source_t source = {data, size, 0, 7};
+        bjd_reader_t reader;
+        test_reader_init_source(&reader, buffer, sizeof(buffer), &source);
+        TEST_TRUE(bjd_path_eval(&reader, paths, 3, source_matches) == 3);
+        TEST_READER_DESTROY_NOERROR(&reader);
+
+        for (int i = 0; i < 3; ++i) {
+            bjd_type_t type = bjd_node_type(nodes[i]);
+            TEST_TRUE(matches[i].found && matches[i].tag.type == type,
+                    "path \"%s\" found %i", exprs[i], (int)matches[i].found);
+            TEST_TRUE(source_matches[i].start == matches[i].start && source_matches[i].end == matches[i].end);
+            if (type == bjd_type_uint)
+                TEST_TRUE(matches[i].tag.v.u == bjd_node_u64(nodes[i]));
+            else if (type == bjd_type_int)
+                TEST_TRUE(matches[i].tag.v.i == bjd_node_i64(nodes[i]));
+            else if (type == bjd_type_str)
+                TEST_TRUE(matches[i].tag.v.l == bjd_node_strlen(nodes[i]) &&
+                        memcmp(data + matches[i].end - matches[i].tag.v.l, bjd_node_str(nodes[i]),
+                            matches[i].tag.v.l) == 0);
+        }
+
+        TEST_TREE_DESTROY_NOERROR(&tree);
+    }
+
+    free(data);
+}
+#endif
+
+void test_path(void) {
+    test_path_cases();
+    test_path_compile_errors();
+    test_path_reader();
+    #if BJDATA_NODE
+    test_path_random();
+    #endif
+}
+
+#endif
@@ -0,0 +1,261 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-projection.h"
+
+#if BJDATA_NODE && defined(BJDATA_MALLOC)
+
+#define TEST_PROJECTION_MAX_STEPS 8
+
+// The steps of a path, to follow in a tree.
+typedef struct test_route_t {
+    struct {
+        const char* key; // NULL for an array index
+        size_t length;
+        size_t index;
+    } steps[TEST_PROJECTION_MAX_STEPS];
+    size_t count;
+} test_route_t;
+
+// Picks a random route from the node, appending its expression. Routes
+// stop at empty keys, which paths can't name.
+static void test_projection_pick(bjd_node_t node, char* expr, test_route_t* route) {
+    while (route->count < TEST_PROJECTION_MAX_STEPS && test_rand() % 4 != 0) {
+        bjd_type_t type = bjd_node_type(node);
+        if (type == bjd_type_array && bjd_node_array_length(node) > 0) {
+            size_t i = test_rand() % bjd_node_array_length(node);
+            sprintf(expr + strlen(expr), "[%i]", (int)i);
+            route->steps[route->count].key = NULL;
+            route->steps[route->count++].index = i;
+            node = bjd_node_array_at(node, i);
+        } else if (type == bjd_type_map && bjd_node_map_count(node) > 0) {
+            bjd_node_t key = bjd_node_map_key_at(node, test_rand() % bjd_node_map_count(node));
+            if (bjd_node_strlen(key) == 0)
+                break;
+            sprintf(expr + strlen(expr), "%s%.*s", *expr ? "." : "", (int)bjd_node_strlen(key), bjd_node_str(key));
+            route->steps[route->count].key = bjd_node_str(key);
+            route->steps[route->count++].length = bjd_node_strlen(key);
+            node = bjd_node_map_str(node, bjd_node_str(key), bjd_node_strlen(key));
+        } else {
+            break;
+        }
+    }
+}
+
+static bjd_node_t test_projection_follow(bjd_node_t node, const test_route_t* route) {
+    for (size_t i = 0; i < route->count; ++i) {
+        if (route->steps[i].key)
+            node = bjd_node_map_str(node, route->steps[i].key, route->steps[i].length);
+        else
+            node = bjd_node_array_at(node, route->steps[i].index);
+    }
+    return node;
+}
+
+// Writes a random message whose root is a map, an array or any value.
+static size_t test_projection_message(char* data) {
+    char* p = data;
+    uint32_t root = test_rand() % 3;
+    bool sized = test_rand() % 2 == 0;
+    uint32_t count = 1 + test_rand() % 4;
+
+    if (root == 2)
+        return (size_t)(test_random_value(p, 0) - data);
+
+    *p++ = (root == 0) ? '{' : '[';
+    if (sized) {
+        *p++ = '#';
+        *p++ = 'U';
+        *p++ = (char)count;
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        if (root == 0) {
+            memcpy(p, "SU\x02r", 4);
+            p[4] = (char)('0' + i);
+            p += 5;
+        }
+        p = test_random_value(p, 0);
+    }
+    if (!sized)
+        *p++ = (root == 0) ? '}' : ']';
+    return (size_t)(p - data);
+}
+
+// Projects random messages onto random paths, expecting the values on the
+// paths to match those of a full parse.
+static void test_projection_random(void) {
+    char* data = (char*)malloc(3 + 4 * (5 + TEST_RANDOM_VALUE_MAX_SIZE));
+    test_rand_seed(24);
+
+    for (int trial = 0; trial < 1000; ++trial) {
+        size_t size = test_projection_message(data);
+
+        bjd_tree_t full;
+        bjd_tree_init_data(&full, data, size);
+        bjd_tree_parse(&full);
+        TEST_TRUE(bjd_tree_error(&full) == bjd_ok);
+
+        size_t count = 1 + test_rand() % 3;
+        char exprs[3][256];
+        bjd_path_t paths[3];
+        test_route_t routes[3];
+        for (size_t i = 0; i < count; ++i) {
+            exprs[i][0] = '\0';
+            routes[i].count = 0;
+            test_projection_pick(bjd_tree_root(&full), exprs[i], &routes[i]);
+            TEST_ERROR_IS(bjd_path_compile(&paths[i], exprs[i]), bjd_ok);
+        }
+
+        bjd_tree_t projected;
+        bjd_tree_init_data(&projected, data, size);
+        bjd_tree_set_projection(&projected, paths, count);
+        bjd_tree_parse(&projected);
+        TEST_TRUE(bjd_tree_error(&projected) == bjd_ok);
+        TEST_TRUE(bjd_tree_size(&projected) == size);
+
+        for (size_t i = 0; i < count; ++i) {
+            bjd_node_t expected = test_projection_follow(bjd_tree_root(&full), &routes[i]);
+            bjd_node_t actual = test_projection_follow(bjd_tree_root(&projected), &routes[i]);
+            TEST_TRUE(test_node_equal(expected, actual), "path \"%s\" differs", exprs[i]);
+        }
+
+        // the projected root only has the keys on the paths
+        bjd_node_t root = bjd_tree_root(&projected);
+        if (bjd_node_type(root) == bjd_type_map) {
+            for (size_t k = 0; k < bjd_node_map_count(root); ++k) {
+                bjd_node_t key = bjd_node_map_key_at(root, k);
+                bool on_path = false;
+                for (size_t i = 0; i < count; ++i) {
+                    on_path |= routes[i].count == 0 ||
+                        (routes[i].steps[0].key && routes[i].steps[0].length == bjd_node_strlen(key) &&
+                         memcmp(routes[i].steps[0].key, bjd_node_str(key), bjd_node_strlen(key)) == 0);
+                }
+                TEST_TRUE(on_path, "key %.*s is not on any path", (int)bjd_node_strlen(key), bjd_node_str(key));
+            }
+        }
+
+        TEST_TREE_DESTROY_NOERROR(&projected);
+
+        // corrupt data fails either way
+        data[test_rand() % size] = "X[]{}#$U"[test_rand() % 8];
+        bjd_tree_t corrupt_full, corrupt_projected;
+        bjd_tree_init_data(&corrupt_full, data, size);
+        bjd_tree_parse(&corrupt_full);
+        bjd_tree_init_data(&corrupt_projected, data, size);
+        bjd_tree_set_projection(&corrupt_projected, paths, count);
+        bjd_tree_parse(&corrupt_projected);
+        TEST_TRUE((bjd_tree_error(&corrupt_full) == bjd_ok) == (bjd_tree_error(&corrupt_projected) == bjd_ok),
+                "corrupt message error %i parsed whole, %i projected",
+                (int)bjd_tree_error(&corrupt_full), (int)bjd_tree_error(&corrupt_projected));
+        bjd_tree_destroy(&corrupt_full);
+        bjd_tree_destroy(&corrupt_projected);
+        bjd_tree_destroy(&full);
+    }
+
+    free(data);
+}
+
+// {"a": {"b": [1, 2, 3, {"c": "hi"}], "x": [$U#3 7 8 9]}, "u": {"z": -3}}
+static const char test_projection_doc[] =
+    "{SU\x01" "a" "{#U\x02"
+        "SU\x01" "b" "[U\x01U\x02U\x03{SU\x01" "cSU\x02hi}]"
+        "SU\x01" "x" "[$U#U\x03\x07\x08\x09"
+    "SU\x01" "u" "{SU\x01zi\xFD}"
+    "}";
+
+static void test_projection_doc_parse(bjd_tree_t* tree, bool projected) {
+    bjd_tree_parse(tree);
+    bjd_node_t root = bjd_tree_root(tree);
+    TEST_TRUE(bjd_node_i8(bjd_node_map_cstr(bjd_node_map_cstr(root, "u"), "z")) == -3);
+    bjd_node_t a = bjd_node_map_cstr(root, "a");
+    bjd_node_t b = bjd_node_map_cstr(a, "b");
+    TEST_TRUE(bjd_node_array_length(b) == 4);
+    TEST_TRUE(bjd_node_u8(bjd_node_array_at(b, 1)) == 2);
+    TEST_TRUE(bjd_node_map_count(a) == (projected ? 1u : 2u));
+
+    // dropped elements keep their indices and dropped pairs are missing
+    bjd_type_t dropped = projected ? bjd_type_missing : bjd_type_uint;
+    TEST_TRUE(bjd_node_type(bjd_node_array_at(b, 0)) == dropped);
+    TEST_TRUE(bjd_node_type(bjd_node_array_at(b, 2)) == dropped);
+    TEST_TRUE(bjd_node_type(bjd_node_map_cstr_optional(a, "x")) ==
+            (projected ? bjd_type_missing : bjd_type_array));
+    TEST_TRUE(bjd_tree_error(tree) == bjd_ok);
+}
+
+static void test_projection_doc_cases(void) {
+    bjd_path_t paths[2];
+    bjd_path_compile(&paths[0], "a.b[1]");
+    bjd_path_compile(&paths[1], "u");
+    size_t size = sizeof(test_projection_doc) - 1;
+
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, test_projection_doc, size);
+    bjd_tree_set_projection(&tree, paths, 2);
+    test_projection_doc_parse(&tree, true);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+
+    // lazy and parallel parsing apply the projection
+    bjd_tree_init_data(&tree, test_projection_doc, size);
+    bjd_tree_set_projection(&tree, paths, 2);
+    bjd_tree_parse_lazy(&tree);
+    TEST_TRUE(bjd_node_map_count(bjd_node_map_cstr(bjd_tree_root(&tree), "a")) == 1);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+
+    bjd_tree_init_data(&tree, test_projection_doc, size);
+    bjd_tree_set_projection(&tree, paths, 2);
+    bjd_tree_parse_parallel(&tree, 4);
+    TEST_TRUE(bjd_node_map_count(bjd_node_map_cstr(bjd_tree_root(&tree), "a")) == 1);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+
+    // clearing the projection parses whole messages again
+    char twice[sizeof(test_projection_doc) * 2];
+    memcpy(twice, test_projection_doc, size);
+    memcpy(twice + size, test_projection_doc, size);
+    bjd_tree_init_data(&tree, twice, size * 2);
+    bjd_tree_set_projection(&tree, paths, 2);
+    test_projection_doc_parse(&tree, true);
+    bjd_tree_set_projection(&tree, NULL, 0);
+    test_projection_doc_parse(&tree, false);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+
+    // dropped values are still checked
+    static const char deep_key[] = "{SU\x01" "d";
+    char deep[BJDATA_SCAN_MAX_DEPTH * 2 + 16];
+    char* p = deep;
+    memcpy(p, deep_key, sizeof(deep_key) - 1);
+    p += sizeof(deep_key) - 1;
+    for (int i = 0; i <= BJDATA_SCAN_MAX_DEPTH; ++i)
+        *p++ = '[';
+    for (int i = 0; i <= BJDATA_SCAN_MAX_DEPTH; ++i)
+        *p++ = ']';
+    *p++ = '}';
+    bjd_tree_init_data(&tree, deep, (size_t)(p - deep));
+    bjd_tree_set_projection(&tree, paths, 2);
+    bjd_tree_parse(&tree);
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_too_big);
+}
+
+void test_projection(void) {
+    test_projection_random();
+    test_projection_doc_cases();
+}
+
+#endif
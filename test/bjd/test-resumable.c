@@ -0,0 +1,420 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-resumable.h"
+
+#if BJDATA_READER
+
+#define TEST_RESUMABLE_MAX_DEPTH 8
+#define TEST_RESUMABLE_LOG_SIZE (256 * 1024)
+#define TEST_RESUMABLE_MESSAGES 3
+
+// A walk through one message a read at a time, logging what it reads so
+// that walks with different readers can be compared. A read that blocks
+// leaves the walk unchanged so that it can be made again.
+typedef struct test_walk_t {
+    struct {
+        bjd_type_t type;
+        uint32_t left;
+        bool unsized;
+    } levels[TEST_RESUMABLE_MAX_DEPTH];
+    size_t depth;
+    uint32_t str_left;
+    bool done;
+} test_walk_t;
+
+typedef struct test_walk_log_t {
+    char data[TEST_RESUMABLE_LOG_SIZE];
+    size_t size;
+} test_walk_log_t;
+
+static void test_walk_log(test_walk_log_t* log, const void* data, size_t size) {
+    TEST_TRUE(log->size + size <= sizeof(log->data), "walk log is full");
+    memcpy(log->data + log->size, data, size);
+    log->size += size;
+}
+
+static void test_walk_pop(bjd_reader_t* reader, test_walk_t* walk, test_walk_log_t* log) {
+    if (walk->levels[--walk->depth].type == bjd_type_array)
+        bjd_done_array(reader);
+    else
+        bjd_done_map(reader);
+    test_walk_log(log, "]", 1);
+}
+
+// Performs one read, returning false if the reader blocked.
+static bool test_walk_step(bjd_reader_t* reader, test_walk_t* walk, test_walk_log_t* log) {
+    if (walk->str_left > 0) {
+        char bytes[5];
+        uint32_t count = (walk->str_left < sizeof(bytes)) ? walk->str_left : (uint32_t)sizeof(bytes);
+        bjd_read_bytes(reader, bytes, count);
+        if (bjd_reader_error(reader) == bjd_would_block)
+            return false;
+        test_walk_log(log, bytes, count);
+        walk->str_left -= count;
+        if (walk->str_left == 0)
+            bjd_done_str(reader);
+        walk->done = walk->depth == 0 && walk->str_left == 0;
+        return true;
+    }
+
+    if (walk->depth > 0) {
+        bool end;
+        if (walk->levels[walk->depth - 1].unsized) {
+            end = (walk->levels[walk->depth - 1].type == bjd_type_array) ?
+                    bjd_read_array_end(reader) : bjd_read_map_end(reader);
+            if (bjd_reader_error(reader) == bjd_would_block)
+                return false;
+        } else {
+            end = walk->levels[walk->depth - 1].left == 0;
+        }
+        if (end) {
+            test_walk_pop(reader, walk, log);
+            walk->done = walk->depth == 0;
+            return true;
+        }
+    }
+
+    bjd_tag_t tag = bjd_peek_tag(reader);
+    if (bjd_reader_error(reader) == bjd_would_block)
+        return false;
+    if (bjd_reader_error(reader) != bjd_ok)
+        return true;
+
+    if (tag.type == bjd_type_array && tag.elemtype != 0) {
+        // optimized arrays and ND-arrays are read whole
+        int64_t values[8];
+        size_t count = bjd_read_typed_array(reader, 'L', values, sizeof(values) / sizeof(values[0]));
+        if (bjd_reader_error(reader) == bjd_would_block)
+            return false;
+        test_walk_log(log, values, count * sizeof(values[0]));
+    } else {
+        tag = bjd_read_tag(reader);
+        if (bjd_reader_error(reader) == bjd_would_block)
+            return false;
+        test_walk_log(log, &tag.type, sizeof(tag.type));
+        test_walk_log(log, &tag.v.u, sizeof(tag.v.u));
+    }
+
+    if (walk->depth > 0 && !walk->levels[walk->depth - 1].unsized)
+        --walk->levels[walk->depth - 1].left;
+
+    if (tag.type == bjd_type_str) {
+        walk->str_left = tag.v.l;
+        if (tag.v.l == 0)
+            bjd_done_str(reader);
+    } else if ((tag.type == bjd_type_array || tag.type == bjd_type_map) && tag.elemtype == 0) {
+        TEST_TRUE(walk->depth < TEST_RESUMABLE_MAX_DEPTH);
+        walk->levels[walk->depth].type = tag.type;
+        walk->levels[walk->depth].unsized = tag.unsized;
+        walk->levels[walk->depth].left = (tag.type == bjd_type_map) ? tag.v.n * 2 : tag.v.n;
+        ++walk->depth;
+    } else if (tag.type == bjd_type_map) {
+        // an optimized map is walked like any other, its values packed
+        walk->levels[walk->depth].type = tag.type;
+        walk->levels[walk->depth].unsized = false;
+        walk->levels[walk->depth].left = tag.v.n * 2;
+        ++walk->depth;
+    }
+
+    walk->done = walk->depth == 0 && walk->str_left == 0;
+    return true;
+}
+
+// Walks the messages with a resumable reader, feeding it chunks of up to
+// max_chunk bytes whenever it blocks. Returns the final error.
+static bjd_error_t test_resumable_walk(const char* data, size_t size, size_t buffer_size,
+        size_t max_chunk, test_walk_log_t* log)
+{
+    char* buffer = (char*)malloc(buffer_size);
+    bjd_reader_t reader;
+    bjd_reader_init_resumable(&reader, buffer, buffer_size);
+    size_t fed = 0;
+    log->size = 0;
+
+    for (int message = 0; message < TEST_RESUMABLE_MESSAGES; ++message) {
+        test_walk_t walk;
+        memset(&walk, 0, sizeof(walk));
+        while (!walk.done) {
+            if (test_walk_step(&reader, &walk, log))
+                continue;
+            if (bjd_reader_error(&reader) != bjd_would_block || fed == size)
+                break;
+            size_t count = 1 + test_rand() % max_chunk;
+            if (count > size - fed)
+                count = size - fed;
+            fed += bjd_reader_feed(&reader, data + fed, count);
+        }
+        if (bjd_reader_error(&reader) != bjd_ok)
+            break;
+    }
+
+    bjd_error_t error = bjd_reader_error(&reader);
+    if (error != bjd_ok)
+        bjd_reader_flag_error(&reader, error == bjd_would_block ? bjd_error_invalid : error);
+    bjd_reader_destroy(&reader);
+    free(buffer);
+    return error;
+}
+
+static void test_resumable_random(void) {
+    static test_walk_log_t expected, actual;
+    char* data = (char*)malloc(TEST_RESUMABLE_MESSAGES * TEST_RANDOM_VALUE_MAX_SIZE);
+    test_rand_seed(25);
+
+    for (int trial = 0; trial < 1000; ++trial) {
+        char* p = data;
+        for (int message = 0; message < TEST_RESUMABLE_MESSAGES; ++message)
+            p = test_random_value(p, 0);
+        size_t size = (size_t)(p - data);
+
+        // the same reads on an in-memory reader
+        bjd_reader_t reader;
+        bjd_reader_init_data(&reader, data, size);
+        expected.size = 0;
+        for (int message = 0; message < TEST_RESUMABLE_MESSAGES; ++message) {
+            test_walk_t walk;
+            memset(&walk, 0, sizeof(walk));
+            while (!walk.done && bjd_reader_error(&reader) == bjd_ok)
+                test_walk_step(&reader, &walk, &expected);
+        }
+        TEST_READER_DESTROY_NOERROR(&reader);
+
+        TEST_ERROR_IS(test_resumable_walk(data, size, BJDATA_READER_MINIMUM_BUFFER_SIZE * 2,
+                    (size_t)(1 + trial % 9), &actual), bjd_ok);
+        TEST_TRUE(actual.size == expected.size &&
+                memcmp(actual.data, expected.data, expected.size) == 0,
+                "resumable walk of %i bytes differs", (int)size);
+    }
+
+    free(data);
+}
+
+// Each message is discarded whole, so the buffer must hold the largest one.
+static void test_resumable_discard(void) {
+    char* data = (char*)malloc(TEST_RESUMABLE_MESSAGES * TEST_RANDOM_VALUE_MAX_SIZE);
+    char* buffer = (char*)malloc(TEST_RANDOM_VALUE_MAX_SIZE);
+    test_rand_seed(26);
+
+    for (int trial = 0; trial < 200; ++trial) {
+        char* p = data;
+        for (int message = 0; message < TEST_RESUMABLE_MESSAGES; ++message)
+            p = test_random_value(p, 0);
+        size_t size = (size_t)(p - data);
+
+        bjd_reader_t reader;
+        bjd_reader_init_resumable(&reader, buffer, TEST_RANDOM_VALUE_MAX_SIZE);
+        size_t fed = 0;
+        int discarded = 0;
+        while (discarded < TEST_RESUMABLE_MESSAGES) {
+            bjd_discard(&reader);
+            if (bjd_reader_error(&reader) == bjd_ok) {
+                ++discarded;
+                continue;
+            }
+            if (bjd_reader_error(&reader) != bjd_would_block || fed == size)
+                break;
+            size_t count = 1 + test_rand() % 64;
+            if (count > size - fed)
+                count = size - fed;
+            fed += bjd_reader_feed(&reader, data + fed, count);
+        }
+        TEST_TRUE(discarded == TEST_RESUMABLE_MESSAGES);
+        TEST_TRUE(fed == size);
+        TEST_READER_DESTROY_NOERROR(&reader);
+    }
+
+    free(buffer);
+    free(data);
+}
+
+static void test_resumable_typed(void) {
+    char data[256];
+    char* p = data;
+    memcpy(p, "[$l#U\x0A", 6);
+    p += 6;
+    for (uint32_t i = 0; i < 10; ++i, p += 4)
+        bjd_store_u32_endian(p, i * 7, bjd_endian_little);
+    memcpy(p, "[$I#U\x3C", 6);
+    p += 6;
+    for (uint16_t i = 0; i < 60; ++i, p += 2)
+        bjd_store_u16_endian(p, i, bjd_endian_little);
+    size_t size = (size_t)(p - data);
+
+    char buffer[64];
+    bjd_reader_t reader;
+    bjd_reader_init_resumable(&reader, buffer, sizeof(buffer));
+    size_t fed = 0;
+
+    // a narrowing read blocks partway through and starts over
+    int8_t small[10];
+    size_t count;
+    int blocks = 0;
+    while (true) {
+        count = bjd_read_typed_array(&reader, 'i', small, 10);
+        if (bjd_reader_error(&reader) != bjd_would_block)
+            break;
+        ++blocks;
+        fed += bjd_reader_feed(&reader, data + fed, 3);
+    }
+    TEST_TRUE(bjd_reader_error(&reader) == bjd_ok);
+    TEST_TRUE(count == 10);
+    TEST_TRUE(blocks > 1);
+    TEST_TRUE(small[0] == 0 && small[9] == 63);
+
+    // an array larger than the buffer can't be read
+    int32_t large[60];
+    while (true) {
+        bjd_read_typed_array(&reader, 'l', large, 60);
+        if (bjd_reader_error(&reader) != bjd_would_block)
+            break;
+        TEST_TRUE(fed < size);
+        fed += bjd_reader_feed(&reader, data + fed, 5);
+    }
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_too_big);
+
+    // as can't bytes
+    bjd_reader_init_resumable(&reader, buffer, sizeof(buffer));
+    char bytes[100];
+    bjd_read_bytes(&reader, bytes, sizeof(bytes));
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_too_big);
+}
+
+static void test_resumable_feed(void) {
+    static const char data[] = "[#U\x02" "U\x01" "U\x02";
+    char buffer[BJDATA_READER_MINIMUM_BUFFER_SIZE];
+    bjd_reader_t reader;
+
+    // blocks with nothing fed, and is still blocked on destroy
+    bjd_reader_init_resumable(&reader, buffer, sizeof(buffer));
+    bjd_read_tag(&reader);
+    TEST_TRUE(bjd_reader_error(&reader) == bjd_would_block);
+    TEST_TRUE(bjd_reader_destroy(&reader) == bjd_would_block);
+
+    // only what fits in the buffer is copied
+    char filler[BJDATA_READER_MINIMUM_BUFFER_SIZE];
+    memset(filler, 'Z', sizeof(filler));
+    bjd_reader_init_resumable(&reader, buffer, sizeof(buffer));
+    TEST_TRUE(bjd_reader_feed(&reader, filler, sizeof(filler) - 1) == sizeof(filler) - 1);
+    TEST_TRUE(bjd_reader_feed(&reader, data, sizeof(data) - 1) == 1);
+
+    // reading makes room for the rest
+    for (int i = 0; i < 7; ++i)
+        TEST_TRUE(bjd_read_tag(&reader).type == bjd_type_nil);
+    TEST_TRUE(bjd_reader_feed(&reader, data + 1, sizeof(data) - 2) == sizeof(data) - 2);
+    TEST_TRUE(bjd_reader_feed(&reader, data, sizeof(data) - 1) == 0);
+    for (size_t i = 7; i < sizeof(filler) - 1; ++i)
+        TEST_TRUE(bjd_read_tag(&reader).type == bjd_type_nil);
+    TEST_TRUE(bjd_read_tag(&reader).v.n == 2);
+    TEST_TRUE(bjd_read_tag(&reader).v.u == 1);
+    TEST_TRUE(bjd_read_tag(&reader).v.u == 2);
+    bjd_done_array(&reader);
+    TEST_READER_DESTROY_NOERROR(&reader);
+
+    // nothing is copied once an error is flagged
+    bjd_reader_init_resumable(&reader, buffer, sizeof(buffer));
+    bjd_reader_flag_error(&reader, bjd_error_data);
+    TEST_TRUE(bjd_reader_feed(&reader, data, sizeof(data) - 1) == 0);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_data);
+}
+
+#if BJDATA_EXPECT
+// Makes an Expect call, feeding one byte whenever it blocks until it
+// completes.
+#define TEST_RESUMABLE_EXPECT(call) do {                                 \
+    while (true) {                                                      \
+        call;                                                           \
+        if (bjd_reader_error(&reader) != bjd_would_block)               \
+            break;                                                      \
+        ++blocks;                                                       \
+        TEST_TRUE(fed < sizeof(data) - 1);                              \
+        fed += bjd_reader_feed(&reader, data + fed, 1);                 \
+    }                                                                   \
+    TEST_TRUE(bjd_reader_error(&reader) == bjd_ok);                     \
+} while (0)
+
+// Expect functions that read a string along with its tag start over if
+// they block partway.
+static void test_resumable_expect(void) {
+    static const char data[] = "[#U\x07" "SU\x05" "hello" "SU\x05" "world" "SU\x03" "abc"
+            "SU\x04" "blue" "SU\x05" "green" "SU\x03" "key" "SU\x01" "b";
+    static const char* colors[] = {"red", "green", "blue"};
+    static const char* keys[] = {"a", "b"};
+    bjd_keyset_t keyset;
+    bjd_keyset_init(&keyset, colors, 3);
+
+    char buffer[BJDATA_READER_MINIMUM_BUFFER_SIZE];
+    bjd_reader_t reader;
+    bjd_reader_init_resumable(&reader, buffer, sizeof(buffer));
+    size_t fed = 0;
+    int blocks = 0;
+
+    uint32_t count = 0;
+    TEST_RESUMABLE_EXPECT(count = bjd_expect_array(&reader));
+    TEST_TRUE(count == 7);
+
+    char str[16];
+    size_t length = 0;
+    TEST_RESUMABLE_EXPECT(length = bjd_expect_str_buf(&reader, str, sizeof(str)));
+    TEST_TRUE(length == 5 && memcmp(str, "hello", 5) == 0);
+
+    #ifdef BJDATA_MALLOC
+    char* heap = NULL;
+    TEST_RESUMABLE_EXPECT(heap = bjd_expect_cstr_alloc(&reader, 16));
+    TEST_TRUE(heap != NULL && strcmp(heap, "world") == 0);
+    BJDATA_FREE(heap);
+    #else
+    TEST_RESUMABLE_EXPECT(bjd_expect_cstr(&reader, str, sizeof(str)));
+    TEST_TRUE(strcmp(str, "world") == 0);
+    #endif
+
+    TEST_RESUMABLE_EXPECT(bjd_expect_utf8_cstr(&reader, str, sizeof(str)));
+    TEST_TRUE(strcmp(str, "abc") == 0);
+
+    size_t index = 0;
+    TEST_RESUMABLE_EXPECT(index = bjd_expect_enum(&reader, colors, 3));
+    TEST_TRUE(index == 2);
+    TEST_RESUMABLE_EXPECT(index = bjd_expect_enum_keyset(&reader, &keyset));
+    TEST_TRUE(index == 1);
+    TEST_RESUMABLE_EXPECT(bjd_expect_str_match(&reader, "key", 3));
+
+    bool found[2] = {false, false};
+    TEST_RESUMABLE_EXPECT(index = bjd_expect_key_cstr(&reader, keys, found, 2));
+    TEST_TRUE(index == 1 && found[1] && !found[0]);
+
+    bjd_done_array(&reader);
+    TEST_TRUE(fed == sizeof(data) - 1);
+    TEST_TRUE(blocks >= (int)fed);
+    TEST_READER_DESTROY_NOERROR(&reader);
+}
+#endif
+
+void test_resumable(void) {
+    test_resumable_random();
+    test_resumable_discard();
+    test_resumable_typed();
+    test_resumable_feed();
+    #if BJDATA_EXPECT
+    test_resumable_expect();
+    #endif
+}
+
+#endif
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-skip-index.h"
+
+#if BJDATA_READER && defined(BJDATA_MALLOC)
+
+#define TEST_SKIP_INDEX_MESSAGES 200
+#define TEST_SKIP_INDEX_LARGE_COUNT 200
+
+// A source that also counts the bytes skipped without being read.
+typedef struct test_skip_source_t {
+    test_source_t source; // must be first for test_source_fill()
+    size_t skipped;
+} test_skip_source_t;
+
+static void test_skip_index_skip(bjd_reader_t* reader, size_t count) {
+    test_skip_source_t* skip_source = (test_skip_source_t*)bjd_reader_context(reader);
+    test_source_t* source = &skip_source->source;
+    if (count > source->size - source->pos) {
+        bjd_reader_flag_error(reader, bjd_error_io);
+        return;
+    }
+    source->pos += count;
+    skip_source->skipped += count;
+}
+
+// Writes a series of random messages, every twentieth of which is a large
+// unsized array.
+static size_t test_skip_index_messages(char* data) {
+    char* p = data;
+    for (int m = 0; m < TEST_SKIP_INDEX_MESSAGES; ++m) {
+        if (m % 20 == 0) {
+            *p++ = '[';
+            for (int i = 0; i < TEST_SKIP_INDEX_LARGE_COUNT; ++i)
+                p = test_random_value(p, 1);
+            *p++ = ']';
+        } else {
+            p = test_random_value(p, 0);
+        }
+    }
+    return (size_t)(p - data);
+}
+
+// Each entry is a container that ends where the index says.
+static void test_skip_index_entries(const char* data, size_t size, const bjd_skip_index_t* index, size_t min_size) {
+    bool valid = true;
+    for (size_t i = 0; i < index->count; ++i) {
+        const bjd_skip_entry_t* entry = &index->entries[i];
+        valid &= entry->start < entry->end && entry->end <= size;
+        valid &= entry->end - entry->start >= min_size;
+        valid &= i == 0 || index->entries[i - 1].start < entry->start;
+        if (!valid)
+            break;
+        valid &= data[entry->start] == '[' || data[entry->start] == '{';
+
+        bjd_reader_t reader;
+        bjd_reader_init_data(&reader, data + entry->start, size - (size_t)entry->start);
+        bjd_discard(&reader);
+        valid &= bjd_reader_remaining(&reader, NULL) == size - (size_t)entry->end;
+        valid &= bjd_reader_destroy(&reader) == bjd_ok;
+    }
+    TEST_TRUE(valid, "invalid skip index with minimum size %i", (int)min_size);
+}
+
+// Discards all messages from a reader that fills in small chunks, returning
+// the number of bytes skipped rather than read.
+static size_t test_skip_index_discard(const char* data, size_t size, const bjd_skip_index_t* index, bool skip) {
+    char buffer[256];
+    test_skip_source_t skip_source = {{data, size, 0, 0}, 0};
+    bjd_reader_t reader;
+    test_reader_init_source(&reader, buffer, sizeof(buffer), &skip_source.source);
+    if (skip)
+        bjd_reader_set_skip(&reader, test_skip_index_skip);
+    bjd_reader_set_skip_index(&reader, index);
+
+    for (int m = 0; m < TEST_SKIP_INDEX_MESSAGES; ++m)
+        bjd_discard(&reader);
+    TEST_TRUE(skip_source.source.pos == size && bjd_reader_remaining(&reader, NULL) == 0,
+            "messages were not discarded exactly");
+    TEST_READER_DESTROY_NOERROR(&reader);
+    return skip_source.skipped;
+}
+
+#if BJDATA_EXPECT
+// Reads the elements of a large array, discarding each of them.
+static void test_skip_index_partial(const char* data, size_t size, const bjd_skip_index_t* index) {
+    bjd_reader_t reader;
+    bjd_reader_init_data(&reader, data, size);
+    bjd_reader_set_skip_index(&reader, index);
+
+    bjd_expect_array_unsized(&reader);
+    size_t count = 0;
+    while (!bjd_read_array_end(&reader)) {
+        bjd_discard(&reader);
+        ++count;
+    }
+    bjd_done_array(&reader);
+    TEST_TRUE(count == TEST_SKIP_INDEX_LARGE_COUNT);
+
+    for (int m = 1; m < TEST_SKIP_INDEX_MESSAGES; ++m)
+        bjd_discard(&reader);
+    TEST_TRUE(bjd_reader_remaining(&reader, NULL) == 0);
+    TEST_READER_DESTROY_NOERROR(&reader);
+}
+#endif
+
+static void test_skip_index_errors(void) {
+    bjd_skip_index_t index;
+
+    static const char truncated[] = "[U\x01[U\x02";
+    TEST_ERROR_IS(bjd_skip_index_build(&index, truncated, sizeof(truncated) - 1, bjd_endian_little, 0),
+            bjd_error_invalid);
+
+    char deep[BJDATA_SCAN_MAX_DEPTH * 2 + 2];
+    for (size_t i = 0; i < sizeof(deep) / 2; ++i) {
+        deep[i] = '[';
+        deep[sizeof(deep) - 1 - i] = ']';
+    }
+    TEST_ERROR_IS(bjd_skip_index_build(&index, deep, sizeof(deep), bjd_endian_little, 0),
+            bjd_error_too_big);
+
+    // nesting up to the limit is fine
+    TEST_ERROR_IS(bjd_skip_index_build(&index, deep + 1, sizeof(deep) - 2, bjd_endian_little, 0),
+            bjd_ok);
+    TEST_TRUE(index.count == BJDATA_SCAN_MAX_DEPTH);
+    bjd_skip_index_destroy(&index);
+}
+
+void test_skip_index(void) {
+    static const size_t min_sizes[] = {0, 64, 1024, SIZE_MAX};
+
+    size_t capacity = (TEST_SKIP_INDEX_MESSAGES / 20) * (TEST_SKIP_INDEX_LARGE_COUNT + 1) * TEST_RANDOM_VALUE_MAX_SIZE +
+        TEST_SKIP_INDEX_MESSAGES * TEST_RANDOM_VALUE_MAX_SIZE;
+    char* data = (char*)malloc(capacity);
+    test_rand_seed(21);
+    size_t size = test_skip_index_messages(data);
+
+    size_t unindexed = test_skip_index_discard(data, size, NULL, true);
+
+    for (size_t i = 0; i < sizeof(min_sizes) / sizeof(min_sizes[0]); ++i) {
+        size_t min_size = min_sizes[i];
+        bjd_skip_index_t index;
+        TEST_ERROR_IS(bjd_skip_index_build(&index, data, size, bjd_endian_little, min_size), bjd_ok);
+        test_skip_index_entries(data, size, &index, min_size);
+        if (min_size <= 1024)
+            TEST_TRUE(index.count >= TEST_SKIP_INDEX_MESSAGES / 20);
+
+        // indexed containers are skipped without being read
+        test_skip_index_discard(data, size, &index, false);
+        size_t skipped = test_skip_index_discard(data, size, &index, true);
+        if (index.count > 0)
+            TEST_TRUE(skipped > unindexed, "%i bytes skipped with index, %i without",
+                    (int)skipped, (int)unindexed);
+
+        #if BJDATA_EXPECT
+        test_skip_index_partial(data, size, &index);
+        #endif
+
+        // a sidecar index is not owned by the reader or the index
+        bjd_skip_entry_t* entries = (bjd_skip_entry_t*)malloc(sizeof(bjd_skip_entry_t) * (index.count + 1));
+        if (index.count > 0)
+            memcpy(entries, index.entries, sizeof(bjd_skip_entry_t) * index.count);
+        bjd_skip_index_t sidecar;
+        memset(&sidecar, 0, sizeof(sidecar));
+        sidecar.entries = entries;
+        sidecar.count = index.count;
+        test_skip_index_discard(data, size, &sidecar, true);
+        free(entries);
+
+        bjd_skip_index_destroy(&index);
+    }
+
+    test_skip_index_errors();
+    free(data);
+}
+
+#endif
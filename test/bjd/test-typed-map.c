@@ -0,0 +1,234 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-typed-map.h"
+
+// {"x": 7, "y": 8} with uint8 values, followed by true. The keys of an
+// optimized map have no 'S' marker.
+static const char test_typed_map_u8[] = "{$U#U\x02" "U\x01x\x07" "U\x01y\x08" "T";
+
+// {"a": -1.5, "bb": 2.0} with float64 values in little endian
+static const char test_typed_map_f64[] = "{$D#U\x02"
+        "U\x01" "a" "\x00\x00\x00\x00\x00\x00\xF8\xBF"
+        "U\x02" "bb" "\x00\x00\x00\x00\x00\x00\x00\x40";
+
+#if BJDATA_READER
+static void test_typed_map_reader(void) {
+    bjd_reader_t reader;
+    bjd_reader_init_data(&reader, test_typed_map_u8, sizeof(test_typed_map_u8) - 1);
+
+    bjd_tag_t tag = bjd_read_tag(&reader);
+    TEST_TRUE(bjd_tag_type(&tag) == bjd_type_map);
+    TEST_TRUE(bjd_tag_map_count(&tag) == 2);
+
+    // each packed value is read as an ordinary tag after its key
+    const char* keys[] = {"x", "y"};
+    for (size_t i = 0; i < 2; ++i) {
+        tag = bjd_read_tag(&reader);
+        TEST_TRUE(bjd_tag_type(&tag) == bjd_type_str);
+        TEST_TRUE(bjd_tag_str_length(&tag) == 1);
+        const char* key = bjd_read_bytes_inplace(&reader, 1);
+        TEST_TRUE(key != NULL && key[0] == keys[i][0]);
+        bjd_done_str(&reader);
+
+        tag = bjd_read_tag(&reader);
+        TEST_TRUE(bjd_tag_type(&tag) == bjd_type_uint);
+        TEST_TRUE(bjd_tag_uint_value(&tag) == 7 + i);
+    }
+    bjd_done_map(&reader);
+
+    tag = bjd_read_tag(&reader);
+    TEST_TRUE(bjd_tag_type(&tag) == bjd_type_bool && bjd_tag_bool_value(&tag));
+    TEST_READER_DESTROY_NOERROR(&reader);
+
+    // the map is discarded as a whole
+    bjd_reader_init_data(&reader, test_typed_map_u8, sizeof(test_typed_map_u8) - 1);
+    bjd_discard(&reader);
+    tag = bjd_read_tag(&reader);
+    TEST_TRUE(bjd_tag_type(&tag) == bjd_type_bool);
+    TEST_READER_DESTROY_NOERROR(&reader);
+}
+#endif
+
+#if BJDATA_EXPECT
+static void test_typed_map_expect(void) {
+    bjd_reader_t reader;
+    char key[8];
+
+    bjd_reader_init_data(&reader, test_typed_map_f64, sizeof(test_typed_map_f64) - 1);
+    TEST_TRUE(bjd_expect_typed_map_max(&reader, 'D', 4) == 2);
+    bjd_expect_cstr(&reader, key, sizeof(key));
+    TEST_TRUE(strcmp(key, "a") == 0);
+    TEST_TRUE(bjd_expect_double(&reader) == -1.5);
+    bjd_expect_cstr(&reader, key, sizeof(key));
+    TEST_TRUE(strcmp(key, "bb") == 0);
+    TEST_TRUE(bjd_expect_double(&reader) == 2.0);
+    bjd_done_map(&reader);
+    TEST_READER_DESTROY_NOERROR(&reader);
+
+    // the wrong value marker
+    bjd_reader_init_data(&reader, test_typed_map_f64, sizeof(test_typed_map_f64) - 1);
+    TEST_TRUE(bjd_expect_typed_map_max(&reader, 'd', 4) == 0);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_type);
+
+    // too many pairs
+    bjd_reader_init_data(&reader, test_typed_map_f64, sizeof(test_typed_map_f64) - 1);
+    TEST_TRUE(bjd_expect_typed_map_max(&reader, 'D', 1) == 0);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_type);
+
+    // packed values are still range checked
+    bjd_reader_init_data(&reader, "{$u#U\x01U\x01z\x00\x01", 11);
+    TEST_TRUE(bjd_expect_typed_map_max(&reader, 'u', 1) == 1);
+    bjd_expect_cstr(&reader, key, sizeof(key));
+    TEST_TRUE(bjd_expect_u8(&reader) == 0);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_type);
+}
+#endif
+
+#if BJDATA_NODE
+static void test_typed_map_node(void) {
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, test_typed_map_f64, sizeof(test_typed_map_f64) - 1);
+    bjd_tree_parse(&tree);
+    bjd_node_t root = bjd_tree_root(&tree);
+
+    TEST_TRUE(bjd_node_map_count(root) == 2);
+    bjd_node_t a = bjd_node_map_cstr(root, "a");
+    bjd_node_t bb = bjd_node_map_cstr(root, "bb");
+    TEST_TRUE(bjd_node_double(a) == -1.5);
+    TEST_TRUE(bjd_node_double(bb) == 2.0);
+    TEST_TRUE(bjd_node_type(bb) == bjd_type_double);
+    TEST_TRUE(bjd_node_double(bjd_node_map_value_at(root, 0)) == -1.5);
+    TEST_TRUE(bjd_node_data_len(bjd_node_map_key_at(root, 1)) == 2);
+    TEST_TRUE(bjd_node_map_contains_cstr(root, "bb"));
+    TEST_TRUE(!bjd_node_map_contains_cstr(root, "c"));
+    TEST_TRUE(bjd_node_is_missing(bjd_node_map_cstr_optional(root, "c")));
+    TEST_TREE_DESTROY_NOERROR(&tree);
+
+    // a missing key
+    bjd_tree_init_data(&tree, test_typed_map_f64, sizeof(test_typed_map_f64) - 1);
+    bjd_tree_parse(&tree);
+    TEST_TRUE(bjd_node_is_nil(bjd_node_map_cstr(bjd_tree_root(&tree), "c")));
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_data);
+
+    // a truncated value
+    bjd_tree_init_data(&tree, test_typed_map_f64, sizeof(test_typed_map_f64) - 2);
+    bjd_tree_parse(&tree);
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_invalid);
+
+    // a key with an 'S' marker
+    static const char marked_key[] = "{$U#U\x01" "SU\x01x\x07";
+    bjd_tree_init_data(&tree, marked_key, sizeof(marked_key) - 1);
+    bjd_tree_parse(&tree);
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_invalid);
+}
+#endif
+
+#if BJDATA_WRITER
+static void test_typed_map_writer(void) {
+    char* data;
+    size_t size;
+    bjd_writer_t writer;
+    uint16_t value = 0x1234;
+
+    // the header, then each key without an 'S' marker followed by its value
+    // packed with no marker
+    bjd_writer_init_growable(&writer, &data, &size);
+    bjd_start_typed_map(&writer, 'u', 2);
+    bjd_write_typed_map_key_cstr(&writer, "a");
+    bjd_write_typed_map_value(&writer, 'u', &value);
+    bjd_write_typed_map_key(&writer, "bc", 2);
+    value = 7;
+    bjd_write_typed_map_value(&writer, 'u', &value);
+    bjd_finish_map(&writer);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    TEST_BYTES_EQUAL(data, size, "{$u#U\x02" "U\x01" "a\x34\x12" "U\x02" "bc\x07\x00");
+
+    #if BJDATA_NODE
+    // the output parses back to the same map
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, data, size);
+    bjd_tree_parse(&tree);
+    bjd_node_t root = bjd_tree_root(&tree);
+    TEST_TRUE(bjd_node_map_count(root) == 2);
+    TEST_TRUE(bjd_node_u16(bjd_node_map_cstr(root, "a")) == 0x1234);
+    TEST_TRUE(bjd_node_u16(bjd_node_map_cstr(root, "bc")) == 7);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+    #endif
+    BJDATA_FREE(data);
+
+    char buffer[64];
+    bjd_writer_init(&writer, buffer, sizeof(buffer));
+    TEST_BREAK((bjd_start_typed_map(&writer, 'S', 1), true));
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_bug);
+
+    // a value marker that does not match the map
+    bjd_writer_init(&writer, buffer, sizeof(buffer));
+    bjd_start_typed_map(&writer, 'u', 1);
+    bjd_write_typed_map_key_cstr(&writer, "a");
+    TEST_BREAK((bjd_write_typed_map_value(&writer, 'm', &value), true));
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_bug);
+
+    // a value outside of a typed map
+    bjd_writer_init(&writer, buffer, sizeof(buffer));
+    TEST_BREAK((bjd_write_typed_map_value(&writer, 'u', &value), true));
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_bug);
+
+    // a key outside of a typed map
+    bjd_writer_init(&writer, buffer, sizeof(buffer));
+    TEST_BREAK((bjd_write_typed_map_key_cstr(&writer, "a"), true));
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_bug);
+
+    // a value after the typed map has been closed
+    bjd_writer_init(&writer, buffer, sizeof(buffer));
+    bjd_start_array(&writer, 2);
+    bjd_start_typed_map(&writer, 'u', 1);
+    bjd_write_typed_map_key_cstr(&writer, "a");
+    bjd_write_typed_map_value(&writer, 'u', &value);
+    bjd_finish_map(&writer);
+    TEST_BREAK((bjd_write_typed_map_value(&writer, 'u', &value), true));
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_bug);
+
+    // and a key
+    bjd_writer_init(&writer, buffer, sizeof(buffer));
+    bjd_start_array(&writer, 2);
+    bjd_start_typed_map(&writer, 'u', 0);
+    bjd_finish_map(&writer);
+    TEST_BREAK((bjd_write_typed_map_key_cstr(&writer, "a"), true));
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_bug);
+}
+#endif
+
+void test_typed_map(void) {
+    #if BJDATA_READER
+    test_typed_map_reader();
+    #endif
+    #if BJDATA_EXPECT
+    test_typed_map_expect();
+    #endif
+    #if BJDATA_NODE
+    test_typed_map_node();
+    #endif
+    #if BJDATA_WRITER
+    test_typed_map_writer();
+    #endif
+}
+
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-typed-node.h"
+
+#if BJDATA_NODE && BJDATA_WRITER
+
+static void test_typed_node_payload(void) {
+    static const char data[] = "[$u#U\x03\x01\x00\x02\x00\xFF\xFF";
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, data, sizeof(data) - 1);
+    bjd_tree_parse(&tree);
+    bjd_node_t root = bjd_tree_root(&tree);
+
+    TEST_TRUE(bjd_node_type(root) == bjd_type_array);
+    TEST_TRUE(bjd_node_array_length(root) == 3);
+    TEST_TRUE(bjd_node_typed_array_type(root) == 'u');
+
+    // the payload is referenced in place
+    TEST_TRUE(bjd_node_typed_array_data(root) == data + 6);
+
+    TEST_TRUE(bjd_node_u16(bjd_node_array_at(root, 0)) == 1);
+    TEST_TRUE(bjd_node_u16(bjd_node_array_at(root, 1)) == 2);
+    TEST_TRUE(bjd_node_u16(bjd_node_array_at(root, 2)) == 0xFFFF);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+
+    // the same payload in big endian
+    bjd_tree_init_data(&tree, data, sizeof(data) - 1);
+    bjd_tree_set_endian(&tree, bjd_endian_big);
+    bjd_tree_parse(&tree);
+    root = bjd_tree_root(&tree);
+    TEST_TRUE(bjd_node_u16(bjd_node_array_at(root, 0)) == 0x100);
+    TEST_TRUE(bjd_node_u16(bjd_node_array_at(root, 1)) == 0x200);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+
+    // an out of bounds index
+    bjd_tree_init_data(&tree, data, sizeof(data) - 1);
+    bjd_tree_parse(&tree);
+    TEST_TRUE(bjd_node_is_nil(bjd_node_array_at(bjd_tree_root(&tree), 3)));
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_data);
+
+    // an ordinary array has no payload
+    bjd_tree_init_data(&tree, "[#U\x01U\x05", 6);
+    bjd_tree_parse(&tree);
+    root = bjd_tree_root(&tree);
+    TEST_TRUE(bjd_node_typed_array_type(root) == 0);
+    TEST_TRUE(bjd_node_u8(bjd_node_array_at(root, 0)) == 5);
+    TEST_TRUE(bjd_node_typed_array_data(root) == NULL);
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_type);
+}
+
+// Element nodes are created in the tree on first access, so handles to
+// different elements can be used together and handles stay two pointers.
+static void test_typed_node_handles(void) {
+    TEST_TRUE(sizeof(bjd_node_t) == 2 * sizeof(void*));
+
+    static const char data[] = "[#U\x02" "[$U#U\x03\x01\x02\x03" "[$D#U\x02"
+            "\x00\x00\x00\x00\x00\x00\xF0\x3F" "\x00\x00\x00\x00\x00\x00\x00\xC0";
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, data, sizeof(data) - 1);
+    bjd_tree_parse(&tree);
+    bjd_node_t root = bjd_tree_root(&tree);
+
+    bjd_node_t bytes = bjd_node_array_at(root, 0);
+    bjd_node_t doubles = bjd_node_array_at(root, 1);
+    bjd_node_t b0 = bjd_node_array_at(bytes, 0);
+    bjd_node_t b2 = bjd_node_array_at(bytes, 2);
+    bjd_node_t d0 = bjd_node_array_at(doubles, 0);
+    bjd_node_t d1 = bjd_node_array_at(doubles, 1);
+
+    TEST_TRUE(bjd_node_u8(b0) == 1);
+    TEST_TRUE(bjd_node_u8(b2) == 3);
+    TEST_TRUE(bjd_node_double(d0) == 1.0);
+    TEST_TRUE(bjd_node_double(d1) == -2.0);
+    TEST_TRUE(bjd_node_type(b0) == bjd_type_uint);
+    TEST_TRUE(bjd_node_type(d1) == bjd_type_double);
+
+    // each element is decoded once
+    TEST_TRUE(bjd_node_array_at(bytes, 2).data == b2.data);
+
+    // an element of the wrong type
+    TEST_TRUE(bjd_node_u8(d0) == 0);
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_type);
+}
+
+// Reads elements directly from the payload without creating nodes.
+static void test_typed_node_direct(void) {
+    static const char data[] = "[#U\x03" "[$i#U\x02\x01\xFE" "[$d#U\x01\x00\x00\xC0\x3F"
+            "[$M#U\x01\xFF\xFF\xFF\xFF\xFF\xFF\xFF\xFF";
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, data, sizeof(data) - 1);
+    bjd_tree_parse(&tree);
+    bjd_node_t root = bjd_tree_root(&tree);
+    bjd_node_t ints = bjd_node_array_at(root, 0);
+    bjd_node_t floats = bjd_node_array_at(root, 1);
+    bjd_node_t big = bjd_node_array_at(root, 2);
+
+    TEST_TRUE(bjd_node_typed_array_i64_at(ints, 0) == 1);
+    TEST_TRUE(bjd_node_typed_array_i64_at(ints, 1) == -2);
+    TEST_TRUE(bjd_node_typed_array_u64_at(ints, 0) == 1);
+    TEST_TRUE(bjd_node_typed_array_double_at(ints, 1) == -2.0);
+    TEST_TRUE(bjd_node_typed_array_double_at(floats, 0) == 1.5);
+    TEST_TRUE(bjd_node_typed_array_u64_at(big, 0) == UINT64_MAX);
+    #ifdef BJDATA_MALLOC
+    TEST_TRUE(tree.index_count == 0);
+    #endif
+    TEST_TREE_DESTROY_NOERROR(&tree);
+
+    // a negative element read as unsigned
+    bjd_tree_init_data(&tree, data, sizeof(data) - 1);
+    bjd_tree_parse(&tree);
+    ints = bjd_node_array_at(bjd_tree_root(&tree), 0);
+    TEST_TRUE(bjd_node_typed_array_u64_at(ints, 1) == 0);
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_type);
+
+    // a float element read as an integer
+    bjd_tree_init_data(&tree, data, sizeof(data) - 1);
+    bjd_tree_parse(&tree);
+    floats = bjd_node_array_at(bjd_tree_root(&tree), 1);
+    TEST_TRUE(bjd_node_typed_array_i64_at(floats, 0) == 0);
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_type);
+
+    // an out of bounds index
+    bjd_tree_init_data(&tree, data, sizeof(data) - 1);
+    bjd_tree_parse(&tree);
+    ints = bjd_node_array_at(bjd_tree_root(&tree), 0);
+    TEST_TRUE(bjd_node_typed_array_i64_at(ints, 2) == 0);
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_data);
+
+    // an ordinary array
+    bjd_tree_init_data(&tree, data, sizeof(data) - 1);
+    bjd_tree_parse(&tree);
+    TEST_TRUE(bjd_node_typed_array_double_at(bjd_tree_root(&tree), 0) == 0.0);
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_type);
+}
+
+// Compares every element of typed arrays of random values with the values
+// written.
+static void test_typed_node_elements(bjd_endian_t endian) {
+    enum { count = 257 };
+    uint8_t u8[count];
+    int16_t i16[count];
+    uint32_t u32[count];
+    int64_t i64[count];
+    float f32[count];
+    for (size_t i = 0; i < count; ++i) {
+        u8[i] = (uint8_t)test_rand();
+        i16[i] = (int16_t)test_rand();
+        u32[i] = test_rand();
+        i64[i] = (int64_t)(((uint64_t)test_rand() << 32) | test_rand());
+        f32[i] = (float)(int32_t)test_rand() / 8.0f;
+    }
+
+    char* data;
+    size_t size;
+    bjd_writer_t writer;
+    bjd_writer_init_growable(&writer, &data, &size);
+    bjd_writer_set_endian(&writer, endian);
+    bjd_start_array_unsized(&writer);
+    bjd_write_u8_array(&writer, u8, count);
+    bjd_write_i16_array(&writer, i16, count);
+    bjd_write_u32_array(&writer, u32, count);
+    bjd_write_i64_array(&writer, i64, count);
+    bjd_write_f32_array(&writer, f32, count);
+    bjd_finish_array_unsized(&writer);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, data, size);
+    bjd_tree_set_endian(&tree, endian);
+    bjd_tree_parse(&tree);
+    bjd_node_t root = bjd_tree_root(&tree);
+
+    bool match = true;
+    for (size_t i = 0; i < count; ++i) {
+        match &= bjd_node_u8(bjd_node_array_at(bjd_node_array_at(root, 0), i)) == u8[i];
+        match &= bjd_node_i16(bjd_node_array_at(bjd_node_array_at(root, 1), i)) == i16[i];
+        match &= bjd_node_u32(bjd_node_array_at(bjd_node_array_at(root, 2), i)) == u32[i];
+        match &= bjd_node_i64(bjd_node_array_at(bjd_node_array_at(root, 3), i)) == i64[i];
+        match &= bjd_node_float(bjd_node_array_at(bjd_node_array_at(root, 4), i)) == f32[i];
+    }
+    TEST_TRUE(match, "elements do not match in %s endian", endian == bjd_endian_big ? "big" : "little");
+    TEST_TRUE(bjd_node_typed_array_type(bjd_node_array_at(root, 3)) == 'L');
+    TEST_TREE_DESTROY_NOERROR(&tree);
+    BJDATA_FREE(data);
+}
+
+void test_typed_node(void) {
+    test_typed_node_payload();
+    test_typed_node_handles();
+    test_typed_node_direct();
+    test_typed_node_elements(bjd_endian_little);
+    test_typed_node_elements(bjd_endian_big);
+}
+
+#endif
+
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-typed-read.h"
+
+#if BJDATA_EXPECT && BJDATA_WRITER
+
+#define TEST_TYPED_COUNT 600
+
+static const char test_typed_markers[] = {'U', 'i', 'u', 'I', 'm', 'l', 'M', 'L', 'd', 'D'};
+
+static void test_typed_store(char marker, void* out, size_t i, int64_t value) {
+    switch (marker) {
+        case 'U': ((uint8_t*)out)[i] = (uint8_t)value; break;
+        case 'i': ((int8_t*)out)[i] = (int8_t)value; break;
+        case 'u': ((uint16_t*)out)[i] = (uint16_t)value; break;
+        case 'I': ((int16_t*)out)[i] = (int16_t)value; break;
+        case 'm': ((uint32_t*)out)[i] = (uint32_t)value; break;
+        case 'l': ((int32_t*)out)[i] = (int32_t)value; break;
+        case 'M': ((uint64_t*)out)[i] = (uint64_t)value; break;
+        case 'L': ((int64_t*)out)[i] = (int64_t)value; break;
+        case 'd': ((float*)out)[i] = (float)value; break;
+        case 'D': ((double*)out)[i] = (double)value; break;
+        default: TEST_TRUE(false, "bad marker %c", marker); break;
+    }
+}
+
+static double test_typed_load(char marker, const void* in, size_t i) {
+    switch (marker) {
+        case 'U': return ((const uint8_t*)in)[i];
+        case 'i': return ((const int8_t*)in)[i];
+        case 'u': return ((const uint16_t*)in)[i];
+        case 'I': return ((const int16_t*)in)[i];
+        case 'm': return ((const uint32_t*)in)[i];
+        case 'l': return ((const int32_t*)in)[i];
+        case 'M': return (double)((const uint64_t*)in)[i];
+        case 'L': return (double)((const int64_t*)in)[i];
+        case 'd': return ((const float*)in)[i];
+        case 'D': return ((const double*)in)[i];
+        default: TEST_TRUE(false, "bad marker %c", marker); return 0;
+    }
+}
+
+static bool test_typed_is_float(char marker) {
+    return marker == 'd' || marker == 'D';
+}
+
+// Returns a value that fits in every element type.
+static int64_t test_typed_small_value(void) {
+    return (int64_t)(test_rand() % 128);
+}
+
+// Writes a typed array of the source marker and reads it back as the
+// destination marker from contiguous data and from a fill function with
+// the given byte order, comparing every element.
+static void test_typed_read_convert(char src, char dest, bjd_endian_t endian) {
+    static char values[TEST_TYPED_COUNT * 8];
+    static char out[TEST_TYPED_COUNT * 8];
+    int64_t expected[TEST_TYPED_COUNT];
+    size_t count = test_rand() % TEST_TYPED_COUNT;
+    for (size_t i = 0; i < count; ++i) {
+        expected[i] = test_typed_small_value();
+        test_typed_store(src, values, i, expected[i]);
+    }
+
+    char* data;
+    size_t size;
+    bjd_writer_t writer;
+    bjd_writer_init_growable(&writer, &data, &size);
+    bjd_writer_set_endian(&writer, endian);
+    bjd_write_typed_array(&writer, src, values, count);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+
+    for (int fill = 0; fill < 2; ++fill) {
+        bjd_reader_t reader;
+        char buffer[BJDATA_READER_MINIMUM_BUFFER_SIZE * 2];
+        test_source_t source = {data, size, 0, 0};
+        if (fill)
+            test_reader_init_source(&reader, buffer, sizeof(buffer), &source);
+        else
+            bjd_reader_init_data(&reader, data, size);
+        bjd_reader_set_endian(&reader, endian);
+
+        memset(out, 0, sizeof(out));
+        size_t read = bjd_read_typed_array(&reader, dest, out, TEST_TYPED_COUNT);
+        TEST_READER_DESTROY_NOERROR(&reader);
+        TEST_TRUE(read == count, "read %i elements instead of %i from %c to %c",
+                (int)read, (int)count, src, dest);
+
+        bool match = true;
+        for (size_t i = 0; i < count && read == count; ++i)
+            match &= test_typed_load(dest, out, i) == (double)expected[i];
+        TEST_TRUE(match, "elements do not match reading %c as %c in %s endian with%s fill",
+                src, dest, endian == bjd_endian_big ? "big" : "little", fill ? "" : "out");
+    }
+
+    BJDATA_FREE(data);
+}
+
+// Reads full-range values of each type back into the same type.
+static void test_typed_read_same(char marker) {
+    static char values[TEST_TYPED_COUNT * 8];
+    static char out[TEST_TYPED_COUNT * 8];
+    size_t count = TEST_TYPED_COUNT;
+    size_t elem = bjd_typed_marker_size(marker);
+    for (size_t i = 0; i < count * elem; ++i)
+        values[i] = (char)test_rand();
+    for (size_t i = 0; i < count; ++i) {
+        // keep the floats finite so that no NaN payloads are compared
+        if (test_typed_is_float(marker))
+            test_typed_store(marker, values, i, (int64_t)test_rand() - (int64_t)UINT32_MAX / 2);
+    }
+
+    char* data;
+    size_t size;
+    bjd_writer_t writer;
+    bjd_writer_init_growable(&writer, &data, &size);
+    bjd_write_typed_array(&writer, marker, values, count);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+
+    bjd_reader_t reader;
+    bjd_reader_init_data(&reader, data, size);
+    TEST_TRUE(bjd_read_typed_array(&reader, marker, out, count) == count);
+    TEST_READER_DESTROY_NOERROR(&reader);
+    TEST_TRUE(memcmp(values, out, count * elem) == 0, "elements of %c do not match", marker);
+    BJDATA_FREE(data);
+}
+
+static void test_typed_read_errors(void) {
+    bjd_reader_t reader;
+    uint8_t u8[4];
+    int32_t i32[4];
+
+    // a value out of range of the destination
+    bjd_reader_init_data(&reader, "[$u#U\x02\x01\x00\x00\x01", 10);
+    TEST_TRUE(bjd_expect_u8_array(&reader, u8, 4) == 0);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_type);
+
+    // a negative value into an unsigned destination
+    bjd_reader_init_data(&reader, "[$i#U\x01\xFF", 7);
+    TEST_TRUE(bjd_expect_u8_array(&reader, u8, 4) == 0);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_type);
+
+    // floats into an integer destination
+    bjd_reader_init_data(&reader, "[$d#U\x01\x00\x00\x80\x3F", 10);
+    TEST_TRUE(bjd_expect_i32_array(&reader, i32, 4) == 0);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_type);
+
+    // more elements than the destination holds
+    bjd_reader_init_data(&reader, "[$U#U\x05\x01\x02\x03\x04\x05", 11);
+    TEST_TRUE(bjd_expect_u8_array(&reader, u8, 4) == 0);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_too_big);
+
+    // not an array
+    bjd_reader_init_data(&reader, "U\x01", 2);
+    TEST_TRUE(bjd_expect_u8_array(&reader, u8, 4) == 0);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_type);
+
+    // a truncated payload
+    bjd_reader_init_data(&reader, "[$l#U\x02\x01\x00\x00\x00\x02", 11);
+    TEST_TRUE(bjd_expect_i32_array(&reader, i32, 4) == 0);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_invalid);
+
+    // an ordinary counted array of mixed numbers
+    bjd_reader_init_data(&reader, "[#U\x03U\x01i\xFFI\x00\x01", 11);
+    TEST_TRUE(bjd_expect_i32_array(&reader, i32, 4) == 3);
+    TEST_READER_DESTROY_NOERROR(&reader);
+    TEST_TRUE(i32[0] == 1 && i32[1] == -1 && i32[2] == 256);
+
+    // an ordinary array with a non-number
+    bjd_reader_init_data(&reader, "[#U\x02U\x01Z", 7);
+    TEST_TRUE(bjd_expect_i32_array(&reader, i32, 4) == 0);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_type);
+}
+
+void test_typed_read(void) {
+    for (size_t i = 0; i < sizeof(test_typed_markers); ++i)
+        test_typed_read_same(test_typed_markers[i]);
+
+    for (size_t i = 0; i < sizeof(test_typed_markers); ++i) {
+        for (size_t j = 0; j < sizeof(test_typed_markers); ++j) {
+            // floats only convert to floats
+            if (test_typed_is_float(test_typed_markers[i]) && !test_typed_is_float(test_typed_markers[j]))
+                continue;
+            test_typed_read_convert(test_typed_markers[i], test_typed_markers[j], bjd_endian_little);
+            test_typed_read_convert(test_typed_markers[i], test_typed_markers[j], bjd_endian_big);
+        }
+    }
+
+    test_typed_read_errors();
+}
+
+#endif
+
@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-typed-write.h"
+
+#if BJDATA_WRITER
+
+// A flush function that appends to a growable output buffer in the
+// writer's context, used to compare flushed output with in-memory output.
+typedef struct test_sink_t {
+    char* data;
+    size_t size;
+} test_sink_t;
+
+static void test_sink_flush(bjd_writer_t* writer, const char* buffer, size_t count) {
+    test_sink_t* sink = (test_sink_t*)bjd_writer_context(writer);
+    sink->data = (char*)realloc(sink->data, sink->size + count);
+    memcpy(sink->data + sink->size, buffer, count);
+    sink->size += count;
+}
+
+static void test_typed_write_u16(bjd_endian_t endian, const char* expected, size_t expected_size) {
+    static const uint16_t values[] = {0x0102, 0xA0B0, 0xFFFF};
+    char* data;
+    size_t size;
+    bjd_writer_t writer;
+    bjd_writer_init_growable(&writer, &data, &size);
+    bjd_writer_set_endian(&writer, endian);
+    bjd_write_u16_array(&writer, values, 3);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    TEST_TRUE(size == expected_size && memcmp(data, expected, size) == 0,
+            "u16 array bytes do not match in %s endian", endian == bjd_endian_big ? "big" : "little");
+    BJDATA_FREE(data);
+}
+
+static void test_typed_write_bytes(void) {
+    test_typed_write_u16(bjd_endian_little, "[$u#U\x03\x02\x01\xB0\xA0\xFF\xFF", 12);
+    test_typed_write_u16(bjd_endian_big, "[$u#U\x03\x01\x02\xA0\xB0\xFF\xFF", 12);
+
+    // single-byte elements are never swapped and counts over 255 use a
+    // wider count marker in the writer's byte order
+    uint8_t bytes[300];
+    for (size_t i = 0; i < sizeof(bytes); ++i)
+        bytes[i] = (uint8_t)i;
+    char* data;
+    size_t size;
+    bjd_writer_t writer;
+    bjd_writer_init_growable(&writer, &data, &size);
+    bjd_writer_set_endian(&writer, bjd_endian_big);
+    bjd_write_u8_array(&writer, bytes, sizeof(bytes));
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    TEST_TRUE(size == 7 + sizeof(bytes));
+    TEST_TRUE(memcmp(data, "[$U#u\x01\x2C", 7) == 0);
+    TEST_TRUE(memcmp(data + 7, bytes, sizeof(bytes)) == 0);
+    BJDATA_FREE(data);
+
+    // an empty array is just its header
+    bjd_writer_init_growable(&writer, &data, &size);
+    bjd_write_f64_array(&writer, NULL, 0);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    TEST_TRUE(size == 6 && memcmp(data, "[$D#U\x00", 6) == 0);
+    BJDATA_FREE(data);
+}
+
+// Writes the same arrays of every element type into a growable writer and
+// into a writer with a tiny flushed buffer, so that headers and payloads
+// straddle flushes at every offset.
+static void test_typed_write_flush(bjd_endian_t endian, size_t buffer_size) {
+    static const char markers[] = {'U', 'i', 'u', 'I', 'm', 'l', 'M', 'L', 'd', 'D'};
+    static char values[1000 * 8];
+    for (size_t i = 0; i < sizeof(values); ++i)
+        values[i] = (char)test_rand();
+    // keep the floats finite so that no NaN payloads are compared
+    float floats[1000];
+    double doubles[1000];
+    for (size_t i = 0; i < 1000; ++i) {
+        floats[i] = (float)i * 0.5f;
+        doubles[i] = (double)i * -0.25;
+    }
+
+    char* expected;
+    size_t expected_size;
+    bjd_writer_t writer;
+    bjd_writer_init_growable(&writer, &expected, &expected_size);
+    bjd_writer_set_endian(&writer, endian);
+    for (size_t count = 0; count < 1000; count = count * 3 + 1) {
+        for (size_t i = 0; i < sizeof(markers); ++i) {
+            const void* data = markers[i] == 'd' ? (const void*)floats :
+                    markers[i] == 'D' ? (const void*)doubles : (const void*)values;
+            bjd_write_typed_array(&writer, markers[i], data, count);
+        }
+    }
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+
+    char* buffer = (char*)malloc(buffer_size);
+    test_sink_t sink = {NULL, 0};
+    bjd_writer_init(&writer, buffer, buffer_size);
+    bjd_writer_set_context(&writer, &sink);
+    bjd_writer_set_flush(&writer, test_sink_flush);
+    bjd_writer_set_endian(&writer, endian);
+    for (size_t count = 0; count < 1000; count = count * 3 + 1) {
+        for (size_t i = 0; i < sizeof(markers); ++i) {
+            const void* data = markers[i] == 'd' ? (const void*)floats :
+                    markers[i] == 'D' ? (const void*)doubles : (const void*)values;
+            bjd_write_typed_array(&writer, markers[i], data, count);
+        }
+    }
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+
+    TEST_TRUE(sink.size == expected_size, "flushed size %i does not match %i with buffer size %i",
+            (int)sink.size, (int)expected_size, (int)buffer_size);
+    TEST_TRUE(sink.size != expected_size || memcmp(sink.data, expected, expected_size) == 0,
+            "flushed bytes do not match with buffer size %i", (int)buffer_size);
+
+    free(sink.data);
+    free(buffer);
+    BJDATA_FREE(expected);
+}
+
+static void test_typed_write_errors(void) {
+    char buffer[64];
+    bjd_writer_t writer;
+    uint8_t value = 1;
+
+    // not a fixed-size numeric marker
+    bjd_writer_init(&writer, buffer, sizeof(buffer));
+    TEST_BREAK((bjd_write_typed_array(&writer, 'S', &value, 1), true));
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_bug);
+
+    // a fixed buffer with no flush function is too small for the payload
+    static const uint32_t values[32] = {0};
+    bjd_writer_init(&writer, buffer, sizeof(buffer));
+    bjd_write_u32_array(&writer, values, 32);
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_too_big);
+}
+
+// Scalars, strings and containers are written with BJData markers that
+// the reader reads back, through a buffer small enough to flush mid-tag.
+static void test_typed_write_scalars(void) {
+    static const char expected[] =
+        "{#U\x02"
+        "SU\x01" "n" "[#U\x08"
+            "Z" "T"
+            "u\x2C\x01"
+            "i\xFE"
+            "l\xC0\x63\xFF\xFF"
+            "M\x00\x00\x00\x00\x00\x01\x00\x00"
+            "d\x00\x00\x80\x3F"
+            "D\x00\x00\x00\x00\x00\x00\xE0\x3F"
+        "SU\x01" "b" "[$U#U\x02\x01\x02";
+
+    char buffer[BJDATA_WRITER_MINIMUM_BUFFER_SIZE];
+    test_sink_t sink = {NULL, 0};
+    bjd_writer_t writer;
+    bjd_writer_init(&writer, buffer, sizeof(buffer));
+    bjd_writer_set_context(&writer, &sink);
+    bjd_writer_set_flush(&writer, test_sink_flush);
+    bjd_start_map(&writer, 2);
+    bjd_write_cstr(&writer, "n");
+    bjd_start_array(&writer, 8);
+    bjd_write_nil(&writer);
+    bjd_write_true(&writer);
+    bjd_write_u16(&writer, 300);
+    bjd_write_i8(&writer, -2);
+    bjd_write_i32(&writer, -40000);
+    bjd_write_u64(&writer, UINT64_C(1) << 40);
+    bjd_write_float(&writer, 1.0f);
+    bjd_write_double(&writer, 0.5);
+    bjd_finish_array(&writer);
+    bjd_write_cstr(&writer, "b");
+    bjd_write_bin(&writer, "\x01\x02", 2);
+    bjd_finish_map(&writer);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+    TEST_BYTES_EQUAL(sink.data, sink.size, expected);
+
+    #if BJDATA_READER
+    bjd_reader_t reader;
+    bjd_reader_init_data(&reader, sink.data, sink.size);
+    TEST_TRUE(bjd_read_tag(&reader).v.n == 2);
+    bjd_tag_t tag = bjd_read_tag(&reader);
+    TEST_TRUE(tag.type == bjd_type_str && tag.v.l == 1);
+    bjd_skip_bytes(&reader, 1);
+    bjd_done_str(&reader);
+    TEST_TRUE(bjd_read_tag(&reader).v.n == 8);
+    TEST_TRUE(bjd_read_tag(&reader).type == bjd_type_nil);
+    TEST_TRUE(bjd_read_tag(&reader).v.b);
+    TEST_TRUE(bjd_read_tag(&reader).v.u == 300);
+    TEST_TRUE(bjd_read_tag(&reader).v.i == -2);
+    TEST_TRUE(bjd_read_tag(&reader).v.i == -40000);
+    TEST_TRUE(bjd_read_tag(&reader).v.u == UINT64_C(1) << 40);
+    TEST_TRUE(bjd_read_tag(&reader).v.f == 1.0f);
+    TEST_TRUE(bjd_read_tag(&reader).v.d == 0.5);
+    bjd_done_array(&reader);
+    bjd_discard(&reader);
+    uint8_t bin[2];
+    TEST_TRUE(bjd_read_typed_array(&reader, 'U', bin, 2) == 2 && bin[1] == 2);
+    bjd_done_map(&reader);
+    TEST_READER_DESTROY_NOERROR(&reader);
+    #endif
+
+    free(sink.data);
+}
+
+void test_typed_write(void) {
+    test_typed_write_bytes();
+    test_typed_write_scalars();
+
+    static const size_t sizes[] = {BJDATA_WRITER_MINIMUM_BUFFER_SIZE, 33, 37, 64, 4096};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        test_typed_write_flush(bjd_endian_little, sizes[i]);
+        test_typed_write_flush(bjd_endian_big, sizes[i]);
+    }
+
+    test_typed_write_errors();
+}
+
+#endif
+
@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-unsized.h"
+
+// [1, [], {"a": 2, "bc": [$U#2 3 4]}, [[-1]]] followed by true
+static const char test_unsized_data[] =
+        "[" "U\x01" "[]" "{" "SU\x01" "a" "U\x02" "SU\x02" "bc" "[$U#U\x02\x03\x04" "}"
+        "[" "[" "i\xFF" "]" "]" "]" "T";
+
+#if BJDATA_READER
+static void test_unsized_reader(bool fill) {
+    bjd_reader_t reader;
+    char buffer[BJDATA_READER_MINIMUM_BUFFER_SIZE];
+    test_source_t source = {test_unsized_data, sizeof(test_unsized_data) - 1, 0, 0};
+    if (fill)
+        test_reader_init_source(&reader, buffer, sizeof(buffer), &source);
+    else
+        bjd_reader_init_data(&reader, test_unsized_data, sizeof(test_unsized_data) - 1);
+
+    bjd_tag_t tag = bjd_read_tag(&reader);
+    TEST_TRUE(bjd_tag_type(&tag) == bjd_type_array && bjd_tag_is_unsized(&tag));
+    TEST_TRUE(bjd_tag_array_count(&tag) == 0);
+
+    TEST_TRUE(!bjd_read_array_end(&reader));
+    tag = bjd_read_tag(&reader);
+    TEST_TRUE(bjd_tag_type(&tag) == bjd_type_uint && bjd_tag_uint_value(&tag) == 1);
+
+    // an empty array
+    tag = bjd_read_tag(&reader);
+    TEST_TRUE(bjd_tag_type(&tag) == bjd_type_array && bjd_tag_is_unsized(&tag));
+    TEST_TRUE(bjd_read_array_end(&reader));
+    bjd_done_array(&reader);
+
+    // the map
+    tag = bjd_read_tag(&reader);
+    TEST_TRUE(bjd_tag_type(&tag) == bjd_type_map && bjd_tag_is_unsized(&tag));
+    size_t pairs = 0;
+    while (!bjd_read_map_end(&reader)) {
+        tag = bjd_read_tag(&reader);
+        TEST_TRUE(bjd_tag_type(&tag) == bjd_type_str);
+        bjd_skip_bytes(&reader, bjd_tag_str_length(&tag));
+        bjd_done_str(&reader);
+        bjd_discard(&reader);
+        ++pairs;
+    }
+    bjd_done_map(&reader);
+    TEST_TRUE(pairs == 2);
+
+    // the rest is discarded
+    size_t rest = 0;
+    while (!bjd_read_array_end(&reader)) {
+        bjd_discard(&reader);
+        ++rest;
+    }
+    bjd_done_array(&reader);
+    TEST_TRUE(rest == 1);
+
+    tag = bjd_read_tag(&reader);
+    TEST_TRUE(bjd_tag_type(&tag) == bjd_type_bool);
+    TEST_READER_DESTROY_NOERROR(&reader);
+
+    // the whole thing is discarded at once
+    if (fill)
+        test_reader_init_source(&reader, buffer, sizeof(buffer), &source);
+    else
+        bjd_reader_init_data(&reader, test_unsized_data, sizeof(test_unsized_data) - 1);
+    bjd_discard(&reader);
+    tag = bjd_read_tag(&reader);
+    TEST_TRUE(bjd_tag_type(&tag) == bjd_type_bool);
+    TEST_READER_DESTROY_NOERROR(&reader);
+}
+#endif
+
+#if BJDATA_EXPECT
+static void test_unsized_expect(void) {
+    bjd_reader_t reader;
+
+    bjd_reader_init_data(&reader, "[U\x01U\x02]", 6);
+    bjd_expect_array_unsized(&reader);
+    size_t sum = 0;
+    while (!bjd_read_array_end(&reader))
+        sum += bjd_expect_u8(&reader);
+    bjd_done_array(&reader);
+    TEST_TRUE(sum == 3);
+    TEST_READER_DESTROY_NOERROR(&reader);
+
+    // the counted functions reject containers without a count
+    bjd_reader_init_data(&reader, "[U\x01]", 4);
+    TEST_TRUE(bjd_expect_array(&reader) == 0);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_type);
+
+    bjd_reader_init_data(&reader, "{}", 2);
+    TEST_TRUE(bjd_expect_map(&reader) == 0);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_type);
+
+    // and the unsized ones containers with a count
+    bjd_reader_init_data(&reader, "[#U\x00", 4);
+    bjd_expect_array_unsized(&reader);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_type);
+
+    // typed array reads accept them
+    int16_t values[4];
+    bjd_reader_init_data(&reader, "[U\x01i\xFFI\x00\x01]", 9);
+    TEST_TRUE(bjd_expect_i16_array(&reader, values, 4) == 3);
+    TEST_TRUE(values[0] == 1 && values[1] == -1 && values[2] == 256);
+    TEST_READER_DESTROY_NOERROR(&reader);
+
+    bjd_reader_init_data(&reader, "[U\x01U\x02U\x03]", 8);
+    TEST_TRUE(bjd_expect_i16_array(&reader, values, 2) == 0);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_too_big);
+
+    // a missing end
+    bjd_reader_init_data(&reader, "[U\x01", 3);
+    bjd_discard(&reader);
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_invalid);
+}
+#endif
+
+#if BJDATA_NODE && defined(BJDATA_MALLOC)
+static void test_unsized_node(void) {
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, test_unsized_data, sizeof(test_unsized_data) - 1);
+    bjd_tree_parse(&tree);
+    bjd_node_t root = bjd_tree_root(&tree);
+
+    TEST_TRUE(bjd_node_array_length(root) == 4);
+    TEST_TRUE(bjd_node_u8(bjd_node_array_at(root, 0)) == 1);
+    TEST_TRUE(bjd_node_array_length(bjd_node_array_at(root, 1)) == 0);
+    bjd_node_t map = bjd_node_array_at(root, 2);
+    TEST_TRUE(bjd_node_map_count(map) == 2);
+    TEST_TRUE(bjd_node_u8(bjd_node_map_cstr(map, "a")) == 2);
+    TEST_TRUE(bjd_node_u8(bjd_node_array_at(bjd_node_map_cstr(map, "bc"), 1)) == 4);
+    TEST_TRUE(bjd_node_i8(bjd_node_array_at(bjd_node_array_at(bjd_node_array_at(root, 3), 0), 0)) == -1);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+
+    // a long array with deeply nested unsized children
+    enum { count = 3000, depth = 20 };
+    size_t size = 2 + count * 2 + depth * 2;
+    char* data = (char*)malloc(size);
+    char* p = data;
+    *p++ = '[';
+    for (size_t i = 0; i < depth; ++i)
+        *p++ = '[';
+    for (size_t i = 0; i < depth; ++i)
+        *p++ = ']';
+    for (size_t i = 0; i < count; ++i) {
+        *p++ = 'U';
+        *p++ = (char)i;
+    }
+    *p++ = ']';
+    TEST_TRUE((size_t)(p - data) == size);
+
+    bjd_tree_init_data(&tree, data, size);
+    bjd_tree_parse(&tree);
+    root = bjd_tree_root(&tree);
+    TEST_TRUE(bjd_node_array_length(root) == count + 1);
+    bool match = true;
+    for (size_t i = 0; i < count; ++i)
+        match &= bjd_node_u8(bjd_node_array_at(root, i + 1)) == (uint8_t)i;
+    TEST_TRUE(match);
+    bjd_node_t node = bjd_node_array_at(root, 0);
+    for (size_t i = 1; i < depth; ++i)
+        node = bjd_node_array_at(node, 0);
+    TEST_TRUE(bjd_node_array_length(node) == 0);
+    TEST_TREE_DESTROY_NOERROR(&tree);
+
+    // missing the end marker
+    bjd_tree_init_data(&tree, data, size - 1);
+    bjd_tree_parse(&tree);
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_invalid);
+    free(data);
+
+    // a stray end marker
+    bjd_tree_init_data(&tree, "]", 1);
+    bjd_tree_parse(&tree);
+    TEST_TRUE(bjd_tree_error(&tree) != bjd_ok);
+    bjd_tree_destroy(&tree);
+}
+#endif
+
+#if BJDATA_WRITER
+static void test_unsized_writer(void) {
+    static const uint8_t bytes[] = {5};
+    char* data;
+    size_t size;
+    bjd_writer_t writer;
+
+    bjd_writer_init_growable(&writer, &data, &size);
+    bjd_start_array_unsized(&writer);
+    bjd_write_u8_array(&writer, bytes, 1);
+    bjd_start_array_unsized(&writer);
+    bjd_finish_array_unsized(&writer);
+    bjd_start_map_unsized(&writer);
+    bjd_finish_map_unsized(&writer);
+    bjd_start_map_unsized(&writer);
+    bjd_write_cstr(&writer, "k");
+    bjd_write_i16(&writer, -300);
+    bjd_write_cstr(&writer, "s");
+    bjd_write_cstr(&writer, "hi");
+    bjd_finish_map_unsized(&writer);
+    bjd_start_array_unsized(&writer);
+    bjd_write_nil(&writer);
+    bjd_write_bool(&writer, true);
+    bjd_write_float(&writer, 1.5f);
+    bjd_finish_array_unsized(&writer);
+    bjd_finish_array_unsized(&writer);
+    TEST_WRITER_DESTROY_NOERROR(&writer);
+
+    // the contents of unsized containers are ordinary BJData values
+    TEST_BYTES_EQUAL(data, size, "[" "[$U#U\x01\x05" "[]" "{}"
+            "{" "SU\x01" "k" "I\xD4\xFE" "SU\x01" "s" "SU\x02" "hi" "}"
+            "[" "Z" "T" "d\x00\x00\xC0\x3F" "]"
+            "]");
+    BJDATA_FREE(data);
+
+    #if BJDATA_WRITE_TRACKING
+    // closing the wrong kind of container
+    char buffer[64];
+    bjd_writer_init(&writer, buffer, sizeof(buffer));
+    bjd_start_array_unsized(&writer);
+    TEST_BREAK((bjd_finish_map_unsized(&writer), true));
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_bug);
+
+    // closing an unsized array as a counted one
+    bjd_writer_init(&writer, buffer, sizeof(buffer));
+    bjd_start_array_unsized(&writer);
+    TEST_BREAK((bjd_finish_array(&writer), true));
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_bug);
+    #endif
+}
+#endif
+
+void test_unsized(void) {
+    #if BJDATA_READER
+    test_unsized_reader(false);
+    test_unsized_reader(true);
+    #endif
+    #if BJDATA_EXPECT
+    test_unsized_expect();
+    #endif
+    #if BJDATA_NODE && defined(BJDATA_MALLOC)
+    test_unsized_node();
+    #endif
+    #if BJDATA_WRITER
+    test_unsized_writer();
+    #endif
+}
+
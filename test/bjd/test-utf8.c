@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test-utf8.h"
+
+static const char* test_utf8_kernels[] = {"scalar", "sse2", "ssse3", "avx2", "neon"};
+
+// A straightforward decoder following RFC 3629.
+static bool test_utf8_reference(const char* str, size_t count, bool allow_null) {
+    const uint8_t* p = (const uint8_t*)str;
+    const uint8_t* end = p + count;
+    while (p < end) {
+        uint32_t c = *p++;
+        size_t extra;
+        uint32_t min;
+        if (c == 0) {
+            if (!allow_null)
+                return false;
+            continue;
+        } else if (c < 0x80) {
+            continue;
+        } else if ((c & 0xE0) == 0xC0) {
+            extra = 1; min = 0x80; c &= 0x1F;
+        } else if ((c & 0xF0) == 0xE0) {
+            extra = 2; min = 0x800; c &= 0x0F;
+        } else if ((c & 0xF8) == 0xF0) {
+            extra = 3; min = 0x10000; c &= 0x07;
+        } else {
+            return false;
+        }
+        if ((size_t)(end - p) < extra)
+            return false;
+        for (size_t i = 0; i < extra; ++i) {
+            if ((*p & 0xC0) != 0x80)
+                return false;
+            c = (c << 6) | (*p++ & 0x3F);
+        }
+        if (c < min || c > 0x10FFFF || (c >= 0xD800 && c <= 0xDFFF))
+            return false;
+    }
+    return true;
+}
+
+// Generates mostly valid text with occasional random bytes, so that errors
+// land at every offset relative to the vector width of the kernels.
+static void test_utf8_generate(char* buffer, size_t size) {
+    static const char* samples[] = {"a", "\x7F", "\xC2\x80", "\xDF\xBF", "\xE0\xA0\x80", "\xED\x9F\xBF",
+            "\xEE\x80\x80", "\xEF\xBF\xBF", "\xF0\x90\x80\x80", "\xF4\x8F\xBF\xBF"};
+    size_t i = 0;
+    while (i < size) {
+        if (test_rand() % 64 == 0) {
+            buffer[i++] = (char)test_rand();
+            continue;
+        }
+        const char* sample = samples[test_rand() % (sizeof(samples) / sizeof(samples[0]))];
+        size_t length = strlen(sample);
+        if (i + length > size)
+            length = size - i; // a truncated sequence
+        memcpy(buffer + i, sample, length);
+        i += length;
+    }
+}
+
+static void test_utf8_kernels_fuzz(void) {
+    static char buffer[512];
+    for (size_t k = 0; k < sizeof(test_utf8_kernels) / sizeof(test_utf8_kernels[0]); ++k) {
+        if (!bjd_convert_use_kernels(test_utf8_kernels[k]))
+            continue;
+
+        bool match = true;
+        for (int trial = 0; trial < 2000; ++trial) {
+            size_t size = test_rand() % sizeof(buffer);
+            test_utf8_generate(buffer, size);
+            for (int allow_null = 0; allow_null < 2; ++allow_null)
+                match &= bjd_utf8_validate(buffer, size, allow_null != 0) ==
+                        test_utf8_reference(buffer, size, allow_null != 0);
+        }
+        TEST_TRUE(match, "%s UTF-8 validation does not match the reference", test_utf8_kernels[k]);
+
+        // a single bad byte at every offset of valid text
+        match = true;
+        for (size_t offset = 0; offset < 200; ++offset) {
+            memset(buffer, 'a', 200);
+            memcpy(buffer + 100, "\xE2\x82\xAC", 3);
+            buffer[offset] = (char)0xFF;
+            match &= !bjd_utf8_validate(buffer, 200, true);
+            buffer[offset] = 0;
+            match &= bjd_utf8_validate(buffer, 200, true) == (offset < 100 || offset > 102);
+            match &= !bjd_utf8_validate(buffer, 200, false);
+        }
+        TEST_TRUE(match, "%s UTF-8 validation misses a bad byte", test_utf8_kernels[k]);
+    }
+    bjd_convert_use_kernels(NULL);
+}
+
+static void test_utf8_functions(void) {
+    #if BJDATA_EXPECT
+    char buffer[16];
+    bjd_reader_t reader;
+    bjd_reader_init_data(&reader, "SU\x05" "caf\xC3\xA9", 8);
+    TEST_TRUE(bjd_expect_utf8(&reader, buffer, sizeof(buffer)) == 5);
+    TEST_READER_DESTROY_NOERROR(&reader);
+
+    bjd_reader_init_data(&reader, "SU\x02" "\xC0\xAF", 5);
+    bjd_expect_utf8(&reader, buffer, sizeof(buffer));
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_type);
+
+    bjd_reader_init_data(&reader, "SU\x03" "a\0b", 6);
+    bjd_expect_utf8_cstr(&reader, buffer, sizeof(buffer));
+    TEST_READER_DESTROY_ERROR(&reader, bjd_error_type);
+    #endif
+
+    #if BJDATA_NODE
+    static const char strings[] = "[#U\x02" "SU\x02" "\xC3\xA9" "SU\x01" "\x80";
+    bjd_tree_t tree;
+    bjd_tree_init_data(&tree, strings, sizeof(strings) - 1);
+    bjd_tree_parse(&tree);
+    bjd_node_check_utf8(bjd_node_array_at(bjd_tree_root(&tree), 0));
+    TEST_TRUE(bjd_tree_error(&tree) == bjd_ok);
+    bjd_node_check_utf8(bjd_node_array_at(bjd_tree_root(&tree), 1));
+    TEST_TREE_DESTROY_ERROR(&tree, bjd_error_type);
+    #endif
+
+    #if BJDATA_WRITER
+    char* data;
+    size_t size;
+    bjd_writer_t writer;
+    bjd_writer_init_growable(&writer, &data, &size);
+    bjd_write_utf8(&writer, "\xF4\x90\x80\x80", 4);
+    TEST_WRITER_DESTROY_ERROR(&writer, bjd_error_invalid);
+    #endif
+}
+
+void test_utf8(void) {
+    test_utf8_kernels_fuzz();
+    test_utf8_functions();
+}
+
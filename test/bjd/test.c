@@ -0,0 +1,401 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "test.h"
+
+#include <stdarg.h>
+
+#include "test-typed-write.h"
+#include "test-typed-read.h"
+#include "test-typed-node.h"
+#include "test-ndarray.h"
+#include "test-typed-map.h"
+#include "test-convert.h"
+#include "test-endian.h"
+#include "test-auto-typed.h"
+#include "test-unsized.h"
+#include "test-node-index.h"
+#include "test-keyset.h"
+#include "test-utf8.h"
+#include "test-mmap.h"
+#include "test-iov.h"
+#include "test-chunked.h"
+#include "test-allocator.h"
+#include "test-page-cache.h"
+#include "test-compact-nodes.h"
+#include "test-parallel.h"
+#include "test-skip-index.h"
+#include "test-lazy.h"
+#include "test-path.h"
+#include "test-projection.h"
+#include "test-resumable.h"
+
+int passes;
+int tests;
+
+#if BJDATA_DEBUG
+bool test_break_set = false;
+bool test_break_hit;
+
+void bjd_assert_fail(const char* message) {
+    TEST_TRUE(false, "assertion hit! %s", message);
+    abort();
+}
+
+void bjd_break_hit(const char* message) {
+    if (!test_break_set) {
+        TEST_TRUE(false, "break hit! %s", message);
+        abort();
+    }
+    test_break_hit = true;
+}
+#endif
+
+void test_true_impl(bool result, const char* file, int line, const char* format, ...) {
+    ++tests;
+    if (result) {
+        ++passes;
+    } else {
+        printf("TEST FAILED AT %s:%i --", file, line);
+
+        va_list args;
+        va_start(args, format);
+        vprintf(format, args);
+        va_end(args);
+
+        printf("\n");
+        fflush(stdout);
+        if (TEST_EARLY_EXIT)
+            abort();
+    }
+}
+
+static uint32_t test_rand_state = 1;
+
+void test_rand_seed(uint32_t seed) {
+    test_rand_state = seed ? seed : 1;
+}
+
+uint32_t test_rand(void) {
+    // xorshift32
+    uint32_t x = test_rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    test_rand_state = x;
+    return x;
+}
+
+static char* test_random_str(char* p, const char* str) {
+    size_t length = strlen(str);
+    *p++ = 'S';
+    *p++ = 'U';
+    *p++ = (char)length;
+    memcpy(p, str, length);
+    return p + length;
+}
+
+char* test_random_value(char* p, int depth) {
+    static const char* keys[] = {"a", "key", "name", ""};
+    uint32_t kind = test_rand() % (depth > 3 ? 8 : 14);
+    uint32_t count = test_rand() % 5;
+    uint32_t i;
+
+    switch (kind) {
+        case 0: *p++ = (test_rand() % 2) ? 'Z' : 'N'; break;
+        case 1: *p++ = (test_rand() % 2) ? 'T' : 'F'; break;
+        case 2: *p++ = 'i'; *p++ = (char)test_rand(); break;
+        case 3:
+            *p++ = 'l';
+            bjd_store_u32_endian(p, test_rand(), bjd_endian_little);
+            p += 4;
+            break;
+        case 4:
+            *p++ = 'M';
+            bjd_store_u64_endian(p, ((uint64_t)test_rand() << 32) | test_rand(), bjd_endian_little);
+            p += 8;
+            break;
+        case 5: {
+            double value = (double)test_rand() / 3.0;
+            uint64_t bits;
+            memcpy(&bits, &value, sizeof(bits));
+            *p++ = 'D';
+            bjd_store_u64_endian(p, bits, bjd_endian_little);
+            p += 8;
+            break;
+        }
+        case 6: p = test_random_str(p, "hello"); break;
+        case 7: p = test_random_str(p, keys[test_rand() % 4]); break;
+
+        case 8:
+            *p++ = '[';
+            *p++ = '#';
+            *p++ = 'U';
+            *p++ = (char)count;
+            for (i = 0; i < count; ++i)
+                p = test_random_value(p, depth + 1);
+            break;
+        case 9:
+            *p++ = '[';
+            for (i = 0; i < count; ++i)
+                p = test_random_value(p, depth + 1);
+            *p++ = ']';
+            break;
+        case 10:
+            *p++ = '{';
+            *p++ = '#';
+            *p++ = 'U';
+            *p++ = (char)(count % 4);
+            for (i = 0; i < count % 4; ++i) {
+                p = test_random_str(p, keys[i]);
+                p = test_random_value(p, depth + 1);
+            }
+            break;
+        case 11:
+            *p++ = '{';
+            for (i = 0; i < count % 4; ++i) {
+                p = test_random_str(p, keys[i]);
+                p = test_random_value(p, depth + 1);
+            }
+            *p++ = '}';
+            break;
+        case 12:
+            // an optimized array of int16
+            memcpy(p, "[$I#U", 5);
+            p += 5;
+            *p++ = (char)count;
+            for (i = 0; i < count * 2; ++i)
+                *p++ = (char)test_rand();
+            break;
+        default:
+            if (count % 2) {
+                // a 2x3 ND-array of uint8
+                static const char header[] = "[$U#[U\x02U\x03]";
+                memcpy(p, header, sizeof(header) - 1);
+                p += sizeof(header) - 1;
+                for (i = 0; i < 6; ++i)
+                    *p++ = (char)i;
+            } else {
+                // an optimized map of uint8
+                static const char header[] = "{$U#U\x02";
+                memcpy(p, header, sizeof(header) - 1);
+                p += sizeof(header) - 1;
+                // whose keys have no 'S' marker
+                memcpy(p, "U\x01" "a", 3);
+                p[3] = (char)test_rand();
+                memcpy(p + 4, "U\x01" "b", 3);
+                p[7] = (char)test_rand();
+                p += 8;
+            }
+            break;
+    }
+
+    return p;
+}
+
+#if BJDATA_NODE
+static bool test_bits_equal(const void* left, const void* right, size_t size) {
+    return memcmp(left, right, size) == 0;
+}
+
+bool test_node_equal(bjd_node_t left, bjd_node_t right) {
+    bjd_type_t type = bjd_node_type(left);
+    if (type != bjd_node_type(right))
+        return false;
+
+    switch (type) {
+        case bjd_type_bool:
+            return bjd_node_bool(left) == bjd_node_bool(right);
+        case bjd_type_int:
+            return bjd_node_i64(left) == bjd_node_i64(right);
+        case bjd_type_uint:
+            return bjd_node_u64(left) == bjd_node_u64(right);
+        case bjd_type_float: {
+            float l = bjd_node_float_strict(left);
+            float r = bjd_node_float_strict(right);
+            return test_bits_equal(&l, &r, sizeof(l));
+        }
+        case bjd_type_double: {
+            double l = bjd_node_double_strict(left);
+            double r = bjd_node_double_strict(right);
+            return test_bits_equal(&l, &r, sizeof(l));
+        }
+        case bjd_type_array: {
+            size_t length = bjd_node_array_length(left);
+            if (length != bjd_node_array_length(right))
+                return false;
+            for (size_t i = 0; i < length; ++i)
+                if (!test_node_equal(bjd_node_array_at(left, i), bjd_node_array_at(right, i)))
+                    return false;
+            return true;
+        }
+        case bjd_type_map: {
+            size_t count = bjd_node_map_count(left);
+            if (count != bjd_node_map_count(right))
+                return false;
+            for (size_t i = 0; i < count; ++i) {
+                if (!test_node_equal(bjd_node_map_key_at(left, i), bjd_node_map_key_at(right, i)) ||
+                        !test_node_equal(bjd_node_map_value_at(left, i), bjd_node_map_value_at(right, i)))
+                    return false;
+            }
+            return true;
+        }
+        case bjd_type_str:
+        case bjd_type_huge: {
+            size_t length = bjd_node_data_len(left);
+            return length == bjd_node_data_len(right) &&
+                test_bits_equal(bjd_node_data(left), bjd_node_data(right), length);
+        }
+        default:
+            return true;
+    }
+}
+#endif
+
+#if BJDATA_READER
+size_t test_source_fill(bjd_reader_t* reader, char* buffer, size_t count) {
+    test_source_t* source = (test_source_t*)bjd_reader_context(reader);
+    size_t left = source->size - source->pos;
+    if (count > left)
+        count = left;
+    if (count == 0)
+        return 0;
+
+    size_t max = source->max_chunk ? source->max_chunk : 1 + test_rand() % count;
+    if (count > max)
+        count = max;
+
+    memcpy(buffer, source->data + source->pos, count);
+    source->pos += count;
+    return count;
+}
+
+void test_reader_init_source(bjd_reader_t* reader, char* buffer, size_t size, test_source_t* source) {
+    source->pos = 0;
+    bjd_reader_init(reader, buffer, size, 0);
+    bjd_reader_set_context(reader, source);
+    bjd_reader_set_fill(reader, test_source_fill);
+}
+#endif
+
+#ifdef BJDATA_MALLOC
+static void* test_counter_allocate(void* context, size_t size) {
+    test_counter_t* counter = (test_counter_t*)context;
+    ++counter->outstanding;
+    ++counter->total;
+    return malloc(size);
+}
+
+static void* test_counter_reallocate(void* context, void* ptr, size_t used_size, size_t new_size) {
+    test_counter_t* counter = (test_counter_t*)context;
+    BJDATA_UNUSED(used_size);
+    if (ptr == NULL) {
+        ++counter->outstanding;
+        ++counter->total;
+    }
+    return realloc(ptr, new_size);
+}
+
+void test_counter_deallocate(void* context, void* ptr) {
+    test_counter_t* counter = (test_counter_t*)context;
+    TEST_TRUE(counter->outstanding > 0, "freed more allocations than were made");
+    --counter->outstanding;
+    free(ptr);
+}
+
+void test_counter_init(test_counter_t* counter, bool reallocate) {
+    memset(counter, 0, sizeof(*counter));
+    counter->allocator.allocate = test_counter_allocate;
+    counter->allocator.reallocate = reallocate ? test_counter_reallocate : NULL;
+    counter->allocator.deallocate = test_counter_deallocate;
+    counter->allocator.context = counter;
+}
+#endif
+
+int main(void) {
+    printf("\n\n");
+
+    #if BJDATA_WRITER
+    test_typed_write();
+    #endif
+    #if BJDATA_EXPECT && BJDATA_WRITER
+    test_typed_read();
+    #endif
+    #if BJDATA_NODE && BJDATA_WRITER
+    test_typed_node();
+    #endif
+    #if BJDATA_WRITER
+    test_ndarray();
+    #endif
+    test_typed_map();
+    test_convert();
+    test_endian();
+    #if BJDATA_WRITER && defined(BJDATA_MALLOC)
+    test_auto_typed();
+    #endif
+    test_unsized();
+    #if BJDATA_NODE && defined(BJDATA_MALLOC)
+    test_node_index();
+    #endif
+    #if BJDATA_EXPECT
+    test_keyset();
+    #endif
+    test_utf8();
+    #if BJDATA_MMAP
+    test_mmap();
+    #endif
+    #if BJDATA_IOV
+    test_iov();
+    #endif
+    #if BJDATA_WRITER && defined(BJDATA_MALLOC)
+    test_chunked();
+    #endif
+    #ifdef BJDATA_MALLOC
+    test_allocator();
+    #endif
+    #if BJDATA_NODE && BJDATA_WRITER && defined(BJDATA_MALLOC)
+    test_page_cache();
+    #endif
+    #if BJDATA_NODE
+    test_compact_nodes();
+    #endif
+    #if BJDATA_NODE && defined(BJDATA_MALLOC)
+    test_parallel();
+    #endif
+    #if BJDATA_READER && defined(BJDATA_MALLOC)
+    test_skip_index();
+    #endif
+    #if BJDATA_NODE
+    test_lazy();
+    #endif
+    #if BJDATA_READER
+    test_path();
+    #endif
+    #if BJDATA_NODE && defined(BJDATA_MALLOC)
+    test_projection();
+    #endif
+    #if BJDATA_READER
+    test_resumable();
+    #endif
+
+    printf("\n\nUnit testing complete. %i failures in %i checks.\n\n\n", tests - passes, tests);
+    return (passes == tests) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
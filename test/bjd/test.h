@@ -0,0 +1,162 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef BJDATA_TEST_H
+#define BJDATA_TEST_H 1
+
+#define _DEFAULT_SOURCE 1
+#define _BSD_SOURCE 1
+
+#ifdef WIN32
+#define _CRT_SECURE_NO_WARNINGS 1
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <setjmp.h>
+
+#include "bjd.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * This is the unit testing framework for the BJData features, modeled on
+ * the one in test/test.h. The reported number of "tests" is the total
+ * number of test asserts, where each actual test case has several asserts.
+ */
+
+// enable this to exit at the first error
+#define TEST_EARLY_EXIT 1
+
+// runs the given expression, causing a unit test failure with the
+// given printf format string if the expression is not true.
+#define TEST_TRUE(...) \
+    BJDATA_EXPAND(TEST_TRUE_IMPL((BJDATA_EXTRACT_ARG0(__VA_ARGS__)), __FILE__, __LINE__, __VA_ARGS__ , "" , NULL))
+
+#define TEST_TRUE_IMPL(result, file, line, ignored, ...) \
+    BJDATA_EXPAND(test_true_impl(result, file, line, __VA_ARGS__))
+
+void test_true_impl(bool result, const char* file, int line, const char* format, ...);
+
+extern int tests;
+extern int passes;
+
+#if BJDATA_DEBUG
+extern bool test_break_set;
+extern bool test_break_hit;
+
+// runs the given expression, causing a unit test failure if it is not
+// true or if it does not hit a bjd_break().
+#define TEST_BREAK(expr) do { \
+    test_break_set = true; \
+    test_break_hit = false; \
+    TEST_TRUE(expr, "expression is not true: " # expr); \
+    TEST_TRUE(test_break_hit, "expression should break, but didn't: " # expr); \
+    test_break_set = false; \
+} while (0)
+#else
+// in release mode there are no break functions, so TEST_BREAK() just runs
+// the expr. it is usually used to test that something flags bjd_error_bug.
+#define TEST_BREAK(expr) do { TEST_TRUE(expr); } while (0)
+#endif
+
+#define TEST_ERROR_IS(actual, expected) do { \
+    bjd_error_t test_actual = (actual); \
+    bjd_error_t test_expected = (expected); \
+    TEST_TRUE(test_actual == test_expected, "error %i (%s) instead of %i (%s)", \
+            (int)test_actual, bjd_error_to_string(test_actual), \
+            (int)test_expected, bjd_error_to_string(test_expected)); \
+} while (0)
+
+#define TEST_TREE_DESTROY_NOERROR(tree) TEST_ERROR_IS(bjd_tree_destroy(tree), bjd_ok)
+#define TEST_TREE_DESTROY_ERROR(tree, error) TEST_ERROR_IS(bjd_tree_destroy(tree), error)
+#define TEST_READER_DESTROY_NOERROR(reader) TEST_ERROR_IS(bjd_reader_destroy(reader), bjd_ok)
+#define TEST_READER_DESTROY_ERROR(reader, error) TEST_ERROR_IS(bjd_reader_destroy(reader), error)
+#define TEST_WRITER_DESTROY_NOERROR(writer) TEST_ERROR_IS(bjd_writer_destroy(writer), bjd_ok)
+#define TEST_WRITER_DESTROY_ERROR(writer, error) TEST_ERROR_IS(bjd_writer_destroy(writer), error)
+
+// Compares bytes written or read against the expected bytes, which are
+// usually a string literal whose terminator is not counted.
+#define TEST_BYTES_EQUAL(data, size, expected) do { \
+    size_t test_bytes_size = (size); \
+    TEST_TRUE(test_bytes_size == sizeof(expected) - 1, "size is %i instead of %i", \
+            (int)test_bytes_size, (int)(sizeof(expected) - 1)); \
+    TEST_TRUE(test_bytes_size != sizeof(expected) - 1 || memcmp((data), (expected), test_bytes_size) == 0, \
+            "bytes do not match"); \
+} while (0)
+
+// A deterministic pseudo-random generator so that failures reproduce.
+uint32_t test_rand(void);
+void test_rand_seed(uint32_t seed);
+
+// The most bytes written by test_random_value().
+#define TEST_RANDOM_VALUE_MAX_SIZE 4096
+
+// Writes a random BJData value at the given nesting depth and returns the
+// end of it. Values nest at most four levels and include sized, unsized and
+// optimized containers, ND-arrays and optimized maps.
+char* test_random_value(char* p, int depth);
+
+#if BJDATA_NODE
+// Compares two nodes and all of their children through the node API.
+bool test_node_equal(bjd_node_t left, bjd_node_t right);
+#endif
+
+#if BJDATA_READER
+// A source of data for a reader fill function that returns at most
+// max_chunk bytes per call (or a random number of bytes up to the
+// remaining size if max_chunk is zero), so that values straddle fills.
+typedef struct test_source_t {
+    const char* data;
+    size_t size;
+    size_t pos;
+    size_t max_chunk;
+} test_source_t;
+
+size_t test_source_fill(bjd_reader_t* reader, char* buffer, size_t count);
+
+// Initializes a reader with the given buffer that fills from the source.
+void test_reader_init_source(bjd_reader_t* reader, char* buffer, size_t size, test_source_t* source);
+#endif
+
+#ifdef BJDATA_MALLOC
+// An allocator that counts outstanding allocations. The reallocate
+// function can be left out to test the fallback to allocate and deallocate.
+typedef struct test_counter_t {
+    bjd_allocator_t allocator;
+    size_t outstanding; // allocations not yet freed
+    size_t total;       // allocations made
+} test_counter_t;
+
+void test_counter_init(test_counter_t* counter, bool reallocate);
+
+// Frees an allocation made from the counter's allocator.
+void test_counter_deallocate(void* context, void* ptr);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2015-2018 Nicholas Fraser
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+/*
+ * Micro-benchmark of the bulk conversion kernels.
+ *
+ * Each kernel set supported by the CPU is first checked against the scalar
+ * kernels on random data of every length up to a few vectors, then timed
+ * on a larger buffer. The per-element loads and stores that the kernels
+ * replace are timed for comparison. Build and run it from the repository
+ * root with:
+ *
+ *     make -f test/bjd/Makefile bench
+ *     build/bjd-bench/bench-convert
+ *
+ * or directly with:
+ *
+ *     cc -std=c99 -O2 -Isrc/bjd tools/bench-convert.c src/bjd/bjd-[a-z]*.c -lm -o bench-convert
+ *
+ * It exits with a non-zero status if any kernel disagrees with the scalar
+ * kernels.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include "bjd.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CHECK_MAX_COUNT 300
+#define BENCH_BYTES (64 * 1024)
+#define BENCH_TOTAL_BYTES ((double)(1 << 28))
+
+static const char* kernel_names[] = {"scalar", "sse2", "ssse3", "avx2", "neon"};
+
+static const size_t widen_sizes[][2] = {{1, 2}, {1, 4}, {1, 8}, {2, 4}, {2, 8}, {4, 8}};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void fill_random(char* buffer, size_t size) {
+    for (size_t i = 0; i < size; ++i)
+        buffer[i] = (char)(rand() & 0xFF);
+}
+
+// Fills the buffer with valid UTF-8 of one to four bytes per code point.
+static void fill_utf8(char* buffer, size_t size) {
+    static const char* samples[] = {"a", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80"};
+    size_t i = 0;
+    while (i < size) {
+        const char* sample = samples[rand() % 4];
+        size_t length = strlen(sample);
+        if (i + length > size) {
+            sample = "a";
+            length = 1;
+        }
+        memcpy(buffer + i, sample, length);
+        i += length;
+    }
+}
+
+static bool utf8_valid(const char* kernels, const char* str, size_t count, bool allow_null) {
+    bjd_convert_use_kernels(kernels);
+    return bjd_utf8_validate(str, count, allow_null);
+}
+
+// Compares the current kernels against the scalar ones, returning the number
+// of mismatches.
+static int check(const char* name) {
+    static char src[CHECK_MAX_COUNT * 8], expected[CHECK_MAX_COUNT * 8], actual[CHECK_MAX_COUNT * 8];
+    int failures = 0;
+
+    for (size_t count = 0; count <= CHECK_MAX_COUNT; ++count) {
+        for (size_t size = 2; size <= 8; size *= 2) {
+            fill_random(src, count * size);
+
+            bjd_convert_use_kernels("scalar");
+            bjd_convert_swap(expected, src, size, count);
+            bjd_convert_use_kernels(name);
+            bjd_convert_swap(actual, src, size, count);
+            failures += memcmp(expected, actual, count * size) != 0;
+
+            // in place
+            memcpy(actual, src, count * size);
+            bjd_convert_swap(actual, actual, size, count);
+            failures += memcmp(expected, actual, count * size) != 0;
+        }
+
+        for (size_t i = 0; i < sizeof(widen_sizes) / sizeof(widen_sizes[0]); ++i) {
+            size_t src_size = widen_sizes[i][0];
+            size_t dest_size = widen_sizes[i][1];
+            for (int is_signed = 0; is_signed < 2; ++is_signed) {
+                fill_random(src, count * src_size);
+
+                bjd_convert_use_kernels("scalar");
+                bjd_convert_widen(expected, dest_size, src, src_size, is_signed != 0, count);
+                bjd_convert_use_kernels(name);
+                bjd_convert_widen(actual, dest_size, src, src_size, is_signed != 0, count);
+                failures += memcmp(expected, actual, count * dest_size) != 0;
+
+                // in place from the tail, as the reader does
+                char* tail = actual + count * (dest_size - src_size);
+                memmove(tail, src, count * src_size);
+                bjd_convert_widen(actual, dest_size, tail, src_size, is_signed != 0, count);
+                failures += memcmp(expected, actual, count * dest_size) != 0;
+            }
+        }
+
+        // valid text, then single corrupted bytes and nulls
+        fill_utf8(src, count);
+        for (int trial = 0; trial < 4; ++trial) {
+            if (trial > 0 && count > 0)
+                src[rand() % count] = (trial == 3) ? 0 : (char)(rand() & 0xFF);
+            for (int allow_null = 0; allow_null < 2; ++allow_null)
+                failures += utf8_valid("scalar", src, count, allow_null != 0) !=
+                        utf8_valid(name, src, count, allow_null != 0);
+        }
+    }
+
+    return failures;
+}
+
+static void report(const char* what, size_t bytes, double start) {
+    double seconds = now() - start;
+    printf("    %-24s %8.2f GB/s\n", what, (double)bytes / seconds / 1e9);
+}
+
+static void bench(void) {
+    static char src[BENCH_BYTES], dest[BENCH_BYTES * 2];
+    fill_random(src, sizeof(src));
+    size_t rounds = (size_t)(BENCH_TOTAL_BYTES / BENCH_BYTES);
+    double start;
+
+    for (size_t size = 2; size <= 8; size *= 2) {
+        char what[32];
+        snprintf(what, sizeof(what), "swap%i", (int)size * 8);
+        start = now();
+        for (size_t r = 0; r < rounds; ++r)
+            bjd_convert_swap(dest, src, size, BENCH_BYTES / size);
+        report(what, rounds * BENCH_BYTES, start);
+    }
+
+    start = now();
+    for (size_t r = 0; r < rounds; ++r)
+        bjd_convert_widen(dest, 2, src, 1, false, BENCH_BYTES);
+    report("widen u8 to u16", rounds * BENCH_BYTES, start);
+
+    start = now();
+    for (size_t r = 0; r < rounds; ++r)
+        bjd_convert_widen(dest, 4, src, 2, true, BENCH_BYTES / 2);
+    report("widen i16 to i32", rounds * BENCH_BYTES, start);
+
+    fill_utf8(src, sizeof(src));
+    bool valid = true;
+    start = now();
+    for (size_t r = 0; r < rounds; ++r)
+        valid &= bjd_utf8_validate(src, BENCH_BYTES, false);
+    report("utf8 validate", rounds * BENCH_BYTES, start);
+    if (!valid)
+        printf("    (utf8 validate rejected valid text)\n");
+}
+
+// Times the per-element conversion the kernels replace.
+static void bench_per_element(void) {
+    static char src[BENCH_BYTES], dest[BENCH_BYTES];
+    fill_random(src, sizeof(src));
+    size_t rounds = (size_t)(BENCH_TOTAL_BYTES / BENCH_BYTES);
+
+    double start = now();
+    for (size_t r = 0; r < rounds; ++r) {
+        for (size_t i = 0; i < BENCH_BYTES; i += 4)
+            bjd_store_u32(dest + i, bjd_load_u32(src + i));
+        // keep the loop from being hoisted out
+        src[r % BENCH_BYTES] = dest[(r * 7) % BENCH_BYTES];
+    }
+    report("load/store u32", rounds * BENCH_BYTES, start);
+}
+
+int main(void) {
+    int failures = 0;
+    srand(1);
+
+    for (size_t i = 0; i < sizeof(kernel_names) / sizeof(kernel_names[0]); ++i) {
+        const char* name = kernel_names[i];
+        if (!bjd_convert_use_kernels(name))
+            continue;
+
+        int kernel_failures = check(name);
+        failures += kernel_failures;
+        printf("%s: %s\n", name, kernel_failures == 0 ? "matches scalar" : "MISMATCH");
+
+        bjd_convert_use_kernels(name);
+        bench();
+    }
+
+    printf("per element:\n");
+    bench_per_element();
+
+    bjd_convert_use_kernels(NULL);
+    printf("default kernels: %s\n", bjd_convert_kernels_name());
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}